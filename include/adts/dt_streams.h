@@ -29,8 +29,15 @@ typedef struct {
         c4m_cookie_t *cookie;
     } contents;
     int64_t flags;
+    // Output waiting to go to the FILE or cookie. Only used when
+    // C4M_F_STREAM_BUFFERED is set; allocated on the first write.
+    // Not locked, so buffered streams are for one writer at a time.
+    char   *wbuf;
+    int32_t wlen;
 } c4m_stream_t;
 
+#define C4M_STREAM_WBUF_SIZE 8192
+
 #define C4M_F_STREAM_READ         0x0001
 #define C4M_F_STREAM_WRITE        0x0002
 #define C4M_F_STREAM_APPEND       0x0004
@@ -40,3 +47,4 @@ typedef struct {
 #define C4M_F_STREAM_UTF8_OUT     0x0040
 #define C4M_F_STREAM_UTF32_OUT    0x0080
 #define C4M_F_STREAM_USING_COOKIE 0x0100
+#define C4M_F_STREAM_BUFFERED     0x0200
@@ -11,9 +11,24 @@
 #define C4M_HASH_CACHE_OBJ_OFFSET       (-4 * (int32_t)sizeof(uint64_t))
 #define C4M_HASH_CACHE_RAW_OFFSET       (-2 * (int32_t)sizeof(uint64_t))
 
+// Sparse codepoint -> byte offset map for UTF-8 strings, built the
+// first time we need random access. offsets[i] is the byte offset of
+// codepoint i * C4M_STR_INDEX_STRIDE.
+#define C4M_STR_INDEX_STRIDE 64
+
+typedef struct {
+    // What the string looked like when we built this; if either has
+    // changed, the string was edited in place and we rebuild.
+    int32_t byte_len;
+    int32_t codepoints;
+    int32_t num_entries;
+    int32_t offsets[];
+} c4m_str_index_t;
+
 typedef struct c4m_str_t {
     char             *data;
     c4m_style_info_t *styling;
+    c4m_str_index_t  *cp_index;
     int32_t           byte_len;
     int32_t           codepoints : 31;
     unsigned int      utf32      : 1;
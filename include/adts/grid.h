@@ -33,6 +33,7 @@ extern c4m_grid_t  *_c4m_ordered_list(c4m_list_t *, ...);
 extern c4m_grid_t  *_c4m_unordered_list(c4m_list_t *, ...);
 extern c4m_grid_t  *_c4m_grid_tree(c4m_tree_node_t *, ...);
 extern c4m_list_t  *_c4m_grid_render(c4m_grid_t *, ...);
+extern void         _c4m_grid_write(c4m_grid_t *, c4m_stream_t *, ...);
 extern void         c4m_set_column_props(c4m_grid_t *,
                                          int,
                                          c4m_render_style_t *);
@@ -43,6 +44,7 @@ extern void         c4m_set_column_style(c4m_grid_t *, int, char *);
 extern void         c4m_set_row_style(c4m_grid_t *, int, char *);
 
 #define c4m_grid_render(g, ...)    _c4m_grid_render(g, C4M_VA(__VA_ARGS__))
+#define c4m_grid_write(g, s, ...)  _c4m_grid_write(g, s, C4M_VA(__VA_ARGS__))
 #define c4m_ordered_list(l, ...)   _c4m_ordered_list(l, C4M_VA(__VA_ARGS__))
 #define c4m_unordered_list(l, ...) _c4m_unordered_list(l, C4M_VA(__VA_ARGS__))
 #define c4m_grid_tree(t, ...)      _c4m_grid_tree(t, C4M_VA(__VA_ARGS__))
@@ -53,6 +55,12 @@ c4m_grid_add_col_span(c4m_grid_t       *grid,
                       int64_t           row,
                       int64_t           start_col,
                       int64_t           num_cols);
+void
+c4m_grid_add_row_span(c4m_grid_t       *grid,
+                      c4m_renderable_t *contents,
+                      int64_t           col,
+                      int64_t           start_row,
+                      int64_t           num_rows);
 
 static inline c4m_renderable_t *
 c4m_to_str_renderable(c4m_str_t *s, char *tag)
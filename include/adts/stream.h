@@ -9,6 +9,7 @@ extern int64_t    c4m_stream_get_location(c4m_stream_t *);
 extern void       c4m_stream_set_location(c4m_stream_t *, int64_t);
 extern void       c4m_stream_close(c4m_stream_t *);
 extern void       c4m_stream_flush(c4m_stream_t *);
+extern void       c4m_stream_set_buffered(c4m_stream_t *, bool);
 extern void       _c4m_print(c4m_obj_t, ...);
 extern c4m_obj_t *c4m_stream_read_all(c4m_stream_t *);
 
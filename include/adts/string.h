@@ -62,6 +62,15 @@ c4m_str_is_u8(const c4m_str_t *s)
     return !s->utf32;
 }
 
+// For UTF-8, the string is ASCII exactly when every byte is its own
+// codepoint, so this doesn't need a flag to keep up to date. We don't
+// bother figuring it out for UTF-32.
+static inline bool
+c4m_str_is_ascii(const c4m_str_t *s)
+{
+    return !s->utf32 && s->byte_len == s->codepoints;
+}
+
 static inline int64_t
 c4m_str_codepoint_len(const c4m_str_t *s)
 {
@@ -18,4 +18,6 @@ c4m_got_fatal_compiler_error(c4m_compile_ctx *ctx)
 extern void c4m_module_decl_pass(c4m_compile_ctx *,
                                c4m_module_compile_ctx *);
 extern void c4m_check_pass(c4m_compile_ctx *);
+extern c4m_vm_t *c4m_cache_lookup(c4m_compile_ctx *);
+extern void      c4m_cache_store(c4m_compile_ctx *, c4m_vm_t *);
 #endif
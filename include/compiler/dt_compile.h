@@ -11,9 +11,10 @@ typedef struct {
     c4m_list_t           *module_ordering;
     c4m_set_t            *backlog;   // Modules we need to process.
     c4m_set_t            *processed; // Modules we've finished with.
+    c4m_set_t            *probed;    // Local module files not found.
     c4m_buf_t            *const_data;
     c4m_buf_t            *const_instantiations;
-    c4m_dict_t           *const_memos;
+    c4m_memo_t           *const_memos;
     c4m_dict_t           *const_instance_map;
     c4m_stream_t         *const_stream;
     // Object location, instead of the place to unmarshal it from.
@@ -24,9 +25,15 @@ typedef struct {
     // and will me mprotect()'d.
     c4m_dict_t           *instance_map;
     c4m_dict_t           *str_map;
+    // Set when c4m_compile_from_entry_point() found an up-to-date
+    // compiled copy of the program in the object cache.
+    c4m_vm_t             *cached_vm;
+    // Dense slot numbers for attribute names that appear in code.
+    c4m_dict_t           *attr_slots;
     int64_t               const_memoid; // Must start at 1.
     // index for which the next marshaled (non-value) const will go.
     int32_t               const_instantiation_id;
+    int32_t               num_attr_slots;
     // offset index for the next statically allocated object we add.
     bool                  fatality;
 } c4m_compile_ctx;
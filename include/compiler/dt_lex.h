@@ -92,8 +92,9 @@ typedef enum {
 
 typedef struct {
     struct c4m_module_compile_ctx *module;
-    c4m_codepoint_t             *start_ptr;
-    c4m_codepoint_t             *end_ptr;
+    // Byte range in the module's (UTF-8) source.
+    char                        *start_ptr;
+    char                        *end_ptr;
     c4m_utf8_t                  *literal_modifier;
     void                        *literal_value; // Once parsed.
     c4m_utf8_t                  *text;
@@ -34,7 +34,7 @@ typedef struct c4m_module_compile_ctx {
     c4m_str_t              *path;            // Fully qualified path
     c4m_str_t              *package;         // Package name.
     c4m_str_t              *loaded_from;     // Abs path / URL if found.
-    c4m_utf32_t            *raw;             // raw contents before lex pass.
+    c4m_utf8_t             *raw;             // raw contents before lex pass.
     c4m_list_t             *tokens;          // an xlist of x4m_token_t objects;
     c4m_tree_node_t        *parse_tree;
     c4m_list_t             *errors;          // an xlist of c4m_compile_errors
@@ -60,3 +60,10 @@ typedef struct c4m_module_compile_ctx {
     c4m_module_compile_status status;
 
 } c4m_module_compile_ctx;
+
+// A source file compiled into the library (see src/harness/sysembed.c).
+typedef struct {
+    char       *name;
+    const char *source;
+    int64_t     len;
+} c4m_embedded_module_t;
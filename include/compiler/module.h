@@ -11,6 +11,7 @@ extern bool                    c4m_add_module_to_worklist(c4m_compile_ctx *,
                                                           c4m_module_compile_ctx *);
 extern c4m_utf8_t             *c4m_package_from_path_prefix(c4m_utf8_t *,
                                                             c4m_utf8_t **);
+extern c4m_utf8_t             *c4m_read_module_source(c4m_str_t *);
 
 static inline void
 c4m_module_set_status(c4m_module_compile_ctx *ctx, c4m_module_compile_status status)
@@ -38,10 +38,12 @@
 
 // Basic string handling.
 #include "adts/codepoint.h"
+#include "util/simd.h"
 #include "adts/string.h"
 #include "util/breaks.h"
 #include "io/ansi.h"
 #include "util/hex.h"
+#include "util/compress.h"
 
 #include "util/style.h"
 #include "util/styledb.h"
@@ -40,6 +40,7 @@
 
 #if defined(__linux__)
 #include <sys/random.h>
+#include <sys/epoll.h>
 #include <threads.h>
 #include <endian.h>
 #include <sys/time.h>
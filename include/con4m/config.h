@@ -143,6 +143,57 @@
 #define C4M_DEFAULT_ARENA_SIZE (1 << 26)
 #endif
 
+#ifdef C4M_GC_GENERATIONAL
+// Both are in words, like C4M_DEFAULT_ARENA_SIZE. The nursery should
+// be small enough that minor collections are cheap; the old space
+// reserves as much again to grow into, and is only collected when it
+// can't take a full nursery's worth of survivors even then.
+#ifndef C4M_NURSERY_SIZE
+#define C4M_NURSERY_SIZE (1 << 22)
+#endif
+
+#ifndef C4M_OLD_SPACE_SIZE
+#define C4M_OLD_SPACE_SIZE C4M_DEFAULT_ARENA_SIZE
+#endif
+#endif
+
+#ifdef C4M_GC_LARGE_OBJECTS
+#ifndef C4M_GC_LARGE_OBJECT_BYTES
+#define C4M_GC_LARGE_OBJECT_BYTES (1 << 18)
+#endif
+#ifdef C4M_FULL_MEMCHECK
+#error "C4M_GC_LARGE_OBJECTS can't be used with C4M_FULL_MEMCHECK"
+#endif
+#endif
+
+#ifdef C4M_GC_COMPACT_HDR
+// Width of the compact header's scan_ix field; together with the
+// three flag bits after it, it fills one 32-bit word.
+#define C4M_GC_SCAN_IX_BITS 29
+// Max number of distinct scan functions; the index has to fit in
+// scan_ix, so this can be at most 2^29.
+#ifndef C4M_GC_MAX_SCAN_FNS
+#define C4M_GC_MAX_SCAN_FNS 4096
+#endif
+#if C4M_GC_MAX_SCAN_FNS > (1 << C4M_GC_SCAN_IX_BITS)
+#error "C4M_GC_MAX_SCAN_FNS doesn't fit in the header's scan_ix field"
+#endif
+#endif
+
+#ifdef C4M_GC_PARALLEL
+#ifndef C4M_GC_THREADS
+#define C4M_GC_THREADS 4
+#endif
+// Heaps with less than this many bytes in use get collected on the
+// calling thread alone; waking the helpers isn't worth it.
+#ifndef C4M_GC_PARALLEL_MIN_BYTES
+#define C4M_GC_PARALLEL_MIN_BYTES (1 << 24)
+#endif
+#ifdef C4M_FULL_MEMCHECK
+#error "C4M_GC_PARALLEL can't be used with C4M_FULL_MEMCHECK"
+#endif
+#endif
+
 #ifndef C4M_STACK_SIZE
 #define C4M_STACK_SIZE (1 << 17)
 #endif
@@ -7,6 +7,7 @@ typedef struct hatrack_set_st c4m_set_t;
 #include "core/dt_kargs.h"
 #include "core/dt_objects.h"
 #include "core/dt_literals.h"
+#include "core/dt_marshal.h"
 #include "util/dt_colors.h"
 #include "adts/dt_codepoints.h"
 #include "util/dt_styles.h"
@@ -45,9 +46,9 @@ typedef struct timespec c4m_duration_t;
 typedef c4m_str_t *(*c4m_repr_fn)(c4m_obj_t);
 typedef void (*c4m_marshal_fn)(c4m_obj_t,
                                c4m_stream_t *,
-                               c4m_dict_t *,
+                               c4m_memo_t *,
                                int64_t *);
-typedef void (*c4m_unmarshal_fn)(c4m_obj_t, c4m_stream_t *, c4m_dict_t *);
+typedef void (*c4m_unmarshal_fn)(c4m_obj_t, c4m_stream_t *, c4m_memo_t *);
 typedef c4m_obj_t (*c4m_copy_fn)(c4m_obj_t);
 typedef c4m_obj_t (*c4m_binop_fn)(c4m_obj_t, c4m_obj_t);
 typedef int64_t (*c4m_len_fn)(c4m_obj_t);
@@ -3,6 +3,35 @@
 
 typedef void (*c4m_mem_scan_fn)(uint64_t *, void *);
 
+#ifdef C4M_GC_COMPACT_HDR
+// Compact layout, for heaps full of small objects; it's half the size
+// of the full header. The end of the allocation is computed from
+// alloc_len (see c4m_alloc_next_addr()), and the scan function is an
+// index into a table (see c4m_gc_scan_fn_index()). There's no arena
+// pointer or hash cache, since nothing reads them off the allocation.
+typedef struct c4m_alloc_hdr {
+    uint64_t              guard;
+    struct c4m_alloc_hdr *fw_addr;
+    uint32_t              alloc_len;
+    uint32_t              request_len;
+
+#ifdef C4M_FULL_MEMCHECK
+    uint64_t *end_guard_loc;
+#endif
+
+#if defined(C4M_ADD_ALLOC_LOC_INFO)
+    char *alloc_file;
+    int   alloc_line;
+#endif
+
+    unsigned int scan_ix   : C4M_GC_SCAN_IX_BITS;
+    unsigned int finalize  : 1;
+    unsigned int con4m_obj : 1;
+    unsigned int large     : 1;
+
+    alignas(C4M_FORCED_ALIGNMENT) uint64_t data[];
+} c4m_alloc_hdr;
+#else
 typedef struct c4m_alloc_hdr {
     // A guard value added to every allocation so that cross-heap
     // memory accesses can scan backwards (if needed) to determine if
@@ -69,12 +98,16 @@ typedef struct c4m_alloc_hdr {
     // True if the memory allocation is a direct con4m object with
     // an object header.
     unsigned int con4m_obj : 1;
+    // True if the allocation lives in its own mapping in the large
+    // object space, instead of in an arena.
+    unsigned int large     : 1;
 
     __uint128_t cached_hash;
 
     // The actual exposed data. This must be 16-byte aligned!
     alignas(C4M_FORCED_ALIGNMENT) uint64_t data[];
 } c4m_alloc_hdr;
+#endif
 
 typedef struct c4m_finalizer_info_t {
     c4m_alloc_hdr               *allocation;
@@ -103,6 +136,24 @@ typedef struct {
 #endif
 } c4m_gc_root_info_t;
 
+#ifdef C4M_GC_LARGE_OBJECTS
+// Allocations of at least C4M_GC_LARGE_OBJECT_BYTES each get their own
+// mapping, and are marked and swept instead of copied. A heap's large
+// objects are kept sorted by address, so the collector can find one
+// from an interior pointer with a binary search.
+typedef struct c4m_large_objs_t {
+    c4m_alloc_hdr **objs;
+    uint8_t        *marks;
+    uint32_t        count;
+    uint32_t        capacity;
+    // Marked objects that still need to be scanned; only used during
+    // a collection.
+    c4m_alloc_hdr **pending;
+    _Atomic int32_t num_pending;
+    pthread_mutex_t lock;
+} c4m_large_objs_t;
+#endif
+
 typedef struct c4m_arena_t {
 #ifdef C4M_FULL_MEMCHECK
     c4m_shadow_alloc_t *shadow_start;
@@ -113,10 +164,44 @@ typedef struct c4m_arena_t {
     c4m_set_t            *external_holds;
     //    queue_t            *late_mutations;
     uint64_t             *heap_end;
+    // The end of the arena's mapping, past the back guard page and
+    // any space reserved for it to grow into.
+    void                 *map_end;
     c4m_finalizer_info_t *to_finalize;
     uint32_t              alloc_count;
     uint32_t              largest_alloc;
     bool                  grow_next;
+    // Set on heaps handed to worker threads, which never collect;
+    // when one fills, we chain on a new one. See gcbase.c.
+    bool                  worker_heap;
+    struct c4m_arena_t   *prev_heap;
+    // On a worker heap, how many roots it inherited from its parent;
+    // anything past that was registered by the worker.
+    uint32_t              worker_roots_base;
+    // Worker heaps adopted since the last collection, chained through
+    // prev_heap. They get evacuated like the from-space, then freed.
+    struct c4m_arena_t   *adopted;
+#ifdef C4M_GC_LARGE_OBJECTS
+    // Handed from arena to arena across collections, like roots.
+    c4m_large_objs_t *large_objs;
+#endif
+#ifdef C4M_GC_GENERATIONAL
+    // Set only on a nursery. Survivors of a minor collection get
+    // promoted directly into the old space, which is only copied
+    // when it fills up (a major collection).
+    struct c4m_arena_t *old_space;
+    // Set only on an old space. For each page of the arena, the
+    // allocation that covers the start of the page, so that we can
+    // scan individual dirty pages without walking the whole space.
+    c4m_alloc_hdr     **page_cover;
+    uint64_t            page_cover_len;
+    // One byte per page, set when the page gets written while the
+    // space is write-protected; see collect.c.
+    uint8_t            *dirty_cards;
+    // 1 + this space's slot in the write-protection table, or 0 if
+    // it isn't being protected.
+    int                 wp_slot;
+#endif
 #ifdef C4M_GC_STATS
     uint64_t legacy_count;
     uint64_t starting_counter;
@@ -46,6 +46,9 @@ typedef struct {
     uint64_t       extra_cif2;
 } c4m_ffi_cif;
 
+#define C4M_FFI_ARG_CSTR 0x01 // Pass the string's bytes, not the object.
+#define C4M_FFI_ARG_HOLD 0x02 // The callee keeps a reference.
+
 typedef struct {
     void          *fptr;
     c4m_utf8_t    *local_name;
@@ -53,6 +56,10 @@ typedef struct {
     uint64_t       str_convert;
     uint64_t       hold_info;
     uint64_t       alloc_info;
+    // One byte of C4M_FFI_ARG_* flags per argument, in stack order
+    // (i.e., last parameter first). Built when the VM binds the
+    // function, so calls don't need to consult the bitfields above.
+    uint8_t       *arg_plan;
     c4m_ffi_type **args;
     c4m_ffi_type  *ret;
     c4m_ffi_cif    cif;
@@ -0,0 +1,28 @@
+#pragma once
+#include "con4m.h"
+
+// Memo table for marshaling or unmarshaling. Each one belongs to one
+// thread at a time, so they're plain arrays, not dictionaries. Most
+// only last for one call, but some live much longer (the compiler
+// keeps one for all the constants it marshals), so they do have to
+// survive collections.
+//
+// Marshaling maps addresses to memo IDs with an open-addressed table
+// (`addrs` and `ids` are parallel, `slots` long). The collector
+// updates the addresses when it moves things, but not the buckets
+// they hash to, so the table is rebuilt the first time it's used
+// after a collection (`epoch` says which one it was built after).
+// Unmarshaling gets the IDs back in the order they were handed out
+// (1, 2, 3, ...), so `addrs` is just a vector indexed by ID, and
+// `ids` is unused.
+//
+// The table also carries the format version of the data, since every
+// marshal function already gets handed it.
+typedef struct {
+    void    **addrs;
+    uint64_t *ids;
+    uint64_t  slots;
+    uint64_t  count;
+    uint64_t  epoch;
+    uint32_t  version;
+} c4m_memo_t;
@@ -16,6 +16,9 @@ typedef struct c4m_type_t {
     c4m_type_info_t *details;
     c4m_type_hash_t  fw;
     c4m_type_hash_t typeid;
+    // Set once we know this node is concrete and has its final type
+    // ID, so c4m_type_resolve() has nothing left to do for it.
+    bool resolved;
 } c4m_type_t;
 
 typedef struct c4m_type_info_t {
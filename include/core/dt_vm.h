@@ -107,7 +107,8 @@ typedef enum : uint8_t {
     // whether the attribute is found... if it is, a non-zero value is
     // pushed after the result. If not, then only a zero is pushed.
     // If that non-zero field also has the `2` bit set, then the
-    // actual value will not be pushed.
+    // actual value will not be pushed. The upper half of the
+    // immediate holds the attribute's slot (see c4m_attr_imm_slot()).
     C4M_ZLoadFromAttr  = 0x0C,
     C4M_ZLoadFromView  = 0x0D,
     // Create a callback and push it onto the stack. The instruction's arg,
@@ -125,11 +126,21 @@ typedef enum : uint8_t {
     // which is run as a native function via C4M_Z0Call, but using a separate
     // VM state.
     C4M_ZPushVmPtr     = 0x0F,
+    // Superinstructions; the peephole pass in optimize.c produces
+    // these, the code generator never emits them directly.
+    //
+    // Push two locals; the first from the arg field, the second from
+    // the immediate field. Same as two C4M_ZPushLocalObj instructions.
+    C4M_ZPushLocalPair   = 0x10,
+    // Push the local at the arg offset plus the immediate value. Same as
+    // C4M_ZPushLocalObj, C4M_ZPushImm, C4M_ZAdd.
+    C4M_ZPushLocalAddImm = 0x11,
     // Stores a value to the attribute named by the top value on the stack. The
     // value to store is the stack value just below it. Both values are popped
     // from the stack. If the instruction's arg is non-zero, the attribute
     // will be locked when it's set. This instruction expects that the attribute
-    // is stored on the stack via C4M_ZPushStaticPtr.
+    // is stored on the stack via C4M_ZPushStaticPtr. The immediate holds
+    // the attribute's slot, as with C4M_ZLoadFromAttr.
     C4M_ZAssignAttr    = 0x1D,
     // Pops the top value from the stack. This is the same as C4M_ZMoveSp with
     // an adjustment of -1.
@@ -148,6 +159,17 @@ typedef enum : uint8_t {
     // value just below it and pops both items from the stack. This should be
     // paired with C4M_ZPushAddr or C4M_ZLoadFromAttr with a non-zero arg.
     C4M_ZAssignToLoc   = 0x25,
+    // The "register" ops. These treat the slots of the current stack
+    // frame as registers, and move values between them directly,
+    // without going through the stack. Like the other
+    // superinstructions, only the peephole pass generates these.
+    //
+    // Pop the top of the stack into the local at the arg offset. Same
+    // as C4M_ZPushLocalRef, C4M_ZAssignToLoc.
+    C4M_ZStoreLocal    = 0x26,
+    // Copy the local at the immediate offset to the one at the arg
+    // offset.
+    C4M_ZMoveLocal     = 0x27,
     // Jump if the top value on the stack is zero. The pc is adjusted by the
     // number of bytes encoded in the instruction's arg field, which is always
     // a multiple of the size of an instruction. A negative value jumps
@@ -199,6 +221,20 @@ typedef enum : uint8_t {
     C4M_ZRunCallback   = 0x37,
     // Unused; will redo when adding objects.
     C4M_ZSObjNew       = 0x38,
+    // Compare and branch. The comparison to do (one of the signed
+    // comparisons below) is in the immediate field, and the jump target
+    // is in the arg field. Otherwise, this is the same as doing the
+    // comparison, then a C4M_ZJz; if the jump is taken, the (zero)
+    // result is left on the stack.
+    C4M_ZCmpJz         = 0x39,
+    // Same, but as if followed by C4M_ZJnz.
+    C4M_ZCmpJnz        = 0x3A,
+    // Compare two locals and branch, without pushing them first. The
+    // immediate field holds the comparison and both frame offsets (see
+    // c4m_local3_imm()); the arg is the jump target. As with
+    // C4M_ZCmpJz, a taken jump leaves the result on the stack.
+    C4M_ZLocalCmpJz    = 0x3B,
+    C4M_ZLocalCmpJnz   = 0x3C,
     // Box a literal, which requires supplying the type for the object.
     C4M_ZBox           = 0x3e,
     // Unbox a value literal into its actual value.
@@ -265,6 +301,9 @@ typedef enum : uint8_t {
     // arg field. This means specifically that the arg field is subtracted from
     // sp, so a single pop would encode -1 as the adjustment.
     C4M_ZMoveSp        = 0x65,
+    // C4M_ZMoveSp followed by C4M_ZPushFromR0, which is what we do after
+    // any call that returns a value.
+    C4M_ZMoveSpPushFromR0 = 0x66,
     // Test the top stack value. If it is non-zero, pop it and continue running
     // the program. Otherwise, print an assertion failure and stop running the
     // program.
@@ -282,6 +321,17 @@ typedef enum : uint8_t {
     C4M_ZBOr           = 0x78,
     C4M_ZBAnd          = 0x79,
     C4M_ZBNot          = 0x7A,
+    // Add the immediate value to the top of the stack, in place. Also
+    // used for subtracting a constant, by negating it.
+    C4M_ZAddImm        = 0x7B,
+    // Three-address arithmetic on locals: the local at the arg offset
+    // gets the result of applying the binary op packed into the
+    // immediate field to the two locals packed with it (see
+    // c4m_local3_imm()).
+    C4M_ZLocalOp3      = 0x7C,
+    // The local at the arg offset gets another local plus a constant,
+    // both packed into the immediate (see c4m_local_add_imm()).
+    C4M_ZLocalAddImm   = 0x7D,
     C4M_ZUAdd          = 0x80, // Same as ZAdd
     C4M_ZUSub          = 0x81, // Same as ZSub
     C4M_ZUMul          = 0x82,
@@ -423,7 +473,7 @@ typedef struct {
     int32_t     mid;    // module_id
     int32_t     offset; // offset to start of instructions in module
     int32_t     size;   // Stack frame size.
-    // TODO: This should go in the marshal, and needs startup initing.
+    // TODO: This needs startup initing.
     // Note, its value must always be
     int32_t     static_lock;
 } c4m_zfn_info_t;
@@ -456,12 +506,21 @@ typedef struct {
     c4m_dict_t *datasyms;
     c4m_list_t *parameters;   // tspec_ref: c4m_zparam_info_t
     c4m_list_t *instructions; // tspec_ref: c4m_zinstruction_t
+    // Flat copy of `instructions` that the VM actually runs from;
+    // built at load time via c4m_vm_freeze_instructions() (not marshaled).
+    c4m_zinstruction_t *code;
     uint64_t    module_hash;
     int32_t     module_id;    // Internal array index.
     int32_t     module_var_size;
     int32_t     init_size;    // size of init code before functions begin
+    // Set when `code` points into a mapped image (see
+    // c4m_vm_map_image()), in which case it's never re-frozen.
+    bool        code_mapped;
 } c4m_zmodule_info_t;
 
+#define C4M_OBJ_MAGIC   0x0c001dea0c001deaULL
+#define C4M_OBJ_VERSION 0x06
+
 typedef struct {
     uint64_t    zero_magic;
     c4m_buf_t  *static_data;
@@ -494,6 +553,13 @@ typedef struct {
     bool                override;
 } c4m_attr_contents_t;
 
+// Cache of `attrs` entries, indexed by the slot the compiler gave
+// each statically known attribute; see attrstore.c.
+typedef struct {
+    int32_t                        len;
+    _Atomic(c4m_attr_contents_t *) entries[];
+} c4m_attr_slots_t;
+
 typedef struct {
     c4m_str_t *shortdoc;
     c4m_str_t *longdoc;
@@ -518,6 +584,13 @@ typedef struct {
     c4m_dict_t   *attrs;        // string, c4m_attr_contents_t (tspec_ref)
     c4m_set_t    *all_sections; // string
     c4m_dict_t   *section_docs; // string, c4m_docs_container_t (tspec_ref)
+    // Replaced wholesale when it grows. Not marshaled.
+    _Atomic(c4m_attr_slots_t *) attr_slots;
+    // Flat copy of obj->ffi_info, so calls don't go through the list
+    // lock. Not marshaled.
+    c4m_ffi_decl_t **ffi_decls;
+    // Pointers must stay above this one; it's the last field the
+    // collector scans (see c4m_vm_gc_bits()).
     c4m_list_t   *ffi_info;
     int           ffi_info_entries;
     bool          using_attrs;
@@ -580,3 +653,36 @@ typedef struct {
 
 #define C4M_F_ATTR_PUSH_FOUND 1
 #define C4M_F_ATTR_SKIP_LOAD  2
+
+// Attribute instructions whose name is known at compile time carry a
+// dense slot index (plus one) in the upper half of the immediate
+// field; flags live in the lower half. A slot of -1 means "no slot",
+// and the VM just uses the attribute dictionary.
+#define C4M_ATTR_SLOT_SHIFT 32
+#define c4m_attr_slot_imm(slot) \
+    (((int64_t)(slot) + 1) << C4M_ATTR_SLOT_SHIFT)
+#define c4m_attr_imm_slot(imm) \
+    ((int32_t)(((uint64_t)(imm)) >> C4M_ATTR_SLOT_SHIFT) - 1)
+#define c4m_attr_imm_flags(imm) ((imm) & 0xffffffff)
+
+// Register ops that need two frame offsets and an opcode pack them
+// into the immediate: the opcode in the top 16 bits, then two signed
+// 24-bit offsets (formals live at negative offsets).
+#define C4M_LOCAL_SLOT_MIN (-(1 << 23))
+#define C4M_LOCAL_SLOT_MAX ((1 << 23) - 1)
+#define c4m_local3_imm(op, a, b)          \
+    (((int64_t)(op) << 48)                \
+     | (((int64_t)(a) & 0xffffff) << 24) \
+     | ((int64_t)(b) & 0xffffff))
+#define c4m_local3_op(imm) ((int64_t)(((uint64_t)(imm)) >> 48))
+#define c4m_local3_a(imm)  (((int64_t)((uint64_t)(imm) << 16)) >> 40)
+#define c4m_local3_b(imm)  (((int64_t)((uint64_t)(imm) << 40)) >> 40)
+// C4M_ZLocalAddImm puts the source offset in the upper half and a
+// 32-bit addend in the lower half. Offsets can be negative (formals),
+// so encoding shifts the unsigned bits (left-shifting a negative
+// value is undefined), and decoding shifts arithmetically to get the
+// sign back.
+#define c4m_local_add_imm(slot, k) \
+    ((int64_t)(((uint64_t)(uint32_t)(slot) << 32) | (uint32_t)(k)))
+#define c4m_local_add_slot(imm) ((int64_t)(imm) >> 32)
+#define c4m_local_add_k(imm)    ((int64_t)(int32_t)((imm) & 0xffffffff))
@@ -89,6 +89,10 @@
 // Shouldn't be accessed by developer, but allows us to inline.
 extern uint64_t     c4m_gc_guard;
 extern c4m_arena_t *c4m_new_arena(size_t, hatrack_zarray_t *);
+extern c4m_arena_t *c4m_new_growable_arena(size_t,
+                                           size_t,
+                                           hatrack_zarray_t *);
+extern bool         c4m_grow_arena(c4m_arena_t *, size_t);
 extern void         c4m_delete_arena(c4m_arena_t *);
 extern void         c4m_expand_arena(size_t, c4m_arena_t **);
 extern c4m_arena_t *c4m_collect_arena(c4m_arena_t *);
@@ -202,6 +206,21 @@ c4m_round_up_to_given_power_of_2(uint64_t power, uint64_t n)
 #define C4M_GC_SCAN_ALL  ((void *)0)
 #define C4M_GC_SCAN_NONE ((void *)0xffffffffffffffff)
 
+#ifdef C4M_GC_COMPACT_HDR
+extern c4m_mem_scan_fn c4m_gc_scan_fns[];
+extern uint32_t        c4m_gc_scan_fn_index(c4m_mem_scan_fn);
+
+#define c4m_alloc_scan_fn(hdr) (c4m_gc_scan_fns[(hdr)->scan_ix])
+#define c4m_alloc_set_scan_fn(hdr, fn) \
+    ((hdr)->scan_ix = c4m_gc_scan_fn_index(fn))
+#define c4m_alloc_next_addr(hdr) \
+    ((uint64_t *)(((char *)(hdr)->data) + (hdr)->alloc_len))
+#else
+#define c4m_alloc_scan_fn(hdr)          ((hdr)->scan_fn)
+#define c4m_alloc_set_scan_fn(hdr, fn)  ((hdr)->scan_fn = (fn))
+#define c4m_alloc_next_addr(hdr)        ((hdr)->next_addr)
+#endif
+
 // gc_malloc and gc_alloc_* should only be used for INTERNAL dynamic
 // allocations. Anything that would be exposed to the language user
 // should be allocated via `gc_new()`, because there's an expectation
@@ -240,12 +259,28 @@ extern c4m_arena_t   *c4m_internal_stash_heap();
 extern void           c4m_internal_unstash_heap();
 extern void           c4m_internal_set_heap(c4m_arena_t *);
 extern void           c4m_internal_lock_then_unstash_heap();
+extern c4m_arena_t   *c4m_internal_new_worker_heap();
+extern c4m_arena_t   *c4m_internal_release_worker_heap();
+extern void           c4m_internal_adopt_worker_heap(c4m_arena_t *);
 extern void           c4m_get_heap_bounds(uint64_t *, uint64_t *, uint64_t *);
-extern void           c4m_gc_register_collect_fns(c4m_gc_hook, c4m_gc_hook);
+extern void           c4m_gc_register_collect_fn(c4m_gc_hook);
 extern c4m_alloc_hdr *c4m_find_alloc(void *);
 extern bool           c4m_in_heap(void *);
 extern void           c4m_header_gc_bits(uint64_t *, c4m_base_obj_t *);
 
+#ifdef C4M_GC_LARGE_OBJECTS
+extern bool c4m_is_large_alloc(void *);
+#endif
+
+// Call before handing heap memory to a system call that writes into
+// it. In generational builds, old-space pages are write-protected to
+// track writes, and the kernel won't fault on them for us.
+#ifdef C4M_GC_GENERATIONAL
+extern void c4m_gc_unprotect(void *, size_t);
+#else
+#define c4m_gc_unprotect(p, n)
+#endif
+
 #ifdef C4M_GC_STATS
 uint64_t c4m_get_alloc_counter();
 #else
@@ -21,6 +21,7 @@ c4m_raw_envp(void)
 extern c4m_list_t *c4m_get_program_arguments(void);
 extern c4m_utf8_t *c4m_get_argv0(void);
 extern c4m_utf8_t *c4m_get_env(c4m_utf8_t *);
+extern void        c4m_set_env(c4m_utf8_t *, c4m_utf8_t *);
 extern c4m_dict_t *c4m_environment(void);
 extern c4m_utf8_t *c4m_path_search(c4m_utf8_t *, c4m_utf8_t *);
 extern c4m_utf8_t *c4m_con4m_root(void);
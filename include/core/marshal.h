@@ -2,6 +2,19 @@
 
 #include "con4m.h"
 
+// Marshal format versions. c4m_marshal() starts its output with a
+// three-byte header (C4M_MARSHAL_MAGIC, the version, and flags);
+// anything without one is C4M_MARSHAL_V1.
+//
+// Data marshaled without c4m_marshal() (e.g., inside object files) is
+// always the current version.
+#define C4M_MARSHAL_V1      1 // Fixed-width integers everywhere.
+#define C4M_MARSHAL_V2      2 // Varints for memo IDs, lengths and types.
+#define C4M_MARSHAL_VERSION C4M_MARSHAL_V2
+#define C4M_MARSHAL_MAGIC   0xc4
+
+#define C4M_MARSHAL_F_COMPRESSED 0x01
+
 extern void    c4m_marshal_cstring(char *, c4m_stream_t *);
 extern char   *c4m_unmarshal_cstring(c4m_stream_t *);
 extern void    c4m_marshal_i64(int64_t, c4m_stream_t *);
@@ -11,25 +24,37 @@ extern int32_t c4m_unmarshal_i32(c4m_stream_t *);
 extern void    c4m_marshal_i16(int16_t, c4m_stream_t *);
 extern int16_t c4m_unmarshal_i16(c4m_stream_t *);
 
+extern void     c4m_marshal_varint(uint64_t, c4m_stream_t *);
+extern uint64_t c4m_unmarshal_varint(c4m_stream_t *);
+
 extern void      c4m_sub_marshal(c4m_obj_t,
                                  c4m_stream_t *,
-                                 c4m_dict_t *,
+                                 c4m_memo_t *,
                                  int64_t *);
-extern c4m_obj_t c4m_sub_unmarshal(c4m_stream_t *, c4m_dict_t *);
+extern c4m_obj_t c4m_sub_unmarshal(c4m_stream_t *, c4m_memo_t *);
 extern void      c4m_marshal(c4m_obj_t, c4m_stream_t *);
+extern void      c4m_marshal_compressed(c4m_obj_t, c4m_stream_t *);
 extern c4m_obj_t c4m_unmarshal(c4m_stream_t *);
 extern void      c4m_marshal_unmanaged_object(void *,
                                               c4m_stream_t *,
-                                              c4m_dict_t *,
+                                              c4m_memo_t *,
                                               int64_t *,
                                               c4m_marshal_fn);
 extern void     *c4m_unmarshal_unmanaged_object(size_t,
                                                 c4m_stream_t *,
-                                                c4m_dict_t *,
+                                                c4m_memo_t *,
                                                 c4m_unmarshal_fn);
 extern void      c4m_dump_c_static_instance_code(c4m_obj_t,
                                                  char *,
                                                  c4m_utf8_t *);
+
+extern c4m_memo_t *c4m_alloc_marshal_memos(void);
+extern c4m_memo_t *c4m_alloc_unmarshal_memos(void);
+extern uint64_t    c4m_memo_get_id(c4m_memo_t *, void *);
+extern void        c4m_memo_put_id(c4m_memo_t *, void *, uint64_t);
+extern void       *c4m_memo_get_addr(c4m_memo_t *, uint64_t);
+extern void        c4m_memo_put_addr(c4m_memo_t *, uint64_t, void *);
+
 static inline void
 c4m_marshal_i8(int8_t c, c4m_stream_t *s)
 {
@@ -106,6 +131,28 @@ c4m_unmarshal_u16(c4m_stream_t *s)
     return (uint16_t)c4m_unmarshal_i16(s);
 }
 
+// For lengths and counts, which V1 always wrote as 32 bits.
+static inline void
+c4m_marshal_len(uint64_t n, c4m_stream_t *s, c4m_memo_t *memos)
+{
+    if (memos->version == C4M_MARSHAL_V1) {
+        c4m_marshal_u32((uint32_t)n, s);
+    }
+    else {
+        c4m_marshal_varint(n, s);
+    }
+}
+
+static inline uint64_t
+c4m_unmarshal_len(c4m_stream_t *s, c4m_memo_t *memos)
+{
+    if (memos->version == C4M_MARSHAL_V1) {
+        return c4m_unmarshal_u32(s);
+    }
+
+    return c4m_unmarshal_varint(s);
+}
+
 static inline c4m_buf_t *
 c4m_marshal_to_buf(c4m_obj_t obj)
 {
@@ -141,14 +188,3 @@ c4m_mem_unmarshal(char *mem, int64_t len)
     return result;
 }
 
-static inline c4m_dict_t *
-c4m_alloc_marshal_memos()
-{
-    return c4m_new(c4m_type_dict(c4m_type_ref(), c4m_type_u64()));
-}
-
-static inline c4m_dict_t *
-c4m_alloc_unmarshal_memos()
-{
-    return c4m_new(c4m_type_dict(c4m_type_u64(), c4m_type_ref()));
-}
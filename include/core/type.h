@@ -7,6 +7,8 @@ extern bool        c4m_type_is_concrete(c4m_type_t *);
 extern c4m_type_t *c4m_type_copy(c4m_type_t *);
 extern c4m_type_t *c4m_get_builtin_type(c4m_builtin_t);
 extern c4m_type_t *c4m_unify(c4m_type_t *, c4m_type_t *);
+extern void        c4m_type_unify_stats(uint64_t *, uint64_t *);
+extern void        c4m_type_reset_unify_stats(void);
 
 #if defined(C4M_GC_STATS) || defined(C4M_DEBUG)
 extern c4m_type_t *_c4m_type_flist(c4m_type_t *, char *, int);
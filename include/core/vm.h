@@ -13,6 +13,12 @@ c4m_vm_reset(c4m_vm_t *vm);
 extern void
 c4m_vm_setup_runtime(c4m_vm_t *vm);
 
+// Copy each module's instructions into the flat array the VM
+// dispatches from. This is done by c4m_vm_setup_runtime(), and when
+// unmarshaling, but must be redone if instructions are ever modified.
+extern void
+c4m_vm_freeze_instructions(c4m_vm_t *vm);
+
 // create a new thread state attached to the specified vm. Multiple threads may
 // run code from the same VM simultaneously, but each one needs its own thread
 // state.
@@ -44,13 +50,48 @@ c4m_vm_attr_set(c4m_vmthread_t *tstate,
                 bool            override,
                 bool            internal);
 
+// the same, but using the slot the compiler assigned to `key`, if any
+// (-1 if not). `key` is still needed the first time a slot is used.
+extern c4m_value_t *
+c4m_vm_attr_slot_get(c4m_vmthread_t *tstate,
+                     c4m_str_t      *key,
+                     int32_t         slot,
+                     bool           *found);
+
+extern void
+c4m_vm_attr_slot_set(c4m_vmthread_t *tstate,
+                     c4m_str_t      *key,
+                     int32_t         slot,
+                     c4m_value_t    *value,
+                     bool            lock,
+                     bool            override,
+                     bool            internal);
+
 // lock an attribute immediately of on_write is false; otherwise, lock it when
 // it is set.
 extern void
 c4m_vm_attr_lock(c4m_vmthread_t *tstate, c4m_str_t *key, bool on_write);
 
 extern void
-c4m_vm_marshal(c4m_vm_t *vm, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid);
+c4m_vm_marshal(c4m_vm_t *vm, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid);
+
+extern void
+c4m_vm_unmarshal(c4m_vm_t *vm, c4m_stream_t *in, c4m_memo_t *memos);
 
+// Write the VM's program out as a flat image, which can be loaded with
+// c4m_vm_map_image() without decoding the code. If `aux` isn't NULL,
+// it's stored in the image too, for the caller's own use.
 extern void
-c4m_vm_unmarshal(c4m_vm_t *vm, c4m_stream_t *in, c4m_dict_t *memos);
+c4m_vm_write_image(c4m_vm_t *vm, c4m_buf_t *aux, c4m_stream_t *out);
+
+// Called with an image's aux data before it's loaded; returning false
+// rejects the image.
+typedef bool (*c4m_image_check_fn)(c4m_buf_t *aux, void *thunk);
+
+// Map an image written by c4m_vm_write_image() and return a VM ready
+// to run it, executing straight from the mapping. Returns NULL if the
+// file can't be read, isn't an image this build can run, or `check`
+// (if given) rejects it. Mapping a path again while it still names the
+// same file reuses the first mapping, rather than adding another.
+extern c4m_vm_t *
+c4m_vm_map_image(c4m_str_t *path, c4m_image_check_fn check, void *thunk);
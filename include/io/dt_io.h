@@ -27,6 +27,33 @@ typedef bool (*c4m_progress_decl)(void *);
  * In most systems when no reader is particularly slow relative to
  * others, there may never need to be more than one malloc call.
  */
+/*
+ * How the switchboard waits for fds to become ready. On Linux, the
+ * default is epoll, where fds are registered once and only re-armed
+ * when the set of events we care about changes. select() is always
+ * available, and is what we fall back to if epoll can't be set up,
+ * or won't take one of our fds (e.g., a regular file).
+ */
+typedef enum {
+    C4M_SB_POLL_SELECT,
+    C4M_SB_POLL_EPOLL,
+} c4m_sb_poller_t;
+
+/*
+ * Per-fd state for the epoll backend, indexed by fd. A single fd
+ * can have both a reader and a writer party (which may or may not be
+ * the same party); `events` is what's currently registered with the
+ * kernel (if `registered`), and `want` is scratch space for computing
+ * what should be.
+ */
+typedef struct {
+    struct c4m_party_t *reader;
+    struct c4m_party_t *writer;
+    uint32_t            events;
+    uint32_t            want;
+    bool                registered;
+} c4m_sb_fdslot_t;
+
 typedef struct c4m_sb_msg_t {
     struct c4m_sb_msg_t *next;
     size_t               len;
@@ -237,6 +264,10 @@ typedef struct c4m_switchboard_t {
     int               fds_ready;
     size_t            heap_elems;
     bool              ignore_running_procs_on_shutdown;
+    c4m_sb_poller_t   poller;
+    int               epoll_fd;
+    int               num_fdslots;
+    c4m_sb_fdslot_t  *fdslots;
 } c4m_switchboard_t;
 
 typedef struct {
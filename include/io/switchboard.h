@@ -85,6 +85,7 @@ extern bool         c4m_sb_route_is_subscribed(c4m_switchboard_t *,
                                                c4m_party_t *,
                                                c4m_party_t *);
 extern void         c4m_sb_init(c4m_switchboard_t *, size_t);
+extern bool         c4m_sb_set_poller(c4m_switchboard_t *, c4m_sb_poller_t);
 extern void         c4m_sb_set_io_timeout(c4m_switchboard_t *,
                                           struct timeval *);
 extern void         c4m_sb_clear_io_timeout(c4m_switchboard_t *);
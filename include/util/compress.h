@@ -0,0 +1,7 @@
+#pragma once
+
+#include "con4m.h"
+
+// Block compression for marshaled data. See compress.c for the format.
+extern void       c4m_compress_to_stream(c4m_buf_t *, c4m_stream_t *);
+extern c4m_buf_t *c4m_decompress_from_stream(c4m_stream_t *);
@@ -24,6 +24,23 @@ typedef struct c4m_fmt_info_t {
     int                    end;
 } c4m_fmt_info_t;
 
+// One argument substitution in a compiled format string.
+typedef struct {
+    c4m_fmt_spec_t spec;
+    int64_t        offset; // Where its {} placeholder is in the skeleton.
+    int64_t        arg;    // Which argument it takes.
+} c4m_fmt_slot_t;
+
+// A format string compiled for reuse; see format.c.
+typedef struct {
+    char           *src;
+    c4m_str_t      *skeleton;
+    c4m_fmt_slot_t *slots;
+    int64_t         src_len;
+    uint64_t        hash;
+    int64_t         num_slots;
+} c4m_fmt_template_t;
+
 #define C4M_FMT_FMT_ONLY 0
 #define C4M_FMT_NUMBERED 1
 #define C4M_FMT_NAMED    2
@@ -6,6 +6,13 @@ extern c4m_utf8_t *_c4m_str_format(const c4m_str_t *, int, ...);
 extern c4m_utf8_t *_c4m_cstr_format(char *, int, ...);
 extern c4m_utf8_t *c4m_cstr_array_format(char *, int, c4m_utf8_t **);
 
+extern void                c4m_init_format_cache(void);
+extern c4m_fmt_template_t *c4m_fmt_compile(const c4m_str_t *);
+extern c4m_fmt_template_t *c4m_fmt_compile_cstr(char *, int64_t);
+extern c4m_utf8_t         *c4m_fmt_render(c4m_fmt_template_t *,
+                                          int,
+                                          c4m_obj_t *);
+
 #define c4m_cstr_format(fmt, ...) \
     _c4m_cstr_format(fmt, C4M_PP_NARG(__VA_ARGS__) __VA_OPT__(, ) __VA_ARGS__)
 #define c4m_str_format(fmt, ...) \
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "con4m.h"
+
+// Byte-level kernels for string handling. On x86-64 these use SSE2,
+// or AVX2 when the CPU has it (checked once, at first use); everywhere
+// else they're plain C.
+
+// Number of leading bytes that are 7-bit ASCII.
+extern int64_t c4m_ascii_prefix_len(const char *, int64_t);
+
+// Like memmem(); returns the first occurrence of the needle, or NULL.
+extern char *c4m_find_bytes(const char *, int64_t, const char *, int64_t);
+
+static inline bool
+c4m_is_ascii(const char *p, int64_t len)
+{
+    return c4m_ascii_prefix_len(p, len) == len;
+}
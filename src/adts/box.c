@@ -23,14 +23,14 @@ box_to_str(c4m_box_t *box)
 static void
 box_marshal(c4m_box_t    *box,
             c4m_stream_t *out,
-            c4m_dict_t   *memos,
+            c4m_memo_t   *memos,
             int64_t      *mid)
 {
     c4m_marshal_u64(box->u64, out);
 }
 
 static void
-box_unmarshal(c4m_box_t *box, c4m_stream_t *in, c4m_dict_t *memos)
+box_unmarshal(c4m_box_t *box, c4m_stream_t *in, c4m_memo_t *memos)
 {
     box->u64 = c4m_unmarshal_u64(in);
 }
@@ -127,7 +127,24 @@ c4m_buffer_resize(c4m_buf_t *buffer, uint64_t new_sz)
 
     // Resize up, copying old data and leaving the rest zero'd.
     uint64_t new_alloc_sz = hatrack_round_up_to_power_of_2(new_sz);
-    char    *new_data     = c4m_gc_raw_alloc(new_alloc_sz, NULL);
+    char    *new_data;
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    // Big buffers can usually grow by remapping, without a copy.
+    if (c4m_is_large_alloc(buffer->data)) {
+        new_data = c4m_gc_resize(buffer->data, new_alloc_sz);
+        memset(new_data + buffer->byte_len,
+               0,
+               buffer->alloc_len - buffer->byte_len);
+
+        buffer->data      = new_data;
+        buffer->byte_len  = new_sz;
+        buffer->alloc_len = new_alloc_sz;
+        return;
+    }
+#endif
+
+    new_data = c4m_gc_raw_alloc(new_alloc_sz, NULL);
 
     memcpy(new_data, buffer->data, buffer->byte_len);
 
@@ -272,18 +289,18 @@ c4m_buf_to_utf8_string(c4m_buf_t *buffer)
 static void
 c4m_buffer_marshal(c4m_buf_t    *b,
                    c4m_stream_t *s,
-                   c4m_dict_t   *memos,
+                   c4m_memo_t   *memos,
                    int64_t      *mid)
 {
-    c4m_marshal_u32(b->byte_len, s);
+    c4m_marshal_len(b->byte_len, s, memos);
     c4m_marshal_u32(b->flags, s); // Not currently used btw.
     c4m_stream_raw_write(s, b->byte_len, b->data);
 }
 
 static void
-c4m_buffer_unmarshal(c4m_buf_t *b, c4m_stream_t *s, c4m_dict_t *memos)
+c4m_buffer_unmarshal(c4m_buf_t *b, c4m_stream_t *s, c4m_memo_t *memos)
 {
-    b->byte_len = c4m_unmarshal_u32(s);
+    b->byte_len = c4m_unmarshal_len(s, memos);
     b->flags    = c4m_unmarshal_u32(s); // Not currently used btw.
     if (b->byte_len) {
         b->data = c4m_gc_raw_alloc(b->byte_len, NULL);
@@ -802,7 +802,7 @@ datetime_init(c4m_date_time_t *self, va_list args)
 static void
 datetime_marshal(c4m_date_time_t *self,
                  c4m_stream_t    *s,
-                 c4m_dict_t      *memos,
+                 c4m_memo_t      *memos,
                  int64_t         *mid)
 {
     c4m_marshal_i32(self->dt.tm_sec, s);
@@ -852,7 +852,7 @@ datetime_marshal(c4m_date_time_t *self,
 }
 
 static void
-datetime_unmarshal(c4m_date_time_t *self, c4m_stream_t *s, c4m_dict_t *memos)
+datetime_unmarshal(c4m_date_time_t *self, c4m_stream_t *s, c4m_memo_t *memos)
 {
     self->dt.tm_sec    = c4m_unmarshal_i32(s);
     self->dt.tm_min    = c4m_unmarshal_i32(s);
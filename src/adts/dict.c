@@ -182,8 +182,8 @@ c4m_early_alloc_dict(size_t hash, bool trace_keys, bool trace_vals)
 }
 
 // Used for dictionaries that are temporary and cannot ever be used in
-// an object context. This is mainly for short-term state like marhal memos
-// and for type hashing.
+// an object context. This is mainly for short-term state like type
+// hashing.
 c4m_dict_t *
 c4m_new_unmanaged_dict(size_t hash, bool trace_keys, bool trace_vals)
 {
@@ -275,7 +275,7 @@ c4m_dict_init(c4m_dict_t *dict, va_list args)
 static void
 c4m_dict_marshal(c4m_dict_t   *d,
                  c4m_stream_t *s,
-                 c4m_dict_t   *memos,
+                 c4m_memo_t   *memos,
                  int64_t      *mid)
 {
     uint64_t    length;
@@ -294,7 +294,7 @@ c4m_dict_marshal(c4m_dict_t   *d,
     bool                 key_by_val  = kinfo->by_value;
     bool                 val_by_val  = vinfo->by_value;
 
-    c4m_marshal_u32((uint32_t)length, s);
+    c4m_marshal_len(length, s, memos);
 
     // keyhash field is the easiest way to tell whether we're passing by
     // value of
@@ -317,9 +317,9 @@ c4m_dict_marshal(c4m_dict_t   *d,
 }
 
 static void
-c4m_dict_unmarshal(c4m_dict_t *d, c4m_stream_t *s, c4m_dict_t *memos)
+c4m_dict_unmarshal(c4m_dict_t *d, c4m_stream_t *s, c4m_memo_t *memos)
 {
-    uint32_t       length        = c4m_unmarshal_u32(s);
+    uint32_t       length        = c4m_unmarshal_len(s, memos);
     c4m_type_t    *c4m_dict_type = c4m_get_my_type(d);
     c4m_list_t    *type_params   = c4m_type_get_params(c4m_dict_type);
     c4m_type_t    *key_type      = c4m_list_get(type_params, 0, NULL);
@@ -488,7 +488,7 @@ duration_repr(c4m_duration_t *ts)
 static void
 duration_marshal(c4m_duration_t *ts,
                  c4m_stream_t   *s,
-                 c4m_dict_t     *m,
+                 c4m_memo_t     *m,
                  int64_t         d)
 {
     c4m_marshal_u64(ts->tv_sec, s);
@@ -496,7 +496,7 @@ duration_marshal(c4m_duration_t *ts,
 }
 
 static void
-duration_unmarshal(c4m_duration_t *ts, c4m_stream_t *s, c4m_dict_t *m)
+duration_unmarshal(c4m_duration_t *ts, c4m_stream_t *s, c4m_memo_t *m)
 {
     ts->tv_sec  = c4m_unmarshal_u64(s);
     ts->tv_nsec = c4m_unmarshal_u64(s);
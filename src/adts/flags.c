@@ -68,7 +68,7 @@ flags_repr(const c4m_flags_t *self)
 static void
 flags_marshal(const c4m_flags_t *self,
               c4m_stream_t      *out,
-              c4m_dict_t        *memos,
+              c4m_memo_t        *memos,
               int64_t           *mid)
 {
     c4m_marshal_i32(self->bit_modulus, out);
@@ -79,7 +79,7 @@ flags_marshal(const c4m_flags_t *self,
 }
 
 static void
-flags_unmarshal(c4m_flags_t *self, c4m_stream_t *in, c4m_dict_t *memos)
+flags_unmarshal(c4m_flags_t *self, c4m_stream_t *in, c4m_memo_t *memos)
 {
     self->bit_modulus   = c4m_unmarshal_i32(in);
     self->alloc_wordlen = c4m_unmarshal_i32(in);
@@ -958,72 +958,83 @@ grid_add_blank_cell(c4m_grid_t *grid,
     render_to_cache(grid, cell, width, height);
 }
 
-static inline int16_t *
-grid_pre_render(c4m_grid_t *grid, int16_t *col_widths)
+// Renders the cells that start in row `i`, and fills in its height.
+static void
+grid_pre_render_row(c4m_grid_t *grid,
+                    int16_t     i,
+                    int16_t    *col_widths,
+                    int16_t    *row_heights)
 {
-    int16_t            *row_heights = c4m_gc_array_value_alloc(int16_t *,
-                                                    grid->num_rows);
     c4m_render_style_t *gs          = grid_style(grid);
+    int16_t             row_height  = 1;
+    int16_t             cell_height = 0;
+    int16_t             width;
 
-    // Run through and tell the individual items to render.
     // For now we tell them all to render to whatever height.
-    for (int16_t i = 0; i < grid->num_rows; i++) {
-        int16_t row_height = 1;
-        int16_t width;
-        int16_t cell_height = 0;
+    for (int16_t j = 0; j < grid->num_cols; j++) {
+        c4m_renderable_t *cell = *c4m_cell_address(grid, i, j);
 
-        for (int16_t j = 0; j < grid->num_cols; j++) {
-            c4m_renderable_t *cell = *c4m_cell_address(grid, i, j);
-
-            if (cell == NULL) {
-                continue;
-            }
+        if (cell == NULL) {
+            continue;
+        }
 
-            if (cell->start_row != i || cell->start_col != j) {
-                continue;
-            }
+        if (cell->start_row != i || cell->start_col != j) {
+            continue;
+        }
 
-            width = 0;
+        width = 0;
 
-            for (int16_t k = j; k < cell->end_col; k++) {
-                width += col_widths[k];
-            }
+        for (int16_t k = j; k < cell->end_col; k++) {
+            width += col_widths[k];
+        }
 
-            // Make sure to account for borders in spans.
-            if (gs->borders & C4M_INTERIOR_VERTICAL) {
-                width += cell->end_col - j - 1;
-            }
+        // Make sure to account for borders in spans.
+        if (gs->borders & C4M_INTERIOR_VERTICAL) {
+            width += cell->end_col - j - 1;
+        }
 
-            cell->render_width = width;
-            cell_height        = render_to_cache(grid, cell, width, -1);
+        cell->render_width = width;
+        cell_height        = render_to_cache(grid, cell, width, -1);
 
-            if (cell_height > row_height) {
-                row_height = cell_height;
-            }
+        if (cell_height > row_height) {
+            row_height = cell_height;
         }
+    }
 
-        row_heights[i] = row_height;
+    row_heights[i] = row_height;
 
-        for (int16_t j = 0; j < grid->num_cols; j++) {
-            c4m_renderable_t *cell = *c4m_cell_address(grid, i, j);
+    for (int16_t j = 0; j < grid->num_cols; j++) {
+        c4m_renderable_t *cell = *c4m_cell_address(grid, i, j);
 
-            if (cell == NULL) {
-                grid_add_blank_cell(grid, i, j, col_widths[j], cell_height);
-                continue;
-            }
+        if (cell == NULL) {
+            grid_add_blank_cell(grid, i, j, col_widths[j], cell_height);
+            continue;
+        }
 
-            if (cell->start_row != i || cell->start_col != j) {
-                continue;
-            }
-            // TODO: handle vertical spans properly; this does
-            // not.  Right now we're assuming all heights are
-            // dynamic to the longest content.
-            cell->render_cache = pad_lines_vertically(gs,
-                                                      cell->render_cache,
-                                                      row_height,
-                                                      cell->render_width);
+        if (cell->start_row != i || cell->start_col != j) {
+            continue;
         }
+        // TODO: handle vertical spans properly; this does
+        // not.  Right now we're assuming all heights are
+        // dynamic to the longest content.
+        cell->render_cache = pad_lines_vertically(gs,
+                                                  cell->render_cache,
+                                                  row_height,
+                                                  cell->render_width);
     }
+}
+
+static inline int16_t *
+grid_pre_render(c4m_grid_t *grid, int16_t *col_widths)
+{
+    int16_t *row_heights = c4m_gc_array_value_alloc(int16_t *,
+                                                    grid->num_rows);
+
+    // Run through and tell the individual items to render.
+    for (int16_t i = 0; i < grid->num_rows; i++) {
+        grid_pre_render_row(grid, i, col_widths, row_heights);
+    }
+
     return row_heights;
 }
 
@@ -1584,17 +1595,45 @@ grid_add_cell_contents(c4m_grid_t *grid,
     return ((c + 1) ^ start_height) == ((cell->end_col) ^ start_height);
 }
 
+// Produces the lines for one (pre-rendered) row of the grid, from the
+// left pad through the right pad.
+static c4m_list_t *
+grid_render_row(c4m_grid_t *grid,
+                int         i,
+                int16_t    *col_widths,
+                int16_t    *row_heights)
+{
+    c4m_list_t *row = grid_add_left_pad(grid, row_heights[i]);
+
+    grid_add_left_border(grid, row);
+
+    for (int j = 0; j < grid->num_cols; j++) {
+        bool vertical_ok = grid_add_cell_contents(grid,
+                                                  row,
+                                                  i,
+                                                  j,
+                                                  col_widths,
+                                                  row_heights);
+
+        if (vertical_ok && (j + 1 < grid->num_cols)) {
+            grid_add_vertical_rule(grid, row);
+        }
+    }
+
+    grid_add_right_border(grid, row);
+    grid_add_right_pad(grid, row);
+
+    return row;
+}
+
 c4m_list_t *
 _c4m_grid_render(c4m_grid_t *grid, ...)
 {
     // There's a lot of work in here, so I'm keeping the high-level
-    // algorithm in this function as simple as possible.  Note that we
-    // currently build up one big output string, but I'd also like to
-    // have a slight variant that writes to a FILE *.
-    //
-    // A single streaming implementation doesn't really work, since
-    // when writing to a FILE *, we would render the ansi codes as we
-    // go.
+    // algorithm in this function as simple as possible.  This builds
+    // up the whole grid as a list of lines; c4m_grid_write() below is
+    // the variant that writes to a stream a row at a time, rendering
+    // the ansi codes as it goes.
 
     int64_t width  = -1;
     int64_t height = -1;
@@ -1649,25 +1688,8 @@ _c4m_grid_render(c4m_grid_t *grid, ...)
     grid_add_top_border(grid, result, col_widths);
 
     for (int i = 0; i < grid->num_rows; i++) {
-        c4m_list_t *row = grid_add_left_pad(grid, row_heights[i]);
-        grid_add_left_border(grid, row);
-
-        for (int j = 0; j < grid->num_cols; j++) {
-            bool vertical_ok = grid_add_cell_contents(grid,
-                                                      row,
-                                                      i,
-                                                      j,
-                                                      col_widths,
-                                                      row_heights);
-
-            if (vertical_ok && (j + 1 < grid->num_cols)) {
-                grid_add_vertical_rule(grid, row);
-            }
-        }
-
-        grid_add_right_border(grid, row);
-        grid_add_right_pad(grid, row);
-        c4m_list_plus_eq(result, row);
+        c4m_list_plus_eq(result,
+                         grid_render_row(grid, i, col_widths, row_heights));
 
         if (i + 1 < grid->num_rows) {
             grid_add_horizontal_rule(grid, i, result, col_widths);
@@ -1680,6 +1702,101 @@ _c4m_grid_render(c4m_grid_t *grid, ...)
     return align_and_crop_grid(grid, result, width, height);
 }
 
+// Writes out lines as they're finished, aligning or cropping each to
+// the grid width the way align_and_crop_grid() would, then drops
+// them.
+static void
+grid_flush_lines(c4m_grid_t   *grid,
+                 c4m_list_t   *lines,
+                 int32_t       width,
+                 c4m_stream_t *stream,
+                 bool          ansi)
+{
+    int n = c4m_list_len(lines);
+
+    for (int i = 0; i < n; i++) {
+        c4m_utf32_t *s = c4m_to_utf32(c4m_list_get(lines, i, NULL));
+
+        if (c4m_str_render_len(s) != width) {
+            s = align_and_crop_grid_line(grid, s, width);
+        }
+
+        c4m_stream_write_object(stream, s, ansi);
+        c4m_stream_putc(stream, '\n');
+    }
+
+    lines->length = 0;
+}
+
+// Like c4m_grid_to_str(), but writes to a stream a row at a time,
+// instead of building the whole thing first. Column widths get
+// computed once up front; after that, each row's cells are rendered
+// just before the row is written, and their rendered lines are let go
+// once it has been, so memory use depends on the size of a row, not
+// the size of the grid.
+//
+// Takes the "width" keyword like c4m_grid_render(); there's no
+// "height", since vertical alignment needs the whole thing. The
+// "ansi" keyword picks between ANSI output and plain text; by
+// default, we use ANSI when the stream is a terminal.
+void
+_c4m_grid_write(c4m_grid_t *grid, c4m_stream_t *stream, ...)
+{
+    int64_t width = -1;
+    int     fd    = c4m_stream_fileno(stream);
+    bool    ansi  = fd != -1 && isatty(fd);
+
+    c4m_karg_only_init(stream);
+    c4m_kw_int64("width", width);
+    c4m_kw_bool("ansi", ansi);
+
+    if (width == -1) {
+        width = c4m_terminal_width();
+        width = c4m_max(width, 20);
+    }
+
+    if (width == 0) {
+        return;
+    }
+
+    int16_t    *col_widths  = calculate_col_widths(grid, width, &grid->width);
+    int16_t    *row_heights = c4m_gc_array_value_alloc(int16_t,
+                                                    c4m_max(grid->num_rows,
+                                                            1));
+    c4m_list_t *lines       = c4m_new(c4m_type_list(c4m_type_utf32()));
+
+    grid_add_top_pad(grid, lines, width);
+    grid_add_top_border(grid, lines, col_widths);
+    grid_flush_lines(grid, lines, width, stream, ansi);
+
+    for (int i = 0; i < grid->num_rows; i++) {
+        grid_pre_render_row(grid, i, col_widths, row_heights);
+
+        // The rule under a row looks at the cells in the row below
+        // it, which need to be filled in first.
+        if (i > 0) {
+            grid_add_horizontal_rule(grid, i - 1, lines, col_widths);
+            grid_flush_lines(grid, lines, width, stream, ansi);
+        }
+
+        c4m_list_t *row = grid_render_row(grid, i, col_widths, row_heights);
+        grid_flush_lines(grid, row, width, stream, ansi);
+
+        for (int j = 0; j < grid->num_cols; j++) {
+            c4m_renderable_t *cell = *c4m_cell_address(grid, i, j);
+
+            if (cell != NULL && cell->end_row == i + 1) {
+                cell->render_cache = NULL;
+            }
+        }
+    }
+
+    grid_add_bottom_border(grid, lines, col_widths);
+    grid_add_bottom_pad(grid, lines, width);
+    grid_flush_lines(grid, lines, width, stream, ansi);
+    c4m_stream_flush(stream);
+}
+
 c4m_utf32_t *
 c4m_grid_to_str(c4m_grid_t *g)
 {
@@ -1952,7 +2069,7 @@ c4m_grid_horizontal_flow(c4m_list_t *items,
 static void
 c4m_grid_marshal(c4m_grid_t   *grid,
                  c4m_stream_t *s,
-                 c4m_dict_t   *memos,
+                 c4m_memo_t   *memos,
                  int64_t      *mid)
 {
     int num_cells = grid->num_rows * grid->num_cols;
@@ -2043,7 +2160,7 @@ c4m_grid_copy(c4m_grid_t *orig)
 }
 
 static void
-c4m_grid_unmarshal(c4m_grid_t *grid, c4m_stream_t *s, c4m_dict_t *memos)
+c4m_grid_unmarshal(c4m_grid_t *grid, c4m_stream_t *s, c4m_memo_t *memos)
 {
     grid->num_cols    = c4m_unmarshal_u16(s);
     grid->num_rows    = c4m_unmarshal_u16(s);
@@ -2075,13 +2192,13 @@ c4m_grid_unmarshal(c4m_grid_t *grid, c4m_stream_t *s, c4m_dict_t *memos)
 extern void
 c4m_style_marshal(c4m_render_style_t *obj,
                   c4m_stream_t       *s,
-                  c4m_dict_t         *memos,
+                  c4m_memo_t         *memos,
                   int64_t            *mid);
 
 static void
 c4m_renderable_marshal(c4m_renderable_t *r,
                        c4m_stream_t     *s,
-                       c4m_dict_t       *memos,
+                       c4m_memo_t       *memos,
                        int64_t          *mid)
 {
     c4m_sub_marshal(r->raw_item, s, memos, mid);
@@ -2099,12 +2216,12 @@ c4m_renderable_marshal(c4m_renderable_t *r,
 extern void
 c4m_style_unmarshal(c4m_render_style_t *obj,
                     c4m_stream_t       *s,
-                    c4m_dict_t         *memos);
+                    c4m_memo_t         *memos);
 
 static void
 c4m_renderable_unmarshal(c4m_renderable_t *r,
                          c4m_stream_t     *s,
-                         c4m_dict_t       *memos)
+                         c4m_memo_t       *memos)
 {
     r->raw_item            = c4m_sub_unmarshal(s, memos);
     r->container_tag       = c4m_unmarshal_cstring(s);
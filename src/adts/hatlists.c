@@ -62,7 +62,7 @@ c4m_stack_init(hatstack_t *stack, va_list args)
 static void
 c4m_flexarray_marshal(flexarray_t  *r,
                       c4m_stream_t *s,
-                      c4m_dict_t   *memos,
+                      c4m_memo_t   *memos,
                       int64_t      *mid)
 {
     c4m_type_t    *list_type   = c4m_get_my_type(r);
@@ -89,7 +89,7 @@ c4m_flexarray_marshal(flexarray_t  *r,
 }
 
 static void
-c4m_flexarray_unmarshal(flexarray_t *r, c4m_stream_t *s, c4m_dict_t *memos)
+c4m_flexarray_unmarshal(flexarray_t *r, c4m_stream_t *s, c4m_memo_t *memos)
 {
     c4m_type_t    *list_type   = c4m_get_my_type(r);
     c4m_list_t    *type_params = c4m_type_get_params(list_type);
@@ -51,7 +51,7 @@ ipaddr_init(c4m_ipaddr_t *obj, va_list args)
 static void
 ipaddr_marshal(c4m_ipaddr_t *obj,
                c4m_stream_t *s,
-               c4m_dict_t   *memos,
+               c4m_memo_t   *memos,
                int64_t      *mid)
 {
     c4m_marshal_u32(sizeof(struct sockaddr_in6), s);
@@ -61,7 +61,7 @@ ipaddr_marshal(c4m_ipaddr_t *obj,
 }
 
 static void
-ipaddr_unmarshal(c4m_ipaddr_t *obj, c4m_stream_t *s, c4m_dict_t *memos)
+ipaddr_unmarshal(c4m_ipaddr_t *obj, c4m_stream_t *s, c4m_memo_t *memos)
 {
     uint32_t struct_sz = c4m_unmarshal_u32(s);
 
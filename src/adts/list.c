@@ -254,7 +254,7 @@ c4m_list_plus(c4m_list_t *l1, c4m_list_t *l2)
 }
 
 void
-c4m_list_marshal(c4m_list_t *r, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid)
+c4m_list_marshal(c4m_list_t *r, c4m_stream_t *s, c4m_memo_t *memos, int64_t *mid)
 {
     c4m_type_t    *list_type   = c4m_get_my_type(r);
     c4m_list_t    *type_params = c4m_type_get_params(list_type);
@@ -263,8 +263,8 @@ c4m_list_marshal(c4m_list_t *r, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid
     bool           by_val      = item_info->by_value;
 
     read_start(r);
-    c4m_marshal_i32(r->append_ix, s);
-    c4m_marshal_i32(r->length, s);
+    c4m_marshal_len(r->append_ix, s, memos);
+    c4m_marshal_len(r->length, s, memos);
 
     if (by_val) {
         for (int i = 0; i < r->append_ix; i++) {
@@ -280,7 +280,7 @@ c4m_list_marshal(c4m_list_t *r, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid
 }
 
 void
-c4m_list_unmarshal(c4m_list_t *r, c4m_stream_t *s, c4m_dict_t *memos)
+c4m_list_unmarshal(c4m_list_t *r, c4m_stream_t *s, c4m_memo_t *memos)
 {
     c4m_type_t    *list_type   = c4m_get_my_type(r);
     c4m_list_t    *type_params = c4m_type_get_params(list_type);
@@ -288,8 +288,8 @@ c4m_list_unmarshal(c4m_list_t *r, c4m_stream_t *s, c4m_dict_t *memos)
     c4m_dt_info_t *item_info   = item_type ? c4m_type_get_data_type_info(item_type) : NULL;
     bool           by_val      = item_info ? item_info->by_value : false;
 
-    r->append_ix = c4m_unmarshal_i32(s);
-    r->length    = c4m_unmarshal_i32(s);
+    r->append_ix = c4m_unmarshal_len(s, memos);
+    r->length    = c4m_unmarshal_len(s, memos);
     r->data      = c4m_gc_array_alloc(int64_t *, r->length);
 
     if (by_val) {
@@ -54,13 +54,13 @@ c4m_set_init(c4m_set_t *set, va_list args)
 // for strings at some point soon though.
 
 static void
-c4m_set_marshal(c4m_set_t *d, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid)
+c4m_set_marshal(c4m_set_t *d, c4m_stream_t *s, c4m_memo_t *memos, int64_t *mid)
 {
     uint64_t length;
     uint8_t  kt   = (uint8_t)d->item_type;
     void   **view = hatrack_set_items_sort(d, &length);
 
-    c4m_marshal_u32((uint32_t)length, s);
+    c4m_marshal_len(length, s, memos);
     c4m_marshal_u8(kt, s);
 
     for (uint64_t i = 0; i < length; i++) {
@@ -81,12 +81,12 @@ c4m_set_marshal(c4m_set_t *d, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid)
 }
 
 static void
-c4m_set_unmarshal(c4m_set_t *d, c4m_stream_t *s, c4m_dict_t *memos)
+c4m_set_unmarshal(c4m_set_t *d, c4m_stream_t *s, c4m_memo_t *memos)
 {
     uint32_t length;
     uint8_t  kt;
 
-    length = c4m_unmarshal_u32(s);
+    length = c4m_unmarshal_len(s, memos);
     kt     = c4m_unmarshal_u8(s);
 
     hatrack_set_init(d, (uint32_t)kt);
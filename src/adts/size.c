@@ -227,13 +227,13 @@ size_init(c4m_size_t *self, va_list args)
 }
 
 static void
-size_marshal(c4m_size_t *self, c4m_stream_t *s, c4m_dict_t *m, int64_t mid)
+size_marshal(c4m_size_t *self, c4m_stream_t *s, c4m_memo_t *m, int64_t mid)
 {
     c4m_marshal_u64(*self, s);
 }
 
 static void
-size_unmarshal(c4m_size_t *self, c4m_stream_t *s, c4m_dict_t *memos)
+size_unmarshal(c4m_size_t *self, c4m_stream_t *s, c4m_memo_t *memos)
 {
     *self = c4m_unmarshal_u64(s);
 }
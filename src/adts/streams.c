@@ -147,6 +147,7 @@ c4m_stream_init(c4m_stream_t *stream, va_list args)
     bool          append        = false;
     bool          no_create     = false;
     bool          close_on_exec = true;
+    bool          buffered      = true;
     c4m_builtin_t out_type      = C4M_T_UTF8;
 
     c4m_karg_va_init(args);
@@ -161,6 +162,7 @@ c4m_stream_init(c4m_stream_t *stream, va_list args)
     c4m_kw_bool("append", append);
     c4m_kw_bool("no_create", no_create);
     c4m_kw_bool("close_on_exec", close_on_exec);
+    c4m_kw_bool("buffered", buffered);
     c4m_kw_int64("out_type", out_type);
 
     int64_t src_count = 0;
@@ -242,6 +244,14 @@ c4m_stream_init(c4m_stream_t *stream, va_list args)
         flags |= C4M_F_STREAM_APPEND;
     }
 
+    // Writes to in-memory buffers are just a memcpy, and callers
+    // look at the buffer directly, so those never get buffered.
+    // Nothing locks the write buffer, so a stream that more than one
+    // thread writes to must pass "buffered", false.
+    if (buffered && !instring && !buffer) {
+        flags |= C4M_F_STREAM_BUFFERED;
+    }
+
     if (filename != NULL) {
         filename           = c4m_to_utf8(filename);
         stream->contents.f = fopen(filename->data, buf);
@@ -255,13 +265,19 @@ err_check:
         return;
     }
 
+    // Streams over an existing FILE or fd get the same flags as any
+    // other (read is on unless "read", false is passed, and the output
+    // type is set); these used to be dropped, which made every read
+    // from them raise.
     if (fstream != NULL) {
         stream->contents.f = fstream;
+        stream->flags      = flags;
         return;
     }
 
     if (fd != -1) {
         stream->contents.f = fdopen(fd, buf);
+        stream->flags      = flags;
         goto err_check;
     }
 
@@ -275,6 +291,7 @@ err_check:
         }
 
         cookie = new_mem_cookie();
+        flags &= ~C4M_F_STREAM_BUFFERED;
     }
     else {
         if (read && !cookie->ptr_read) {
@@ -333,6 +350,8 @@ c4m_stream_bytes_to_output(int64_t flags, char *buf, int64_t len)
     }
 }
 
+static void stream_drain(c4m_stream_t *);
+
 // We generally assume c4m is passing around 64 bit sizes, but when
 // dealing w/ the C API, things are often 32 bits (e.g., size_t).
 // Therefore, for the internal API, we accept a 64-bit value in, but
@@ -372,6 +391,8 @@ c4m_stream_raw_read(c4m_stream_t *stream, int64_t len, char *buf)
         C4M_CRAISE("Cannot read; stream was not opened with read enabled.");
     }
 
+    stream_drain(stream);
+
     if (flags & C4M_F_STREAM_UTF32_OUT) {
         len *= 4;
     }
@@ -383,6 +404,8 @@ c4m_stream_raw_read(c4m_stream_t *stream, int64_t len, char *buf)
         actual = (*f)(cookie, buf, len);
     }
     else {
+        // Big reads go straight from the kernel into buf.
+        c4m_gc_unprotect(buf, len);
         actual = fread(buf, 1, len, stream->contents.f);
     }
 
@@ -454,20 +477,12 @@ c4m_stream_read_all(c4m_stream_t *stream)
         return (c4m_obj_t *)c4m_buffer_join(l, NULL);
     }
 }
-size_t
-c4m_stream_raw_write(c4m_stream_t *stream, int64_t len, char *buf)
+static size_t
+stream_write_through(c4m_stream_t *stream, int64_t len, char *buf)
 {
     size_t        actual = 0;
     c4m_cookie_t *cookie = NULL;
 
-    if (stream->flags & C4M_F_STREAM_CLOSED) {
-        C4M_CRAISE("Stream is already closed.");
-    }
-
-    if (len <= 0) {
-        return 0;
-    }
-
     if (stream->flags & C4M_F_STREAM_USING_COOKIE) {
         cookie = stream->contents.cookie;
 
@@ -476,7 +491,7 @@ c4m_stream_raw_write(c4m_stream_t *stream, int64_t len, char *buf)
         actual = (*f)(cookie, buf, len);
     }
     else {
-        actual = fwrite(buf, len, 1, stream->contents.f);
+        actual = fwrite(buf, len, 1, stream->contents.f) ? len : 0;
     }
 
     if (actual > 0) {
@@ -501,6 +516,64 @@ c4m_stream_raw_write(c4m_stream_t *stream, int64_t len, char *buf)
     return 0;
 }
 
+// Hands anything sitting in the write buffer to the FILE or cookie.
+// The buffer is emptied first, so if the write raises, we don't try
+// to send the same bytes again on the next flush.
+static void
+stream_drain(c4m_stream_t *stream)
+{
+    int32_t len = stream->wlen;
+    int32_t off = 0;
+
+    stream->wlen = 0;
+
+    while (off < len) {
+        size_t n = stream_write_through(stream, len - off, stream->wbuf + off);
+
+        if (n == 0) {
+            break;
+        }
+        off += n;
+    }
+}
+
+// For buffered streams, small writes are collected until the buffer
+// fills, or until someone calls c4m_stream_flush() or
+// c4m_stream_close(). Writes too big for the buffer go straight
+// through (after whatever was already pending).
+size_t
+c4m_stream_raw_write(c4m_stream_t *stream, int64_t len, char *buf)
+{
+    if (stream->flags & C4M_F_STREAM_CLOSED) {
+        C4M_CRAISE("Stream is already closed.");
+    }
+
+    if (len <= 0) {
+        return 0;
+    }
+
+    if (!(stream->flags & C4M_F_STREAM_BUFFERED)) {
+        return stream_write_through(stream, len, buf);
+    }
+
+    if (stream->wlen + len > C4M_STREAM_WBUF_SIZE) {
+        stream_drain(stream);
+    }
+
+    if (len >= C4M_STREAM_WBUF_SIZE) {
+        return stream_write_through(stream, len, buf);
+    }
+
+    if (stream->wbuf == NULL) {
+        stream->wbuf = c4m_gc_array_value_alloc(char, C4M_STREAM_WBUF_SIZE);
+    }
+
+    memcpy(stream->wbuf + stream->wlen, buf, len);
+    stream->wlen += len;
+
+    return len;
+}
+
 void
 c4m_stream_write_object(c4m_stream_t *stream, c4m_obj_t obj, bool ansi)
 {
@@ -538,6 +611,8 @@ c4m_stream_at_eof(c4m_stream_t *stream)
         return true;
     }
 
+    stream_drain(stream);
+
     if (stream->flags & C4M_F_STREAM_USING_COOKIE) {
         c4m_cookie_t *cookie = stream->contents.cookie;
 
@@ -554,6 +629,8 @@ c4m_stream_get_location(c4m_stream_t *stream)
         C4M_CRAISE("Stream is already closed.");
     }
 
+    stream_drain(stream);
+
     if (stream->flags & C4M_F_STREAM_USING_COOKIE) {
         return stream->contents.cookie->position;
     }
@@ -568,6 +645,8 @@ c4m_stream_set_location(c4m_stream_t *stream, int64_t offset)
         C4M_CRAISE("Stream is already closed.");
     }
 
+    stream_drain(stream);
+
     if (stream->flags & C4M_F_STREAM_USING_COOKIE) {
         c4m_cookie_t *cookie = stream->contents.cookie;
 
@@ -612,6 +691,23 @@ c4m_stream_close(c4m_stream_t *stream)
         return;
     }
 
+    // This also runs as the finalizer, where we can't raise, so
+    // pending output is written on a best-effort basis, the same way
+    // errors from fclose() are ignored below.
+    if (stream->wlen) {
+        if (stream->flags & C4M_F_STREAM_USING_COOKIE) {
+            c4m_cookie_t *cookie = stream->contents.cookie;
+
+            if (cookie && cookie->ptr_write) {
+                (*cookie->ptr_write)(cookie, stream->wbuf, stream->wlen);
+            }
+        }
+        else {
+            fwrite(stream->wbuf, stream->wlen, 1, stream->contents.f);
+        }
+        stream->wlen = 0;
+    }
+
     if (stream->flags & C4M_F_STREAM_USING_COOKIE) {
         c4m_cookie_t *cookie = stream->contents.cookie;
 
@@ -636,9 +732,32 @@ c4m_stream_close(c4m_stream_t *stream)
     }
 
     stream->contents.f = NULL;
+    stream->wbuf       = NULL;
     stream->flags      = C4M_F_STREAM_CLOSED;
 }
 
+// Turns write buffering on or off after the fact; the std streams
+// start out unbuffered, since any thread might write to them. Only
+// turn it on for a stream that one thread writes at a time. Streams
+// over in-memory strings and buffers never get buffered.
+void
+c4m_stream_set_buffered(c4m_stream_t *stream, bool buffered)
+{
+    if (stream->flags & C4M_F_STREAM_CLOSED) {
+        C4M_CRAISE("Stream is already closed.");
+    }
+
+    if (!buffered) {
+        stream_drain(stream);
+        stream->flags &= ~C4M_F_STREAM_BUFFERED;
+        return;
+    }
+
+    if (!(stream->flags & (C4M_F_STREAM_STR_IN | C4M_F_STREAM_BUFFER_IN))) {
+        stream->flags |= C4M_F_STREAM_BUFFERED;
+    }
+}
+
 void
 c4m_stream_flush(c4m_stream_t *stream)
 {
@@ -646,8 +765,10 @@ c4m_stream_flush(c4m_stream_t *stream)
         C4M_CRAISE("Stream is already closed.");
     }
 
+    stream_drain(stream);
+
     if (stream->flags & C4M_F_STREAM_USING_COOKIE) {
-        return; // Not actually buffering ATM.
+        return;
     }
 
     if (fflush(stream->contents.f)) {
@@ -679,6 +800,8 @@ _c4m_print(c4m_obj_t first, ...)
 
     if (first == NULL) {
         c4m_stream_putc(c4m_get_stdout(), '\n');
+        stream_drain(c4m_get_stdout());
+        va_end(args);
         return;
     }
 
@@ -763,9 +886,15 @@ _c4m_print(c4m_obj_t first, ...)
         c4m_stream_putcp(stream, end);
     }
 
+    // Whether or not the FILE itself gets flushed, don't leave
+    // output sitting in our buffer, where anyone else writing to
+    // the same FILE would get ahead of it.
     if (flush) {
         c4m_stream_flush(stream);
     }
+    else {
+        stream_drain(stream);
+    }
 
     va_end(args);
 }
@@ -774,6 +903,19 @@ static c4m_stream_t *c4m_stream_stdin  = NULL;
 static c4m_stream_t *c4m_stream_stdout = NULL;
 static c4m_stream_t *c4m_stream_stderr = NULL;
 
+// If someone turned on buffering for stdout, not everything that
+// writes to it flushes (c4m_stream_write_object() and
+// c4m_stream_putc() don't), so hand whatever's left to the FILE on the
+// way out. This runs before libc flushes its own FILE buffers.
+static void
+drain_std_streams(void)
+{
+    if (c4m_stream_stdout != NULL
+        && !(c4m_stream_stdout->flags & C4M_F_STREAM_CLOSED)) {
+        stream_drain(c4m_stream_stdout);
+    }
+}
+
 void
 c4m_init_std_streams()
 {
@@ -781,12 +923,19 @@ c4m_init_std_streams()
         c4m_stream_stdin  = c4m_new(c4m_type_stream(),
                                    c4m_kw("cstream", c4m_ka(stdin)));
         c4m_stream_stdout = c4m_new(c4m_type_stream(),
-                                    c4m_kw("cstream", c4m_ka(stdout)));
+                                    c4m_kw("cstream",
+                                           c4m_ka(stdout),
+                                           "buffered",
+                                           c4m_ka(false)));
         c4m_stream_stderr = c4m_new(c4m_type_stream(),
-                                    c4m_kw("cstream", c4m_ka(stderr)));
+                                    c4m_kw("cstream",
+                                           c4m_ka(stderr),
+                                           "buffered",
+                                           c4m_ka(false)));
         c4m_gc_register_root(&c4m_stream_stdin, 1);
         c4m_gc_register_root(&c4m_stream_stdout, 1);
         c4m_gc_register_root(&c4m_stream_stderr, 1);
+        atexit(drain_std_streams);
     }
 }
 
@@ -811,7 +960,10 @@ c4m_get_stderr()
 static void
 c4m_stream_set_gc_bits(uint64_t *bitfield, c4m_base_obj_t *alloc)
 {
+    c4m_stream_t *s = (c4m_stream_t *)alloc->data;
+
     c4m_set_bit(bitfield, c4m_ptr_diff(alloc, alloc->data));
+    c4m_set_bit(bitfield, c4m_ptr_diff(alloc, &s->wbuf));
 }
 
 const c4m_vtable_t c4m_stream_vtable = {
@@ -4,23 +4,36 @@ C4M_STATIC_ASCII_STR(c4m_empty_string_const, "");
 C4M_STATIC_ASCII_STR(c4m_newline_const, "\n");
 C4M_STATIC_ASCII_STR(c4m_crlf_const, "\r\n");
 
+// Both of these skip over runs of ASCII a vector at a time, and only
+// decode the rest.
 void
 c4m_internal_utf8_set_codepoint_count(c4m_utf8_t *instr)
 {
     uint8_t        *p   = (uint8_t *)instr->data;
     uint8_t        *end = p + instr->byte_len;
+    int64_t         n   = 0;
     c4m_codepoint_t cp;
 
-    instr->codepoints = 0;
     while (p < end) {
-        instr->codepoints += 1;
-        int n = utf8proc_iterate(p, 4, &cp);
-        if (n < 0) {
+        int64_t ascii = c4m_ascii_prefix_len((char *)p, end - p);
+
+        n += ascii;
+        p += ascii;
+
+        if (p == end) {
+            break;
+        }
+
+        n += 1;
+        int len = utf8proc_iterate(p, 4, &cp);
+        if (len < 0) {
             // Assume we have a partial code point at the end.
-            return;
+            break;
         }
-        p += n;
+        p += len;
     }
+
+    instr->codepoints = n;
 }
 
 int64_t
@@ -32,6 +45,15 @@ c4m_utf8_validate(const c4m_utf8_t *instr)
     int64_t         n = 0;
 
     while (p < end) {
+        int64_t ascii = c4m_ascii_prefix_len((char *)p, end - p);
+
+        n += ascii;
+        p += ascii;
+
+        if (p == end) {
+            break;
+        }
+
         int to_add = utf8proc_iterate(p, 4, &cp);
 
         if (to_add < 0) {
@@ -46,16 +68,148 @@ c4m_utf8_validate(const c4m_utf8_t *instr)
     return 0;
 }
 
-// For now, we're going to do this just for u32, so u8 will convert to
-// u32, in full.
+// Random access into UTF-8 goes through a sparse index, built on
+// demand, so that we only ever decode up to C4M_STR_INDEX_STRIDE
+// codepoints to find a position. Pure ASCII strings don't need it,
+// since byte and codepoint offsets are the same.
+static inline bool
+utf8_is_lead_byte(uint8_t c)
+{
+    return (c & 0xc0) != 0x80;
+}
+
+static inline bool
+utf8_needs_index(const c4m_utf8_t *s)
+{
+    return !c4m_str_is_ascii(s) && s->codepoints > C4M_STR_INDEX_STRIDE;
+}
+
+static c4m_str_index_t *
+utf8_get_index(c4m_utf8_t *s)
+{
+    c4m_str_index_t *ix = s->cp_index;
+
+    if (ix != NULL && ix->byte_len == s->byte_len
+        && ix->codepoints == s->codepoints) {
+        return ix;
+    }
+
+    int32_t n = (s->codepoints + C4M_STR_INDEX_STRIDE - 1)
+              / C4M_STR_INDEX_STRIDE;
+
+    ix = c4m_gc_raw_alloc(sizeof(c4m_str_index_t) + n * sizeof(int32_t),
+                          NULL);
+
+    ix->byte_len    = s->byte_len;
+    ix->codepoints  = s->codepoints;
+    ix->num_entries = n;
+
+    uint8_t *p  = (uint8_t *)s->data;
+    int64_t  cp = 0;
+
+    for (int32_t i = 0; i < s->byte_len; i++) {
+        if (!utf8_is_lead_byte(p[i])) {
+            continue;
+        }
+        if (cp % C4M_STR_INDEX_STRIDE == 0) {
+            if (cp / C4M_STR_INDEX_STRIDE >= n) {
+                break;
+            }
+            ix->offsets[cp / C4M_STR_INDEX_STRIDE] = i;
+        }
+        cp++;
+    }
+
+    s->cp_index = ix;
+
+    return ix;
+}
+
+// Byte offset of codepoint n, where 0 <= n <= codepoints.
+static int64_t
+utf8_byte_offset(const c4m_utf8_t *s, int64_t n)
+{
+    if (n >= s->codepoints) {
+        return s->byte_len;
+    }
+
+    if (c4m_str_is_ascii(s)) {
+        return n;
+    }
+
+    uint8_t *p = (uint8_t *)s->data;
+    int64_t  i = 0;
+
+    if (utf8_needs_index(s)) {
+        c4m_str_index_t *ix = utf8_get_index((c4m_utf8_t *)s);
+
+        i = ix->offsets[n / C4M_STR_INDEX_STRIDE];
+        n = n % C4M_STR_INDEX_STRIDE;
+    }
+
+    while (n--) {
+        i++;
+        while (i < s->byte_len && !utf8_is_lead_byte(p[i])) {
+            i++;
+        }
+    }
+
+    return i;
+}
+
+// Codepoint number of the codepoint starting at byte offset b.
+static int64_t
+utf8_codepoint_offset(const c4m_utf8_t *s, int64_t b)
+{
+    if (b >= s->byte_len) {
+        return s->codepoints;
+    }
+
+    if (c4m_str_is_ascii(s)) {
+        return b;
+    }
+
+    uint8_t *p  = (uint8_t *)s->data;
+    int64_t  i  = 0;
+    int64_t  cp = 0;
+
+    if (utf8_needs_index(s)) {
+        c4m_str_index_t *ix   = utf8_get_index((c4m_utf8_t *)s);
+        int64_t          low  = 0;
+        int64_t          high = ix->num_entries - 1;
+
+        while (low < high) {
+            int64_t mid = (low + high + 1) / 2;
+
+            if (ix->offsets[mid] <= b) {
+                low = mid;
+            }
+            else {
+                high = mid - 1;
+            }
+        }
+
+        i  = ix->offsets[low];
+        cp = low * C4M_STR_INDEX_STRIDE;
+    }
+
+    while (i < b) {
+        if (utf8_is_lead_byte(p[i++])) {
+            cp++;
+        }
+    }
+
+    return cp;
+}
+
 c4m_utf32_t *
 c4m_str_slice(const c4m_str_t *instr, int64_t start, int64_t end)
 {
     if (!instr || c4m_str_codepoint_len(instr) == 0) {
         return c4m_to_utf32(c4m_empty_string());
     }
-    c4m_utf32_t *s   = c4m_to_utf32(instr);
-    int64_t      len = c4m_str_codepoint_len(s);
+    const c4m_str_t *s   = instr;
+    int64_t          len = c4m_str_codepoint_len(s);
 
     if (end < 0) {
         end += len;
@@ -83,11 +237,35 @@ c4m_str_slice(const c4m_str_t *instr, int64_t start, int64_t end)
 
     res->codepoints = slice_len;
 
-    c4m_codepoint_t *src = (c4m_codepoint_t *)s->data;
     c4m_codepoint_t *dst = (c4m_codepoint_t *)res->data;
 
-    for (int i = 0; i < slice_len; i++) {
-        dst[i] = src[start + i];
+    if (c4m_str_is_ascii(s)) {
+        uint8_t *p = (uint8_t *)s->data + start;
+
+        for (int i = 0; i < slice_len; i++) {
+            dst[i] = p[i];
+        }
+    }
+    else if (c4m_str_is_u8(s)) {
+        // Only decode the part we're keeping. Finding the offset can
+        // allocate, so don't look at s->data until after.
+        int64_t  offset = utf8_byte_offset(s, start);
+        uint8_t *p      = (uint8_t *)s->data + offset;
+
+        for (int i = 0; i < slice_len; i++) {
+            int val = utf8proc_iterate(p, 4, &dst[i]);
+            if (val < 0) {
+                C4M_CRAISE("Invalid utf8 in string when slicing.");
+            }
+            p += val;
+        }
+    }
+    else {
+        c4m_codepoint_t *src = (c4m_codepoint_t *)s->data;
+
+        for (int i = 0; i < slice_len; i++) {
+            dst[i] = src[start + i];
+        }
     }
 
     while (res->codepoints != 0) {
@@ -183,15 +361,12 @@ c4m_utf8_index(const c4m_utf8_t *s, int64_t n)
         C4M_CRAISE("Index out of bounds.");
     }
 
-    char           *p = (char *)s->data;
+    int64_t         offset = utf8_byte_offset(s, n);
+    char           *p      = (char *)s->data + offset;
     c4m_codepoint_t cp;
 
-    for (int i = 0; i <= n; i++) {
-        int val = utf8proc_iterate((uint8_t *)p, 4, &cp);
-        if (val < 0) {
-            C4M_CRAISE("Index out of bounds.");
-        }
-        p += val;
+    if (utf8proc_iterate((uint8_t *)p, 4, &cp) < 0) {
+        C4M_CRAISE("Index out of bounds.");
     }
 
     return cp;
@@ -877,6 +1052,14 @@ c4m_str_render_len(const c4m_str_t *s)
             result += c4m_codepoint_width(p[i]);
         }
     }
+    else if (c4m_str_is_ascii(s)) {
+        uint8_t *p = (uint8_t *)s->data;
+
+        // Control characters (and DEL) don't take up any space.
+        for (int i = 0; i < n; i++) {
+            result += p[i] >= 0x20 && p[i] < 0x7f;
+        }
+    }
     else {
         uint8_t        *p = (uint8_t *)s->data;
         c4m_codepoint_t cp;
@@ -1097,6 +1280,8 @@ err:
     c4m_utf8_t *result = c4m_new(c4m_type_utf8(), c4m_kw("length", c4m_ka(len)));
     char       *p      = result->data;
 
+    c4m_gc_unprotect(p, len);
+
     while (1) {
         ssize_t num_read = read(fd, p, len);
 
@@ -1128,9 +1313,6 @@ _c4m_str_find(c4m_str_t *str, c4m_str_t *sub, ...)
     c4m_kw_int64("start", start);
     c4m_kw_int64("end", end);
 
-    str = c4m_to_utf32(str);
-    sub = c4m_to_utf32(sub);
-
     uint64_t strcp = c4m_str_codepoint_len(str);
     uint64_t subcp = c4m_str_codepoint_len(sub);
 
@@ -1153,25 +1335,45 @@ _c4m_str_find(c4m_str_t *str, c4m_str_t *sub, ...)
         return start;
     }
 
-    uint32_t *strp = (uint32_t *)str->data;
-    uint32_t *endp = &strp[end - subcp + 1];
-    uint32_t *subp;
-    uint32_t *p;
+    if (c4m_str_is_u8(str)) {
+        // Any match of valid UTF-8 starts on a codepoint boundary, so
+        // we can search the bytes directly.
+        sub = c4m_to_utf8(sub);
 
-    strp += start;
-    while (strp < endp) {
-        p    = strp;
-        subp = (uint32_t *)sub->data;
-        for (uint64_t i = 0; i < subcp; i++) {
-            if (*p++ != *subp++) {
-                goto next_start;
-            }
+        int64_t bstart = utf8_byte_offset(str, start);
+        int64_t bend   = utf8_byte_offset(str, end);
+        char   *hit    = c4m_find_bytes(str->data + bstart,
+                                     bend - bstart,
+                                     sub->data,
+                                     sub->byte_len);
+
+        if (hit == NULL) {
+            return -1;
         }
-        return start;
-next_start:
-        strp++;
-        start++;
+
+        return utf8_codepoint_offset(str, hit - str->data);
     }
+
+    sub = c4m_to_utf32(sub);
+
+    // Search the raw bytes too, but only accept matches that line up
+    // with a codepoint.
+    char   *base  = str->data + start * 4;
+    int64_t blen  = (end - start) * 4;
+    int64_t sblen = subcp * 4;
+    int64_t off   = 0;
+    char   *hit;
+
+    while ((hit = c4m_find_bytes(base + off, blen - off, sub->data, sblen))) {
+        off = hit - base;
+
+        if ((off & 3) == 0) {
+            return start + off / 4;
+        }
+
+        off++;
+    }
+
     return -1;
 }
 
@@ -1186,9 +1388,6 @@ _c4m_str_rfind(c4m_str_t *str, c4m_str_t *sub, ...)
     c4m_kw_int64("stop", stop);
     c4m_kw_int64("start", start);
 
-    str = c4m_to_utf32(str);
-    sub = c4m_to_utf32(sub);
-
     uint64_t strcp = c4m_str_codepoint_len(str);
     uint64_t subcp = c4m_str_codepoint_len(sub);
 
@@ -1213,6 +1412,26 @@ _c4m_str_rfind(c4m_str_t *str, c4m_str_t *sub, ...)
         return start - 1;
     }
 
+    if (c4m_str_is_u8(str)) {
+        sub = c4m_to_utf8(sub);
+
+        int64_t bstop  = utf8_byte_offset(str, stop);
+        int64_t bstart = utf8_byte_offset(str, start);
+        char   *base   = str->data + bstop;
+        char   *p      = str->data + bstart - sub->byte_len;
+
+        while (p >= base) {
+            if (*p == sub->data[0] && !memcmp(p, sub->data, sub->byte_len)) {
+                return utf8_codepoint_offset(str, p - str->data);
+            }
+            p--;
+        }
+
+        return -1;
+    }
+
+    sub = c4m_to_utf32(sub);
+
     uint32_t *strp   = (uint32_t *)str->data;
     uint32_t *startp = (strp + start) - subcp;
     uint32_t *endp   = strp + stop;
@@ -1234,9 +1453,72 @@ next_start:
     return -1;
 }
 
+// Splitting unstyled UTF-8 on a non-empty separator works on the
+// bytes, and gives back UTF-8 pieces, instead of converting everything
+// to UTF-32 first.
+static inline bool
+utf8_can_split_bytes(c4m_str_t *str, c4m_str_t *sub)
+{
+    return c4m_str_is_u8(str) && c4m_str_codepoint_len(sub) != 0
+        && (str->styling == NULL || str->styling->num_entries == 0);
+}
+
+static c4m_utf8_t *
+utf8_byte_slice(c4m_utf8_t *s, int64_t start, int64_t end)
+{
+    if (start == end) {
+        return c4m_empty_string();
+    }
+
+    return c4m_new(c4m_type_utf8(),
+                   c4m_kw("cstring",
+                          c4m_ka(s->data + start),
+                          "length",
+                          c4m_ka(end - start)));
+}
+
+// Returns the byte offset of the next match at or after `start`, or -1.
+static inline int64_t
+utf8_next_match(c4m_utf8_t *str, c4m_utf8_t *sub, int64_t start)
+{
+    char *hit = c4m_find_bytes(str->data + start,
+                               str->byte_len - start,
+                               sub->data,
+                               sub->byte_len);
+
+    return hit ? hit - str->data : -1;
+}
+
 flexarray_t *
 c4m_str_fsplit(c4m_str_t *str, c4m_str_t *sub)
 {
+    if (utf8_can_split_bytes(str, sub)) {
+        sub = c4m_to_utf8(sub);
+
+        flexarray_t *result = c4m_new(c4m_type_list(c4m_type_utf8()),
+                                      c4m_kw("length",
+                                             c4m_ka(str->codepoints)));
+        int64_t      start  = 0;
+        int64_t      ix     = utf8_next_match(str, sub, start);
+        int          n      = 0;
+
+        while (ix != -1) {
+            flexarray_set(result, n++, utf8_byte_slice(str, start, ix));
+            start = ix + sub->byte_len;
+            ix    = utf8_next_match(str, sub, start);
+        }
+
+        if (start != str->byte_len) {
+            flexarray_set(result,
+                          n++,
+                          utf8_byte_slice(str, start, str->byte_len));
+        }
+
+        flexarray_shrink(result, n);
+
+        return result;
+    }
+
     str            = c4m_to_utf32(str);
     sub            = c4m_to_utf32(sub);
     uint64_t strcp = c4m_str_codepoint_len(str);
@@ -1274,6 +1556,27 @@ c4m_str_fsplit(c4m_str_t *str, c4m_str_t *sub)
 c4m_list_t *
 c4m_str_split(c4m_str_t *str, c4m_str_t *sub)
 {
+    if (utf8_can_split_bytes(str, sub)) {
+        sub = c4m_to_utf8(sub);
+
+        c4m_list_t *result = c4m_new(c4m_type_list(c4m_type_utf8()));
+        int64_t     start  = 0;
+        int64_t     ix     = utf8_next_match(str, sub, start);
+
+        while (ix != -1) {
+            c4m_list_append(result, utf8_byte_slice(str, start, ix));
+            start = ix + sub->byte_len;
+            ix    = utf8_next_match(str, sub, start);
+        }
+
+        if (start != str->byte_len) {
+            c4m_list_append(result,
+                            utf8_byte_slice(str, start, str->byte_len));
+        }
+
+        return result;
+    }
+
     str            = c4m_to_utf32(str);
     sub            = c4m_to_utf32(sub);
     uint64_t strcp = c4m_str_codepoint_len(str);
@@ -1307,17 +1610,17 @@ c4m_str_split(c4m_str_t *str, c4m_str_t *sub)
 static void
 c4m_string_marshal(c4m_str_t    *s,
                    c4m_stream_t *out,
-                   c4m_dict_t   *memos,
+                   c4m_memo_t   *memos,
                    int64_t      *mid)
 {
-    c4m_marshal_u32(s->codepoints, out);
-    c4m_marshal_u32(s->byte_len, out);
+    c4m_marshal_len((uint32_t)s->codepoints, out, memos);
+    c4m_marshal_len((uint32_t)s->byte_len, out, memos);
 
     if (s->styling == NULL) {
-        c4m_marshal_u32(0, out);
+        c4m_marshal_len(0, out, memos);
     }
     else {
-        c4m_marshal_u32((int32_t)s->styling->num_entries, out);
+        c4m_marshal_len(s->styling->num_entries, out, memos);
         for (int i = 0; i < s->styling->num_entries; i++) {
             c4m_marshal_i32(s->styling->styles[i].start, out);
             c4m_marshal_i32(s->styling->styles[i].end, out);
@@ -1330,12 +1633,12 @@ c4m_string_marshal(c4m_str_t    *s,
 }
 
 static void
-c4m_string_unmarshal(c4m_str_t *s, c4m_stream_t *in, c4m_dict_t *memos)
+c4m_string_unmarshal(c4m_str_t *s, c4m_stream_t *in, c4m_memo_t *memos)
 {
-    s->codepoints = c4m_unmarshal_u32(in);
-    s->byte_len   = c4m_unmarshal_u32(in);
+    s->codepoints = c4m_unmarshal_len(in, memos);
+    s->byte_len   = c4m_unmarshal_len(in, memos);
 
-    int32_t num_styles = c4m_unmarshal_u32(in);
+    int32_t num_styles = c4m_unmarshal_len(in, memos);
 
     if (num_styles > 0) {
         c4m_alloc_styles(s, num_styles);
@@ -1475,6 +1778,40 @@ c4m_str_lit(c4m_utf8_t          *s_u8,
     return s_u8;
 }
 
+// Compare without converting either side.
+static bool
+utf8_eq_utf32(c4m_utf8_t *s1, c4m_utf32_t *s2)
+{
+    int64_t          n  = c4m_str_codepoint_len(s1);
+    uint8_t         *p  = (uint8_t *)s1->data;
+    c4m_codepoint_t *p2 = (c4m_codepoint_t *)s2->data;
+    c4m_codepoint_t  cp;
+
+    if (n != c4m_str_codepoint_len(s2)) {
+        return false;
+    }
+
+    if (c4m_str_is_ascii(s1)) {
+        for (int64_t i = 0; i < n; i++) {
+            if (p[i] != p2[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    for (int64_t i = 0; i < n; i++) {
+        int val = utf8proc_iterate(p, 4, &cp);
+
+        if (val < 0 || cp != p2[i]) {
+            return false;
+        }
+        p += val;
+    }
+
+    return true;
+}
+
 bool
 c4m_str_eq(c4m_str_t *s1, c4m_str_t *s2)
 {
@@ -1492,12 +1829,7 @@ c4m_str_eq(c4m_str_t *s1, c4m_str_t *s2)
     bool s2_is_u32 = c4m_str_is_u32(s2);
 
     if (s1_is_u32 ^ s2_is_u32) {
-        if (s1_is_u32) {
-            s2 = c4m_to_utf32(s2);
-        }
-        else {
-            s1 = c4m_to_utf32(s1);
-        }
+        return utf8_eq_utf32(s1_is_u32 ? s2 : s1, s1_is_u32 ? s1 : s2);
     }
 
     if (s1->byte_len != s2->byte_len) {
@@ -1689,7 +2021,7 @@ c4m_str_set_gc_bits(uint64_t *bitfield, c4m_base_obj_t *alloc)
 {
     c4m_str_t *s = (c4m_str_t *)alloc->data;
 
-    c4m_mark_obj_to_addr(bitfield, alloc, &s->styling);
+    c4m_mark_obj_to_addr(bitfield, alloc, &s->cp_index);
 }
 
 const c4m_vtable_t c4m_u8str_vtable = {
@@ -39,7 +39,7 @@ c4m_tuple_get(c4m_tuple_t *tup, int64_t ix)
 static void
 tuple_marshal(c4m_tuple_t  *tup,
               c4m_stream_t *s,
-              c4m_dict_t   *memos,
+              c4m_memo_t   *memos,
               int64_t      *mid)
 {
     c4m_list_t *tparams = c4m_type_get_params(c4m_get_my_type(tup));
@@ -58,7 +58,7 @@ tuple_marshal(c4m_tuple_t  *tup,
 }
 
 static void
-tuple_unmarshal(c4m_tuple_t *tup, c4m_stream_t *s, c4m_dict_t *memos)
+tuple_unmarshal(c4m_tuple_t *tup, c4m_stream_t *s, c4m_memo_t *memos)
 {
     c4m_list_t *tparams = c4m_type_get_params(c4m_get_my_type(tup));
 
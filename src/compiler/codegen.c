@@ -37,6 +37,7 @@ typedef struct {
     c4m_pnode_t            *cur_pnode;
     c4m_zmodule_info_t     *cur_module;
     c4m_list_t             *call_backpatches;
+    c4m_list_t             *fn_decls; // Functions generated this time.
     target_info_t          *target_info;
     c4m_symbol_t           *retsym;
     int                     instruction_counter;
@@ -76,7 +77,7 @@ c4m_new_zfn()
 static void
 c4m_zmodule_gc_bits(uint64_t *bitmap, c4m_zmodule_info_t *zm)
 {
-    c4m_mark_raw_to_addr(bitmap, zm, &zm->instructions);
+    c4m_mark_raw_to_addr(bitmap, zm, &zm->code);
 }
 
 c4m_zmodule_info_t *
@@ -350,6 +351,12 @@ gen_sym_load_const(gen_ctx *ctx, c4m_symbol_t *sym, bool addressof)
          c4m_kw("arg", c4m_ka(sym->static_offset), "type", c4m_ka(type)));
 }
 
+static inline int64_t
+attr_slot_imm(gen_ctx *ctx, c4m_symbol_t *sym)
+{
+    return c4m_attr_slot_imm(c4m_layout_attr_slot(ctx->cctx, sym->name));
+}
+
 static inline void
 gen_sym_load_attr(gen_ctx *ctx, c4m_symbol_t *sym, bool addressof)
 {
@@ -360,7 +367,12 @@ gen_sym_load_attr(gen_ctx *ctx, c4m_symbol_t *sym, bool addressof)
          c4m_kw("arg", c4m_ka(offset), "type", c4m_ka(sym->type)));
     emit(ctx,
          C4M_ZLoadFromAttr,
-         c4m_kw("arg", c4m_ka(addressof), "type", c4m_ka(sym->type)));
+         c4m_kw("arg",
+                c4m_ka(addressof),
+                "immediate",
+                c4m_ka(attr_slot_imm(ctx, sym)),
+                "type",
+                c4m_ka(sym->type)));
 }
 
 // Right now we only ever generate the version that returns the rhs
@@ -374,7 +386,9 @@ gen_sym_load_attr_and_found(gen_ctx *ctx, c4m_symbol_t *sym, bool skipload)
     emit(ctx,
          C4M_ZPushConstObj,
          c4m_kw("arg", c4m_ka(offset), "type", c4m_ka(sym->type)));
-    emit(ctx, C4M_ZLoadFromAttr, c4m_kw("immediate", c4m_ka(flag)));
+    emit(ctx,
+         C4M_ZLoadFromAttr,
+         c4m_kw("immediate", c4m_ka(flag | attr_slot_imm(ctx, sym))));
 }
 
 static inline void
@@ -481,7 +495,12 @@ gen_sym_store(gen_ctx *ctx, c4m_symbol_t *sym, bool pop_and_lock)
         arg = c4m_layout_string_const(ctx->cctx, sym->name);
         gen_load_const_by_offset(ctx, arg, c4m_type_utf8());
 
-        emit(ctx, C4M_ZAssignAttr, c4m_kw("arg", c4m_ka(pop_and_lock)));
+        emit(ctx,
+             C4M_ZAssignAttr,
+             c4m_kw("arg",
+                    c4m_ka(pop_and_lock),
+                    "immediate",
+                    c4m_ka(attr_slot_imm(ctx, sym))));
         return;
     case C4M_SK_VARIABLE:
     case C4M_SK_FORMAL:
@@ -2357,6 +2376,8 @@ gen_function(gen_ctx            *ctx,
     // that's why this is below the append.
     decl->local_id = c4m_list_len(vm->obj->func_info);
     ctx->retsym    = NULL;
+
+    c4m_list_append(ctx->fn_decls, decl);
 }
 
 static void
@@ -2450,17 +2471,37 @@ backpatch_calls(gen_ctx *ctx)
     }
 }
 
+// The optimizer moves code around, and only knows to fix up the
+// object file's function info, so the decls pick their offsets back
+// up from there.
+static inline void
+sync_decl_offsets(gen_ctx *ctx, c4m_vm_t *vm)
+{
+    int n = c4m_list_len(ctx->fn_decls);
+
+    for (int i = 0; i < n; i++) {
+        c4m_fn_decl_t  *decl = c4m_list_get(ctx->fn_decls, i, NULL);
+        c4m_zfn_info_t *info = c4m_list_get(vm->obj->func_info,
+                                            decl->local_id - 1,
+                                            NULL);
+
+        decl->offset = info->offset;
+    }
+}
+
 void
 c4m_internal_codegen(c4m_compile_ctx *cctx, c4m_vm_t *c4m_new_vm)
 {
     gen_ctx ctx = {
         .cctx             = cctx,
         .call_backpatches = c4m_new(c4m_type_list(c4m_type_ref())),
+        .fn_decls         = c4m_new(c4m_type_list(c4m_type_ref())),
         0,
     };
 
-    int n        = c4m_list_len(cctx->module_ordering);
-    int existing = c4m_list_len(c4m_new_vm->obj->module_contents);
+    int         n        = c4m_list_len(cctx->module_ordering);
+    int         existing = c4m_list_len(c4m_new_vm->obj->module_contents);
+    c4m_list_t *new_mods = c4m_list(c4m_type_ref());
 
     for (int i = existing; i < n; i++) {
         ctx.fctx = c4m_list_get(cctx->module_ordering, i, NULL);
@@ -2481,10 +2522,21 @@ c4m_internal_codegen(c4m_compile_ctx *cctx, c4m_vm_t *c4m_new_vm)
 
         ctx.fctx->status = c4m_compile_status_generated_code;
         c4m_add_module(c4m_new_vm->obj, ctx.fctx->module_object);
+        c4m_list_append(new_mods, ctx.fctx->module_object);
     }
 
     backpatch_calls(&ctx);
 
+    // This has to come after the backpatching, which holds pointers
+    // to the instructions it needs to fix.
+    int l = c4m_list_len(new_mods);
+
+    for (int i = 0; i < l; i++) {
+        c4m_optimize_module(c4m_new_vm, c4m_list_get(new_mods, i, NULL));
+    }
+
+    sync_decl_offsets(&ctx, c4m_new_vm);
+
     c4m_new_vm->obj->num_const_objs = cctx->const_instantiation_id;
     c4m_new_vm->obj->static_data    = cctx->const_data;
     c4m_new_vm->obj->entrypoint     = cctx->entry_point->local_module_id;
@@ -4,7 +4,7 @@
 static void
 cctx_gc_bits(uint64_t *bitfield, c4m_compile_ctx *ctx)
 {
-    c4m_mark_raw_to_addr(bitfield, ctx, &ctx->str_map);
+    c4m_mark_raw_to_addr(bitfield, ctx, &ctx->attr_slots);
 }
 
 c4m_compile_ctx *
@@ -32,11 +32,13 @@ c4m_new_compile_context(c4m_str_t *input)
                               c4m_kw("hash", c4m_ka(module_ctx_hash)));
     result->processed     = c4m_new(c4m_type_set(c4m_type_ref()),
                                 c4m_kw("hash", c4m_ka(module_ctx_hash)));
+    result->probed        = c4m_new(c4m_type_set(c4m_type_utf8()));
     result->const_data    = c4m_buffer_empty();
     result->const_memos   = c4m_alloc_marshal_memos();
     result->const_memoid  = 1;
     result->instance_map  = c4m_dict(c4m_type_ref(), c4m_type_i64());
     result->str_map       = c4m_dict(c4m_type_utf8(), c4m_type_i64());
+    result->attr_slots    = c4m_dict(c4m_type_utf8(), c4m_type_i64());
     result->const_stream  = c4m_buffer_outstream(result->const_data, true);
 
     if (input != NULL) {
@@ -119,12 +121,194 @@ merge_function_decls(c4m_compile_ctx *cctx, c4m_module_compile_ctx *fctx)
     }
 }
 
-// This loads all modules up through symbol declaration.
+static void
+load_one_module(c4m_compile_ctx *ctx, c4m_module_compile_ctx *cur)
+{
+    c4m_parse(cur);
+    c4m_module_decl_pass(ctx, cur);
+    if (c4m_fatal_error_in_module(cur)) {
+        ctx->fatality = true;
+    }
+}
+
+#ifdef C4M_COMPILE_THREADS
+// Until their symbols get merged, modules can be parsed and
+// decl-passed independently of each other, so we hand them to a pool
+// of threads. Imports found during a decl pass go onto the backlog,
+// where any idle worker can claim them.
+//
+// Each worker allocates from its own heap (see gcbase.c). The main
+// thread only waits, so its heap can't move under the workers; once
+// they're all done, it adopts their heaps.
+typedef struct {
+    c4m_compile_ctx *cctx;
+    c4m_set_t       *claimed;
+    pthread_mutex_t  lock;
+    pthread_cond_t   idle;
+    int              busy;
+} load_pool_t;
+
+typedef struct {
+    load_pool_t *pool;
+    c4m_arena_t *heap;
+    pthread_t    thread;
+} load_worker_t;
+
+static c4m_module_compile_ctx *
+claim_module(load_pool_t *pool)
+{
+    c4m_compile_ctx         *cctx = pool->cctx;
+    c4m_module_compile_ctx **items;
+    uint64_t                 n;
+
+    if (cctx->fatality) {
+        return NULL;
+    }
+
+    items = c4m_set_items(cctx->backlog, &n);
+
+    for (uint64_t i = 0; i < n; i++) {
+        c4m_module_compile_ctx *m = items[i];
+
+        if (m->status >= c4m_compile_status_code_loaded) {
+            continue;
+        }
+        if (c4m_set_add(pool->claimed, m)) {
+            return m;
+        }
+    }
+
+    return NULL;
+}
+
+static void *
+load_worker_main(void *arg)
+{
+    load_worker_t          *w    = arg;
+    load_pool_t            *pool = w->pool;
+    c4m_module_compile_ctx *cur;
+
+    c4m_internal_set_heap(w->heap);
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (true) {
+        cur = claim_module(pool);
+
+        if (cur != NULL) {
+            pool->busy++;
+            pthread_mutex_unlock(&pool->lock);
+
+            load_one_module(pool->cctx, cur);
+
+            pthread_mutex_lock(&pool->lock);
+            pool->busy--;
+            // Anything it imported is now up for grabs.
+            pthread_cond_broadcast(&pool->idle);
+            continue;
+        }
+
+        // Nothing left to claim, and nobody is still working on
+        // something that might import more.
+        if (pool->busy == 0) {
+            pthread_cond_broadcast(&pool->idle);
+            break;
+        }
+
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    w->heap = c4m_internal_release_worker_heap();
+
+    return NULL;
+}
+
+// Returns false if we couldn't start any threads, in which case
+// nothing's been loaded.
+static bool
+parallel_module_loads(c4m_compile_ctx *ctx)
+{
+    load_worker_t workers[C4M_COMPILE_THREADS];
+    int           n       = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int           started = 0;
+    load_pool_t   pool    = {
+             .cctx    = ctx,
+             .claimed = c4m_new(c4m_type_set(c4m_type_ref()),
+                            c4m_kw("hash", c4m_ka(module_ctx_hash))),
+             .lock    = PTHREAD_MUTEX_INITIALIZER,
+             .idle    = PTHREAD_COND_INITIALIZER,
+             .busy    = 0,
+    };
+
+    if (n > C4M_COMPILE_THREADS) {
+        n = C4M_COMPILE_THREADS;
+    }
+
+    if (n < 2) {
+        return false;
+    }
+
+    // This is set up lazily on first use, which the workers would
+    // otherwise race to do.
+    c4m_setup_treematch_patterns();
+
+    // All heaps get made up front; once the first worker is running,
+    // this thread can't allocate.
+    for (int i = 0; i < n; i++) {
+        workers[i].pool = &pool;
+        workers[i].heap = c4m_internal_new_worker_heap();
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(&workers[i].thread,
+                           NULL,
+                           load_worker_main,
+                           &workers[i])) {
+            break;
+        }
+        started++;
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < n; i++) {
+        c4m_internal_adopt_worker_heap(workers[i].heap);
+    }
+
+    return started != 0;
+}
+#endif
+
+// This loads all modules up through symbol declaration. Function
+// declarations get merged in merge_global_info(), once we have the
+// topological ordering.
 static void
 c4m_perform_module_loads(c4m_compile_ctx *ctx)
 {
     c4m_module_compile_ctx *cur;
 
+#ifdef C4M_COMPILE_THREADS
+    if (parallel_module_loads(ctx)) {
+        if (ctx->fatality) {
+            return;
+        }
+
+        uint64_t n;
+        void   **items = c4m_set_items(ctx->backlog, &n);
+
+        for (uint64_t i = 0; i < n; i++) {
+            c4m_set_put(ctx->processed, items[i]);
+            c4m_set_remove(ctx->backlog, items[i]);
+        }
+
+        return;
+    }
+#endif
+
     while (true) {
         cur = c4m_set_any_item(ctx->backlog, NULL);
         if (cur == NULL) {
@@ -132,19 +316,12 @@ c4m_perform_module_loads(c4m_compile_ctx *ctx)
         }
 
         if (cur->status < c4m_compile_status_code_loaded) {
-            c4m_parse(cur);
-            c4m_module_decl_pass(ctx, cur);
+            load_one_module(ctx, cur);
             if (c4m_fatal_error_in_module(cur)) {
-                ctx->fatality = true;
                 return;
             }
         }
 
-        if (cur->status < c4m_compile_status_scopes_merged) {
-            merge_function_decls(ctx, cur);
-            c4m_module_set_status(cur, c4m_compile_status_scopes_merged);
-        }
-
         c4m_set_put(ctx->processed, cur);
         c4m_set_remove(ctx->backlog, cur);
     }
@@ -412,6 +589,15 @@ merge_global_info(c4m_compile_ctx *cctx)
 
     uint64_t mod_len = c4m_list_len(cctx->module_ordering);
 
+    for (uint64_t i = 0; i < mod_len; i++) {
+        fctx = c4m_list_get(cctx->module_ordering, i, NULL);
+
+        if (fctx->status < c4m_compile_status_scopes_merged) {
+            merge_function_decls(cctx, fctx);
+            c4m_module_set_status(fctx, c4m_compile_status_scopes_merged);
+        }
+    }
+
     for (uint64_t i = 0; i < mod_len; i++) {
         fctx = c4m_list_get(cctx->module_ordering, i, NULL);
 
@@ -456,6 +642,14 @@ c4m_compile_from_entry_point(c4m_str_t *entry)
         }
     }
 
+    // Everything up to here only had to find and lex the sys package
+    // and the entry point; if neither they nor anything they pulled
+    // in has changed since the last compile, there's nothing left to do.
+    result->cached_vm = c4m_cache_lookup(result);
+    if (result->cached_vm != NULL) {
+        return result;
+    }
+
     c4m_perform_module_loads(result);
     if (result->fatality) {
         return result;
@@ -476,6 +670,10 @@ c4m_compile_from_entry_point(c4m_str_t *entry)
 c4m_vm_t *
 c4m_generate_code(c4m_compile_ctx *ctx)
 {
+    if (ctx->cached_vm != NULL) {
+        return ctx->cached_vm;
+    }
+
     c4m_vm_t *result = c4m_new_vm(ctx);
 
     c4m_vm_reset(result);
@@ -487,5 +685,7 @@ c4m_generate_code(c4m_compile_ctx *ctx)
     }
 
     c4m_vm_reset(result);
+    c4m_cache_store(ctx, result);
+
     return result;
 }
@@ -14,6 +14,9 @@ typedef enum : int8_t {
     fmt_load_from_attr,
     fmt_label,
     fmt_tcall,
+    fmt_zop,
+    fmt_local3,
+    fmt_local_add,
 } inst_arg_fmt_t;
 
 typedef struct {
@@ -82,6 +85,16 @@ const inst_info_t inst_info[256] = {
         .arg_fmt = fmt_sym_local,
         .unused  = true,
     },
+    [C4M_ZPushLocalPair] = {
+        .name    = "ZPushLocalPair",
+        .arg_fmt = fmt_sym_local,
+        .imm_fmt = fmt_sym_local,
+    },
+    [C4M_ZPushLocalAddImm] = {
+        .name    = "ZPushLocalAddImm",
+        .arg_fmt = fmt_sym_local,
+        .imm_fmt = fmt_int,
+    },
     [C4M_ZPushStaticObj] = {
         .name        = "ZPushStaticObj",
         .show_module = 1,
@@ -105,6 +118,16 @@ const inst_info_t inst_info[256] = {
         .name    = "ZJnz",
         .arg_fmt = fmt_offset,
     },
+    [C4M_ZCmpJz] = {
+        .name    = "ZCmpJz",
+        .arg_fmt = fmt_offset,
+        .imm_fmt = fmt_zop,
+    },
+    [C4M_ZCmpJnz] = {
+        .name    = "ZCmpJnz",
+        .arg_fmt = fmt_offset,
+        .imm_fmt = fmt_zop,
+    },
     [C4M_ZDupTop] = {
         .name = "ZDupTop",
     },
@@ -117,10 +140,40 @@ const inst_info_t inst_info[256] = {
     [C4M_ZAssignAttr] = {
         .name    = "ZAssignAttr",
         .arg_fmt = fmt_bool,
+        .imm_fmt = fmt_load_from_attr,
     },
     [C4M_ZAssignToLoc] = {
         .name = "ZAssignToLoc",
     },
+    [C4M_ZStoreLocal] = {
+        .name    = "ZStoreLocal",
+        .arg_fmt = fmt_sym_local,
+    },
+    [C4M_ZMoveLocal] = {
+        .name    = "ZMoveLocal",
+        .arg_fmt = fmt_sym_local,
+        .imm_fmt = fmt_sym_local,
+    },
+    [C4M_ZLocalOp3] = {
+        .name    = "ZLocalOp3",
+        .arg_fmt = fmt_sym_local,
+        .imm_fmt = fmt_local3,
+    },
+    [C4M_ZLocalAddImm] = {
+        .name    = "ZLocalAddImm",
+        .arg_fmt = fmt_sym_local,
+        .imm_fmt = fmt_local_add,
+    },
+    [C4M_ZLocalCmpJz] = {
+        .name    = "ZLocalCmpJz",
+        .arg_fmt = fmt_offset,
+        .imm_fmt = fmt_local3,
+    },
+    [C4M_ZLocalCmpJnz] = {
+        .name    = "ZLocalCmpJnz",
+        .arg_fmt = fmt_offset,
+        .imm_fmt = fmt_local3,
+    },
     [C4M_ZBail] = {
         .name = "ZBail",
     },
@@ -149,6 +202,10 @@ const inst_info_t inst_info[256] = {
         .name    = "ZMoveSp",
         .arg_fmt = fmt_int,
     },
+    [C4M_ZMoveSpPushFromR0] = {
+        .name    = "ZMoveSpPushFromR0",
+        .arg_fmt = fmt_int,
+    },
     [C4M_ZModuleEnter] = {
         .name    = "ZModuleEnter",
         .arg_fmt = fmt_int,
@@ -171,6 +228,10 @@ const inst_info_t inst_info[256] = {
     [C4M_ZAdd] = {
         .name = "ZAdd",
     },
+    [C4M_ZAddImm] = {
+        .name    = "ZAddImm",
+        .imm_fmt = fmt_int,
+    },
     [C4M_ZUAdd] = {
         .name = "ZUAdd",
     },
@@ -484,13 +545,27 @@ fmt_arg_or_imm_no_syms(c4m_vm_t *vm, c4m_zinstruction_t *instr, int i, bool imm)
         return c4m_cstr_format("static offset: {:x}",
                                c4m_box_i64(value));
     case fmt_load_from_attr:
-        return c4m_cstr_format("attr name @{:8x}", c4m_box_i64(value));
+        return c4m_cstr_format("attr slot {}, flags {:x}",
+                               c4m_box_i64(c4m_attr_imm_slot(value)),
+                               c4m_box_i64(c4m_attr_imm_flags(value)));
     case fmt_label:
         return c4m_cstr_format("[h2]{}",
                                value_to_object(vm, value, c4m_type_utf8()));
     case fmt_tcall:
         return c4m_cstr_format("builtin call of [em]{}[/]",
                                fmt_builtin_fn(value));
+    case fmt_zop:
+        return c4m_cstr_format("[em]{}[/]", c4m_instr_utf8_names[value & 0xff]);
+    case fmt_local3:
+        return c4m_cstr_format(
+            "[em]{}[/] of slots {}, {}",
+            c4m_instr_utf8_names[c4m_local3_op(value) & 0xff],
+            c4m_box_i64(c4m_local3_a(value)),
+            c4m_box_i64(c4m_local3_b(value)));
+    case fmt_local_add:
+        return c4m_cstr_format("slot {} + {}",
+                               c4m_box_i64(c4m_local_add_slot(value)),
+                               c4m_box_i64(c4m_local_add_k(value)));
     default:
         c4m_unreachable();
     }
@@ -107,19 +107,44 @@ c4m_token_type_to_string(c4m_token_kind_t tk)
     return c4m_new_utf8(tt_info[tk].tt_name);
 }
 
+// The lexer works directly on the UTF-8 source. Everything with
+// meaning to the lexer is ASCII, so single bytes get handled inline,
+// and we only decode when we hit a multi-byte sequence (which can
+// only matter inside identifiers; in strings and comments it's just
+// skipped over).
 typedef struct {
     c4m_module_compile_ctx *ctx;
-    c4m_codepoint_t        *start;
-    c4m_codepoint_t        *end;
-    c4m_codepoint_t        *pos;
-    c4m_codepoint_t        *line_start;
+    char                   *start;
+    char                   *end;
+    char                   *pos;
+    char                   *line_start;
     c4m_token_t            *last_token;
     size_t                  token_id;
     size_t                  line_no;
     size_t                  cur_tok_line_no;
     size_t                  cur_tok_offset;
+    // UTF-8 continuation bytes seen so far on the current line, so
+    // that token columns still count codepoints, not bytes.
+    size_t                  line_cont;
 } lex_state_t;
 
+#define ID_START    0x01
+#define ID_CONTINUE 0x02
+
+// Classification of ASCII bytes; must agree with
+// c4m_codepoint_is_c4m_id_start() / c4m_codepoint_is_c4m_id_continue().
+static const uint8_t ascii_class[128] = {
+    ['$'] = ID_START | ID_CONTINUE,
+    ['?'] = ID_START | ID_CONTINUE,
+    ['_'] = ID_START | ID_CONTINUE,
+    ['0' ... '9'] = ID_CONTINUE,
+    ['A' ... 'Z'] = ID_START | ID_CONTINUE,
+    ['a' ... 'z'] = ID_START | ID_CONTINUE,
+};
+
+// The longest keyword; anything longer is an identifier.
+#define MAX_KEYWORD_LEN 8
+
 // These helpers definitely require us to keep names consistent internally.
 //
 // They just remove clutter in calling stuff and emphasize the variability:
@@ -139,27 +164,52 @@ typedef struct {
 
 static const __uint128_t max_intval = (__uint128_t)0xffffffffffffffffULL;
 
+static inline void fill_lex_error(lex_state_t *, c4m_compile_error_t);
+
+static c4m_codepoint_t
+decode(lex_state_t *state, int *lenp)
+{
+    c4m_codepoint_t cp;
+    int             len = utf8proc_iterate((uint8_t *)state->pos,
+                                           state->end - state->pos,
+                                           &cp);
+
+    if (len < 0) {
+        LEX_ERROR(c4m_err_lex_invalid_char);
+    }
+
+    *lenp = len;
+
+    return cp;
+}
+
 static inline c4m_codepoint_t
 next(lex_state_t *state)
 {
     if (state->pos >= state->end) {
         return 0;
     }
-    return *state->pos++;
-}
 
-static inline void
-unput(lex_state_t *state)
-{
-    if (state->pos && state->pos <= state->end) {
-        --state->pos;
+    uint8_t b = *(uint8_t *)state->pos;
+
+    if (b < 0x80) {
+        state->pos++;
+        return b;
     }
+
+    int             len;
+    c4m_codepoint_t cp = decode(state, &len);
+
+    state->pos += len;
+    state->line_cont += len - 1;
+
+    return cp;
 }
 
 static inline void
 advance(lex_state_t *state)
 {
-    state->pos++;
+    next(state);
 }
 
 static inline c4m_codepoint_t
@@ -168,7 +218,16 @@ peek(lex_state_t *state)
     if (state->pos >= state->end) {
         return 0;
     }
-    return *(state->pos);
+
+    uint8_t b = *(uint8_t *)state->pos;
+
+    if (b < 0x80) {
+        return b;
+    }
+
+    int len;
+
+    return decode(state, &len);
 }
 
 static inline void
@@ -176,6 +235,14 @@ at_new_line(lex_state_t *state)
 {
     state->line_no++;
     state->line_start = state->pos;
+    state->line_cont  = 0;
+}
+
+static inline c4m_utf8_t *
+span_to_utf8(char *start, int64_t len)
+{
+    return c4m_new(c4m_type_utf8(),
+                   c4m_kw("cstring", c4m_ka(start), "length", c4m_ka(len)));
 }
 
 static inline void
@@ -197,7 +264,7 @@ output_token(lex_state_t *state, c4m_token_kind_t kind)
 static inline void
 skip_optional_newline(lex_state_t *state)
 {
-    c4m_codepoint_t *start = state->pos;
+    char *start = state->pos;
 
     while (true) {
         switch (peek(state)) {
@@ -245,34 +312,37 @@ handle_lit_mod(lex_state_t *state, c4m_lit_syntax_t syntax)
     }
     advance(state);
 
-    c4m_codepoint_t *lm_start = state->pos;
+    char *lm_start = state->pos;
 
     while (c4m_codepoint_is_c4m_id_continue(peek(state))) {
         advance(state);
     }
 
-    size_t n = (size_t)(state->pos - lm_start);
-
-    tok->literal_modifier = c4m_to_utf8(
-        c4m_new(c4m_type_utf32(),
-                c4m_kw("length",
-                       c4m_ka(n),
-                       "codepoints",
-                       c4m_ka(lm_start))));
-    state->start = state->pos;
+    tok->literal_modifier = span_to_utf8(lm_start, state->pos - lm_start);
+    state->start          = state->pos;
 }
 
 static inline void
 capture_lit_text(c4m_token_t *tok)
 {
-    int64_t      diff = tok->end_ptr - tok->start_ptr - 2 * tok->adjustment;
-    c4m_utf32_t *u32  = c4m_new(c4m_type_utf32(),
-                               c4m_kw("length",
-                                      c4m_ka(diff),
-                                      "codepoints",
-                                      tok->start_ptr + tok->adjustment));
-
-    tok->text = c4m_to_utf8(u32);
+    int64_t diff = tok->end_ptr - tok->start_ptr - 2 * tok->adjustment;
+
+    tok->text = span_to_utf8(tok->start_ptr + tok->adjustment, diff);
+}
+
+// Only used for errors, so we don't bother w/ line_cont here.
+static int
+codepoints_between(char *p, char *end)
+{
+    int n = 0;
+
+    for (; p < end; p++) {
+        if ((*p & 0xc0) != 0x80) {
+            n++;
+        }
+    }
+
+    return n;
 }
 
 static inline void
@@ -284,7 +354,9 @@ fill_lex_error(lex_state_t *state, c4m_compile_error_t code)
     tok->start_ptr   = state->start;
     tok->end_ptr     = state->pos;
     tok->line_no     = state->line_no;
-    tok->line_offset = state->start - state->line_start;
+    tok->line_offset = state->start > state->line_start
+                         ? codepoints_between(state->line_start, state->start)
+                         : 0;
 
     c4m_compile_error *err = c4m_new_error(0);
     err->code              = code;
@@ -324,14 +396,12 @@ scan_int_or_float_literal(lex_state_t *state)
     // This one probably does make more sense to fully parse here.
     // There is an issue:
     //
-    // We're using u32 as our internal repr for what we're parsing.
-    // But the easiest way to deal w/ floats is to call strtod(),
-    // which expects UTF8 (well, ASCII really). We don't want to
-    // reconvert (or keep around) the whole remainder of the file, so
-    // we just scan forward looking at absolutely every character than
-    // can possibly be in a valid float (including E/e, but not NaN /
-    // infinity; those will have to be handled as keywords).  We
-    // convert that bit back to UTF-8.
+    // The easiest way to deal w/ floats is to call strtod(), but the
+    // source isn't null terminated where the number ends. So we just
+    // scan forward looking at absolutely every character than can
+    // possibly be in a valid float (including E/e, but not NaN /
+    // infinity; those will have to be handled as keywords), and copy
+    // that bit out.
     //
     // If did we see a starting character that indicates a float, we
     // know it might be a float, so we keep a record of where the
@@ -349,11 +419,14 @@ scan_int_or_float_literal(lex_state_t *state)
     // got here. But state->start does point to the beginning, so we
     // use that when we need to reconstruct the string.
 
-    c4m_codepoint_t *start    = state->start;
-    int              ix       = 1; // First index we need to check.
-    int              float_ix = 0; // 0 means not a float.
+    char *start    = state->start;
+    int   ix       = 1; // First index we need to check.
+    int   float_ix = 0; // 0 means not a float.
 
     while (true) {
+        if (start + ix >= state->end) {
+            break;
+        }
         switch (start[ix]) {
         case '0':
         case '1':
@@ -391,12 +464,7 @@ scan_int_or_float_literal(lex_state_t *state)
         break;
     }
 
-    c4m_utf32_t *u32 = c4m_new(c4m_type_utf32(),
-                               c4m_kw("length",
-                                      c4m_ka(ix),
-                                      "codepoints",
-                                      c4m_ka(start)));
-    c4m_utf8_t  *u8  = c4m_to_utf8(u32);
+    c4m_utf8_t *u8 = span_to_utf8(start, ix);
 
     if (float_ix) {
         char  *endp  = NULL;
@@ -728,17 +796,28 @@ init_keywords()
 static void
 scan_id_or_keyword(lex_state_t *state)
 {
+    bool ascii = true;
+
     init_keywords();
 
-    // The pointer should be over an id_start
-    while (true) {
-        c4m_codepoint_t c = next(state);
-        if (!c4m_codepoint_is_c4m_id_continue(c)) {
-            if (c) {
-                unput(state);
+    // We're already past the id_start.
+    while (state->pos < state->end) {
+        uint8_t b = *(uint8_t *)state->pos;
+
+        if (b < 0x80) {
+            if (!(ascii_class[b] & ID_CONTINUE)) {
+                break;
             }
+            state->pos++;
+            continue;
+        }
+
+        if (!c4m_codepoint_is_c4m_id_continue(peek(state))) {
             break;
         }
+
+        ascii = false;
+        advance(state);
     }
 
     bool    found  = false;
@@ -748,16 +827,14 @@ scan_id_or_keyword(lex_state_t *state)
         return;
     }
 
-    c4m_utf32_t *as_u32 = c4m_new(
-        c4m_type_utf32(),
-        c4m_kw("codepoints",
-               c4m_ka(state->start),
-               "length",
-               c4m_ka(length)));
+    if (!ascii || length > MAX_KEYWORD_LEN) {
+        TOK(c4m_tt_identifier);
+        return;
+    }
 
     c4m_token_kind_t r = (c4m_token_kind_t)(int64_t)hatrack_dict_get(
         keywords,
-        c4m_to_utf8(as_u32),
+        span_to_utf8(state->start, length),
         &found);
 
     if (!found) {
@@ -771,14 +848,7 @@ scan_id_or_keyword(lex_state_t *state)
         LITERAL_TOK(r, 0, ST_Bool);
         return;
     case c4m_tt_float_lit: {
-        c4m_utf32_t *u32 = c4m_new(
-            c4m_type_utf32(),
-            c4m_kw("length",
-                   c4m_ka((int64_t)(state->pos - state->start)),
-                   "codepoints",
-                   c4m_ka(state->start)));
-
-        c4m_utf8_t *u8    = c4m_to_utf8(u32);
+        c4m_utf8_t *u8    = span_to_utf8(state->start, length);
         double      value = strtod((char *)u8->data, NULL);
 
         LITERAL_TOK(r, 0, ST_Float);
@@ -805,7 +875,8 @@ lex(lex_state_t *state)
 lex_next_token:
         state->start           = state->pos;
         state->cur_tok_line_no = state->line_no;
-        state->cur_tok_offset  = state->start - state->line_start;
+        state->cur_tok_offset  = state->start - state->line_start
+                              - state->line_cont;
         c                      = next(state);
 
         switch (c) {
@@ -844,19 +915,20 @@ lex_next_token:
             // the lexer jumps back up here once it advances past the
             // second slash.
 line_comment:
-            while (true) {
-                switch (next(state)) {
-                case '\n':
-                    at_new_line(state);
-                    TOK(c4m_tt_line_comment);
-                    goto lex_next_token;
-                case 0: // EOF
+            do {
+                char *nl = memchr(state->pos, '\n', state->end - state->pos);
+
+                if (nl == NULL) {
+                    state->pos = state->end;
                     TOK(c4m_tt_eof);
                     return;
-                default:
-                    continue;
                 }
-            }
+
+                state->pos = nl + 1;
+                at_new_line(state);
+                TOK(c4m_tt_line_comment);
+            } while (0);
+            continue;
         case '~':
             TOK(c4m_tt_lock_attr);
             continue;
@@ -1107,7 +1179,12 @@ line_comment:
             scan_string_literal(state);
             continue;
         default:
-            if (!c4m_codepoint_is_c4m_id_start(c)) {
+            if (c < 0x80) {
+                if (!(ascii_class[c] & ID_START)) {
+                    LEX_ERROR(c4m_err_lex_invalid_char);
+                }
+            }
+            else if (!c4m_codepoint_is_c4m_id_start(c)) {
                 LEX_ERROR(c4m_err_lex_invalid_char);
             }
             scan_id_or_keyword(state);
@@ -1126,13 +1203,13 @@ c4m_lex(c4m_module_compile_ctx *ctx, c4m_stream_t *stream)
     int outkind;
     outkind = stream->flags & (C4M_F_STREAM_UTF8_OUT | C4M_F_STREAM_UTF32_OUT);
 
-    c4m_obj_t   *raw = c4m_stream_read_all(stream);
-    c4m_utf32_t *utf32;
-    lex_state_t  lex_info = {
-         .token_id   = 0,
-         .line_no    = 1,
-         .line_start = 0,
-         .ctx        = ctx,
+    c4m_obj_t  *raw = c4m_stream_read_all(stream);
+    c4m_utf8_t *utf8;
+    lex_state_t lex_info = {
+        .token_id   = 0,
+        .line_no    = 1,
+        .line_start = 0,
+        .ctx        = ctx,
     };
 
     if (raw == NULL) {
@@ -1141,35 +1218,32 @@ c4m_lex(c4m_module_compile_ctx *ctx, c4m_stream_t *stream)
 
     switch (outkind) {
     case C4M_F_STREAM_UTF32_OUT:
-        utf32 = (c4m_str_t *)raw;
-
-        if (c4m_str_codepoint_len(utf32) == 0) {
-            return false;
-        }
+        utf8 = c4m_to_utf8((c4m_utf32_t *)raw);
         break;
     case C4M_F_STREAM_UTF8_OUT:
-        if (c4m_str_codepoint_len((c4m_utf8_t *)raw) == 0) {
-            return false;
-        }
-
-        utf32 = c4m_to_utf32((c4m_utf8_t *)raw);
+        utf8 = (c4m_utf8_t *)raw;
         break;
     default:
         // A buffer object, which we assume is utf8.
         if (c4m_buffer_len((c4m_buf_t *)raw) == 0) {
             return false;
         }
-        utf32 = c4m_to_utf32(c4m_buf_to_utf8_string((c4m_buf_t *)raw));
+        utf8 = c4m_buf_to_utf8_string((c4m_buf_t *)raw);
         break;
     }
 
-    int len             = c4m_str_codepoint_len(utf32);
-    ctx->raw            = utf32;
+    int64_t len = c4m_str_byte_len(utf8);
+
+    if (len == 0) {
+        return false;
+    }
+
+    ctx->raw            = utf8;
     ctx->tokens         = c4m_new(c4m_type_list(c4m_type_ref()));
-    lex_info.start      = (c4m_codepoint_t *)utf32->data;
-    lex_info.pos        = (c4m_codepoint_t *)utf32->data;
-    lex_info.line_start = (c4m_codepoint_t *)utf32->data;
-    lex_info.end        = &((c4m_codepoint_t *)(utf32->data))[len];
+    lex_info.start      = utf8->data;
+    lex_info.pos        = utf8->data;
+    lex_info.line_start = utf8->data;
+    lex_info.end        = utf8->data + len;
 
     bool error = false;
 
@@ -1198,13 +1272,8 @@ c4m_format_one_token(c4m_token_t *tok, c4m_str_t *prefix)
     c4m_utf8_t  *name    = c4m_new_utf8(tt_info[info_ix].tt_name);
     int32_t     *line    = c4m_box_i32(tok->line_no);
     int32_t     *offset  = c4m_box_i32(tok->line_offset);
-    c4m_utf32_t *val;
-
-    val = c4m_new(c4m_type_utf32(),
-                  c4m_kw("length",
-                         c4m_ka((int64_t)(tok->end_ptr - tok->start_ptr)),
-                         "codepoints",
-                         c4m_ka(tok->start_ptr)));
+    c4m_utf8_t  *val     = span_to_utf8(tok->start_ptr,
+                                   tok->end_ptr - tok->start_ptr);
 
     return c4m_cstr_format("{}#{} {} ({}:{}) {}",
                            prefix,
@@ -1252,13 +1321,9 @@ c4m_format_tokens(c4m_module_compile_ctx *ctx)
         c4m_list_append(row, c4m_str_from_int(tok->line_offset));
 
         if (tt_info[info_ix].show_contents) {
-            c4m_list_append(
-                row,
-                c4m_new(c4m_type_utf32(),
-                        c4m_kw("length",
-                               c4m_ka((int64_t)(tok->end_ptr - tok->start_ptr)),
-                               "codepoints",
-                               c4m_ka(tok->start_ptr))));
+            c4m_list_append(row,
+                            span_to_utf8(tok->start_ptr,
+                                         tok->end_ptr - tok->start_ptr));
         }
         else {
             c4m_list_append(row, c4m_rich_lit(" "));
@@ -59,6 +59,25 @@ c4m_layout_string_const(c4m_compile_ctx *cctx,
     return instance_id;
 }
 
+// Attribute names we see in code get a dense slot number, which the VM
+// uses to find the attribute without hashing the name.
+int32_t
+c4m_layout_attr_slot(c4m_compile_ctx *cctx, c4m_str_t *s)
+{
+    int64_t slot;
+    bool    found;
+
+    s    = c4m_to_utf8(s);
+    slot = (int64_t)hatrack_dict_get(cctx->attr_slots, s, &found);
+
+    if (found == false) {
+        slot = cctx->num_attr_slots++;
+        hatrack_dict_put(cctx->attr_slots, s, (void *)slot);
+    }
+
+    return (int32_t)slot;
+}
+
 uint32_t
 _c4m_layout_const_obj(c4m_compile_ctx *cctx, c4m_obj_t obj, ...)
 {
@@ -85,7 +104,6 @@ _c4m_layout_const_obj(c4m_compile_ctx *cctx, c4m_obj_t obj, ...)
         return 0;
     }
 
-    bool        found;
     uint32_t    result;
     int64_t     id;
     c4m_str_t  *s;
@@ -116,9 +134,7 @@ _c4m_layout_const_obj(c4m_compile_ctx *cctx, c4m_obj_t obj, ...)
         break;
     }
 
-    hatrack_dict_get(cctx->const_memos, obj, &found);
-
-    if (found) {
+    if (c4m_memo_get_id(cctx->const_memos, obj)) {
         id = (int64_t)hatrack_dict_get(cctx->instance_map, obj, NULL);
         return (8 * (int32_t)id);
     }
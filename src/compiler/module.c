@@ -89,6 +89,66 @@ module_key(c4m_utf8_t *package, c4m_utf8_t *module)
     return ((uint64_t *)digest->data)[0];
 }
 
+#ifdef C4M_EMBED_SYS_MODULES
+extern const c4m_embedded_module_t c4m_embedded_sys_modules[];
+extern const int                   c4m_num_embedded_sys_modules;
+
+static c4m_utf8_t *sys_dir = NULL;
+
+// The sys/ modules are linked into the library at build time, so when
+// a lookup lands in the system module directory, we don't need to go
+// to disk at all.
+static c4m_utf8_t *
+embedded_sys_source(c4m_utf8_t *path)
+{
+    if (sys_dir == NULL) {
+        c4m_gc_register_root(&sys_dir, 1);
+        sys_dir = c4m_path_trim_slashes(c4m_system_module_path());
+    }
+
+    int64_t n = c4m_str_byte_len(sys_dir);
+
+    if (c4m_str_byte_len(path) <= n + 1 || path->data[n] != '/'
+        || strncmp(path->data, sys_dir->data, n)) {
+        return NULL;
+    }
+
+    char *name = path->data + n + 1;
+
+    for (int i = 0; i < c4m_num_embedded_sys_modules; i++) {
+        const c4m_embedded_module_t *m = &c4m_embedded_sys_modules[i];
+
+        if (!strcmp(name, m->name)) {
+            return c4m_new(c4m_type_utf8(),
+                           c4m_kw("cstring",
+                                  c4m_ka(m->source),
+                                  "length",
+                                  c4m_ka(m->len)));
+        }
+    }
+
+    return NULL;
+}
+#endif
+
+// Returns the source for a local module file, or NULL if there isn't
+// one. Sys modules come from the copy built into the library, if any.
+c4m_utf8_t *
+c4m_read_module_source(c4m_str_t *path)
+{
+    path = c4m_to_utf8(path);
+
+#ifdef C4M_EMBED_SYS_MODULES
+    c4m_utf8_t *result = embedded_sys_source(path);
+
+    if (result != NULL) {
+        return result;
+    }
+#endif
+
+    return c4m_read_utf8_file(path);
+}
+
 // package is the only string allowed to be null here.
 // fext can also be null, in which case we take in the default values.
 static c4m_module_compile_ctx *
@@ -148,7 +208,14 @@ one_lookup_try(c4m_compile_ctx *ctx,
             contents                     = c4m_http_op_get_output_utf8(r);
         }
         else {
-            contents = c4m_read_utf8_file(attempt);
+            contents = c4m_read_module_source(attempt);
+
+            // The object cache needs to know about these, since a
+            // file showing up at one of them later would change
+            // which module this lookup finds.
+            if (contents == NULL) {
+                c4m_set_add(ctx->probed, attempt);
+            }
         }
         if (contents != NULL) {
             break;
@@ -180,7 +247,11 @@ one_lookup_try(c4m_compile_ctx *ctx,
         ctx->fatality = true;
     }
 
-    hatrack_dict_put(ctx->module_cache, (void *)key, result);
+    // When modules load in parallel, two of them can import the same
+    // module at the same time; the first one into the cache wins.
+    if (!hatrack_dict_add(ctx->module_cache, (void *)key, result)) {
+        return hatrack_dict_get(ctx->module_cache, (void *)key, NULL);
+    }
 
     return result;
 }
@@ -0,0 +1,327 @@
+// On-disk cache of compiled programs.
+//
+// Compiling re-does everything for every module on every run,
+// including the whole sys package, which dominates start-up time for
+// short runs of unchanged code. When CON4M_CACHE_DIR is set, we save
+// the generated VM there after a clean compile, and on the next
+// compile of the same entry point we load it instead, as long as
+// every module that went into it still has the same contents.
+//
+// This works at the level of the whole program, not individual
+// modules; the per-module compile state (parse trees, scopes,
+// symbols) has no marshal support, but the object file does, and it's
+// what we actually need to run.
+//
+// A cache file is a program image (see c4m_vm_write_image()), so a
+// hit maps the code rather than decoding it. The image's aux data
+// holds:
+//
+// - A magic number, and the compiler version the file was written by.
+// - The number of modules, then for each one, the path it was loaded
+//   from, a SHA-256 digest of its contents, and enough of its module
+//   info (package, name, search path, ids) to rebuild the compile
+//   context's module_ordering on a hit.
+// - The number of local files that module lookups tried and did not
+//   find, then their paths. If any of them exists now, it could
+//   shadow a module we loaded from further along the search path, so
+//   that's a miss, even though every source we used is unchanged.
+//
+// We only ever cache programs that compiled with no errors or
+// warnings (so that a cache hit doesn't hide anything), that came
+// entirely from local files, and that don't use module parameters,
+// which the object file can't yet carry.
+
+#define C4M_USE_INTERNAL_API
+#include "con4m.h"
+
+#ifndef C4M_VERSION
+#define C4M_VERSION "unknown"
+#endif
+
+#define C4M_CACHE_MAGIC 0xc4c4ca4ec4c4ca4fULL
+
+static c4m_utf8_t *
+cache_dir(void)
+{
+    c4m_utf8_t *dir = c4m_get_env(c4m_new_utf8("CON4M_CACHE_DIR"));
+
+    if (dir == NULL || !c4m_str_byte_len(dir)) {
+        return NULL;
+    }
+
+    return dir;
+}
+
+static c4m_buf_t *
+source_digest(c4m_str_t *path)
+{
+    c4m_utf8_t *contents = c4m_read_module_source(path);
+
+    if (contents == NULL) {
+        return NULL;
+    }
+
+    c4m_sha_t sha;
+    c4m_sha_init(&sha, NULL);
+    c4m_sha_string_update(&sha, contents);
+
+    return c4m_sha_finish(&sha);
+}
+
+// The file name depends on everything that decides which source files
+// an entry point resolves to, not just the entry point itself.
+static c4m_utf8_t *
+cache_path(c4m_utf8_t *dir, c4m_module_compile_ctx *entry)
+{
+    c4m_utf8_t *search = c4m_get_env(c4m_new_utf8("CON4M_PATH"));
+    c4m_utf8_t *exts   = c4m_get_env(c4m_new_utf8("CON4M_EXTENSIONS"));
+    c4m_sha_t   sha;
+
+    c4m_sha_init(&sha, NULL);
+    c4m_sha_cstring_update(&sha, C4M_VERSION);
+    c4m_sha_string_update(&sha, c4m_con4m_root());
+    c4m_sha_string_update(&sha, entry->loaded_from);
+    if (search != NULL) {
+        c4m_sha_string_update(&sha, search);
+    }
+    if (exts != NULL) {
+        c4m_sha_string_update(&sha, exts);
+    }
+
+    c4m_buf_t *digest = c4m_sha_finish(&sha);
+    uint64_t   key    = ((uint64_t *)digest->data)[0];
+
+    return c4m_cstr_format("{}/{:x}.c4o", dir, c4m_box_u64(key));
+}
+
+static void
+marshal_opt_string(c4m_str_t *str, c4m_stream_t *s)
+{
+    c4m_marshal_cstring(str == NULL ? "" : c4m_to_utf8(str)->data, s);
+}
+
+static c4m_utf8_t *
+unmarshal_opt_string(c4m_stream_t *s)
+{
+    char *str = c4m_unmarshal_cstring(s);
+
+    return *str ? c4m_new_utf8(str) : NULL;
+}
+
+static bool
+cacheable(c4m_compile_ctx *cctx)
+{
+    int n = c4m_list_len(cctx->module_ordering);
+
+    if (cctx->entry_point == NULL || cctx->entry_point->loaded_from == NULL) {
+        return false;
+    }
+
+    for (int i = 0; i < n; i++) {
+        c4m_module_compile_ctx *m = c4m_list_get(cctx->module_ordering,
+                                                 i,
+                                                 NULL);
+
+        if (m->loaded_from == NULL || c4m_path_is_url(m->loaded_from)) {
+            return false;
+        }
+        if (m->errors != NULL && c4m_list_len(m->errors) != 0) {
+            return false;
+        }
+        if (m->module_object == NULL
+            || c4m_list_len(m->module_object->parameters) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+c4m_cache_store(c4m_compile_ctx *cctx, c4m_vm_t *vm)
+{
+    c4m_utf8_t *dir = cache_dir();
+
+    if (dir == NULL || !cacheable(cctx)) {
+        return;
+    }
+
+    int           n   = c4m_list_len(cctx->module_ordering);
+    c4m_buf_t    *aux = c4m_buffer_empty();
+    c4m_buf_t    *buf = c4m_buffer_empty();
+    c4m_stream_t *s   = c4m_buffer_outstream(aux, false);
+
+    c4m_marshal_u64(C4M_CACHE_MAGIC, s);
+    c4m_marshal_cstring(C4M_VERSION, s);
+    c4m_marshal_u32(n, s);
+
+    for (int i = 0; i < n; i++) {
+        c4m_module_compile_ctx *m = c4m_list_get(cctx->module_ordering,
+                                                 i,
+                                                 NULL);
+        c4m_buf_t              *d = source_digest(m->loaded_from);
+
+        if (d == NULL) {
+            c4m_stream_close(s);
+            return;
+        }
+
+        c4m_marshal_cstring(c4m_to_utf8(m->loaded_from)->data, s);
+        c4m_stream_raw_write(s, d->byte_len, d->data);
+        marshal_opt_string(m->package, s);
+        marshal_opt_string(m->module, s);
+        marshal_opt_string(m->path, s);
+        c4m_marshal_u64(m->module_id, s);
+        c4m_marshal_u32(m->local_module_id, s);
+    }
+
+    uint64_t     nprobed;
+    c4m_utf8_t **probed = c4m_set_items(cctx->probed, &nprobed);
+
+    c4m_marshal_u32((uint32_t)nprobed, s);
+
+    for (uint64_t i = 0; i < nprobed; i++) {
+        c4m_marshal_cstring(probed[i]->data, s);
+    }
+
+    c4m_stream_close(s);
+
+    s = c4m_buffer_outstream(buf, false);
+    c4m_vm_write_image(vm, aux, s);
+    c4m_stream_close(s);
+
+    // Write somewhere private and rename into place, so a concurrent
+    // run never sees half a file.
+    c4m_utf8_t *path = cache_path(dir, cctx->entry_point);
+    c4m_utf8_t *tmp  = c4m_cstr_format("{}.{}",
+                                      path,
+                                      c4m_box_u64(getpid()));
+    int         fd;
+
+    mkdir(dir->data, 0700);
+
+    fd = open(tmp->data, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    if (fd == -1) {
+        return;
+    }
+
+    char   *p    = buf->data;
+    int64_t left = buf->byte_len;
+
+    while (left > 0) {
+        ssize_t w = write(fd, p, left);
+
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        p += w;
+        left -= w;
+    }
+
+    close(fd);
+
+    if (left || rename(tmp->data, path->data)) {
+        unlink(tmp->data);
+    }
+}
+
+static bool
+sources_match(c4m_stream_t *s, c4m_list_t *modules)
+{
+    if (c4m_unmarshal_u64(s) != C4M_CACHE_MAGIC) {
+        return false;
+    }
+
+    if (strcmp(c4m_unmarshal_cstring(s), C4M_VERSION)) {
+        return false;
+    }
+
+    uint32_t n = c4m_unmarshal_u32(s);
+
+    for (uint32_t i = 0; i < n; i++) {
+        c4m_utf8_t *path = c4m_new_utf8(c4m_unmarshal_cstring(s));
+        c4m_buf_t  *d    = source_digest(path);
+        char        saved[32];
+
+        c4m_stream_raw_read(s, sizeof(saved), saved);
+
+        if (d == NULL || d->byte_len != sizeof(saved)
+            || memcmp(d->data, saved, sizeof(saved))) {
+            return false;
+        }
+
+        // The sources are only digested here, not parsed, so these
+        // carry no parse state; they're only good for reporting.
+        c4m_module_compile_ctx *m = c4m_new_module_compile_ctx();
+
+        m->loaded_from     = path;
+        m->package         = unmarshal_opt_string(s);
+        m->module          = unmarshal_opt_string(s);
+        m->path            = unmarshal_opt_string(s);
+        m->module_id       = c4m_unmarshal_u64(s);
+        m->local_module_id = c4m_unmarshal_u32(s);
+        m->errors          = c4m_list(c4m_type_ref());
+
+        c4m_list_append(modules, m);
+    }
+
+    n = c4m_unmarshal_u32(s);
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (!access(c4m_unmarshal_cstring(s), F_OK)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+check_cache_file(c4m_buf_t *aux, void *modules)
+{
+    c4m_stream_t *s      = c4m_buffer_instream(aux);
+    bool          result = false;
+
+    // A truncated or otherwise bad file is just a miss.
+    C4M_TRY
+    {
+        result = sources_match(s, modules);
+    }
+    C4M_EXCEPT
+    {
+        result = false;
+    }
+    C4M_TRY_END;
+
+    c4m_stream_close(s);
+
+    return result;
+}
+
+c4m_vm_t *
+c4m_cache_lookup(c4m_compile_ctx *cctx)
+{
+    c4m_utf8_t *dir = cache_dir();
+
+    if (dir == NULL || cctx->entry_point == NULL
+        || cctx->entry_point->loaded_from == NULL
+        || c4m_path_is_url(cctx->entry_point->loaded_from)) {
+        return NULL;
+    }
+
+    c4m_list_t *modules = c4m_list(c4m_type_ref());
+    c4m_vm_t   *result  = c4m_vm_map_image(cache_path(dir, cctx->entry_point),
+                                        check_cache_file,
+                                        modules);
+
+    if (result != NULL) {
+        cctx->module_ordering = modules;
+    }
+
+    return result;
+}
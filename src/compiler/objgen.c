@@ -24,8 +24,8 @@ c4m_new_zobject()
 static void
 c4m_setup_obj(c4m_buf_t *static_data, int32_t nc, c4m_zobject_file_t *obj)
 {
-    obj->zero_magic       = 0x0c001dea0c001dea;
-    obj->zc_object_vers   = 0x02;
+    obj->zero_magic       = C4M_OBJ_MAGIC;
+    obj->zc_object_vers   = C4M_OBJ_VERSION;
     obj->marshaled_consts = static_data;
     obj->num_const_objs   = nc;
     obj->module_contents  = c4m_list(c4m_type_ref());
@@ -47,7 +47,16 @@ c4m_new_vm(c4m_compile_ctx *cctx)
 {
     c4m_vm_t *result = c4m_gc_alloc_mapped(c4m_vm_t, c4m_vm_gc_bits);
     result->obj      = c4m_new_zobject();
-    c4m_setup_obj(cctx->const_data, cctx->const_instantiation_id, result->obj);
+
+    // No compile context when the program comes from an image.
+    if (cctx == NULL) {
+        c4m_setup_obj(NULL, 0, result->obj);
+    }
+    else {
+        c4m_setup_obj(cctx->const_data,
+                      cctx->const_instantiation_id,
+                      result->obj);
+    }
 
     return result;
 }
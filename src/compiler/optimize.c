@@ -0,0 +1,532 @@
+// Peephole pass over generated bytecode.
+//
+// Code generation is a straightforward walk of the tree that emits
+// stack code without looking at what it emitted last, so we get
+// plenty of sequences that cost more dispatches than they need to:
+// an add of a constant takes a push and an add, a comparison feeding
+// an `if` takes a compare and a conditional jump, every call is
+// followed by a MoveSp and a push of the return register, and jumps
+// to the end of a nested block often land on another jump.
+//
+// This runs once per module, after all the calls have been
+// backpatched, and before the module is handed to the VM. Each pass:
+//
+// 1. Threads jump chains.
+// 2. Deletes instructions that do nothing, and fuses common pairs and
+//    triples into the superinstructions in dt_vm.h.
+// 3. Compacts the module, and fixes up everything that holds an
+//    absolute instruction index (jumps, function entry points, and
+//    the end of the module's init code).
+//
+// We repeat until a pass makes no changes, since fusing can expose
+// more to do (e.g., a MoveSp merge enabling a MoveSpPushFromR0).
+//
+// Inside functions, the last rounds of fusing turn stack code that
+// only touches locals into the register ops, which treat frame slots
+// as registers. E.g., `x = y + z` starts out as five instructions:
+//
+//     PushLocalObj y; PushLocalObj z; Add; PushLocalRef x; AssignToLoc
+//
+// The first pass turns that into PushLocalPair; Add; StoreLocal, and
+// the second into a single LocalOp3. Locals already have fixed frame
+// slots from memory_layout.c, so no allocation is needed; anything
+// that involves temporaries, calls or attributes stays on the stack.
+//
+// The only hard rule is that we never fuse across a jump target; the
+// instructions after the first one in a fused sequence must not be
+// reachable other than by falling through. Deleting a single
+// instruction that is a target is fine, since the target moves to
+// whatever comes next. Return addresses aren't an issue, since the
+// VM computes them at run time from the final layout.
+//
+// Build with -Doptimize_bytecode=disabled to skip this, which is
+// useful when debugging the code generator.
+
+#define C4M_USE_INTERNAL_API
+#include "con4m.h"
+
+#ifndef C4M_NO_BYTECODE_OPT
+
+// The longest chain of rewrites we have (stack code to fused pair to
+// register op) settles in two passes, plus one to see nothing changed.
+#define MAX_OPT_PASSES 4
+#define MAX_JUMP_CHAIN 16
+
+typedef struct {
+    c4m_vm_t            *vm;
+    c4m_zmodule_info_t  *module;
+    c4m_zinstruction_t **code;
+    bool                *is_target;
+    int32_t             *new_ix;
+    int                  len;
+    bool                 changed;
+} opt_ctx;
+
+static inline bool
+is_jump(c4m_zop_t op)
+{
+    switch (op) {
+    case C4M_ZJ:
+    case C4M_ZJz:
+    case C4M_ZJnz:
+    case C4M_ZCmpJz:
+    case C4M_ZCmpJnz:
+    case C4M_ZLocalCmpJz:
+    case C4M_ZLocalCmpJnz:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Pushes that don't touch anything but the stack slot they push, so
+// a push followed by a pop can go away entirely.
+static inline bool
+is_pure_push(c4m_zop_t op)
+{
+    switch (op) {
+    case C4M_ZPushConstObj:
+    case C4M_ZPushConstRef:
+    case C4M_ZPushLocalObj:
+    case C4M_ZPushLocalRef:
+    case C4M_ZPushStaticObj:
+    case C4M_ZPushStaticRef:
+    case C4M_ZPushImm:
+    case C4M_ZPushFromR0:
+    case C4M_ZPushFromR1:
+    case C4M_ZPushFromR2:
+    case C4M_ZPushFromR3:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The unsigned compares are left alone; their VM handlers compare
+// as signed values, and the fused handler shouldn't second-guess
+// that.
+static inline bool
+is_fusable_compare(c4m_zop_t op)
+{
+    switch (op) {
+    case C4M_ZCmp:
+    case C4M_ZNeq:
+    case C4M_ZLt:
+    case C4M_ZLte:
+    case C4M_ZGt:
+    case C4M_ZGte:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Binary ops that C4M_ZLocalOp3 can stand in for. These all leave
+// their result in place of the left operand, and can't fail.
+static inline bool
+is_local3_op(c4m_zop_t op)
+{
+    switch (op) {
+    case C4M_ZAdd:
+    case C4M_ZSub:
+    case C4M_ZMul:
+    case C4M_ZUAdd:
+    case C4M_ZUSub:
+    case C4M_ZUMul:
+    case C4M_ZBOr:
+    case C4M_ZBAnd:
+    case C4M_ZBXOr:
+    case C4M_ZFAdd:
+    case C4M_ZFSub:
+    case C4M_ZFMul:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline bool
+local_slots_fit(int64_t a, int64_t b)
+{
+    return a >= C4M_LOCAL_SLOT_MIN && a <= C4M_LOCAL_SLOT_MAX
+        && b >= C4M_LOCAL_SLOT_MIN && b <= C4M_LOCAL_SLOT_MAX;
+}
+
+// Returns the stack adjustment (in MoveSp terms) for Pop and MoveSp,
+// or false if the instruction is something else.
+static inline bool
+sp_adjustment(c4m_zinstruction_t *ins, int64_t *adj)
+{
+    switch (ins->op) {
+    case C4M_ZPop:
+        *adj = -1;
+        return true;
+    case C4M_ZMoveSp:
+        *adj = ins->arg;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void
+load_module(opt_ctx *ctx)
+{
+    c4m_list_t *l = ctx->module->instructions;
+
+    ctx->len       = c4m_list_len(l);
+    ctx->code      = c4m_gc_array_alloc(c4m_zinstruction_t *, ctx->len + 1);
+    ctx->is_target = c4m_gc_array_value_alloc(bool, ctx->len + 1);
+    ctx->new_ix    = c4m_gc_array_value_alloc(int32_t, ctx->len + 1);
+
+    for (int i = 0; i < ctx->len; i++) {
+        ctx->code[i] = c4m_list_get(l, i, NULL);
+    }
+}
+
+static void
+mark_targets(opt_ctx *ctx)
+{
+    int n = c4m_list_len(ctx->vm->obj->func_info);
+
+    ctx->is_target[0] = true;
+    ctx->is_target[ctx->module->init_size / sizeof(c4m_zinstruction_t)] = true;
+
+    for (int i = 0; i < ctx->len; i++) {
+        c4m_zinstruction_t *ins = ctx->code[i];
+
+        if (is_jump(ins->op) && ins->arg >= 0 && ins->arg <= ctx->len) {
+            ctx->is_target[ins->arg] = true;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        c4m_zfn_info_t *fn = c4m_list_get(ctx->vm->obj->func_info, i, NULL);
+
+        if (fn->mid == ctx->module->module_id) {
+            ctx->is_target[fn->offset] = true;
+        }
+    }
+}
+
+// Can the instruction at ix be folded into the one before it?
+static inline c4m_zinstruction_t *
+follower(opt_ctx *ctx, int ix)
+{
+    if (ix >= ctx->len || ctx->is_target[ix]) {
+        return NULL;
+    }
+
+    return ctx->code[ix];
+}
+
+static inline void
+delete(opt_ctx *ctx, int ix)
+{
+    ctx->code[ix] = NULL;
+    ctx->changed  = true;
+}
+
+// When Jz jumps, the zero it tested stays on the stack, so if the
+// target is another Jz, it will jump too. Same for Jnz. Anything can
+// go straight through an unconditional jump, and unconditional jumps
+// to returns just become the return.
+static void
+thread_jumps(opt_ctx *ctx)
+{
+    for (int i = 0; i < ctx->len; i++) {
+        c4m_zinstruction_t *ins = ctx->code[i];
+        c4m_zop_t           follow;
+
+        switch (ins->op) {
+        case C4M_ZJ:
+            follow = C4M_ZJ;
+            break;
+        case C4M_ZJz:
+        case C4M_ZCmpJz:
+        case C4M_ZLocalCmpJz:
+            follow = C4M_ZJz;
+            break;
+        case C4M_ZJnz:
+        case C4M_ZCmpJnz:
+        case C4M_ZLocalCmpJnz:
+            follow = C4M_ZJnz;
+            break;
+        default:
+            continue;
+        }
+
+        int64_t target = ins->arg;
+
+        for (int n = 0; n < MAX_JUMP_CHAIN; n++) {
+            if (target < 0 || target >= ctx->len
+                || (ctx->code[target]->op != follow
+                    && ctx->code[target]->op != C4M_ZJ)
+                || ctx->code[target]->arg == target) {
+                break;
+            }
+            target = ctx->code[target]->arg;
+        }
+
+        if (target != ins->arg) {
+            ins->arg     = target;
+            ctx->changed = true;
+        }
+
+        if (ins->op == C4M_ZJ && target >= 0 && target < ctx->len) {
+            c4m_zinstruction_t *dst = ctx->code[target];
+
+            if (dst->op == C4M_ZRet || dst->op == C4M_ZModuleRet) {
+                ins->op        = dst->op;
+                ins->arg       = dst->arg;
+                ins->immediate = dst->immediate;
+                ins->type_info = dst->type_info;
+                ctx->changed   = true;
+            }
+        }
+    }
+}
+
+// Returns the number of instructions consumed at ix.
+static int
+rewrite_one(opt_ctx *ctx, int ix)
+{
+    c4m_zinstruction_t *ins = ctx->code[ix];
+    c4m_zinstruction_t *n1  = follower(ctx, ix + 1);
+    c4m_zinstruction_t *n2  = n1 ? follower(ctx, ix + 2) : NULL;
+    int64_t             a1;
+    int64_t             a2;
+
+    switch (ins->op) {
+    case C4M_ZNop:
+        // Nops with an arg are labels for the disassembler.
+        if (!ins->arg) {
+            delete(ctx, ix);
+        }
+        return 1;
+    case C4M_ZJ:
+        if (ins->arg == ix + 1) {
+            delete(ctx, ix);
+        }
+        return 1;
+    case C4M_ZDupTop:
+        if (n1 && n1->op == C4M_ZPop) {
+            delete(ctx, ix);
+            delete(ctx, ix + 1);
+            return 2;
+        }
+        return 1;
+    default:
+        break;
+    }
+
+    if (sp_adjustment(ins, &a1)) {
+        if (a1 == 0) {
+            delete(ctx, ix);
+            return 1;
+        }
+        if (n1 && sp_adjustment(n1, &a2)) {
+            ins->op  = C4M_ZMoveSp;
+            ins->arg = a1 + a2;
+            delete(ctx, ix + 1);
+            return 2;
+        }
+        if (n1 && n1->op == C4M_ZPushFromR0) {
+            ins->op  = C4M_ZMoveSpPushFromR0;
+            ins->arg = a1;
+            delete(ctx, ix + 1);
+            return 2;
+        }
+        return 1;
+    }
+
+    if (is_pure_push(ins->op) && n1 && n1->op == C4M_ZPop) {
+        delete(ctx, ix);
+        delete(ctx, ix + 1);
+        return 2;
+    }
+
+    if (ins->op == C4M_ZPushLocalObj && n1 && n1->op == C4M_ZPushImm && n2) {
+        switch (n2->op) {
+        case C4M_ZAdd:
+        case C4M_ZUAdd:
+            ins->op        = C4M_ZPushLocalAddImm;
+            ins->immediate = n1->immediate;
+            ins->type_info = n2->type_info;
+            delete(ctx, ix + 1);
+            delete(ctx, ix + 2);
+            return 3;
+        case C4M_ZSub:
+        case C4M_ZUSub:
+            ins->op        = C4M_ZPushLocalAddImm;
+            ins->immediate = -n1->immediate;
+            ins->type_info = n2->type_info;
+            delete(ctx, ix + 1);
+            delete(ctx, ix + 2);
+            return 3;
+        default:
+            break;
+        }
+    }
+
+    if (ins->op == C4M_ZPushImm && n1) {
+        switch (n1->op) {
+        case C4M_ZAdd:
+        case C4M_ZUAdd:
+            ins->op        = C4M_ZAddImm;
+            ins->type_info = n1->type_info;
+            delete(ctx, ix + 1);
+            return 2;
+        case C4M_ZSub:
+        case C4M_ZUSub:
+            ins->op        = C4M_ZAddImm;
+            ins->immediate = -ins->immediate;
+            ins->type_info = n1->type_info;
+            delete(ctx, ix + 1);
+            return 2;
+        default:
+            return 1;
+        }
+    }
+
+    if (ins->op == C4M_ZPushLocalRef && n1 && n1->op == C4M_ZAssignToLoc) {
+        ins->op = C4M_ZStoreLocal;
+        delete(ctx, ix + 1);
+        return 2;
+    }
+
+    if (ins->op == C4M_ZPushLocalObj && n1 && n1->op == C4M_ZStoreLocal) {
+        ins->op        = C4M_ZMoveLocal;
+        ins->immediate = ins->arg;
+        ins->arg       = n1->arg;
+        delete(ctx, ix + 1);
+        return 2;
+    }
+
+    if (ins->op == C4M_ZPushLocalAddImm && n1 && n1->op == C4M_ZStoreLocal
+        && ins->immediate >= INT32_MIN && ins->immediate <= INT32_MAX) {
+        ins->op        = C4M_ZLocalAddImm;
+        ins->immediate = c4m_local_add_imm(ins->arg, ins->immediate);
+        ins->arg       = n1->arg;
+        delete(ctx, ix + 1);
+        return 2;
+    }
+
+    if (ins->op == C4M_ZPushLocalPair && n1
+        && local_slots_fit(ins->arg, ins->immediate)) {
+        if (is_local3_op(n1->op) && n2 && n2->op == C4M_ZStoreLocal) {
+            ins->immediate = c4m_local3_imm(n1->op, ins->arg, ins->immediate);
+            ins->op        = C4M_ZLocalOp3;
+            ins->arg       = n2->arg;
+            ins->type_info = n1->type_info;
+            delete(ctx, ix + 1);
+            delete(ctx, ix + 2);
+            return 3;
+        }
+        if (n1->op == C4M_ZCmpJz || n1->op == C4M_ZCmpJnz) {
+            ins->immediate = c4m_local3_imm(n1->immediate,
+                                            ins->arg,
+                                            ins->immediate);
+            ins->op        = n1->op == C4M_ZCmpJz ? C4M_ZLocalCmpJz
+                                                  : C4M_ZLocalCmpJnz;
+            ins->arg       = n1->arg;
+            delete(ctx, ix + 1);
+            return 2;
+        }
+    }
+
+    if (ins->op == C4M_ZPushLocalObj && n1 && n1->op == C4M_ZPushLocalObj) {
+        ins->op        = C4M_ZPushLocalPair;
+        ins->immediate = n1->arg;
+        delete(ctx, ix + 1);
+        return 2;
+    }
+
+    if (is_fusable_compare(ins->op) && n1
+        && (n1->op == C4M_ZJz || n1->op == C4M_ZJnz)) {
+        ins->immediate = ins->op;
+        ins->op        = n1->op == C4M_ZJz ? C4M_ZCmpJz : C4M_ZCmpJnz;
+        ins->arg       = n1->arg;
+        delete(ctx, ix + 1);
+        return 2;
+    }
+
+    return 1;
+}
+
+static void
+compact(opt_ctx *ctx)
+{
+    int         kept = 0;
+    c4m_list_t *l    = c4m_list(c4m_type_ref());
+
+    for (int i = 0; i < ctx->len; i++) {
+        ctx->new_ix[i] = kept;
+        if (ctx->code[i] != NULL) {
+            c4m_list_append(l, ctx->code[i]);
+            kept++;
+        }
+    }
+
+    ctx->new_ix[ctx->len] = kept;
+
+    for (int i = 0; i < kept; i++) {
+        c4m_zinstruction_t *ins = c4m_list_get(l, i, NULL);
+
+        if (is_jump(ins->op) && ins->arg >= 0 && ins->arg <= ctx->len) {
+            ins->arg = ctx->new_ix[ins->arg];
+        }
+    }
+
+    int n = c4m_list_len(ctx->vm->obj->func_info);
+
+    for (int i = 0; i < n; i++) {
+        c4m_zfn_info_t *fn = c4m_list_get(ctx->vm->obj->func_info, i, NULL);
+
+        if (fn->mid == ctx->module->module_id) {
+            fn->offset = ctx->new_ix[fn->offset];
+        }
+    }
+
+    int init_end = ctx->module->init_size / sizeof(c4m_zinstruction_t);
+
+    ctx->module->init_size    = ctx->new_ix[init_end]
+                           * sizeof(c4m_zinstruction_t);
+    ctx->module->instructions = l;
+}
+
+void
+c4m_optimize_module(c4m_vm_t *vm, c4m_zmodule_info_t *module)
+{
+    opt_ctx ctx = {
+        .vm     = vm,
+        .module = module,
+    };
+
+    for (int pass = 0; pass < MAX_OPT_PASSES; pass++) {
+        ctx.changed = false;
+
+        load_module(&ctx);
+        thread_jumps(&ctx);
+        mark_targets(&ctx);
+
+        for (int i = 0; i < ctx.len;) {
+            i += rewrite_one(&ctx, i);
+        }
+
+        if (!ctx.changed) {
+            return;
+        }
+
+        compact(&ctx);
+    }
+}
+
+#else
+
+void
+c4m_optimize_module(c4m_vm_t *vm, c4m_zmodule_info_t *module)
+{
+}
+
+#endif
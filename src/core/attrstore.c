@@ -6,14 +6,106 @@ populate_defaults(c4m_vm_t *vm, c4m_str_t *key)
     // TODO populate_defaults
 }
 
+// Statically known attributes get a slot in vm->attr_slots, which
+// holds their current entry, so that the VM doesn't have to hash
+// the name on every access. Reading the cache doesn't lock; anything
+// that changes it (publishing an entry, or swapping in a bigger
+// array) holds attr_lock, so the cache and the dictionary can't get
+// out of step. Writes that don't know their slot (the C API, locking)
+// drop the whole cache instead.
+static pthread_mutex_t attr_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Call with attr_lock held.
+static void
+cache_slot(c4m_vm_t *vm, int32_t slot, c4m_attr_contents_t *info)
+{
+    c4m_attr_slots_t *cache = atomic_load(&vm->attr_slots);
+
+    if (cache == NULL || slot >= cache->len) {
+        int32_t           old_len = cache == NULL ? 0 : cache->len;
+        int32_t           n       = c4m_max(slot + 1, old_len * 2);
+        c4m_attr_slots_t *grown   = c4m_gc_raw_alloc(
+            sizeof(c4m_attr_slots_t) + n * sizeof(c4m_attr_contents_t *),
+            C4M_GC_SCAN_ALL);
+
+        grown->len = n;
+
+        for (int32_t i = 0; i < old_len; i++) {
+            atomic_store(&grown->entries[i], atomic_load(&cache->entries[i]));
+        }
+
+        atomic_store(&vm->attr_slots, grown);
+        cache = grown;
+    }
+
+    atomic_store(&cache->entries[slot], info);
+}
+
+static inline c4m_attr_contents_t *
+attr_lookup(c4m_vm_t *vm, c4m_str_t *key, int32_t slot)
+{
+    c4m_attr_slots_t    *cache = atomic_load(&vm->attr_slots);
+    c4m_attr_contents_t *info;
+
+    if (slot < 0) {
+        return hatrack_dict_get(vm->attrs, key, NULL);
+    }
+
+    if (cache != NULL && slot < cache->len) {
+        info = atomic_load(&cache->entries[slot]);
+        if (info != NULL) {
+            return info;
+        }
+    }
+
+    // Look it up under the lock, so that a write can't get in between
+    // the lookup and filling in the cache.
+    pthread_mutex_lock(&attr_lock);
+    info = hatrack_dict_get(vm->attrs, key, NULL);
+
+    if (info != NULL) {
+        cache_slot(vm, slot, info);
+    }
+    pthread_mutex_unlock(&attr_lock);
+
+    return info;
+}
+
+static void
+attr_publish(c4m_vm_t            *vm,
+             c4m_str_t           *key,
+             int32_t              slot,
+             c4m_attr_contents_t *info)
+{
+    pthread_mutex_lock(&attr_lock);
+    hatrack_dict_put(vm->attrs, key, info);
+
+    if (slot >= 0) {
+        cache_slot(vm, slot, info);
+    }
+    else if (atomic_load(&vm->attr_slots) != NULL) {
+        atomic_store(&vm->attr_slots, NULL);
+    }
+    pthread_mutex_unlock(&attr_lock);
+}
+
 c4m_value_t *
 c4m_vm_attr_get(c4m_vmthread_t *tstate,
                 c4m_str_t      *key,
                 bool           *found)
+{
+    return c4m_vm_attr_slot_get(tstate, key, -1, found);
+}
+
+c4m_value_t *
+c4m_vm_attr_slot_get(c4m_vmthread_t *tstate,
+                     c4m_str_t      *key,
+                     int32_t         slot,
+                     bool           *found)
 {
     populate_defaults(tstate->vm, key);
 
-    c4m_attr_contents_t *info = hatrack_dict_get(tstate->vm->attrs, key, NULL);
+    c4m_attr_contents_t *info = attr_lookup(tstate->vm, key, slot);
     if (found != NULL) {
         if (info != NULL && info->is_set) {
             *found = true;
@@ -41,6 +133,18 @@ c4m_vm_attr_set(c4m_vmthread_t *tstate,
                 bool            lock,
                 bool            override,
                 bool            internal)
+{
+    c4m_vm_attr_slot_set(tstate, key, -1, value, lock, override, internal);
+}
+
+void
+c4m_vm_attr_slot_set(c4m_vmthread_t *tstate,
+                     c4m_str_t      *key,
+                     int32_t         slot,
+                     c4m_value_t    *value,
+                     bool            lock,
+                     bool            override,
+                     bool            internal)
 {
     c4m_vm_t *vm    = tstate->vm;
     vm->using_attrs = true;
@@ -52,8 +156,9 @@ c4m_vm_attr_set(c4m_vmthread_t *tstate,
     // We will create a new entry on every write, just to avoid any race
     // conditions with multiple threads updating via reference.
 
-    bool                 found;
-    c4m_attr_contents_t *old_info = hatrack_dict_get(vm->attrs, key, &found);
+    c4m_attr_contents_t *old_info = attr_lookup(vm, key, slot);
+    bool                 found    = old_info != NULL;
+
     if (found) {
         // Nim code does this after allocating new_info and never settings it's
         // override field here, so that's clearly wrong. We do it first to avoid
@@ -117,7 +222,7 @@ c4m_vm_attr_set(c4m_vmthread_t *tstate,
         new_info->locked = true;
     }
 
-    hatrack_dict_put(vm->attrs, key, new_info);
+    attr_publish(vm, key, slot, new_info);
 }
 
 void
@@ -128,8 +233,9 @@ c4m_vm_attr_lock(c4m_vmthread_t *tstate, c4m_str_t *key, bool on_write)
     // We will create a new entry on every write, just to avoid any race
     // conditions with multiple threads updating via reference.
 
-    bool                 found;
-    c4m_attr_contents_t *old_info = hatrack_dict_get(vm->attrs, key, &found);
+    c4m_attr_contents_t *old_info = attr_lookup(vm, key, -1);
+    bool                 found    = old_info != NULL;
+
     if (found && old_info->locked) {
         // Nim version uses Con4mError stuff that doesn't exist in
         // libcon4m (yet?)
@@ -149,5 +255,5 @@ c4m_vm_attr_lock(c4m_vmthread_t *tstate, c4m_str_t *key, bool on_write)
         new_info->is_set   = old_info->is_set;
     }
 
-    hatrack_dict_put(vm->attrs, key, new_info);
+    attr_publish(vm, key, -1, new_info);
 }
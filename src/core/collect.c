@@ -19,7 +19,27 @@ typedef struct {
     c4m_arena_t *to_space;
     void        *fromspc_start;
     void        *fromspc_end;
+#ifdef C4M_GC_GENERATIONAL
+    // Only set for a major collection, where the old space gets
+    // evacuated along with the nursery.
+    void        *oldspc_start;
+    void        *oldspc_end;
+#endif
+    // Worker heaps adopted since the last collection, which get
+    // evacuated along with the from-space and then freed.
+    c4m_arena_t *adopted;
     worklist_t  *worklist;
+#ifdef C4M_GC_LARGE_OBJECTS
+    // Set when large objects get marked and swept, along with the
+    // range of addresses they span.
+    c4m_large_objs_t *large;
+    void             *large_lo;
+    void             *large_hi;
+#endif
+#ifdef C4M_GC_PARALLEL
+    // Set while the roots get scanned for a parallel collection.
+    struct gc_worker_t *worker;
+#endif
     int          reached_allocs;
     int          copied_allocs;
 } c4m_collection_ctx;
@@ -28,11 +48,21 @@ typedef struct {
 #define GC_OP_COPY 1
 
 static void process_worklist(c4m_collection_ctx *);
+#ifdef C4M_GC_LARGE_OBJECTS
+static void scan_in_place(c4m_collection_ctx *, c4m_alloc_hdr *);
+static bool large_is_marked(c4m_large_objs_t *, c4m_alloc_hdr *);
+#endif
+
+#ifdef C4M_GC_PARALLEL
+typedef struct gc_worker_t gc_worker_t;
+
+static void par_forward(gc_worker_t *, void **);
+#endif
 
 static worklist_t *
-c4m_alloc_collection_worklist(c4m_arena_t *fromspace)
+c4m_alloc_collection_worklist(uint32_t largest_alloc)
 {
-    int n = (1 << (64 - __builtin_clzll(fromspace->largest_alloc)));
+    int n = (1 << (64 - __builtin_clzll(largest_alloc)));
 
     int alloc_len = n * sizeof(worklist_item) + sizeof(worklist_t);
     alloc_len     = c4m_round_up_to_given_power_of_2(getpagesize(),
@@ -92,6 +122,9 @@ extern thread_local c4m_arena_t *c4m_current_heap;
 extern uint64_t                  c4m_page_bytes;
 extern uint64_t                  c4m_page_modulus;
 extern uint64_t                  c4m_modulus_mask;
+#ifdef C4M_GC_LARGE_OBJECTS
+extern int64_t c4m_large_obj_index(c4m_large_objs_t *, void *);
+#endif
 
 static c4m_system_finalizer_fn system_finalizer = NULL;
 
@@ -199,6 +232,38 @@ run_post_collect_hooks()
     }
 }
 
+// Grows the space we're copying into until it reaches `want`. If it
+// can't, we're stuck; we can't stop part-way through moving things.
+static void
+tospace_grow(c4m_arena_t *to, char *want)
+{
+    // Grow by at least an eighth, so we're not back here for every
+    // allocation.
+    uint64_t grow = c4m_max((uint64_t)(want - (char *)to->heap_end),
+                            ((uint64_t)((char *)to->heap_end - (char *)to))
+                                >> 3);
+
+    if (!c4m_grow_arena(to, grow)
+        && !c4m_grow_arena(to, want - (char *)to->heap_end)) {
+        fprintf(stderr,
+                "GC: to-space @%p is out of room (%llu bytes short)\n",
+                to,
+                (unsigned long long)(want - (char *)to->heap_end));
+        abort();
+    }
+}
+
+// Makes sure the space we're copying into can take `bytes` more.
+static inline void
+tospace_reserve(c4m_arena_t *to, uint64_t bytes)
+{
+    char *want = (char *)to->next_alloc + bytes;
+
+    if (want > (char *)to->heap_end) {
+        tospace_grow(to, want);
+    }
+}
+
 static c4m_alloc_hdr *
 prep_allocation(c4m_alloc_hdr *old, c4m_arena_t *new_arena)
 {
@@ -214,20 +279,28 @@ prep_allocation(c4m_alloc_hdr *old, c4m_arena_t *new_arena)
 #define TRACE_DEBUG_ARGS
 #endif
 
+    // The copy is the same size as the original. Without this, a full
+    // to-space would try to collect itself.
+    tospace_reserve(arena, (char *)c4m_alloc_next_addr(old) - (char *)old);
+
     res              = c4m_alloc_from_arena(&arena,
                                old->request_len,
-                               old->scan_fn,
+                               c4m_alloc_scan_fn(old),
                                (bool)old->finalize
                                    TRACE_DEBUG_ARGS);
     res              = &res[-1];
     res->con4m_obj   = old->con4m_obj;
+#ifndef C4M_GC_COMPACT_HDR
     res->cached_hash = old->cached_hash;
+#endif
 
     return res;
 }
 
 static void
-migrate_finalizers(c4m_arena_t *old, c4m_arena_t *new)
+migrate_finalizers(c4m_collection_ctx *ctx,
+                   c4m_arena_t        *old,
+                   c4m_arena_t        *new)
 {
     c4m_finalizer_info_t *cur = old->to_finalize;
     c4m_finalizer_info_t *next;
@@ -236,6 +309,24 @@ migrate_finalizers(c4m_arena_t *old, c4m_arena_t *new)
         c4m_alloc_hdr *alloc = cur->allocation;
         next                 = cur->next;
 
+#ifdef C4M_GC_LARGE_OBJECTS
+        // Large objects don't move, so their records just carry over,
+        // unless they're about to be swept.
+        if (alloc->large) {
+            if (ctx->large == NULL || large_is_marked(ctx->large, alloc)) {
+                cur->next        = new->to_finalize;
+                new->to_finalize = cur;
+            }
+            else {
+                system_finalizer(alloc->data);
+                c4m_rc_free(cur);
+            }
+
+            cur = next;
+            continue;
+        }
+#endif
+
         // If it's been forwarded, we migrate the record to the new heap.
         // In the other branch, we'll call the finalizer and delete the
         // record (we do not cache records right now).
@@ -255,20 +346,82 @@ migrate_finalizers(c4m_arena_t *old, c4m_arena_t *new)
     }
 }
 
+// There's one adopted heap per compile worker (plus any it chained
+// on), so a list walk is fine here.
+static bool
+value_in_adopted(c4m_collection_ctx *ctx, void *ptr)
+{
+    for (c4m_arena_t *a = ctx->adopted; a != NULL; a = a->prev_heap) {
+        if (ptr > (void *)a->data && ptr < (void *)a->next_alloc) {
+            c4m_gc_trace(C4M_GCT_PTR_TEST, "In adopted (%p) == true", ptr);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static inline bool
 value_in_fromspace(c4m_collection_ctx *ctx, void *ptr)
 {
     if (ptr >= ctx->fromspc_end || ptr <= ctx->fromspc_start) {
+#ifdef C4M_GC_GENERATIONAL
+        if (ptr < ctx->oldspc_end && ptr > ctx->oldspc_start) {
+            c4m_gc_trace(C4M_GCT_PTR_TEST, "In old space (%p) == true", ptr);
+            return true;
+        }
+#endif
+        if (ctx->adopted != NULL) {
+            return value_in_adopted(ctx, ptr);
+        }
         return false;
     }
     c4m_gc_trace(C4M_GCT_PTR_TEST, "In fromspace (%p) == true", ptr);
     return true;
 }
 
+// Returns the words in use across the adopted heaps, and raises
+// *largest to the biggest allocation in any of them.
+static uint64_t
+adopted_words(c4m_arena_t *a, uint32_t *largest)
+{
+    uint64_t result = 0;
+
+    for (; a != NULL; a = a->prev_heap) {
+        result += (uint64_t *)a->next_alloc - a->data;
+
+        if (a->largest_alloc > *largest) {
+            *largest = a->largest_alloc;
+        }
+    }
+
+    return result;
+}
+
+// Once everything live has been copied out, the adopted heaps go away.
+static void
+release_adopted(c4m_collection_ctx *ctx, c4m_arena_t *dst)
+{
+    c4m_arena_t *a = ctx->adopted;
+
+    ctx->adopted = NULL;
+
+    while (a != NULL) {
+        c4m_arena_t *next = a->prev_heap;
+
+        if (system_finalizer != NULL) {
+            migrate_finalizers(ctx, a, dst);
+        }
+
+        c4m_delete_arena(a);
+        a = next;
+    }
+}
+
 static inline bool
 value_in_allocation(c4m_alloc_hdr *hdr, void *ptr)
 {
-    if (ptr > (void *)hdr && ptr < (void *)hdr->next_addr) {
+    if (ptr > (void *)hdr && ptr < (void *)c4m_alloc_next_addr(hdr)) {
         c4m_gc_trace(C4M_GCT_PTR_TEST,
                      "In alloc (ptr @%p alloc @%p) == true",
                      ptr,
@@ -283,6 +436,124 @@ value_in_allocation(c4m_alloc_hdr *hdr, void *ptr)
     return false;
 }
 
+#ifdef C4M_GC_LARGE_OBJECTS
+// Large objects never move. The collector marks the ones it reaches,
+// fixes up any pointers they hold into the from-space, and unmaps the
+// rest once it's done. Marks are only taken on a full collection; a
+// generational minor collection treats every large object as a root.
+static void
+large_begin(c4m_collection_ctx *ctx, c4m_large_objs_t *lo)
+{
+    ctx->large    = lo;
+    ctx->large_lo = NULL;
+    ctx->large_hi = NULL;
+
+    if (lo != NULL) {
+        lo->pending = malloc((lo->count + 1) * sizeof(c4m_alloc_hdr *));
+        atomic_store(&lo->num_pending, 0);
+
+        if (lo->count != 0) {
+            ctx->large_lo = lo->objs[0];
+            ctx->large_hi = c4m_alloc_next_addr(lo->objs[lo->count - 1]);
+        }
+    }
+}
+
+static inline void
+large_mark(c4m_collection_ctx *ctx, void *ptr)
+{
+    // Cheap rejection for the common case of something that isn't a
+    // large object; with none, the range is empty.
+    if (ptr <= ctx->large_lo || ptr >= ctx->large_hi) {
+        return;
+    }
+
+    c4m_large_objs_t *lo = ctx->large;
+    int64_t           ix = c4m_large_obj_index(lo, ptr);
+
+    if (ix == -1 || __atomic_exchange_n(&lo->marks[ix], 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    pthread_mutex_lock(&lo->lock);
+    lo->pending[atomic_load(&lo->num_pending)] = lo->objs[ix];
+    atomic_fetch_add(&lo->num_pending, 1);
+    pthread_mutex_unlock(&lo->lock);
+}
+
+static inline c4m_alloc_hdr *
+large_pop(c4m_collection_ctx *ctx)
+{
+    c4m_large_objs_t *lo     = ctx->large;
+    c4m_alloc_hdr    *result = NULL;
+
+    if (lo == NULL || atomic_load(&lo->num_pending) == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lo->lock);
+    if (atomic_load(&lo->num_pending) != 0) {
+        result = lo->pending[atomic_fetch_sub(&lo->num_pending, 1) - 1];
+    }
+    pthread_mutex_unlock(&lo->lock);
+
+    return result;
+}
+
+// During a parallel collection, the workers handle these instead.
+static inline c4m_alloc_hdr *
+large_pop_serial(c4m_collection_ctx *ctx)
+{
+#ifdef C4M_GC_PARALLEL
+    if (ctx->worker != NULL) {
+        return NULL;
+    }
+#endif
+    return large_pop(ctx);
+}
+
+static bool
+large_is_marked(c4m_large_objs_t *lo, c4m_alloc_hdr *hdr)
+{
+    int64_t ix = c4m_large_obj_index(lo, hdr->data);
+
+    return ix != -1 && lo->marks[ix];
+}
+
+static void
+large_sweep(c4m_collection_ctx *ctx)
+{
+    c4m_large_objs_t *lo = ctx->large;
+    uint32_t          n  = 0;
+
+    if (lo == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < lo->count; i++) {
+        c4m_alloc_hdr *hdr = lo->objs[i];
+
+        if (lo->marks[i]) {
+            lo->objs[n]    = hdr;
+            lo->marks[n++] = 0;
+            continue;
+        }
+
+        c4m_gc_trace(C4M_GCT_MUNMAP, "large: del @%p", hdr);
+        munmap(hdr,
+               c4m_round_up_to_given_power_of_2(c4m_page_bytes,
+                                                sizeof(c4m_alloc_hdr)
+                                                    + hdr->alloc_len));
+    }
+
+    lo->count = n;
+    free(lo->pending);
+    lo->pending = NULL;
+}
+#else
+#define large_mark(ctx, ptr)
+#endif
+
 // We perhaps should instead keep a binary range tree or k-d tree to
 // not have to keep scanning memory.
 //
@@ -327,9 +598,11 @@ get_header(c4m_collection_ctx *ctx, void *ptr)
         c4m_gc_trace(C4M_GCT_ALLOC_FOUND,
                      "found alloc @%p, end @%p, obj len = %d, total len = %d",
                      result,
-                     result->next_addr,
-                     (int)(((char *)result->next_addr) - (char *)result->data),
-                     (int)(((char *)result->next_addr) - (char *)result));
+                     c4m_alloc_next_addr(result),
+                     (int)(((char *)c4m_alloc_next_addr(result))
+                           - (char *)result->data),
+                     (int)(((char *)c4m_alloc_next_addr(result))
+                           - (char *)result));
     }
 #endif
 
@@ -380,8 +653,8 @@ static inline void
 scan_allocation(c4m_collection_ctx *ctx, c4m_alloc_hdr *hdr)
 {
     void          **p       = (void **)hdr->data;
-    void          **end     = (void **)hdr->next_addr;
-    c4m_mem_scan_fn scanner = hdr->scan_fn;
+    void          **end     = (void **)c4m_alloc_next_addr(hdr);
+    c4m_mem_scan_fn scanner = c4m_alloc_scan_fn(hdr);
     void           *contents;
 
 #ifdef C4M_USE_GC_HOOKS
@@ -413,6 +686,9 @@ scan_allocation(c4m_collection_ctx *ctx, c4m_alloc_hdr *hdr)
                     add_forward_to_worklist(ctx, p);
                 }
             }
+            else {
+                large_mark(ctx, contents);
+            }
 
             p++;
         }
@@ -454,6 +730,9 @@ scan_allocation(c4m_collection_ctx *ctx, c4m_alloc_hdr *hdr)
                     add_forward_to_worklist(ctx, loc);
                 }
             }
+            else {
+                large_mark(ctx, contents);
+            }
         }
         p += 64;
     }
@@ -519,6 +798,17 @@ process_worklist(c4m_collection_ctx *ctx)
 
     void **p = c4m_wl_read(ctx, &op);
 
+#ifdef C4M_GC_LARGE_OBJECTS
+    c4m_alloc_hdr *large;
+
+    // Large objects marked along the way get scanned once the worklist
+    // drains, which can add more work.
+    while (p == NULL && (large = large_pop_serial(ctx)) != NULL) {
+        scan_in_place(ctx, large);
+        p = c4m_wl_read(ctx, &op);
+    }
+#endif
+
     while (p != (void **)NULL) {
         if (op == GC_OP_FW) {
             forward_one_allocation(ctx, p);
@@ -546,9 +836,91 @@ process_worklist(c4m_collection_ctx *ctx)
                          dst->alloc_line);
         }
         p = c4m_wl_read(ctx, &op);
+
+#ifdef C4M_GC_LARGE_OBJECTS
+        while (p == NULL && (large = large_pop_serial(ctx)) != NULL) {
+            scan_in_place(ctx, large);
+            p = c4m_wl_read(ctx, &op);
+        }
+#endif
     }
 }
 
+#if defined(C4M_GC_GENERATIONAL) || defined(C4M_GC_LARGE_OBJECTS)
+static inline void
+forward_in_place(c4m_collection_ctx *ctx, void **loc)
+{
+    if (value_in_fromspace(ctx, *loc)) {
+        forward_one_allocation(ctx, loc);
+    }
+#ifdef C4M_GC_LARGE_OBJECTS
+    else {
+        large_mark(ctx, *loc);
+    }
+#endif
+}
+
+// Like scan_allocation(), but for old-space and large allocations,
+// which never move; we forward anything in the from-space on the spot.
+static void
+scan_in_place(c4m_collection_ctx *ctx, c4m_alloc_hdr *hdr)
+{
+    void          **p       = (void **)hdr->data;
+    void          **end     = (void **)c4m_alloc_next_addr(hdr);
+    c4m_mem_scan_fn scanner = c4m_alloc_scan_fn(hdr);
+
+    if ((void *)scanner == C4M_GC_SCAN_NONE) {
+        return;
+    }
+
+#ifdef C4M_USE_GC_HOOKS
+    if ((void *)scanner != C4M_GC_SCAN_ALL) {
+        uint32_t  numwords    = hdr->alloc_len;
+        uint32_t  bf_byte_len = ((numwords / 64) + 1) * 8;
+        uint64_t *map         = alloca(bf_byte_len);
+        int       last_cell   = numwords / 64;
+
+        memset(map, 0, bf_byte_len);
+
+        if (hdr->con4m_obj) {
+            map[0] = C4M_HEADER_SCAN_CONST;
+        }
+
+        (*scanner)(map, hdr->data);
+
+        for (int i = 0; i <= last_cell; i++) {
+            uint64_t w = map[i];
+            while (w) {
+                int ix = 63 - __builtin_clzll(w);
+                w &= ~(1ULL << ix);
+
+                forward_in_place(ctx, &p[ix]);
+            }
+            p += 64;
+        }
+        return;
+    }
+#endif
+
+    while (p < end) {
+        forward_in_place(ctx, p);
+        p++;
+    }
+}
+#endif
+
+static inline void
+forward_root(c4m_collection_ctx *ctx, void **loc)
+{
+#ifdef C4M_GC_PARALLEL
+    if (ctx->worker != NULL) {
+        par_forward(ctx->worker, loc);
+        return;
+    }
+#endif
+    forward_one_allocation(ctx, loc);
+}
+
 // This is only used for roots, not for memory allocations.
 //
 // That's because memory allocations have a hook to help us figure out which cells
@@ -564,7 +936,10 @@ scan_range_for_allocs(c4m_collection_ctx *ctx, void **start, int num)
         }
 #endif
         if (value_in_fromspace(ctx, *start)) {
-            forward_one_allocation(ctx, start);
+            forward_root(ctx, start);
+        }
+        else {
+            large_mark(ctx, *start);
         }
         start++;
     }
@@ -579,7 +954,10 @@ scan_stack_for_allocs(c4m_collection_ctx *ctx, void **start, int num)
 
     for (int i = 0; i < num; i++) {
         if (value_in_fromspace(ctx, *start)) {
-            forward_one_allocation(ctx, start);
+            forward_root(ctx, start);
+        }
+        else {
+            large_mark(ctx, *start);
         }
         p++;
         start = (void **)p;
@@ -613,33 +991,15 @@ scan_roots(c4m_collection_ctx *ctx)
     }
 }
 
-static inline void
-raw_trace(c4m_collection_ctx *ctx)
+static void
+scan_roots_and_stack(c4m_collection_ctx *ctx)
 {
-    c4m_arena_t      *cur   = ctx->from_space;
-    c4m_arena_t      *stash = (void *)~(uint64_t)cur;
-    uint64_t          len   = cur->heap_end - (uint64_t *)cur;
-    hatrack_zarray_t *r     = cur->roots;
-    uint64_t         *stack_top;
-    uint64_t         *stack_bottom;
-
-    if (cur->grow_next) {
-        len <<= 1;
-    }
+    uint64_t *stack_top;
+    uint64_t *stack_bottom;
 
-    ctx->to_space = c4m_new_arena((size_t)len, r);
-
-    ASAN_UNPOISON_MEMORY_REGION(
-        ctx->to_space,
-        (((char *)ctx->to_space->heap_end) - (char *)ctx->to_space->data));
-
-    ctx->worklist = c4m_alloc_collection_worklist(cur);
     c4m_get_stack_scan_region((uint64_t *)&stack_top,
                               (uint64_t *)&stack_bottom);
 
-    ctx->fromspc_start = ctx->from_space->data;
-    ctx->fromspc_end   = ctx->from_space->heap_end;
-
     scan_roots(ctx);
     c4m_gc_trace(C4M_GCT_SCAN,
                  "Stack scan start: %p to %p (%lu item(s))",
@@ -653,63 +1013,613 @@ raw_trace(c4m_collection_ctx *ctx)
     scan_range_for_allocs(ctx, (void **)stack_top, stack_bottom - stack_top);
 #endif
 
-    ctx->from_space = (void *)~(uint64_t)stash;
-
     c4m_gc_trace(C4M_GCT_SCAN,
                  "Stack scan end: %p to %p (%lu item(s))",
                  stack_top,
                  stack_bottom,
                  stack_bottom - stack_top);
+}
 
-    if (system_finalizer != NULL) {
-        migrate_finalizers(cur, ctx->to_space);
-    }
+#ifdef C4M_GC_PARALLEL
+// Parallel collection.
+//
+// Big heaps get copied by a pool of helper threads. The serial
+// collector reserves an allocation's new home first, then copies the
+// data once everything it points to has a home. Instead, each worker
+// here copies an allocation as soon as it claims it, then fixes up
+// the pointers in the *copy*. That way every pointer slot has exactly
+// one owner. The only shared state is the forwarding address, which
+// gets claimed with a CAS, and the to-space bump pointer.
+//
+// Each worker keeps a Chase-Lev deque of copied allocations that still
+// need scanning, and idle workers steal from the other end. We can't
+// use hatrack's queues for this, since they allocate from the heap
+// we're in the middle of collecting.
 
-    ASAN_UNPOISON_MEMORY_REGION(
-        ctx->to_space->next_alloc,
-        (((char *)ctx->to_space->heap_end) - (char *)ctx->to_space->next_alloc));
+#define GC_FW_BUSY ((void *)1)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define gc_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define gc_cpu_relax() __asm__ __volatile__("yield")
+#else
+#define gc_cpu_relax()
+#endif
+
+typedef struct {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    int64_t         mask;
+    size_t          alloc_len;
+    c4m_alloc_hdr **items;
+} gc_deque_t;
+
+struct gc_worker_t {
+    c4m_collection_ctx *ctx;
+    gc_deque_t          deque;
+    uint32_t            largest_alloc;
+    uint32_t            alloc_count;
+    uint32_t            id;
+    uint32_t            rng;
+};
+
+static struct {
+    pthread_mutex_t lock; // One parallel collection at a time.
+    pthread_mutex_t wake_lock;
+    pthread_mutex_t grow_lock; // Held while growing the to-space.
+    pthread_cond_t  wake;
+    pthread_cond_t  done;
+    uint64_t        generation;
+    int             num_workers; // Including the collecting thread.
+    int             num_finished;
+    _Atomic int     active;
+    gc_worker_t     workers[C4M_GC_THREADS];
+} gc_pool = {
+    .lock      = PTHREAD_MUTEX_INITIALIZER,
+    .wake_lock = PTHREAD_MUTEX_INITIALIZER,
+    .grow_lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake      = PTHREAD_COND_INITIALIZER,
+    .done      = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_once_t gc_pool_once = PTHREAD_ONCE_INIT;
+
+static void
+deque_init(gc_deque_t *d, uint64_t max_items)
+{
+    // Every allocation gets pushed at most once, by whoever copied it,
+    // so sizing for every allocation in the from-space means we never
+    // have to grow. The pages only get touched if they're used.
+    uint64_t n = 1ULL << (64 - __builtin_clzll(max_items));
+
+    d->alloc_len = c4m_round_up_to_given_power_of_2(c4m_page_bytes,
+                                                    n * sizeof(void *));
+    d->items     = mmap(NULL,
+                    d->alloc_len,
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANON | MAP_NORESERVE,
+                    -1,
+                    0);
+    d->mask      = n - 1;
+    atomic_store(&d->top, 0);
+    atomic_store(&d->bottom, 0);
 }
 
-#ifdef C4M_FULL_MEMCHECK
+static inline void
+deque_push(gc_deque_t *d, c4m_alloc_hdr *hdr)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
 
-extern uint64_t c4m_end_guard;
+    d->items[b & d->mask] = hdr;
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
 
-static inline char *
-name_alloc(c4m_alloc_hdr *alloc)
+static inline c4m_alloc_hdr *
+deque_take(gc_deque_t *d)
 {
-    if (!alloc->con4m_obj) {
-        return "raw alloc";
+    int64_t        b = atomic_load_explicit(&d->bottom,
+                                     memory_order_relaxed)
+              - 1;
+    int64_t        t;
+    c4m_alloc_hdr *result = NULL;
+
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t <= b) {
+        result = d->items[b & d->mask];
+
+        if (t != b) {
+            return result;
+        }
+
+        // Last one; race any thieves for it.
+        if (!atomic_compare_exchange_strong(&d->top, &t, t + 1)) {
+            result = NULL;
+        }
     }
-    c4m_base_obj_t *base = (c4m_base_obj_t *)alloc->data;
-    return (char *)base->base_data_type->name;
+
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+
+    return result;
 }
 
-void
-_c4m_memcheck_raw_alloc(void *a, char *file, int line)
+static inline c4m_alloc_hdr *
+deque_steal(gc_deque_t *d)
 {
-    // This uses info int the alloc itself that might be corrupt;
-    // It's a TODO to make the external records log n searchable,
-    // to remove that potential issue.
+    int64_t        t = atomic_load_explicit(&d->top, memory_order_acquire);
+    int64_t        b;
+    c4m_alloc_hdr *result;
 
-    if (!c4m_in_heap(a)) {
-        fprintf(stderr,
-                "\n%s:%d: Heap pointer %p is corrupt; not in heap.\n",
-                file,
-                line,
-                a);
-        abort();
+    atomic_thread_fence(memory_order_seq_cst);
+    b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return NULL;
     }
 
-    c4m_alloc_hdr *h = (c4m_alloc_hdr *)(((unsigned char *)a) - sizeof(c4m_alloc_hdr));
-    if (h->guard != c4m_gc_guard) {
-        fprintf(stderr, "\n%s:%d: ", file, line);
-        c4m_alloc_display_front_guard_error(h, a, NULL, 0, true);
+    result = d->items[t & d->mask];
+
+    if (!atomic_compare_exchange_strong(&d->top, &t, t + 1)) {
+        return NULL;
     }
 
-    if (*h->end_guard_loc != c4m_end_guard) {
-        fprintf(stderr, "\n%s:%d: ", file, line);
-        c4m_alloc_display_rear_guard_error(h,
-                                           a,
+    return result;
+}
+
+static inline bool
+deque_is_empty(gc_deque_t *d)
+{
+    return atomic_load(&d->top) >= atomic_load(&d->bottom);
+}
+
+static c4m_alloc_hdr *
+par_copy(gc_worker_t *w, c4m_alloc_hdr *src)
+{
+    c4m_arena_t   *to  = w->ctx->to_space;
+    uint64_t       len = ((char *)c4m_alloc_next_addr(src)) - (char *)src;
+    c4m_alloc_hdr *dst;
+
+    dst = (c4m_alloc_hdr *)__atomic_fetch_add((uint64_t *)&to->next_alloc,
+                                              len,
+                                              __ATOMIC_RELAXED);
+
+    // Past the end, the to-space's reservation is inaccessible until
+    // somebody grows into it; whoever gets the lock grows it far
+    // enough for everyone waiting.
+    char *end = (char *)dst + len;
+
+    if (end > (char *)__atomic_load_n(&to->heap_end, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&gc_pool.grow_lock);
+        if (end > (char *)to->heap_end) {
+            tospace_grow(to, end);
+        }
+        pthread_mutex_unlock(&gc_pool.grow_lock);
+    }
+
+    memcpy(dst, src, len);
+
+    dst->fw_addr = NULL;
+#ifndef C4M_GC_COMPACT_HDR
+    dst->next_addr = (uint64_t *)(((char *)dst) + len);
+    dst->arena     = to;
+#endif
+
+    if (dst->alloc_len > w->largest_alloc) {
+        w->largest_alloc = dst->alloc_len;
+    }
+
+    w->alloc_count++;
+
+    return dst;
+}
+
+static void
+par_forward(gc_worker_t *w, void **ptr_loc)
+{
+    void          *ptr = *ptr_loc;
+    c4m_alloc_hdr *hdr = get_header(w->ctx, ptr);
+    void          *fw  = __atomic_load_n(&hdr->fw_addr, __ATOMIC_ACQUIRE);
+
+    if (fw == NULL) {
+        if (__atomic_compare_exchange_n(&hdr->fw_addr,
+                                        &fw,
+                                        GC_FW_BUSY,
+                                        false,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            fw = par_copy(w, hdr);
+            __atomic_store_n(&hdr->fw_addr, fw, __ATOMIC_RELEASE);
+            deque_push(&w->deque, hdr);
+        }
+    }
+
+    // Someone else is mid-copy; it's a memcpy, so it won't be long.
+    while (fw == GC_FW_BUSY) {
+        gc_cpu_relax();
+        fw = __atomic_load_n(&hdr->fw_addr, __ATOMIC_ACQUIRE);
+    }
+
+    update_pointer(hdr, ptr, ptr_loc);
+}
+
+static inline void
+par_scan_slot(gc_worker_t *w, c4m_alloc_hdr *old, void **loc)
+{
+    void *contents = *loc;
+
+    if (value_in_fromspace(w->ctx, contents)) {
+        if (value_in_allocation(old, contents)) {
+            update_pointer(old, contents, loc);
+        }
+        else {
+            par_forward(w, loc);
+        }
+    }
+    else {
+        large_mark(w->ctx, contents);
+    }
+}
+
+// Fix up the pointers in `hdr`, which is either the copy of `old`,
+// or `old` itself if it's a large object.
+static void
+par_scan(gc_worker_t *w, c4m_alloc_hdr *old, c4m_alloc_hdr *hdr)
+{
+    void          **p       = (void **)hdr->data;
+    void          **end     = (void **)c4m_alloc_next_addr(hdr);
+    c4m_mem_scan_fn scanner = c4m_alloc_scan_fn(hdr);
+
+    if ((void *)scanner == C4M_GC_SCAN_NONE) {
+        return;
+    }
+
+#ifdef C4M_USE_GC_HOOKS
+    if ((void *)scanner != C4M_GC_SCAN_ALL) {
+        uint32_t  numwords    = hdr->alloc_len;
+        uint32_t  bf_byte_len = ((numwords / 64) + 1) * 8;
+        uint64_t *map         = alloca(bf_byte_len);
+        int       last_cell   = numwords / 64;
+
+        memset(map, 0, bf_byte_len);
+
+        if (hdr->con4m_obj) {
+            map[0] = C4M_HEADER_SCAN_CONST;
+        }
+
+        (*scanner)(map, hdr->data);
+
+        for (int i = 0; i <= last_cell; i++) {
+            uint64_t w_bits = map[i];
+            while (w_bits) {
+                int ix = 63 - __builtin_clzll(w_bits);
+                w_bits &= ~(1ULL << ix);
+                par_scan_slot(w, old, &p[ix]);
+            }
+            p += 64;
+        }
+        return;
+    }
+#endif
+
+    while (p < end) {
+        par_scan_slot(w, old, p);
+        p++;
+    }
+}
+
+static c4m_alloc_hdr *
+par_steal(gc_worker_t *w)
+{
+    int            n = gc_pool.num_workers;
+    c4m_alloc_hdr *result;
+
+    w->rng = w->rng * 1103515245 + 12345;
+
+    for (int i = 0, start = w->rng >> 16; i < n; i++) {
+        gc_worker_t *victim = &gc_pool.workers[(start + i) % n];
+
+        if (victim == w) {
+            continue;
+        }
+
+        result = deque_steal(&victim->deque);
+
+        if (result != NULL) {
+            return result;
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+par_work_visible(c4m_collection_ctx *ctx)
+{
+#ifdef C4M_GC_LARGE_OBJECTS
+    if (ctx->large != NULL && atomic_load(&ctx->large->num_pending) != 0) {
+        return true;
+    }
+#endif
+
+    for (int i = 0; i < gc_pool.num_workers; i++) {
+        if (!deque_is_empty(&gc_pool.workers[i].deque)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+par_run(gc_worker_t *w)
+{
+    c4m_alloc_hdr *hdr;
+
+    while (true) {
+        while ((hdr = deque_take(&w->deque)) != NULL) {
+            par_scan(w, hdr, hdr->fw_addr);
+        }
+
+        hdr = par_steal(w);
+
+        if (hdr != NULL) {
+            par_scan(w, hdr, hdr->fw_addr);
+            continue;
+        }
+
+#ifdef C4M_GC_LARGE_OBJECTS
+        hdr = large_pop(w->ctx);
+
+        if (hdr != NULL) {
+            par_scan(w, hdr, hdr);
+            continue;
+        }
+#endif
+
+        // Work only ever gets added by an active worker, and a worker
+        // only goes idle once its own deque is empty. So once nobody
+        // is active, we're done.
+        atomic_fetch_sub(&gc_pool.active, 1);
+
+        while (true) {
+            if (atomic_load(&gc_pool.active) == 0) {
+                return;
+            }
+            if (par_work_visible(w->ctx)) {
+                atomic_fetch_add(&gc_pool.active, 1);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+static void *
+par_helper_main(void *arg)
+{
+    gc_worker_t *w   = arg;
+    uint64_t     gen = 0;
+
+    while (true) {
+        pthread_mutex_lock(&gc_pool.wake_lock);
+        while (gc_pool.generation == gen) {
+            pthread_cond_wait(&gc_pool.wake, &gc_pool.wake_lock);
+        }
+        gen = gc_pool.generation;
+        pthread_mutex_unlock(&gc_pool.wake_lock);
+
+        par_run(w);
+
+        pthread_mutex_lock(&gc_pool.wake_lock);
+        if (++gc_pool.num_finished == gc_pool.num_workers - 1) {
+            pthread_cond_signal(&gc_pool.done);
+        }
+        pthread_mutex_unlock(&gc_pool.wake_lock);
+    }
+
+    return NULL;
+}
+
+static void
+par_pool_start(void)
+{
+    int       n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t t;
+
+    if (n > C4M_GC_THREADS) {
+        n = C4M_GC_THREADS;
+    }
+
+    gc_pool.num_workers = 1;
+
+    for (int i = 1; i < n; i++) {
+        gc_pool.workers[i].id = i;
+        if (pthread_create(&t, NULL, par_helper_main, &gc_pool.workers[i])) {
+            break;
+        }
+        pthread_detach(t);
+        gc_pool.num_workers++;
+    }
+}
+
+// Returns false if the collection should be done serially instead;
+// otherwise, the to-space is fully populated on return.
+static bool
+par_trace(c4m_collection_ctx *ctx)
+{
+    c4m_arena_t *from = ctx->from_space;
+    uint64_t     used = ((char *)from->next_alloc) - (char *)from->data;
+    uint32_t     big  = 0;
+    gc_worker_t *w;
+
+    used += adopted_words(ctx->adopted, &big) * sizeof(uint64_t);
+
+    if (used < C4M_GC_PARALLEL_MIN_BYTES) {
+        return false;
+    }
+
+    pthread_once(&gc_pool_once, par_pool_start);
+
+    // Each thread has its own heap, so two threads might want the pool
+    // at once. Whoever loses just collects on its own.
+    if (gc_pool.num_workers < 2 || pthread_mutex_trylock(&gc_pool.lock)) {
+        return false;
+    }
+
+    for (int i = 0; i < gc_pool.num_workers; i++) {
+        w                = &gc_pool.workers[i];
+        w->ctx           = ctx;
+        w->largest_alloc = 0;
+        w->alloc_count   = 0;
+        w->rng           = i + 1;
+        deque_init(&w->deque, used / sizeof(c4m_alloc_hdr) + 1);
+    }
+
+    w           = &gc_pool.workers[0];
+    ctx->worker = w;
+
+    atomic_store(&gc_pool.active, gc_pool.num_workers);
+
+    pthread_mutex_lock(&gc_pool.wake_lock);
+    gc_pool.num_finished = 0;
+    gc_pool.generation++;
+    pthread_cond_broadcast(&gc_pool.wake);
+    pthread_mutex_unlock(&gc_pool.wake_lock);
+
+    // The helpers start stealing as soon as roots start landing in our
+    // deque.
+    scan_roots_and_stack(ctx);
+    par_run(w);
+
+    pthread_mutex_lock(&gc_pool.wake_lock);
+    while (gc_pool.num_finished != gc_pool.num_workers - 1) {
+        pthread_cond_wait(&gc_pool.done, &gc_pool.wake_lock);
+    }
+    pthread_mutex_unlock(&gc_pool.wake_lock);
+
+    for (int i = 0; i < gc_pool.num_workers; i++) {
+        w = &gc_pool.workers[i];
+
+        if (w->largest_alloc > ctx->to_space->largest_alloc) {
+            ctx->to_space->largest_alloc = w->largest_alloc;
+        }
+
+        ctx->to_space->alloc_count += w->alloc_count;
+        ctx->copied_allocs += w->alloc_count;
+        ctx->reached_allocs += w->alloc_count;
+        munmap(w->deque.items, w->deque.alloc_len);
+    }
+
+    ctx->worker = NULL;
+    pthread_mutex_unlock(&gc_pool.lock);
+
+    return true;
+}
+#endif
+
+static inline void
+raw_trace(c4m_collection_ctx *ctx)
+{
+    c4m_arena_t      *cur   = ctx->from_space;
+    c4m_arena_t      *stash = (void *)~(uint64_t)cur;
+    uint64_t          len   = cur->heap_end - (uint64_t *)cur;
+    hatrack_zarray_t *r     = cur->roots;
+    uint32_t          big   = cur->largest_alloc;
+    uint64_t          extra = adopted_words(cur->adopted, &big);
+
+    if (cur->grow_next) {
+        len <<= 1;
+    }
+
+    // Most of what worker heaps hold is garbage by the time we get
+    // here (parse trees and such), so committing room for all of it
+    // up front would mostly be wasted. Reserve the address space, and
+    // grow into it only if the survivors really don't fit.
+    ctx->adopted  = cur->adopted;
+    ctx->to_space = c4m_new_growable_arena((size_t)len, (size_t)extra, r);
+
+    ASAN_UNPOISON_MEMORY_REGION(
+        ctx->to_space,
+        (((char *)ctx->to_space->heap_end) - (char *)ctx->to_space->data));
+
+    ctx->worklist = c4m_alloc_collection_worklist(big);
+
+    ctx->fromspc_start = ctx->from_space->data;
+    ctx->fromspc_end   = ctx->from_space->heap_end;
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    large_begin(ctx, cur->large_objs);
+    ctx->to_space->large_objs = cur->large_objs;
+#endif
+
+#ifdef C4M_GC_PARALLEL
+    if (!par_trace(ctx)) {
+        scan_roots_and_stack(ctx);
+    }
+#else
+    scan_roots_and_stack(ctx);
+#endif
+
+    ctx->from_space = (void *)~(uint64_t)stash;
+
+    if (system_finalizer != NULL) {
+        migrate_finalizers(ctx, cur, ctx->to_space);
+    }
+
+    release_adopted(ctx, ctx->to_space);
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    large_sweep(ctx);
+#endif
+
+    ASAN_UNPOISON_MEMORY_REGION(
+        ctx->to_space->next_alloc,
+        (((char *)ctx->to_space->heap_end) - (char *)ctx->to_space->next_alloc));
+}
+
+#ifdef C4M_FULL_MEMCHECK
+
+extern uint64_t c4m_end_guard;
+
+static inline char *
+name_alloc(c4m_alloc_hdr *alloc)
+{
+    if (!alloc->con4m_obj) {
+        return "raw alloc";
+    }
+    c4m_base_obj_t *base = (c4m_base_obj_t *)alloc->data;
+    return (char *)base->base_data_type->name;
+}
+
+void
+_c4m_memcheck_raw_alloc(void *a, char *file, int line)
+{
+    // This uses info int the alloc itself that might be corrupt;
+    // It's a TODO to make the external records log n searchable,
+    // to remove that potential issue.
+
+    if (!c4m_in_heap(a)) {
+        fprintf(stderr,
+                "\n%s:%d: Heap pointer %p is corrupt; not in heap.\n",
+                file,
+                line,
+                a);
+        abort();
+    }
+
+    c4m_alloc_hdr *h = (c4m_alloc_hdr *)(((unsigned char *)a) - sizeof(c4m_alloc_hdr));
+    if (h->guard != c4m_gc_guard) {
+        fprintf(stderr, "\n%s:%d: ", file, line);
+        c4m_alloc_display_front_guard_error(h, a, NULL, 0, true);
+    }
+
+    if (*h->end_guard_loc != c4m_end_guard) {
+        fprintf(stderr, "\n%s:%d: ", file, line);
+        c4m_alloc_display_rear_guard_error(h,
+                                           a,
                                            h->request_len,
                                            a,
                                            NULL,
@@ -906,7 +1816,7 @@ memcheck_validate_old_records(c4m_arena_t *from_space)
                                 a->start->alloc_file,
                                 a->start->alloc_line,
                                 a->start->fw_addr,
-                                a->start->scan_fn,
+                                c4m_alloc_scan_fn(a->start),
                                 h->alloc_file,
                                 h->alloc_line);
 #ifdef C4M_STRICT_MEMCHECK
@@ -935,9 +1845,490 @@ memcheck_delete_old_records(c4m_arena_t *from_space)
 
 #endif
 
+#ifdef C4M_GC_GENERATIONAL
+// Generational mode.
+//
+// Allocation happens in a relatively small nursery. When the nursery
+// fills, we do a *minor* collection: everything reachable in the
+// nursery gets copied straight into the old space, and the nursery is
+// thrown away. Nothing in the old space moves.
+//
+// The catch is finding pointers from the old space back into the
+// nursery, which is normally the job of a write barrier. We can't put
+// a barrier on every pointer store in C, so we use the MMU instead:
+// after each collection, the old space gets write-protected, and the
+// first write to each page faults into wp_fault(), which marks the
+// page's card, unprotects the page, and lets the write go through.
+// Only the old space is protected, so nothing else in the process
+// pays for this. A minor collection then only scans old-space
+// allocations that overlap a marked page. To find the allocation
+// covering the start of a page, the old space keeps a page_cover map,
+// which we extend as allocations get promoted.
+//
+// The kernel doesn't fault on its own writes; a system call that
+// writes into a protected page fails with EFAULT. Code that passes
+// heap memory to the kernel to fill in has to call c4m_gc_unprotect()
+// on it first.
+//
+// If we can't protect a space (the fault handler couldn't be
+// installed, or there are more old spaces than slots), every page of
+// it counts as dirty. That still scans the whole old space on a minor
+// collection, but never copies it.
+//
+// The old space reserves room to grow. If the survivors of a minor
+// collection don't fit in what's committed, it grows into that
+// reservation. When even the reservation can't absorb a full
+// nursery's worth of survivors, we do a *major* collection, which
+// evacuates both spaces into a new old space, just like the
+// non-generational collector.
+
+#define WP_MAX_SPACES 256
+
+typedef struct {
+    _Atomic(char *) start;
+    char           *end;
+    uint8_t        *cards;
+} wp_range_t;
+
+static wp_range_t       wp_ranges[WP_MAX_SPACES];
+static pthread_mutex_t  wp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t   wp_once = PTHREAD_ONCE_INIT;
+static bool             wp_ok   = false;
+static struct sigaction wp_prev_segv;
+static struct sigaction wp_prev_bus;
+
+static inline wp_range_t *
+wp_find(char *addr)
+{
+    for (int i = 0; i < WP_MAX_SPACES; i++) {
+        char *start = atomic_load(&wp_ranges[i].start);
+
+        if (start != NULL && addr >= start && addr < wp_ranges[i].end) {
+            return &wp_ranges[i];
+        }
+    }
+
+    return NULL;
+}
+
+static inline void
+wp_mark_page(wp_range_t *r, char *addr)
+{
+    uint64_t page = (addr - atomic_load(&r->start)) / c4m_page_bytes;
+    char    *p    = atomic_load(&r->start) + page * c4m_page_bytes;
+
+    r->cards[page] = 1;
+    mprotect(p, c4m_page_bytes, PROT_READ | PROT_WRITE);
+}
+
+static void
+wp_fault(int sig, siginfo_t *info, void *uctx)
+{
+    wp_range_t       *r    = wp_find(info->si_addr);
+    struct sigaction *prev = sig == SIGSEGV ? &wp_prev_segv : &wp_prev_bus;
+
+    if (r != NULL) {
+        wp_mark_page(r, info->si_addr);
+        return;
+    }
+
+    // Not ours. Hand it to whoever was installed before us; if that
+    // was the default action, put it back and let the access fault
+    // again.
+    if (prev->sa_flags & SA_SIGINFO) {
+        (*prev->sa_sigaction)(sig, info, uctx);
+        return;
+    }
+
+    if (prev->sa_handler == SIG_DFL || prev->sa_handler == SIG_IGN) {
+        sigaction(sig, prev, NULL);
+        return;
+    }
+
+    (*prev->sa_handler)(sig);
+}
+
+static void
+wp_setup(void)
+{
+    struct sigaction sa = {
+        .sa_sigaction = wp_fault,
+        .sa_flags     = SA_SIGINFO | SA_RESTART | SA_NODEFER,
+    };
+
+    sigemptyset(&sa.sa_mask);
+
+    wp_ok = !sigaction(SIGSEGV, &sa, &wp_prev_segv)
+         && !sigaction(SIGBUS, &sa, &wp_prev_bus);
+}
+
+void
+c4m_gc_unprotect(void *ptr, size_t len)
+{
+    char *p   = ptr;
+    char *end = p + len;
+
+    while (p < end) {
+        wp_range_t *r = wp_find(p);
+
+        if (r != NULL) {
+            wp_mark_page(r, p);
+        }
+
+        p = (char *)(((uint64_t)p & c4m_modulus_mask) + c4m_page_bytes);
+    }
+}
+
+// Write-protects an old space, and starts tracking writes into it.
+static void
+old_space_protect(c4m_arena_t *old)
+{
+    pthread_once(&wp_once, wp_setup);
+
+    if (!wp_ok) {
+        return;
+    }
+
+    if (old->wp_slot == 0) {
+        pthread_mutex_lock(&wp_lock);
+        for (int i = 0; i < WP_MAX_SPACES; i++) {
+            if (atomic_load(&wp_ranges[i].start) == NULL) {
+                // Keep it claimed until we fill it in below.
+                atomic_store(&wp_ranges[i].start, (char *)~0ULL);
+                old->wp_slot = i + 1;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&wp_lock);
+
+        if (old->wp_slot == 0) {
+            return;
+        }
+    }
+
+    wp_range_t *r   = &wp_ranges[old->wp_slot - 1];
+    uint64_t    len = (char *)old->heap_end - (char *)old;
+
+    memset(old->dirty_cards, 0, len / c4m_page_bytes);
+
+    r->cards = old->dirty_cards;
+    r->end   = (char *)old->heap_end;
+    atomic_store(&r->start, (char *)old);
+
+    mprotect(old, len, PROT_READ);
+}
+
+// Called at the start of a collection, which needs to write all over
+// the old space. Returns the cards, or NULL if every page needs to be
+// treated as dirty.
+static uint8_t *
+old_space_unprotect(c4m_arena_t *old)
+{
+    if (old->wp_slot == 0) {
+        return NULL;
+    }
+
+    mprotect(old, (char *)old->heap_end - (char *)old, PROT_READ | PROT_WRITE);
+
+    return old->dirty_cards;
+}
+
+// Stops tracking an old space that's about to be deleted.
+static void
+old_space_release(c4m_arena_t *old)
+{
+    if (old->wp_slot != 0) {
+        atomic_store(&wp_ranges[old->wp_slot - 1].start, NULL);
+        old->wp_slot = 0;
+    }
+}
+
+// How many bytes an old space can still take, counting its
+// reservation.
+static inline uint64_t
+old_space_room(c4m_arena_t *old)
+{
+    return (char *)old->map_end - c4m_page_bytes - (char *)old->next_alloc;
+}
+
+// Record, for each page whose first byte lands inside an allocation
+// from `hdr` onward, which allocation that is.
+static void
+cover_pages(c4m_arena_t *old, c4m_alloc_hdr *hdr)
+{
+    char *base = (char *)old;
+
+    if (old->page_cover == NULL) {
+        // Size it for the whole reservation, since the space can grow.
+        old->page_cover_len = (((char *)old->map_end) - base)
+                            / c4m_page_bytes;
+        old->page_cover     = mmap(NULL,
+                               old->page_cover_len * sizeof(c4m_alloc_hdr *),
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANON,
+                               -1,
+                               0);
+        old->dirty_cards    = mmap(NULL,
+                                old->page_cover_len,
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANON,
+                                -1,
+                                0);
+    }
+
+    while (hdr < old->next_alloc) {
+        char    *end   = (char *)c4m_alloc_next_addr(hdr);
+        uint64_t first = ((char *)hdr - base + c4m_page_modulus)
+                       / c4m_page_bytes;
+        uint64_t last  = (end - 1 - base) / c4m_page_bytes;
+
+        for (uint64_t i = first; i <= last; i++) {
+            old->page_cover[i] = hdr;
+        }
+
+        hdr = (c4m_alloc_hdr *)end;
+    }
+}
+
+// Scans old-space allocations below `end` that overlap a dirty page.
+// With no cards, every page is dirty.
+static void
+scan_remembered_set(c4m_collection_ctx *ctx,
+                    c4m_arena_t        *old,
+                    c4m_alloc_hdr      *end,
+                    uint8_t            *cards)
+{
+    char          *base   = (char *)old;
+    uint64_t       npages = ((char *)end - base + c4m_page_modulus)
+                    / c4m_page_bytes;
+    c4m_alloc_hdr *last   = NULL;
+    c4m_alloc_hdr *hdr;
+
+    if (end == (c4m_alloc_hdr *)old->data) {
+        return;
+    }
+
+    for (uint64_t i = 0; i < npages; i++) {
+        if (cards != NULL && !cards[i]) {
+            continue;
+        }
+
+        hdr = old->page_cover[i];
+
+        if (hdr == NULL) {
+            // Only the first page can start outside an allocation.
+            if (i != 0) {
+                continue;
+            }
+            hdr = (c4m_alloc_hdr *)old->data;
+        }
+
+        if (last != NULL && hdr <= last) {
+            hdr = (c4m_alloc_hdr *)c4m_alloc_next_addr(last);
+        }
+
+        char *page_end = base + (i + 1) * c4m_page_bytes;
+
+        while (hdr < end && (char *)hdr < page_end) {
+            scan_in_place(ctx, hdr);
+            last = hdr;
+            hdr  = (c4m_alloc_hdr *)c4m_alloc_next_addr(hdr);
+        }
+    }
+
+    process_worklist(ctx);
+}
+
+static void
+minor_collection(c4m_collection_ctx *ctx, c4m_arena_t *old, uint8_t *cards)
+{
+    // Promotions get appended past this point, and don't need scanning.
+    c4m_alloc_hdr *old_end = old->next_alloc;
+    uint32_t       largest = ctx->from_space->largest_alloc;
+
+    adopted_words(ctx->adopted, &largest);
+
+    ctx->to_space      = old;
+    ctx->worklist      = c4m_alloc_collection_worklist(largest);
+    ctx->fromspc_start = ctx->from_space->data;
+    ctx->fromspc_end   = ctx->from_space->heap_end;
+
+    scan_roots_and_stack(ctx);
+    scan_remembered_set(ctx, old, old_end, cards);
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    // We don't know which large objects are live without tracing the
+    // old space, so they all count as roots until the next major.
+    c4m_large_objs_t *lo = ctx->from_space->large_objs;
+
+    if (lo != NULL) {
+        for (uint32_t i = 0; i < lo->count; i++) {
+            scan_in_place(ctx, lo->objs[i]);
+        }
+        process_worklist(ctx);
+    }
+#endif
+
+    if (system_finalizer != NULL) {
+        migrate_finalizers(ctx, ctx->from_space, old);
+    }
+
+    release_adopted(ctx, old);
+    cover_pages(old, old_end);
+}
+
+static c4m_arena_t *
+major_collection(c4m_collection_ctx *ctx, c4m_arena_t *old)
+{
+    c4m_arena_t *nursery = ctx->from_space;
+    uint64_t     total   = old->heap_end - (uint64_t *)old;
+    uint64_t     nlen    = nursery->heap_end - (uint64_t *)nursery;
+    uint64_t     live    = ((uint64_t *)old->next_alloc - old->data)
+                  + ((uint64_t *)nursery->next_alloc - nursery->data);
+    uint32_t     largest = old->largest_alloc;
+
+    live += adopted_words(ctx->adopted, &largest);
+
+    if (old->grow_next) {
+        total <<= 1;
+    }
+
+    // Everything could survive, so the new space has to be able to
+    // take all of it without needing to collect in the middle. On
+    // top of that, it needs to be able to absorb at least one full
+    // nursery, or we'd do nothing but major collections once the
+    // nursery has grown past the old space.
+    if (total < live + nlen) {
+        total = live + nlen;
+    }
+
+    if (nursery->largest_alloc > largest) {
+        largest = nursery->largest_alloc;
+    }
+
+    ctx->to_space      = c4m_new_growable_arena((size_t)total,
+                                           (size_t)total,
+                                           old->roots);
+    ctx->worklist      = c4m_alloc_collection_worklist(largest);
+    ctx->fromspc_start = nursery->data;
+    ctx->fromspc_end   = nursery->heap_end;
+    ctx->oldspc_start  = old->data;
+    ctx->oldspc_end    = old->heap_end;
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    large_begin(ctx, nursery->large_objs);
+#endif
+
+    scan_roots_and_stack(ctx);
+
+#ifdef C4M_FULL_MEMCHECK
+    memcheck_validate_old_records(old);
+    memcheck_delete_old_records(old);
+#endif
+
+    if (system_finalizer != NULL) {
+        migrate_finalizers(ctx, nursery, ctx->to_space);
+        migrate_finalizers(ctx, old, ctx->to_space);
+    }
+
+    release_adopted(ctx, ctx->to_space);
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    large_sweep(ctx);
+#endif
+
+    cover_pages(ctx->to_space, (c4m_alloc_hdr *)ctx->to_space->data);
+    old_space_release(old);
+    c4m_delete_arena(old);
+
+    // If more than half of it survived, we'd be back here soon.
+    live = (uint64_t *)ctx->to_space->next_alloc - ctx->to_space->data;
+
+    if (live > (total >> 1)) {
+        ctx->to_space->grow_next = true;
+    }
+
+    return ctx->to_space;
+}
+
+static c4m_arena_t *
+collect_generations(c4m_arena_t *nursery)
+{
+    c4m_collection_ctx ctx = {
+        .from_space     = nursery,
+        .adopted        = nursery->adopted,
+        .reached_allocs = 0,
+        .copied_allocs  = 0,
+    };
+
+    c4m_arena_t *old   = nursery->old_space;
+    uint32_t     big   = 0;
+    uint64_t     len   = nursery->heap_end - (uint64_t *)nursery;
+    uint64_t     used  = (char *)nursery->next_alloc - (char *)nursery->data;
+    uint64_t     room  = old_space_room(old);
+    uint8_t     *cards = old_space_unprotect(old);
+    c4m_arena_t *result;
+
+    used += adopted_words(ctx.adopted, &big) * sizeof(uint64_t);
+
+    c4m_gc_trace(C4M_GCT_COLLECT,
+                 "=========== %s COLLECT START; nursery @%p",
+                 room < used ? "MAJOR" : "MINOR",
+                 nursery);
+
+    // Survivors are never bigger than what they were in the nursery,
+    // so as long as the old space can grow that much, a minor
+    // collection can't run out of room.
+    if (room < used) {
+        old = major_collection(&ctx, old);
+    }
+    else {
+        minor_collection(&ctx, old, cards);
+    }
+
+    c4m_gc_trace(C4M_GCT_COLLECT,
+                 "=========== COLLECT END; nursery @%p\n",
+                 nursery);
+
+#ifdef C4M_FULL_MEMCHECK
+    memcheck_validate_old_records(nursery);
+    memcheck_delete_old_records(nursery);
+#endif
+
+    if (nursery->grow_next) {
+        len <<= 1;
+    }
+
+    result            = c4m_new_arena((size_t)len, nursery->roots);
+    result->old_space = old;
+#ifdef C4M_GC_LARGE_OBJECTS
+    result->large_objs = nursery->large_objs;
+#endif
+
+    run_post_collect_hooks();
+
+    c4m_delete_arena(nursery);
+
+    c4m_gc_trace(C4M_GCT_MUNMAP, "worklist: del @%p", ctx.worklist);
+    c4m_free_collection_worklist(ctx.worklist);
+
+    // Nothing in the old space points into the (empty) nursery now,
+    // so start tracking writes from here.
+    old_space_protect(old);
+
+    return result;
+}
+#endif
+
 c4m_arena_t *
 c4m_collect_arena(c4m_arena_t *from_space)
 {
+#ifdef C4M_GC_GENERATIONAL
+    if (from_space->old_space != NULL) {
+        return collect_generations(from_space);
+    }
+#endif
+
     c4m_collection_ctx ctx = {
         .from_space     = from_space,
         .reached_allocs = 0,
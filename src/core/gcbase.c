@@ -30,10 +30,325 @@ struct c4m_pthread {
     char   data[];
 };
 
+#ifdef C4M_GC_COMPACT_HDR
+// Compact headers store an index into this table instead of a scan
+// function pointer. Slots 0 and 1 are the two special values; other
+// functions get added the first time they're used, and are never
+// removed.
+//
+// Lookups go through an open-addressed map from function pointer to
+// index, so allocation doesn't need to take a lock. A key is only
+// published after its value is written.
+#define SCAN_FN_BUCKETS (C4M_GC_MAX_SCAN_FNS * 2)
+
+c4m_mem_scan_fn c4m_gc_scan_fns[C4M_GC_MAX_SCAN_FNS] = {
+    C4M_GC_SCAN_ALL,
+    C4M_GC_SCAN_NONE,
+};
+
+static uint32_t                 num_scan_fns = 2;
+static pthread_mutex_t          scan_fn_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic(c4m_mem_scan_fn) scan_fn_keys[SCAN_FN_BUCKETS];
+static uint32_t                 scan_fn_vals[SCAN_FN_BUCKETS];
+
+static inline uint64_t
+scan_fn_bucket(c4m_mem_scan_fn fn)
+{
+    return ((((uint64_t)fn) >> 2) * 0x9e3779b97f4a7c15ULL >> 32)
+         & (SCAN_FN_BUCKETS - 1);
+}
+
+static uint32_t
+add_scan_fn(c4m_mem_scan_fn fn)
+{
+    uint64_t        b = scan_fn_bucket(fn);
+    c4m_mem_scan_fn k;
+    uint32_t        result;
+
+    pthread_mutex_lock(&scan_fn_lock);
+
+    while ((k = atomic_load(&scan_fn_keys[b])) != NULL) {
+        if (k == fn) {
+            pthread_mutex_unlock(&scan_fn_lock);
+            return scan_fn_vals[b];
+        }
+        b = (b + 1) & (SCAN_FN_BUCKETS - 1);
+    }
+
+    if (num_scan_fns == C4M_GC_MAX_SCAN_FNS) {
+        fprintf(stderr,
+                "Too many GC scan functions; increase C4M_GC_MAX_SCAN_FNS.\n");
+        abort();
+    }
+
+    result                  = num_scan_fns++;
+    c4m_gc_scan_fns[result] = fn;
+    scan_fn_vals[b]         = result;
+    atomic_store(&scan_fn_keys[b], fn);
+
+    pthread_mutex_unlock(&scan_fn_lock);
+
+    return result;
+}
+
+uint32_t
+c4m_gc_scan_fn_index(c4m_mem_scan_fn fn)
+{
+    uint64_t        b;
+    c4m_mem_scan_fn k;
+
+    if ((void *)fn == C4M_GC_SCAN_ALL) {
+        return 0;
+    }
+
+    if ((void *)fn == C4M_GC_SCAN_NONE) {
+        return 1;
+    }
+
+    b = scan_fn_bucket(fn);
+
+    while ((k = atomic_load(&scan_fn_keys[b])) != NULL) {
+        if (k == fn) {
+            return scan_fn_vals[b];
+        }
+        b = (b + 1) & (SCAN_FN_BUCKETS - 1);
+    }
+
+    return add_scan_fn(fn);
+}
+#endif
+
+#ifdef C4M_GC_LARGE_OBJECTS
+static inline size_t
+large_map_len(c4m_alloc_hdr *hdr)
+{
+    return c4m_round_up_to_given_power_of_2(c4m_page_bytes,
+                                            sizeof(c4m_alloc_hdr)
+                                                + hdr->alloc_len);
+}
+
+// The registry lives outside the heap, since the collector updates it
+// mid-collection.
+static c4m_large_objs_t *
+large_objs_new(void)
+{
+    c4m_large_objs_t *result = calloc(1, sizeof(c4m_large_objs_t));
+
+    pthread_mutex_init(&result->lock, NULL);
+
+    return result;
+}
+
+// Returns the index of the first object that starts after `ptr`.
+static inline uint32_t
+large_objs_search(c4m_large_objs_t *lo, void *ptr)
+{
+    uint32_t low  = 0;
+    uint32_t high = lo->count;
+
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+
+        if ((void *)lo->objs[mid] <= ptr) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static void
+large_objs_insert(c4m_large_objs_t *lo, c4m_alloc_hdr *hdr)
+{
+    if (lo->count == lo->capacity) {
+        lo->capacity = lo->capacity ? lo->capacity * 2 : 16;
+        lo->objs     = realloc(lo->objs,
+                           lo->capacity * sizeof(c4m_alloc_hdr *));
+        lo->marks    = realloc(lo->marks, lo->capacity);
+    }
+
+    uint32_t ix = large_objs_search(lo, hdr);
+
+    memmove(&lo->objs[ix + 1],
+            &lo->objs[ix],
+            (lo->count - ix) * sizeof(c4m_alloc_hdr *));
+    memmove(&lo->marks[ix + 1], &lo->marks[ix], lo->count - ix);
+
+    lo->objs[ix]  = hdr;
+    lo->marks[ix] = 0;
+    lo->count++;
+}
+
+static void
+large_objs_remove(c4m_large_objs_t *lo, int64_t ix)
+{
+    lo->count--;
+
+    memmove(&lo->objs[ix],
+            &lo->objs[ix + 1],
+            (lo->count - ix) * sizeof(c4m_alloc_hdr *));
+    memmove(&lo->marks[ix], &lo->marks[ix + 1], lo->count - ix);
+}
+
+// Returns the index of the large object containing `ptr`, or -1.
+int64_t
+c4m_large_obj_index(c4m_large_objs_t *lo, void *ptr)
+{
+    if (lo == NULL || lo->count == 0 || ptr <= (void *)lo->objs[0]) {
+        return -1;
+    }
+
+    int64_t        ix  = ((int64_t)large_objs_search(lo, ptr)) - 1;
+    c4m_alloc_hdr *hdr = lo->objs[ix];
+
+    if (ptr >= (void *)c4m_alloc_next_addr(hdr)) {
+        return -1;
+    }
+
+    return ix;
+}
+
+// True if `ptr` is the start of a large allocation in the current heap.
+bool
+c4m_is_large_alloc(void *ptr)
+{
+    c4m_large_objs_t *lo = c4m_current_heap->large_objs;
+    int64_t           ix = c4m_large_obj_index(lo, ptr);
+
+    return ix != -1 && lo->objs[ix]->data == ptr;
+}
+
+static c4m_alloc_hdr *
+alloc_large(c4m_arena_t *arena, size_t len)
+{
+    size_t         map_len = c4m_round_up_to_given_power_of_2(
+        c4m_page_bytes,
+        sizeof(c4m_alloc_hdr) + len);
+    c4m_alloc_hdr *result  = mmap(NULL,
+                                 map_len,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANON,
+                                 -1,
+                                 0);
+
+    if (result == MAP_FAILED) {
+        fprintf(stderr, "Out of memory (large allocation of %zu bytes)\n", len);
+        abort();
+    }
+
+    if (arena->large_objs == NULL) {
+        arena->large_objs = large_objs_new();
+    }
+
+    result->large = 1;
+    large_objs_insert(arena->large_objs, result);
+
+    return result;
+}
+
+// Large objects can grow without copying, by remapping their pages.
+// Returns NULL if the new size isn't large, or we can't remap here.
+static void *
+resize_large(c4m_alloc_hdr *hdr, size_t len)
+{
+#if defined(__linux__)
+    c4m_large_objs_t *lo       = c4m_current_heap->large_objs;
+    int64_t           ix       = c4m_large_obj_index(lo, hdr->data);
+    size_t            new_len  = c4m_round_up_to_given_power_of_2(
+        C4M_FORCED_ALIGNMENT,
+        len + sizeof(c4m_alloc_hdr));
+    size_t            map_len  = large_map_len(hdr);
+    size_t            new_map  = c4m_round_up_to_given_power_of_2(
+        c4m_page_bytes,
+        sizeof(c4m_alloc_hdr) + new_len);
+    c4m_alloc_hdr    *result;
+
+    // Stashed heaps keep their own registry; just copy those.
+    if (new_len < C4M_GC_LARGE_OBJECT_BYTES || ix == -1) {
+        return NULL;
+    }
+
+    result = mremap(hdr, map_len, new_map, MREMAP_MAYMOVE);
+
+    if (result == MAP_FAILED) {
+        return NULL;
+    }
+
+    result->alloc_len   = new_len;
+    result->request_len = len;
+#ifndef C4M_GC_COMPACT_HDR
+    result->next_addr = (uint64_t *)(((char *)result->data) + new_len);
+#endif
+
+    large_objs_remove(lo, ix);
+    large_objs_insert(lo, result);
+
+    if (result->finalize) {
+        c4m_finalizer_info_t *p = c4m_current_heap->to_finalize;
+
+        while (p != NULL) {
+            if (p->allocation == hdr) {
+                p->allocation = result;
+                break;
+            }
+            p = p->next;
+        }
+    }
+
+    return result->data;
+#else
+    return NULL;
+#endif
+}
+
+static void
+large_objs_merge(c4m_arena_t *dst, c4m_arena_t *src)
+{
+    c4m_large_objs_t *lo = src->large_objs;
+
+    if (lo == NULL) {
+        return;
+    }
+
+    if (dst->large_objs == NULL) {
+        dst->large_objs = lo;
+        src->large_objs = NULL;
+        return;
+    }
+
+    for (uint32_t i = 0; i < lo->count; i++) {
+        large_objs_insert(dst->large_objs, lo->objs[i]);
+    }
+
+    lo->count = 0;
+}
+#endif
+
+static inline bool
+in_arena(c4m_arena_t *arena, void *p)
+{
+    return p > ((void *)arena) && p < (void *)arena->heap_end;
+}
+
 bool
 c4m_in_heap(void *p)
 {
-    return p > ((void *)c4m_current_heap) && p < (void *)c4m_current_heap->heap_end;
+#ifdef C4M_GC_GENERATIONAL
+    c4m_arena_t *old = c4m_current_heap->old_space;
+
+    if (old != NULL && in_arena(old, p)) {
+        return true;
+    }
+#endif
+#ifdef C4M_GC_LARGE_OBJECTS
+    if (c4m_large_obj_index(c4m_current_heap->large_objs, p) != -1) {
+        return true;
+    }
+#endif
+    return in_arena(c4m_current_heap, p);
 }
 
 void
@@ -74,9 +389,21 @@ c4m_gc_heap_stats(uint64_t *used, uint64_t *available, uint64_t *total)
     uint64_t start = (uint64_t)c4m_current_heap;
     uint64_t end   = (uint64_t)c4m_current_heap->heap_end;
     uint64_t cur   = (uint64_t)c4m_current_heap->next_alloc;
+    uint64_t extra = 0;
+
+#ifdef C4M_GC_GENERATIONAL
+    // Count the old space as used, since we can't allocate from it
+    // directly.
+    c4m_arena_t *old = c4m_current_heap->old_space;
+
+    if (old != NULL) {
+        extra = (uint64_t)old->next_alloc - (uint64_t)old;
+        end += (uint64_t)old->heap_end - (uint64_t)old->next_alloc;
+    }
+#endif
 
     if (used != NULL) {
-        *used = cur - start;
+        *used = cur - start + extra;
     }
 
     if (available != NULL) {
@@ -84,7 +411,7 @@ c4m_gc_heap_stats(uint64_t *used, uint64_t *available, uint64_t *total)
     }
 
     if (total != NULL) {
-        *total = end - start;
+        *total = end - start + extra;
     }
 }
 
@@ -204,8 +531,17 @@ c4m_initialize_gc()
         c4m_page_modulus = c4m_page_bytes - 1; // Page size is always a power of 2.
         c4m_modulus_mask = ~c4m_page_modulus;
 
+#ifdef C4M_GC_GENERATIONAL
+        c4m_current_heap = c4m_new_arena(C4M_NURSERY_SIZE, initial_roots);
+
+        c4m_current_heap->old_space = c4m_new_growable_arena(
+            C4M_OLD_SPACE_SIZE,
+            C4M_OLD_SPACE_SIZE,
+            initial_roots);
+#else
         int initial_len  = C4M_DEFAULT_ARENA_SIZE;
         c4m_current_heap = c4m_new_arena(initial_len, initial_roots);
+#endif
         c4m_arena_register_root(c4m_current_heap, &external_holds, 1);
 
         mmm_setthreadfns(c4m_thread_acquire, NULL);
@@ -286,6 +622,9 @@ c4m_internal_unstash_heap()
     uint64_t *e = (uint64_t *)popping->next_alloc;
 
     c4m_arena_register_root(c4m_current_heap, popping, e - s);
+#ifdef C4M_GC_LARGE_OBJECTS
+    large_objs_merge(c4m_current_heap, popping);
+#endif
 }
 
 void
@@ -294,25 +633,139 @@ c4m_internal_set_heap(c4m_arena_t *heap)
     c4m_current_heap = heap;
 }
 
+// Worker heaps are for threads that build up shared data alongside
+// other threads (e.g., the compiler's module loader). Objects in one
+// can end up pointed to from the main heap or other workers' heaps,
+// and there's no way to find and fix those pointers if the worker
+// collects. So worker heaps never get collected; when one fills up,
+// we start another, chained to the old one.
+//
+// The main thread makes the heap and hands it to the worker, which
+// installs it with c4m_internal_set_heap(). When the worker is done,
+// it gives back whatever heap it ended up on, and the main thread
+// adopts it: roots the worker registered get added to the main heap,
+// and the next collection copies whatever is still live out of the
+// chain, then frees it. The main thread must not allocate in the
+// meantime, since a collection would move objects out from under the
+// workers.
+c4m_arena_t *
+c4m_internal_new_worker_heap()
+{
+    hatrack_zarray_t *roots  = c4m_current_heap->roots;
+    c4m_arena_t      *result = c4m_new_arena(C4M_DEFAULT_ARENA_SIZE,
+                                        hatrack_zarray_unsafe_copy(roots));
+
+    result->worker_heap       = true;
+    result->worker_roots_base = hatrack_zarray_len(result->roots);
+
+    return result;
+}
+
+static c4m_arena_t *
+extend_worker_heap(c4m_arena_t *full, size_t wordlen)
+{
+    uint64_t     words  = ((uint64_t *)full->heap_end) - ((uint64_t *)full);
+    c4m_arena_t *result = c4m_new_arena(c4m_max(words, (uint64_t)wordlen * 2),
+                                        full->roots);
+
+    result->worker_heap       = true;
+    result->worker_roots_base = full->worker_roots_base;
+    result->prev_heap         = full;
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    result->large_objs = full->large_objs;
+    full->large_objs   = NULL;
+#endif
+
+    return result;
+}
+
+c4m_arena_t *
+c4m_internal_release_worker_heap()
+{
+    c4m_arena_t *result = c4m_current_heap;
+
+    c4m_current_heap = NULL;
+
+    return result;
+}
+
+// Workers lazily register roots for their own statics (caches and
+// such), which would otherwise only ever be scanned on the worker's
+// copy of the root list.
+static void
+adopt_worker_roots(c4m_arena_t *parent, c4m_arena_t *heap)
+{
+    hatrack_zarray_t *roots = heap->roots;
+    uint32_t          n     = hatrack_zarray_len(roots);
+
+    if (n > roots->last_item) {
+        n = roots->last_item;
+    }
+
+    for (uint32_t i = heap->worker_roots_base; i < n; i++) {
+        c4m_gc_root_info_t *ri = hatrack_zarray_cell_address(roots, i);
+
+        if (ri->ptr != NULL) {
+            c4m_arena_register_root(parent, ri->ptr, ri->num_items);
+        }
+    }
+
+    hatrack_zarray_delete(roots);
+}
+
+void
+c4m_internal_adopt_worker_heap(c4m_arena_t *heap)
+{
+    c4m_arena_t *parent = c4m_current_heap;
+
+    if (heap == NULL) {
+        return;
+    }
+
+    adopt_worker_roots(parent, heap);
+
+    while (heap != NULL) {
+        c4m_arena_t *prev = heap->prev_heap;
+
+        heap->roots = NULL;
+#ifdef C4M_GC_LARGE_OBJECTS
+        large_objs_merge(parent, heap);
+#endif
+        heap->prev_heap = parent->adopted;
+        parent->adopted = heap;
+        heap            = prev;
+    }
+}
+
 static void *
-raw_arena_alloc(uint64_t len, void **end)
+raw_arena_alloc(uint64_t len, uint64_t reserve, void **end, void **map_end)
 {
-    // Add two guard pages to sandwich the alloc.
-    size_t total_len  = (size_t)(c4m_page_bytes * 2 + len);
-    char  *full_alloc = mmap(NULL,
+    // Add two guard pages to sandwich the alloc. Any reserved space
+    // goes after the back guard, and stays inaccessible until the
+    // arena grows into it.
+    size_t total_len  = (size_t)(c4m_page_bytes * 2 + len + reserve);
+    int    flags      = MAP_PRIVATE | MAP_ANON;
+
+    if (reserve) {
+        flags |= MAP_NORESERVE;
+    }
+
+    char *full_alloc = mmap(NULL,
                             total_len,
                             PROT_READ | PROT_WRITE,
-                            MAP_PRIVATE | MAP_ANON,
+                            flags,
                             0,
                             0);
 
     char *ret   = full_alloc + c4m_page_bytes;
-    char *guard = full_alloc + total_len - c4m_page_bytes;
+    char *guard = ret + len;
 
     mprotect(full_alloc, c4m_page_bytes, PROT_NONE);
-    mprotect(guard, c4m_page_bytes, PROT_NONE);
+    mprotect(guard, c4m_page_bytes + reserve, PROT_NONE);
 
-    *end = guard;
+    *end     = guard;
+    *map_end = full_alloc + total_len;
 
     c4m_gc_trace(C4M_GCT_MMAP,
                  "arena:mmap:@%p-@%p (%p):%llu",
@@ -326,25 +779,48 @@ raw_arena_alloc(uint64_t len, void **end)
     return ret;
 }
 
-c4m_arena_t *
-c4m_new_arena(size_t num_words, hatrack_zarray_t *roots)
+static inline uint64_t
+arena_round_bytes(uint64_t allocation)
 {
-    // Convert words to bytes.
-    uint64_t allocation = ((uint64_t)num_words) * 8;
-
     // We're okay to over-allocate here. We round up to the nearest
     // power of 2 that is a multiple of the page size.
-
     if (allocation & c4m_page_modulus) {
         allocation = (allocation & c4m_modulus_mask) + c4m_page_bytes;
-        num_words  = allocation >> 3;
     }
 
+    return allocation;
+}
+
+c4m_arena_t *
+c4m_new_arena(size_t num_words, hatrack_zarray_t *roots)
+{
+    return c4m_new_growable_arena(num_words, 0, roots);
+}
+
+// Like c4m_new_arena(), but also reserves (without committing)
+// `reserve_words` of address space past the end, which
+// c4m_grow_arena() can later grow into. The collector uses this for
+// spaces that it copies into, so that it never has to give up
+// part-way through a collection.
+c4m_arena_t *
+c4m_new_growable_arena(size_t            num_words,
+                       size_t            reserve_words,
+                       hatrack_zarray_t *roots)
+{
+    // Convert words to bytes.
+    uint64_t allocation = arena_round_bytes(((uint64_t)num_words) * 8);
+    uint64_t reserve    = arena_round_bytes(((uint64_t)reserve_words) * 8);
+
     void        *arena_end;
-    c4m_arena_t *new_arena = raw_arena_alloc(allocation, &arena_end);
+    void        *map_end;
+    c4m_arena_t *new_arena = raw_arena_alloc(allocation,
+                                             reserve,
+                                             &arena_end,
+                                             &map_end);
 
     new_arena->next_alloc = (c4m_alloc_hdr *)new_arena->data;
     new_arena->heap_end   = arena_end;
+    new_arena->map_end    = map_end;
 
     // new_arena->late_mutations = calloc(sizeof(queue_t), 1);
 
@@ -357,6 +833,38 @@ c4m_new_arena(size_t num_words, hatrack_zarray_t *roots)
     return new_arena;
 }
 
+// Grows an arena in place by at least `bytes`, if it has that much
+// reserved space left. The back guard page moves up with it.
+bool
+c4m_grow_arena(c4m_arena_t *arena, size_t bytes)
+{
+    char *end = (char *)arena->heap_end;
+
+    bytes = arena_round_bytes(bytes);
+
+    if (end + bytes + c4m_page_bytes > (char *)arena->map_end) {
+        return false;
+    }
+
+    if (mprotect(end, bytes, PROT_READ | PROT_WRITE)) {
+        return false;
+    }
+
+    c4m_gc_trace(C4M_GCT_MMAP,
+                 "arena:grow:@%p-@%p (+%zu)",
+                 arena,
+                 end + bytes,
+                 bytes);
+
+    ASAN_POISON_MEMORY_REGION(end, bytes);
+    // Parallel collector threads check this without the lock.
+    __atomic_store_n(&arena->heap_end,
+                     (uint64_t *)(end + bytes),
+                     __ATOMIC_RELEASE);
+
+    return true;
+}
+
 #if defined(C4M_ADD_ALLOC_LOC_INFO)
 #define TRACE_DEBUG_ARGS , debug_file, debug_ln
 
@@ -410,6 +918,16 @@ c4m_gc_resize(void *ptr, size_t len)
 
     assert(hdr->guard = c4m_gc_guard);
 
+#ifdef C4M_GC_LARGE_OBJECTS
+    if (hdr->large) {
+        void *result = resize_large(hdr, len);
+
+        if (result != NULL) {
+            return result;
+        }
+    }
+#endif
+
 #if defined(C4M_ADD_ALLOC_LOC_INFO)
     char *debug_file = hdr->alloc_file;
     int   debug_ln   = hdr->alloc_line;
@@ -417,10 +935,10 @@ c4m_gc_resize(void *ptr, size_t len)
 
     void *result = c4m_alloc_from_arena(&c4m_current_heap,
                                         len,
-                                        hdr->scan_fn,
+                                        c4m_alloc_scan_fn(hdr),
                                         (bool)hdr->finalize TRACE_DEBUG_ARGS);
     if (len > 0) {
-        size_t bytes = ((size_t)(hdr->next_addr - hdr->data)) * 8;
+        size_t bytes = ((size_t)(c4m_alloc_next_addr(hdr) - hdr->data)) * 8;
         memcpy(result, ptr, c4m_min(len, bytes));
     }
 
@@ -453,8 +971,16 @@ c4m_delete_arena(c4m_arena_t *arena)
     // arena->late_mutations);
     // free(arena->late_mutations);
 
+#ifdef C4M_GC_GENERATIONAL
+    if (arena->page_cover != NULL) {
+        munmap(arena->page_cover,
+               arena->page_cover_len * sizeof(c4m_alloc_hdr *));
+        munmap(arena->dirty_cards, arena->page_cover_len);
+    }
+#endif
+
     char *start = ((char *)arena) - c4m_page_bytes;
-    char *end   = (char *)arena->heap_end + c4m_page_bytes;
+    char *end   = (char *)arena->map_end;
 
     c4m_gc_trace(C4M_GCT_MUNMAP, "arena:delete:%p:%p", start, end);
 
@@ -507,9 +1033,24 @@ c4m_arena_remove_root(c4m_arena_t *arena, void *ptr)
 c4m_alloc_hdr *
 c4m_find_alloc(void *ptr)
 {
-    void **p = (void **)(((uint64_t)ptr) & ~0x0000000000000007);
+    void       **p     = (void **)(((uint64_t)ptr) & ~0x0000000000000007);
+    c4m_arena_t *arena = c4m_current_heap;
+
+#ifdef C4M_GC_GENERATIONAL
+    if (arena->old_space != NULL && in_arena(arena->old_space, ptr)) {
+        arena = arena->old_space;
+    }
+#endif
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    int64_t ix = c4m_large_obj_index(arena->large_objs, ptr);
+
+    if (ix != -1) {
+        return arena->large_objs->objs[ix];
+    }
+#endif
 
-    while (p > (void **)c4m_current_heap) {
+    while (p > (void **)arena) {
         if (*p == (void *)c4m_gc_guard) {
             return (c4m_alloc_hdr *)p;
         }
@@ -634,11 +1175,27 @@ c4m_alloc_from_arena(c4m_arena_t   **arena_ptr,
     len = c4m_round_up_to_given_power_of_2(C4M_FORCED_ALIGNMENT, len);
 
     size_t         wordlen = len / 8;
-    c4m_alloc_hdr *raw     = arena->next_alloc;
-    c4m_alloc_hdr *next    = (c4m_alloc_hdr *)&(raw->data[wordlen]);
+    c4m_alloc_hdr *raw;
+    c4m_alloc_hdr *next;
+
+#ifdef C4M_GC_LARGE_OBJECTS
+    if (len >= C4M_GC_LARGE_OBJECT_BYTES) {
+        raw  = alloc_large(arena, len);
+        next = (c4m_alloc_hdr *)&(raw->data[wordlen]);
+        goto init_header;
+    }
+#endif
+
+    raw  = arena->next_alloc;
+    next = (c4m_alloc_hdr *)&(raw->data[wordlen]);
 
     if (((uint64_t *)next) > arena->heap_end) {
-        arena      = c4m_collect_arena(arena);
+        if (arena->worker_heap) {
+            arena = extend_worker_heap(arena, wordlen);
+        }
+        else {
+            arena = c4m_collect_arena(arena);
+        }
         *arena_ptr = arena;
 
         raw  = arena->next_alloc;
@@ -665,12 +1222,18 @@ c4m_alloc_from_arena(c4m_arena_t   **arena_ptr,
     ASAN_UNPOISON_MEMORY_REGION(raw, ((char *)next - (char *)raw));
     arena->alloc_count++;
     arena->next_alloc = next;
-    raw->guard        = c4m_gc_guard;
-    raw->arena        = arena;
-    raw->next_addr    = (uint64_t *)arena->next_alloc;
+
+#ifdef C4M_GC_LARGE_OBJECTS
+init_header:
+#endif
+    raw->guard = c4m_gc_guard;
+#ifndef C4M_GC_COMPACT_HDR
+    raw->arena     = arena;
+    raw->next_addr = (uint64_t *)next;
+#endif
     raw->alloc_len    = len;
     raw->request_len  = orig_len;
-    raw->scan_fn      = scan_fn;
+    c4m_alloc_set_scan_fn(raw, scan_fn);
 
 #ifdef C4M_FULL_MEMCHECK
     uint64_t *end_guard_addr = &raw->data[wordlen - 2];
@@ -733,7 +1296,7 @@ c4m_alloc_from_arena(c4m_arena_t   **arena_ptr,
     c4m_gc_trace(C4M_GCT_ALLOC,
                  "new_record:%p-%p:data:%p:len:%zu:arena:%p-%p (%s:%d)",
                  raw,
-                 raw->next_addr,
+                 c4m_alloc_next_addr(raw),
                  raw->data,
                  len,
                  arena,
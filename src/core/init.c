@@ -92,6 +92,23 @@ c4m_get_env(c4m_utf8_t *name)
     return hatrack_dict_get(cached_environment_vars, name, NULL);
 }
 
+// Changes what c4m_get_env() gives back for `name` from here on, and
+// the process environment to match. A NULL value removes the name.
+void
+c4m_set_env(c4m_utf8_t *name, c4m_utf8_t *value)
+{
+    c4m_get_env(name);
+
+    if (value == NULL) {
+        hatrack_dict_remove(cached_environment_vars, name);
+        unsetenv(name->data);
+    }
+    else {
+        hatrack_dict_put(cached_environment_vars, name, value);
+        setenv(name->data, value->data, 1);
+    }
+}
+
 c4m_dict_t *
 c4m_environment(void)
 {
@@ -319,6 +336,7 @@ c4m_init(int argc, char **argv, char **envp)
     c4m_backtrace_init(argv[0]);
     c4m_gc_openssl();
     c4m_initialize_gc();
+    c4m_init_format_cache();
     c4m_gc_register_root(&cached_environment_vars, 1);
     c4m_gc_register_root(&con4m_root, 1);
     c4m_gc_register_root(&con4m_path, 1);
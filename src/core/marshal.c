@@ -94,39 +94,301 @@ c4m_unmarshal_i16(c4m_stream_t *s)
     return result;
 }
 
+// Unsigned LEB128: seven bits per byte, low bits first, with the top
+// bit set on every byte but the last.
+void
+c4m_marshal_varint(uint64_t n, c4m_stream_t *s)
+{
+    char buf[10];
+    int  i = 0;
+
+    while (n >= 0x80) {
+        buf[i++] = (char)(n | 0x80);
+        n >>= 7;
+    }
+
+    buf[i++] = (char)n;
+
+    c4m_stream_raw_write(s, i, buf);
+}
+
+uint64_t
+c4m_unmarshal_varint(c4m_stream_t *s)
+{
+    uint64_t result = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+
+        if ((uint64_t)c4m_stream_raw_read(s, 1, (char *)&byte) != 1) {
+            C4M_CRAISE("Invalid marshal format (truncated varint)");
+        }
+
+        result |= ((uint64_t)(byte & 0x7f)) << shift;
+
+        if (!(byte & 0x80)) {
+            return result;
+        }
+    }
+
+    C4M_CRAISE("Invalid marshal format (varint too long)");
+}
+
+// Memo IDs were 64 bits in V1; type IDs and counts inside compact
+// types were 16.
+static inline void
+marshal_vu64(uint64_t n, c4m_stream_t *s, c4m_memo_t *memos)
+{
+    if (memos->version == C4M_MARSHAL_V1) {
+        c4m_marshal_u64(n, s);
+    }
+    else {
+        c4m_marshal_varint(n, s);
+    }
+}
+
+static inline uint64_t
+unmarshal_vu64(c4m_stream_t *s, c4m_memo_t *memos)
+{
+    if (memos->version == C4M_MARSHAL_V1) {
+        return c4m_unmarshal_u64(s);
+    }
+
+    return c4m_unmarshal_varint(s);
+}
+
+static inline void
+marshal_vu16(uint16_t n, c4m_stream_t *s, c4m_memo_t *memos)
+{
+    if (memos->version == C4M_MARSHAL_V1) {
+        c4m_marshal_u16(n, s);
+    }
+    else {
+        c4m_marshal_varint(n, s);
+    }
+}
+
+static inline uint64_t
+unmarshal_vu16(c4m_stream_t *s, c4m_memo_t *memos)
+{
+    if (memos->version == C4M_MARSHAL_V1) {
+        return c4m_unmarshal_u16(s);
+    }
+
+    return c4m_unmarshal_varint(s);
+}
+
+// Memo tables; see dt_marshal.h.
+#define C4M_MEMO_MIN_SLOTS 64
+
+static _Atomic uint64_t memo_epoch = 0;
+static pthread_once_t   memo_once  = PTHREAD_ONCE_INIT;
+
+static void
+memo_note_collect(void)
+{
+    atomic_fetch_add(&memo_epoch, 1);
+}
+
+static void
+memo_setup(void)
+{
+    c4m_gc_register_collect_fn(memo_note_collect);
+}
+
+static void
+c4m_memo_gc_bits(uint64_t *bitfield, c4m_memo_t *memos)
+{
+    c4m_mark_raw_to_addr(bitfield, memos, &memos->ids);
+}
+
+static inline c4m_memo_t *
+alloc_memos(void)
+{
+    pthread_once(&memo_once, memo_setup);
+
+    c4m_memo_t *result = c4m_gc_raw_alloc(sizeof(c4m_memo_t),
+                                          (c4m_mem_scan_fn)c4m_memo_gc_bits);
+
+    result->slots   = C4M_MEMO_MIN_SLOTS;
+    result->version = C4M_MARSHAL_VERSION;
+    result->addrs = c4m_gc_raw_alloc(result->slots * sizeof(void *),
+                                     C4M_GC_SCAN_ALL);
+
+    return result;
+}
+
+c4m_memo_t *
+c4m_alloc_marshal_memos(void)
+{
+    c4m_memo_t *result = alloc_memos();
+
+    result->ids   = c4m_gc_raw_alloc(result->slots * sizeof(uint64_t),
+                                   C4M_GC_SCAN_NONE);
+    result->epoch = atomic_load(&memo_epoch);
+
+    return result;
+}
+
+c4m_memo_t *
+c4m_alloc_unmarshal_memos(void)
+{
+    return alloc_memos();
+}
+
+static inline uint64_t
+memo_bucket(c4m_memo_t *memos, void *addr)
+{
+    // Allocations are 16-byte aligned, so the low bits say nothing.
+    uint64_t h = ((uint64_t)addr >> 4) * 0x9e3779b97f4a7c15ULL;
+
+    return (h ^ (h >> 29)) & (memos->slots - 1);
+}
+
+static void
+memo_insert(c4m_memo_t *memos, void *addr, uint64_t id)
+{
+    uint64_t mask = memos->slots - 1;
+    uint64_t i    = memo_bucket(memos, addr);
+
+    while (memos->addrs[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+
+    memos->addrs[i] = addr;
+    memos->ids[i]   = id;
+}
+
+// Re-buckets everything into a table `slots` long. The epoch is read
+// after allocating, since allocating is what can trigger a collection.
+static void
+memo_rebuild(c4m_memo_t *memos, uint64_t slots)
+{
+    void    **old_addrs = memos->addrs;
+    uint64_t *old_ids   = memos->ids;
+    uint64_t  old_slots = memos->slots;
+    void    **addrs     = c4m_gc_raw_alloc(slots * sizeof(void *),
+                                    C4M_GC_SCAN_ALL);
+    uint64_t *ids       = c4m_gc_raw_alloc(slots * sizeof(uint64_t),
+                                     C4M_GC_SCAN_NONE);
+
+    memos->addrs = addrs;
+    memos->ids   = ids;
+    memos->slots = slots;
+    memos->epoch = atomic_load(&memo_epoch);
+
+    for (uint64_t i = 0; i < old_slots; i++) {
+        if (old_addrs[i] != NULL) {
+            memo_insert(memos, old_addrs[i], old_ids[i]);
+        }
+    }
+}
+
+static inline void
+memo_catch_up(c4m_memo_t *memos)
+{
+    if (memos->epoch != atomic_load(&memo_epoch)) {
+        memo_rebuild(memos, memos->slots);
+    }
+}
+
+uint64_t
+c4m_memo_get_id(c4m_memo_t *memos, void *addr)
+{
+    memo_catch_up(memos);
+
+    uint64_t mask = memos->slots - 1;
+    uint64_t i    = memo_bucket(memos, addr);
+
+    while (memos->addrs[i] != NULL) {
+        if (memos->addrs[i] == addr) {
+            return memos->ids[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    return 0;
+}
+
+// Keeps the table at most half full.
+void
+c4m_memo_put_id(c4m_memo_t *memos, void *addr, uint64_t id)
+{
+    if ((memos->count + 1) * 2 > memos->slots) {
+        memo_rebuild(memos, memos->slots * 2);
+    }
+    else {
+        memo_catch_up(memos);
+    }
+
+    memo_insert(memos, addr, id);
+    memos->count++;
+}
+
+void *
+c4m_memo_get_addr(c4m_memo_t *memos, uint64_t id)
+{
+    if (id > memos->count) {
+        return NULL;
+    }
+
+    return memos->addrs[id];
+}
+
+// IDs are handed out in the same order they're first written, so the
+// only new ID we can legitimately see is the next one.
+void
+c4m_memo_put_addr(c4m_memo_t *memos, uint64_t id, void *addr)
+{
+    if (id != memos->count + 1) {
+        C4M_CRAISE("Invalid marshal format (got out-of-order memo ID)");
+    }
+
+    if (id >= memos->slots) {
+        void **old = memos->addrs;
+
+        memos->addrs = c4m_gc_raw_alloc(memos->slots * 2 * sizeof(void *),
+                                        C4M_GC_SCAN_ALL);
+        memcpy(memos->addrs, old, memos->slots * sizeof(void *));
+        memos->slots *= 2;
+    }
+
+    memos->addrs[id] = addr;
+    memos->count     = id;
+}
+
 void
 c4m_marshal_unmanaged_object(void          *addr,
                              c4m_stream_t  *s,
-                             c4m_dict_t    *memos,
+                             c4m_memo_t    *memos,
                              int64_t       *mid,
                              c4m_marshal_fn fn)
 {
     if (addr == NULL) {
-        c4m_marshal_u64(0ull, s);
+        marshal_vu64(0ull, s, memos);
         return;
     }
 
-    bool    found = false;
-    int64_t memo  = (int64_t)hatrack_dict_get(memos, addr, &found);
+    int64_t memo = (int64_t)c4m_memo_get_id(memos, addr);
 
-    if (found) {
-        c4m_marshal_u64(memo, s);
+    if (memo) {
+        marshal_vu64(memo, s, memos);
         return;
     }
 
     memo = *mid;
     *mid = memo + 1;
-    c4m_marshal_u64(memo, s);
-    hatrack_dict_put(memos, addr, (void *)memo);
+    marshal_vu64(memo, s, memos);
+    c4m_memo_put_id(memos, addr, memo);
     (*fn)(addr, s, memos, mid);
 }
 
 void
-c4m_marshal_compact_type(c4m_type_t *t, c4m_stream_t *s)
+c4m_marshal_compact_type(c4m_type_t *t, c4m_stream_t *s, c4m_memo_t *memos)
 {
     uint16_t param_count;
 
-    c4m_marshal_u16(t->details->base_type->typeid, s);
+    marshal_vu16(t->details->base_type->typeid, s, memos);
     c4m_marshal_u64(t->typeid, s);
     switch (t->details->base_type->dt_kind) {
     case C4M_DT_KIND_nil:
@@ -146,14 +408,15 @@ c4m_marshal_compact_type(c4m_type_t *t, c4m_stream_t *s)
     case C4M_DT_KIND_tuple:
     case C4M_DT_KIND_object:
         param_count = (uint16_t)c4m_len(t->details->items);
-        c4m_marshal_u16(param_count, s);
+        marshal_vu16(param_count, s, memos);
         for (int i = 0; i < param_count; i++) {
             c4m_marshal_compact_type(c4m_list_get(t->details->items, i, NULL),
-                                     s);
+                                     s,
+                                     memos);
         }
         return;
     case C4M_DT_KIND_box:
-        c4m_marshal_compact_type((c4m_type_t *)t->details->tsi, s);
+        c4m_marshal_compact_type((c4m_type_t *)t->details->tsi, s, memos);
         return;
     default:
         c4m_unreachable();
@@ -161,14 +424,20 @@ c4m_marshal_compact_type(c4m_type_t *t, c4m_stream_t *s)
 }
 
 c4m_type_t *
-c4m_unmarshal_compact_type(c4m_stream_t *s)
+c4m_unmarshal_compact_type(c4m_stream_t *s, c4m_memo_t *memos)
 {
-    c4m_builtin_t  base = (c4m_builtin_t)c4m_unmarshal_u16(s);
+    uint64_t       base = unmarshal_vu16(s, memos);
     uint64_t       tid  = c4m_unmarshal_u64(s);
     c4m_type_t    *result;
     uint8_t        flags = 0;
     uint16_t       param_count;
-    c4m_dt_info_t *dtinfo = (c4m_dt_info_t *)&c4m_base_type_info[base];
+    c4m_dt_info_t *dtinfo;
+
+    if (base >= C4M_NUM_BUILTIN_DTS) {
+        C4M_CRAISE("Invalid marshal format (got invalid data type ID)");
+    }
+
+    dtinfo = (c4m_dt_info_t *)&c4m_base_type_info[base];
 
     switch (dtinfo->dt_kind) {
     case C4M_DT_KIND_nil:
@@ -195,19 +464,25 @@ c4m_unmarshal_compact_type(c4m_stream_t *s)
     case C4M_DT_KIND_dict:
     case C4M_DT_KIND_tuple:
     case C4M_DT_KIND_object:
-        param_count            = c4m_unmarshal_u16(s);
+        param_count            = (uint16_t)unmarshal_vu16(s, memos);
         result                 = c4m_new(c4m_type_typespec(), NULL, NULL, 1UL);
         result->typeid         = tid;
         result->details->flags = flags;
         result->details->items = c4m_list(c4m_type_typespec());
 
         for (int i = 0; i < param_count; i++) {
-            c4m_list_append(result->details->items, c4m_unmarshal_compact_type(s));
+            c4m_list_append(result->details->items,
+                            c4m_unmarshal_compact_type(s, memos));
         }
+
+        // The stored ID came from whatever hash function the writer
+        // used; recompute it so it matches types built here.
+        result->details->base_type = dtinfo;
+        c4m_calculate_type_hash(result);
         break;
     case C4M_DT_KIND_box:
         result                     = c4m_new(c4m_type_typespec(), C4M_T_BOX);
-        result->details->tsi       = c4m_unmarshal_compact_type(s);
+        result->details->tsi       = c4m_unmarshal_compact_type(s, memos);
         result->details->base_type = (c4m_dt_info_t *)&c4m_base_type_info[base];
         c4m_calculate_type_hash(result);
         break;
@@ -221,21 +496,20 @@ c4m_unmarshal_compact_type(c4m_stream_t *s)
 }
 
 void
-c4m_sub_marshal(c4m_obj_t obj, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid)
+c4m_sub_marshal(c4m_obj_t obj, c4m_stream_t *s, c4m_memo_t *memos, int64_t *mid)
 {
     if (obj == NULL) {
-        c4m_marshal_u64(0ull, s);
+        marshal_vu64(0ull, s, memos);
         return;
     }
 
-    bool    found = 0;
-    int64_t memo  = (int64_t)hatrack_dict_get(memos, obj, &found);
+    int64_t memo = (int64_t)c4m_memo_get_id(memos, obj);
 
     // If we have already processed this object, we will already have
     // a memo, so we write out the ID for the memo only, and do not
     // duplicate the contents.
-    if (found) {
-        c4m_marshal_u64(memo, s);
+    if (memo) {
+        marshal_vu64(memo, s, memos);
         return;
     }
 
@@ -243,8 +517,8 @@ c4m_sub_marshal(c4m_obj_t obj, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid)
     // we also need to add it to the dict.
     memo = *mid;
     *mid = memo + 1;
-    c4m_marshal_u64(memo, s);
-    hatrack_dict_put(memos, obj, (void *)memo);
+    marshal_vu64(memo, s, memos);
+    c4m_memo_put_id(memos, obj, memo);
 
     c4m_base_obj_t *hdr = c4m_object_header(obj);
     c4m_marshal_fn  ptr;
@@ -261,10 +535,10 @@ c4m_sub_marshal(c4m_obj_t obj, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid)
 
     // This captures the actual index of the base type.
     uint16_t diff = (uint16_t)(hdr->base_data_type - &c4m_base_type_info[0]);
-    c4m_marshal_u16(diff, s);
+    marshal_vu16(diff, s, memos);
 
     // And now, the concrete type.
-    c4m_marshal_compact_type(hdr->concrete_type, s);
+    c4m_marshal_compact_type(hdr->concrete_type, s, memos);
 
     (*ptr)(obj, s, memos, mid);
     return;
@@ -273,59 +547,54 @@ c4m_sub_marshal(c4m_obj_t obj, c4m_stream_t *s, c4m_dict_t *memos, int64_t *mid)
 void *
 c4m_unmarshal_unmanaged_object(size_t           len,
                                c4m_stream_t    *s,
-                               c4m_dict_t      *memos,
+                               c4m_memo_t      *memos,
                                c4m_unmarshal_fn fn)
 {
-    bool     found = false;
     uint64_t memo;
     void    *addr;
 
-    memo = c4m_unmarshal_u64(s);
+    memo = unmarshal_vu64(s, memos);
 
     if (!memo) {
         return NULL;
     }
 
-    addr = hatrack_dict_get(memos, (void *)memo, &found);
+    addr = c4m_memo_get_addr(memos, memo);
 
-    if (found) {
+    if (addr != NULL) {
         return addr;
     }
 
     // TODO: fix this; it needs to marshal the handler.
     addr = c4m_gc_raw_alloc(len, C4M_GC_SCAN_ALL);
-    hatrack_dict_put(memos, (void *)memo, addr);
+    c4m_memo_put_addr(memos, memo, addr);
 
     (*fn)(addr, s, memos);
 
     return addr;
 }
 
-c4m_obj_t
-c4m_sub_unmarshal(c4m_stream_t *s, c4m_dict_t *memos)
+static c4m_obj_t
+unmarshal_memo(c4m_stream_t *s, c4m_memo_t *memos, uint64_t memo)
 {
-    bool            found = false;
-    uint64_t        memo;
     c4m_base_obj_t *obj;
 
-    memo = c4m_unmarshal_u64(s);
-
     if (!memo) {
         return NULL;
     }
 
-    obj = hatrack_dict_get(memos, (void *)memo, &found);
+    obj = c4m_memo_get_addr(memos, memo);
 
-    if (found) {
+    if (obj != NULL) {
         return obj->data;
     }
 
-    c4m_builtin_t    base_type_id = (c4m_builtin_t)c4m_unmarshal_u16(s);
+    uint64_t         base_type_id = unmarshal_vu16(s, memos);
     c4m_dt_info_t   *dt_entry;
     uint64_t         alloc_len;
     c4m_unmarshal_fn ptr;
 
-    if (base_type_id > C4M_NUM_BUILTIN_DTS) {
+    if (base_type_id >= C4M_NUM_BUILTIN_DTS) {
         C4M_CRAISE("Invalid marshal format (got invalid data type ID)");
     }
     dt_entry  = (c4m_dt_info_t *)&c4m_base_type_info[base_type_id];
@@ -336,10 +605,10 @@ c4m_sub_unmarshal(c4m_stream_t *s, c4m_dict_t *memos)
 
     // Now that we've allocated the object, we need to fill in the memo
     // before we unmarshal, because cycles happen.
-    hatrack_dict_put(memos, (void *)memo, obj);
+    c4m_memo_put_addr(memos, memo, obj);
 
     obj->base_data_type = dt_entry;
-    obj->concrete_type  = c4m_unmarshal_compact_type(s);
+    obj->concrete_type  = c4m_unmarshal_compact_type(s, memos);
 
     ptr = (c4m_unmarshal_fn)dt_entry->vtable->methods[C4M_BI_UNMARSHAL];
 
@@ -354,10 +623,16 @@ c4m_sub_unmarshal(c4m_stream_t *s, c4m_dict_t *memos)
     return obj->data;
 }
 
+c4m_obj_t
+c4m_sub_unmarshal(c4m_stream_t *s, c4m_memo_t *memos)
+{
+    return unmarshal_memo(s, memos, unmarshal_vu64(s, memos));
+}
+
 thread_local int c4m_marshaling = 0;
 
-void
-c4m_marshal(c4m_obj_t obj, c4m_stream_t *s)
+static void
+marshal_top(c4m_obj_t obj, c4m_stream_t *s, uint8_t flags)
 {
     if (c4m_marshaling) {
         C4M_CRAISE(
@@ -369,12 +644,39 @@ c4m_marshal(c4m_obj_t obj, c4m_stream_t *s)
 
     // Start w/ 1 as 0 represents the null pointer.
     int64_t     next_memo = 1;
-    c4m_dict_t *memos     = c4m_alloc_marshal_memos();
+    c4m_memo_t *memos     = c4m_alloc_marshal_memos();
+
+    c4m_marshal_u8(C4M_MARSHAL_MAGIC, s);
+    c4m_marshal_u8(C4M_MARSHAL_VERSION, s);
+    c4m_marshal_u8(flags, s);
+
+    if (flags & C4M_MARSHAL_F_COMPRESSED) {
+        c4m_buf_t    *raw = c4m_buffer_empty();
+        c4m_stream_t *rs  = c4m_buffer_outstream(raw, false);
+
+        c4m_sub_marshal(obj, rs, memos, &next_memo);
+        c4m_stream_close(rs);
+        c4m_compress_to_stream(raw, s);
+    }
+    else {
+        c4m_sub_marshal(obj, s, memos, &next_memo);
+    }
 
-    c4m_sub_marshal(obj, s, memos, &next_memo);
     c4m_marshaling = 0;
 }
 
+void
+c4m_marshal(c4m_obj_t obj, c4m_stream_t *s)
+{
+    marshal_top(obj, s, 0);
+}
+
+void
+c4m_marshal_compressed(c4m_obj_t obj, c4m_stream_t *s)
+{
+    marshal_top(obj, s, C4M_MARSHAL_F_COMPRESSED);
+}
+
 c4m_obj_t
 c4m_unmarshal(c4m_stream_t *s)
 {
@@ -384,12 +686,53 @@ c4m_unmarshal(c4m_stream_t *s)
             "call c4m_sub_unmarshal.");
     }
 
-    c4m_dict_t *memos = c4m_alloc_unmarshal_memos();
-    c4m_obj_t   result;
+    c4m_memo_t   *memos = c4m_alloc_unmarshal_memos();
+    c4m_stream_t *raw   = NULL;
+    c4m_obj_t     result;
+    uint8_t       first;
+
+    first = c4m_unmarshal_u8(s);
+
+    if (first == C4M_MARSHAL_MAGIC) {
+        uint8_t version = c4m_unmarshal_u8(s);
+        uint8_t flags   = c4m_unmarshal_u8(s);
+
+        if (version < C4M_MARSHAL_V1 || version > C4M_MARSHAL_VERSION) {
+            C4M_CRAISE("Unsupported marshal format version");
+        }
+
+        memos->version = version;
+
+        // Decompress before marking ourselves busy, so that bad
+        // compressed data doesn't leave c4m_marshaling set.
+        if (flags & C4M_MARSHAL_F_COMPRESSED) {
+            raw = c4m_buffer_instream(c4m_decompress_from_stream(s));
+        }
+    }
 
     c4m_marshaling = 1;
 
-    result = c4m_sub_unmarshal(s, memos);
+    if (first != C4M_MARSHAL_MAGIC) {
+        // No header, so this is V1, and we've just read the low byte
+        // of the top object's 64-bit memo ID (which is 0 or 1, so
+        // can't be confused with the magic byte).
+        uint8_t  bytes[8] = {first};
+        uint64_t memo;
+
+        c4m_stream_raw_read(s, 7, (char *)&bytes[1]);
+        memcpy(&memo, bytes, sizeof(memo));
+        little_64(memo);
+
+        memos->version = C4M_MARSHAL_V1;
+        result         = unmarshal_memo(s, memos, memo);
+    }
+    else if (raw != NULL) {
+        result = c4m_sub_unmarshal(raw, memos);
+        c4m_stream_close(raw);
+    }
+    else {
+        result = c4m_sub_unmarshal(s, memos);
+    }
 
     c4m_marshaling = 0;
 
@@ -443,7 +443,9 @@ c4m_obj_t
 _c4m_new(c4m_type_t *type, ...)
 #endif
 {
-    type = c4m_type_resolve(type);
+    if (!type->resolved) {
+        type = c4m_type_resolve(type);
+    }
 
     c4m_base_obj_t  *obj;
     c4m_obj_t        result;
@@ -187,10 +187,22 @@ type_end_log()
 
 #define BASE_ALLOC_SZ (sizeof(c4m_alloc_hdr) + sizeof(c4m_base_obj_t))
 
+// Type IDs are the low 64 bits of an XXH3-128 hash over a stream of
+// words describing the type's structure. Nothing here needs a
+// cryptographic hash, just one that doesn't collide by accident, and
+// this way hashing a type allocates nothing in the common case.
+#define TYPE_HASH_INLINE_WORDS 32
+#define TYPE_HASH_INLINE_TVARS 8
+
 typedef struct {
-    c4m_sha_t  *sha;
-    c4m_dict_t *memos;
-    int         tv_count;
+    uint64_t *words;
+    uint64_t *tvars;
+    int       num_words;
+    int       word_cap;
+    int       tv_count;
+    int       tv_cap;
+    uint64_t  inline_words[TYPE_HASH_INLINE_WORDS];
+    uint64_t  inline_tvars[TYPE_HASH_INLINE_TVARS];
 } type_hash_ctx;
 
 static uint64_t            c4m_default_next_typevar(void);
@@ -330,38 +342,97 @@ setup_list_of_types()
 //
 // We take the lookup opportunity to add ourselves to the type store
 // if we aren't already there.c4m_type_t *
+//
+// Concrete types never change once hashed, so once we've found one in
+// the store we mark it, and don't go back to the store for it again.
+static inline c4m_type_t *
+mark_if_resolved(c4m_type_t *node)
+{
+    if (typeid_is_concrete(node->typeid)) {
+        node->resolved = true;
+    }
+
+    return node;
+}
+
 c4m_type_t *
 c4m_type_resolve(c4m_type_t *node)
 {
-    c4m_type_t *next;
-
-    if (!node->typeid) {
+    if (node->resolved || !node->typeid) {
         return node;
     }
 
     if (c4m_universe_add(&c4m_type_universe, node)) {
-        return node;
+        return mark_if_resolved(node);
     }
 
-    while (true) {
-        next = c4m_universe_get(&c4m_type_universe, node->typeid);
+    return mark_if_resolved(c4m_universe_find(&c4m_type_universe, node));
+}
 
-        if (!next) {
-            return node;
-        }
+void
+c4m_lock_type(c4m_type_t *t)
+{
+    t->details->flags &= C4M_FN_TY_LOCK;
+}
 
-        if (next == node || node->typeid == next->typeid) {
-            return next;
-        }
+static inline void
+type_hash_ctx_init(type_hash_ctx *ctx)
+{
+    ctx->words     = ctx->inline_words;
+    ctx->tvars     = ctx->inline_tvars;
+    ctx->num_words = 0;
+    ctx->word_cap  = TYPE_HASH_INLINE_WORDS;
+    ctx->tv_count  = 0;
+    ctx->tv_cap    = TYPE_HASH_INLINE_TVARS;
+}
 
-        node = next;
+static uint64_t *
+grow_words(uint64_t *words, int len, int *cap)
+{
+    uint64_t *result = c4m_gc_array_value_alloc(uint64_t, *cap * 2);
+
+    memcpy(result, words, len * sizeof(uint64_t));
+    *cap *= 2;
+
+    return result;
+}
+
+static inline void
+type_hash_word(type_hash_ctx *ctx, uint64_t word)
+{
+    if (ctx->num_words == ctx->word_cap) {
+        ctx->words = grow_words(ctx->words, ctx->num_words, &ctx->word_cap);
     }
+
+    ctx->words[ctx->num_words++] = word;
 }
 
-void
-c4m_lock_type(c4m_type_t *t)
+static inline uint64_t
+type_hash_finish(type_hash_ctx *ctx)
 {
-    t->details->flags &= C4M_FN_TY_LOCK;
+    XXH128_hash_t h = XXH3_128bits(ctx->words,
+                                   ctx->num_words * sizeof(uint64_t));
+
+    return h.low64;
+}
+
+// Type variables get numbered in the order we first see them.
+static uint64_t
+type_hash_tvar_num(type_hash_ctx *ctx, uint64_t tid)
+{
+    for (int i = 0; i < ctx->tv_count; i++) {
+        if (ctx->tvars[i] == tid) {
+            return i + 1;
+        }
+    }
+
+    if (ctx->tv_count == ctx->tv_cap) {
+        ctx->tvars = grow_words(ctx->tvars, ctx->tv_count, &ctx->tv_cap);
+    }
+
+    ctx->tvars[ctx->tv_count++] = tid;
+
+    return ctx->tv_count;
 }
 
 static void
@@ -380,28 +451,19 @@ internal_type_hash(c4m_type_t *node, type_hash_ctx *ctx)
     c4m_type_info_t *deets = node->details;
     uint64_t         num_tvars;
 
-    c4m_sha_int_update(ctx->sha, (uint64_t)deets->base_type->typeid);
-    c4m_sha_int_update(ctx->sha, (uint64_t)node->details->base_type->dt_kind);
+    type_hash_word(ctx, (uint64_t)deets->base_type->typeid);
+    type_hash_word(ctx, (uint64_t)node->details->base_type->dt_kind);
 
     switch (node->details->base_type->dt_kind) {
         // Currently not hashing for future things.
     case C4M_DT_KIND_func:
-        c4m_sha_int_update(ctx->sha, (uint64_t)deets->flags);
+        type_hash_word(ctx, (uint64_t)deets->flags);
         break;
     case C4M_DT_KIND_type_var:
-        num_tvars = (uint64_t)hatrack_dict_get(ctx->memos,
-                                               (void *)node->typeid,
-                                               NULL);
-
-        if (num_tvars == 0) {
-            num_tvars = ++ctx->tv_count;
-            hatrack_dict_put(ctx->memos,
-                             (void *)node->typeid,
-                             (void *)num_tvars);
-        }
+        num_tvars = type_hash_tvar_num(ctx, node->typeid);
 
-        c4m_sha_int_update(ctx->sha, num_tvars);
-        c4m_sha_int_update(ctx->sha, node->typeid);
+        type_hash_word(ctx, num_tvars);
+        type_hash_word(ctx, node->typeid);
         break;
     case C4M_DT_KIND_primitive:
     case C4M_DT_KIND_box:
@@ -417,7 +479,7 @@ internal_type_hash(c4m_type_t *node, type_hash_ctx *ctx)
 
     size_t n = c4m_list_len(deets->items);
 
-    c4m_sha_int_update(ctx->sha, n);
+    type_hash_word(ctx, n);
 
     for (size_t i = 0; i < n; i++) {
         c4m_type_t *t = c4m_list_get(deets->items, i, NULL);
@@ -433,7 +495,6 @@ type_hash_and_dedupe(c4m_type_t **nodeptr)
     // someone requests a concrete type, we keep yielding shared
     // instances, since there is no more resolution that can happen.
 
-    c4m_buf_t    *buf;
     uint64_t      result;
     c4m_type_t   *node = *nodeptr;
     type_hash_ctx ctx;
@@ -446,23 +507,16 @@ type_hash_and_dedupe(c4m_type_t **nodeptr)
         return c4m_universe_attempt_to_add(&c4m_type_universe, node)->typeid;
 
     case C4M_DT_KIND_box:
-        ctx.sha      = c4m_new(c4m_type_hash());
-        ctx.tv_count = 0;
-        ctx.memos    = c4m_new_unmanaged_dict(HATRACK_DICT_KEY_TYPE_PTR,
-                                           false,
-                                           false);
+        type_hash_ctx_init(&ctx);
 
         c4m_type_info_t *deets = node->details;
         c4m_type_t      *base  = (c4m_type_t *)deets->tsi;
 
-        c4m_sha_int_update(ctx.sha, (uint64_t)deets->base_type->dt_kind);
+        type_hash_word(&ctx, (uint64_t)deets->base_type->dt_kind);
         deets = base->details;
-        c4m_sha_int_update(ctx.sha, (uint64_t)deets->base_type->typeid);
+        type_hash_word(&ctx, (uint64_t)deets->base_type->typeid);
 
-        buf    = c4m_sha_finish(ctx.sha);
-        result = ((uint64_t *)buf->data)[0];
-
-        little_64(result);
+        result = type_hash_finish(&ctx);
         result &= ~(1LLU << 63);
 
         node->typeid = result;
@@ -473,19 +527,13 @@ type_hash_and_dedupe(c4m_type_t **nodeptr)
         c4m_universe_put(&c4m_type_universe, node);
         return node->typeid;
     default:
-        node->typeid = 0;
-        ctx.sha      = c4m_new(c4m_type_hash());
-        ctx.tv_count = 0;
-        ctx.memos    = c4m_new_unmanaged_dict(HATRACK_DICT_KEY_TYPE_PTR,
-                                           false,
-                                           false);
+        node->typeid   = 0;
+        node->resolved = false;
+        type_hash_ctx_init(&ctx);
 
         internal_type_hash(node, &ctx);
 
-        buf    = c4m_sha_finish(ctx.sha);
-        result = ((uint64_t *)buf->data)[0];
-
-        little_64(result);
+        result = type_hash_finish(&ctx);
 
         if (ctx.tv_count == 0) {
             result &= ~(1LLU << 63);
@@ -1017,8 +1065,118 @@ unify_tv_with_concrete_type(c4m_type_t *t1,
     return t2;
 }
 
+// Cache of unification results for pairs of concrete types. The type
+// checker unifies the same few pairs of concrete types over and over,
+// and every time, that means re-hashing both sides before finding
+// out they're the same (or aren't). Since concrete types never
+// change, the answer for a pair of type IDs never does either.
+//
+// We only consult the cache when both sides are marked resolved,
+// since that's when we know their type IDs are current. Like the
+// hash-consing cache, it's direct-mapped and shared by all threads;
+// entries are immutable and installed with a single pointer store,
+// so a racing overwrite can only ever cause a miss.
+#define UNIFY_CACHE_SLOTS 1024
+
+typedef struct {
+    c4m_type_t     *result;
+    c4m_type_hash_t t1;
+    c4m_type_hash_t t2;
+} unify_cache_entry_t;
+
+static unify_cache_entry_t *unify_cache[UNIFY_CACHE_SLOTS];
+
+static thread_local uint64_t unify_steps      = 0;
+static thread_local uint64_t unify_cache_hits = 0;
+
+static void
+unify_cache_entry_gc_bits(uint64_t *bitfield, unify_cache_entry_t *entry)
+{
+    c4m_mark_raw_to_addr(bitfield, entry, &entry->result);
+}
+
+static inline uint64_t
+unify_cache_slot(c4m_type_hash_t t1, c4m_type_hash_t t2)
+{
+    uint64_t h = (t1 * 0x9e3779b97f4a7c15ULL) ^ t2;
+
+    h *= 0x9e3779b97f4a7c15ULL;
+
+    return (h ^ (h >> 32)) & (UNIFY_CACHE_SLOTS - 1);
+}
+
+// Returns how many times c4m_unify() has been called on this thread
+// (including recursive calls for type parameters), and how many of
+// those were answered from the cache.
+void
+c4m_type_unify_stats(uint64_t *steps, uint64_t *cache_hits)
+{
+    if (steps) {
+        *steps = unify_steps;
+    }
+    if (cache_hits) {
+        *cache_hits = unify_cache_hits;
+    }
+}
+
+void
+c4m_type_reset_unify_stats(void)
+{
+    unify_steps      = 0;
+    unify_cache_hits = 0;
+}
+
+static c4m_type_t *unify_internal(c4m_type_t *, c4m_type_t *);
+
 c4m_type_t *
 c4m_unify(c4m_type_t *t1, c4m_type_t *t2)
+{
+    if (!t1 || !t2) {
+        return c4m_type_error();
+    }
+
+    unify_steps++;
+
+    t1 = c4m_type_resolve(t1);
+    t2 = c4m_type_resolve(t2);
+
+    if (!t1->resolved || !t2->resolved) {
+        return unify_internal(t1, t2);
+    }
+
+    c4m_type_hash_t      id1   = t1->typeid;
+    c4m_type_hash_t      id2   = t2->typeid;
+    uint64_t             slot  = unify_cache_slot(id1, id2);
+    unify_cache_entry_t *entry = unify_cache[slot];
+    c4m_type_t          *result;
+
+    if (entry && entry->t1 == id1 && entry->t2 == id2) {
+        unify_cache_hits++;
+        return entry->result;
+    }
+
+    result = unify_internal(t1, t2);
+
+    // Don't remember anything if unifying turned out to re-hash
+    // either side; the key would be stale.
+    if (t1->typeid != id1 || t2->typeid != id2
+        || !c4m_type_is_concrete(result)) {
+        return result;
+    }
+
+    entry = c4m_gc_alloc_mapped(unify_cache_entry_t,
+                                unify_cache_entry_gc_bits);
+
+    entry->result     = result;
+    entry->t1         = id1;
+    entry->t2         = id2;
+    unify_cache[slot] = entry;
+
+    return result;
+}
+
+static c4m_type_t *
+unify_internal(c4m_type_t *t1, c4m_type_t *t2)
 {
     c4m_type_t *result;
     c4m_type_t *sub1;
@@ -1645,19 +1803,21 @@ c4m_type_repr(c4m_type_t *t)
     return c4m_internal_type_repr(c4m_type_resolve(t), memos, &n);
 }
 
-extern void        c4m_marshal_compact_type(c4m_type_t *t, c4m_stream_t *s);
-extern c4m_type_t *c4m_unmarshal_compact_type(c4m_stream_t *s);
+extern void        c4m_marshal_compact_type(c4m_type_t *,
+                                            c4m_stream_t *,
+                                            c4m_memo_t *);
+extern c4m_type_t *c4m_unmarshal_compact_type(c4m_stream_t *, c4m_memo_t *);
 
 static void
-c4m_type_marshal(c4m_type_t *n, c4m_stream_t *s, c4m_dict_t *m, int64_t *mid)
+c4m_type_marshal(c4m_type_t *n, c4m_stream_t *s, c4m_memo_t *m, int64_t *mid)
 {
-    c4m_marshal_compact_type(n, s);
+    c4m_marshal_compact_type(n, s, m);
 }
 
 static void
-c4m_type_unmarshal(c4m_type_t *n, c4m_stream_t *s, c4m_dict_t *m)
+c4m_type_unmarshal(c4m_type_t *n, c4m_stream_t *s, c4m_memo_t *m)
 {
-    c4m_type_t *r = c4m_unmarshal_compact_type(s);
+    c4m_type_t *r = c4m_unmarshal_compact_type(s, m);
 
     n->details = r->details;
     n->typeid  = r->typeid;
@@ -1701,6 +1861,7 @@ setup_primitive_types()
         case C4M_DT_KIND_internal:;
             c4m_type_t *t         = c4m_early_alloc_type(&base);
             t->typeid             = i;
+            t->resolved           = true;
             t->details->base_type = one_spec;
             t->details->items     = NULL;
             c4m_bi_types[i]       = t;
@@ -1715,10 +1876,86 @@ setup_primitive_types()
     }
 }
 
+// Hash-consing for the container type constructors below. Asking for
+// list[string] (for instance) used to allocate a fresh node and hash
+// it on every call, only for the universe to hand back the node it
+// already had. Once we've built a concrete instantiation, we remember
+// the canonical node here, keyed on the base type and the type IDs of
+// its parameters.
+//
+// This is a direct-mapped cache shared by all threads. Entries are
+// single pointers, and every hit is checked against the node itself,
+// so a racing overwrite can only ever cause a miss.
+#define TYPE_CONS_SLOTS      1024
+#define TYPE_CONS_MAX_PARAMS 8
+
+static c4m_type_t *type_cons[TYPE_CONS_SLOTS];
+
+// Returns TYPE_CONS_SLOTS if the parameters aren't all concrete yet.
+static uint64_t
+type_cons_slot(c4m_builtin_t base, int n, c4m_type_t **params)
+{
+    uint64_t h = (uint64_t)base * 0x9e3779b97f4a7c15ULL;
+
+    if (n > TYPE_CONS_MAX_PARAMS) {
+        return TYPE_CONS_SLOTS;
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint64_t tid = params[i]->typeid;
+
+        if (!tid || !typeid_is_concrete(tid)) {
+            return TYPE_CONS_SLOTS;
+        }
+
+        h = (h ^ tid) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    return (h ^ (h >> 32)) & (TYPE_CONS_SLOTS - 1);
+}
+
+static c4m_type_t *
+type_cons_lookup(uint64_t       slot,
+                 c4m_builtin_t  base,
+                 int            n,
+                 c4m_type_t   **params)
+{
+    if (slot == TYPE_CONS_SLOTS) {
+        return NULL;
+    }
+
+    c4m_type_t *t = type_cons[slot];
+
+    if (t == NULL || t->details->base_type->typeid != base
+        || c4m_list_len(t->details->items) != n) {
+        return NULL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        c4m_type_t *item = c4m_list_get(t->details->items, i, NULL);
+
+        if (item->typeid != params[i]->typeid) {
+            return NULL;
+        }
+    }
+
+    return t;
+}
+
+static inline void
+type_cons_remember(uint64_t slot, c4m_type_t *t)
+{
+    if (slot != TYPE_CONS_SLOTS && t->typeid && typeid_is_concrete(t->typeid)) {
+        type_cons[slot] = t;
+    }
+}
+
 void
 c4m_initialize_global_types()
 {
     c4m_gc_register_root(&c4m_type_universe.store, 1);
+    c4m_gc_register_root(type_cons, TYPE_CONS_SLOTS);
+    c4m_gc_register_root(unify_cache, UNIFY_CACHE_SLOTS);
     c4m_universe_init(&c4m_type_universe);
 
     setup_primitive_types();
@@ -1727,33 +1964,45 @@ c4m_initialize_global_types()
 }
 
 #if defined(C4M_GC_STATS) || defined(C4M_DEBUG)
-#define DECLARE_ONE_PARAM_FN(tname, idnumber)                       \
-    c4m_type_t *                                                    \
-        _c4m_type_##tname(c4m_type_t *sub, char *file, int line)    \
-    {                                                               \
-        c4m_type_t *ts     = c4m_type_typespec();                   \
-        c4m_type_t *result = _c4m_new(file, line, ts, idnumber, 0); \
-        c4m_list_t *items  = result->details->items;                \
-        c4m_list_append(items, sub);                                \
-                                                                    \
-        type_hash_and_dedupe(&result);                              \
-                                                                    \
-        return result;                                              \
+#define DECLARE_ONE_PARAM_FN(tname, idnumber)                            \
+    c4m_type_t *                                                         \
+        _c4m_type_##tname(c4m_type_t *sub, char *file, int line)         \
+    {                                                                    \
+        uint64_t    slot   = type_cons_slot(idnumber, 1, &sub);          \
+        c4m_type_t *result = type_cons_lookup(slot, idnumber, 1, &sub);  \
+                                                                         \
+        if (result) {                                                    \
+            return result;                                               \
+        }                                                                \
+                                                                         \
+        result = _c4m_new(file, line, c4m_type_typespec(), idnumber, 0); \
+        c4m_list_append(result->details->items, sub);                    \
+                                                                         \
+        type_hash_and_dedupe(&result);                                   \
+        type_cons_remember(slot, result);                                \
+                                                                         \
+        return result;                                                   \
     }
 
 #else
-#define DECLARE_ONE_PARAM_FN(tname, idnumber)        \
-    c4m_type_t *                                     \
-        c4m_type_##tname(c4m_type_t *sub)            \
-    {                                                \
-        c4m_type_t *ts     = c4m_type_typespec();    \
-        c4m_type_t *result = c4m_new(ts, idnumber);  \
-        c4m_list_t *items  = result->details->items; \
-        c4m_list_append(items, sub);                 \
-                                                     \
-        type_hash_and_dedupe(&result);               \
-                                                     \
-        return result;                               \
+#define DECLARE_ONE_PARAM_FN(tname, idnumber)                           \
+    c4m_type_t *                                                        \
+        c4m_type_##tname(c4m_type_t *sub)                               \
+    {                                                                   \
+        uint64_t    slot   = type_cons_slot(idnumber, 1, &sub);         \
+        c4m_type_t *result = type_cons_lookup(slot, idnumber, 1, &sub); \
+                                                                        \
+        if (result) {                                                   \
+            return result;                                              \
+        }                                                               \
+                                                                        \
+        result = c4m_new(c4m_type_typespec(), idnumber);                \
+        c4m_list_append(result->details->items, sub);                   \
+                                                                        \
+        type_hash_and_dedupe(&result);                                  \
+        type_cons_remember(slot, result);                               \
+                                                                        \
+        return result;                                                  \
     }
 #endif
 
@@ -1764,14 +2013,19 @@ extern int TMP_DEBUG;
 c4m_type_t *
 _c4m_type_list(c4m_type_t *sub, char *file, int line)
 {
-    c4m_type_t *result = _c4m_new(file,
-                                  line,
-                                  c4m_type_typespec(),
-                                  C4M_T_LIST);
+    uint64_t    slot   = type_cons_slot(C4M_T_LIST, 1, &sub);
+    c4m_type_t *result = type_cons_lookup(slot, C4M_T_LIST, 1, &sub);
+
+    if (result) {
+        return result;
+    }
+
+    result = _c4m_new(file, line, c4m_type_typespec(), C4M_T_LIST);
 
     c4m_list_t *items = result->details->items;
     c4m_list_append(items, sub);
     type_hash_and_dedupe(&result);
+    type_cons_remember(slot, result);
 
     return result;
 }
@@ -1798,14 +2052,22 @@ c4m_type_box(c4m_type_t *sub)
 c4m_type_t *
 c4m_type_dict(c4m_type_t *sub1, c4m_type_t *sub2)
 {
-    c4m_type_t *result = c4m_new(c4m_type_typespec(),
-                                 C4M_T_DICT);
-    c4m_list_t *items  = result->details->items;
+    c4m_type_t *params[2] = {sub1, sub2};
+    uint64_t    slot      = type_cons_slot(C4M_T_DICT, 2, params);
+    c4m_type_t *result    = type_cons_lookup(slot, C4M_T_DICT, 2, params);
+
+    if (result) {
+        return result;
+    }
+
+    result            = c4m_new(c4m_type_typespec(), C4M_T_DICT);
+    c4m_list_t *items = result->details->items;
 
     c4m_list_append(items, sub1);
     c4m_list_append(items, sub2);
 
     type_hash_and_dedupe(&result);
+    type_cons_remember(slot, result);
 
     return result;
 }
@@ -1814,22 +2076,44 @@ c4m_type_t *
 c4m_type_tuple(int64_t nitems, ...)
 {
     va_list     args;
-    c4m_type_t *result = c4m_new(c4m_type_typespec(),
-                                 C4M_T_TUPLE);
-    c4m_list_t *items  = result->details->items;
-
-    va_start(args, nitems);
+    c4m_type_t *params[TYPE_CONS_MAX_PARAMS];
+    uint64_t    slot = TYPE_CONS_SLOTS;
+    c4m_type_t *result;
+    c4m_list_t *items;
 
     if (nitems <= 1) {
         C4M_CRAISE("Tuples must contain 2 or more items.");
     }
 
+    if (nitems <= TYPE_CONS_MAX_PARAMS) {
+        va_start(args, nitems);
+        for (int i = 0; i < nitems; i++) {
+            params[i] = va_arg(args, c4m_type_t *);
+        }
+        va_end(args);
+
+        slot   = type_cons_slot(C4M_T_TUPLE, nitems, params);
+        result = type_cons_lookup(slot, C4M_T_TUPLE, nitems, params);
+
+        if (result) {
+            return result;
+        }
+    }
+
+    result = c4m_new(c4m_type_typespec(), C4M_T_TUPLE);
+    items  = result->details->items;
+
+    va_start(args, nitems);
+
     for (int i = 0; i < nitems; i++) {
         c4m_type_t *sub = va_arg(args, c4m_type_t *);
         c4m_list_append(items, sub);
     }
 
+    va_end(args);
+
     type_hash_and_dedupe(&result);
+    type_cons_remember(slot, result);
 
     return result;
 }
@@ -70,16 +70,70 @@ c4m_universe_attempt_to_add(c4m_type_universe_t *u, c4m_type_t *t)
     return c4m_universe_get(u, t->typeid);
 }
 
-void
-c4m_universe_forward(c4m_type_universe_t *u, c4m_type_t *t1, c4m_type_t *t2)
+static inline void
+put_at(c4m_type_universe_t *u, c4m_type_hash_t typeid, c4m_type_t *t)
 {
     hatrack_hash_t hv;
 
+    init_hv(&hv, typeid);
+    crown_put_mmm(&u->store, mmm_thread_acquire(), hv, t, NULL);
+}
+
+// Follows forwarding links from `t` to the node at the end of the
+// chain (the union-find 'find'). Unifying type variables can build up
+// long chains, and every resolve would walk the whole thing, so when
+// the chain is more than one link long, we point every key on it
+// straight at the end (path compression).
+c4m_type_t *
+c4m_universe_find(c4m_type_universe_t *u, c4m_type_t *t)
+{
+    c4m_type_t *root  = t;
+    c4m_type_t *next;
+    int         links = 0;
+
+    while (true) {
+        next = c4m_universe_get(u, root->typeid);
+
+        if (!next) {
+            break;
+        }
+
+        if (next == root || next->typeid == root->typeid) {
+            root = next;
+            break;
+        }
+
+        root = next;
+        links++;
+    }
+
+    if (links > 1) {
+        while (t->typeid != root->typeid) {
+            next = c4m_universe_get(u, t->typeid);
+            put_at(u, t->typeid, root);
+            t->fw = root->typeid;
+            t     = next;
+        }
+    }
+
+    return root;
+}
+
+// Forwards `t1` to whatever `t2` currently resolves to. We always
+// link to the end of t2's chain, so chains only get longer when
+// there's no way around it.
+void
+c4m_universe_forward(c4m_type_universe_t *u, c4m_type_t *t1, c4m_type_t *t2)
+{
     assert(t1->typeid);
     assert(t2->typeid);
-    assert(!t2->fw);
+
+    t2 = c4m_universe_find(u, t2);
+
+    if (t1 == t2 || t1->typeid == t2->typeid) {
+        return;
+    }
 
     t1->fw = t2->typeid;
-    init_hv(&hv, t1->typeid);
-    crown_put_mmm(&u->store, mmm_thread_acquire(), hv, t2, NULL);
+    put_at(u, t1->typeid, t2);
 }
@@ -93,9 +93,7 @@ c4m_vm_exception(c4m_vmthread_t *tstate, c4m_exception_t *exc)
     uint64_t      lineno;
 
     // instruction that triggered the error:
-    c4m_zinstruction_t *i = c4m_list_get(tstate->current_module->instructions,
-                                         tstate->pc,
-                                         NULL);
+    c4m_zinstruction_t *i = &tstate->current_module->code[tstate->pc];
 
     lineno  = i->line_no;
     modname = tstate->current_module->modname;
@@ -179,6 +177,72 @@ c4m_vm_exception(c4m_vmthread_t *tstate, c4m_exception_t *exc)
         tstate->sp->sint = !!((int64_t)(v2 op v1)); \
     } while (0)
 
+
+// The comparison for C4M_ZCmpJz / C4M_ZCmpJnz, which is any of the
+// signed SIMPLE_COMPARE() ops above.
+static inline bool
+fused_compare(int64_t op, int64_t v2, int64_t v1)
+{
+    switch (op) {
+    case C4M_ZCmp:
+        return v2 == v1;
+    case C4M_ZNeq:
+        return v2 != v1;
+    case C4M_ZLt:
+        return v2 < v1;
+    case C4M_ZLte:
+        return v2 <= v1;
+    case C4M_ZGt:
+        return v2 > v1;
+    case C4M_ZGte:
+        return v2 >= v1;
+    default:
+        c4m_unreachable();
+    }
+}
+
+// The arithmetic for C4M_ZLocalOp3; this must give the same results
+// as the stack op it's standing in for.
+static inline c4m_stack_value_t
+local_binop(int64_t op, c4m_stack_value_t lhs, c4m_stack_value_t rhs)
+{
+    switch (op) {
+    case C4M_ZAdd:
+    case C4M_ZUAdd:
+        lhs.uint += rhs.uint;
+        break;
+    case C4M_ZSub:
+    case C4M_ZUSub:
+        lhs.uint -= rhs.uint;
+        break;
+    case C4M_ZMul:
+    case C4M_ZUMul:
+        lhs.uint *= rhs.uint;
+        break;
+    case C4M_ZBOr:
+        lhs.uint |= rhs.uint;
+        break;
+    case C4M_ZBAnd:
+        lhs.uint &= rhs.uint;
+        break;
+    case C4M_ZBXOr:
+        lhs.uint ^= rhs.uint;
+        break;
+    case C4M_ZFAdd:
+        lhs.dbl += rhs.dbl;
+        break;
+    case C4M_ZFSub:
+        lhs.dbl -= rhs.dbl;
+        break;
+    case C4M_ZFMul:
+        lhs.dbl *= rhs.dbl;
+        break;
+    default:
+        c4m_unreachable();
+    }
+
+    return lhs;
+}
 #define SIMPLE_COMPARE_UNSIGNED(op)                 \
     do {                                            \
         int64_t v1 = tstate->sp->uint;              \
@@ -632,9 +696,7 @@ c4m_vm_0call(c4m_vmthread_t *tstate, c4m_zinstruction_t *i, int64_t ix)
                                           fn->mid,
                                           NULL);
 
-    c4m_zinstruction_t *nexti = c4m_list_get(tstate->current_module->instructions,
-                                             tstate->pc,
-                                             NULL);
+    c4m_zinstruction_t *nexti = &tstate->current_module->code[tstate->pc];
 
     // push a frame onto the call stack
     c4m_vmframe_push(tstate,
@@ -666,9 +728,7 @@ c4m_vm_call_module(c4m_vmthread_t *tstate, c4m_zinstruction_t *i)
                                           i->module_id,
                                           NULL);
 
-    c4m_zinstruction_t *nexti = c4m_list_get(tstate->current_module->instructions,
-                                             tstate->pc,
-                                             NULL);
+    c4m_zinstruction_t *nexti = &tstate->current_module->code[tstate->pc];
 
     // push a frame onto the call stack
     c4m_vmframe_push(tstate,
@@ -682,53 +742,46 @@ c4m_vm_call_module(c4m_vmthread_t *tstate, c4m_zinstruction_t *i)
 static void
 c4m_vm_ffi_call(c4m_vmthread_t *tstate, c4m_zinstruction_t *i, int64_t ix)
 {
-    c4m_ffi_decl_t *decl = c4m_list_get(tstate->vm->obj->ffi_info,
-                                        i->arg,
-                                        NULL);
+    c4m_ffi_decl_t *decl = NULL;
 
-    if (decl == NULL) {
+    if (ix >= 0 && ix < tstate->vm->ffi_info_entries) {
+        decl = tstate->vm->ffi_decls[ix];
+    }
+
+    if (decl == NULL || decl->cif.fptr == NULL) {
         fprintf(stderr, "Could not load external function.\n");
         abort();
     }
 
     c4m_zffi_cif *ffiinfo = &decl->cif;
-    void        **args;
-
-    if (!ffiinfo->cif.nargs) {
-        args = NULL;
-    }
-    else {
-        args  = c4m_gc_array_value_alloc(void *, ffiinfo->cif.nargs);
-        int n = ffiinfo->cif.nargs;
-
-        for (unsigned int i = 0; i < ffiinfo->cif.nargs; i++) {
-            // clang-format off
-	    --n;
-
-	    if (ffiinfo->str_convert &&
-		n < 63 &&
-		((1 << n) & ffiinfo->str_convert)) {
-
-		c4m_utf8_t *s = (c4m_utf8_t *)tstate->sp[i].rvalue.obj;
-		s             = c4m_to_utf8(s);
-		args[n]       = &s->data;
-            }
-            // clang-format on
-            else {
-                c4m_box_t  value = {.u64 = tstate->sp[i].uint};
-                c4m_box_t *box   = c4m_new(c4m_type_box(c4m_type_ref()),
-                                         value);
-                args[n]          = c4m_ref_via_ffi_type(box,
-                                               ffiinfo->cif.arg_types[n]);
-            }
+    int           n       = ffiinfo->cif.nargs;
+
+    // libffi wants the address of each argument. Values get copied
+    // into `vals`, which is on the C stack along with `args`, so
+    // calls w/ primitive arguments don't allocate. Every member of a
+    // c4m_box_t lives at its start, so this works for any width.
+    void     *args[n ? n : 1];
+    c4m_box_t vals[n ? n : 1];
+
+    for (int j = 0; j < n; j++) {
+        int     param = n - j - 1;
+        uint8_t plan  = ffiinfo->arg_plan[j];
+
+        if (plan & C4M_FFI_ARG_CSTR) {
+            c4m_utf8_t *s = c4m_to_utf8(tstate->sp[j].rvalue.obj);
+            args[param]   = &s->data;
+        }
+        else {
+            vals[param].u64 = tstate->sp[j].uint;
+            args[param]     = &vals[param];
+        }
 
-            if (n < 63 && ((1 << n) & ffiinfo->hold_info)) {
-                c4m_gc_add_hold(tstate->sp[i].rvalue.obj);
-            }
+        if (plan & C4M_FFI_ARG_HOLD) {
+            c4m_gc_add_hold(tstate->sp[j].rvalue.obj);
         }
     }
 
-    ffi_call(&ffiinfo->cif, ffiinfo->fptr, &tstate->r0, args);
+    ffi_call(&ffiinfo->cif, ffiinfo->fptr, &tstate->r0, n ? args : NULL);
 
     if (ffiinfo->str_convert & (1UL << 63)) {
         char *s        = (char *)tstate->r0.obj;
@@ -784,6 +837,120 @@ c4m_vm_return(c4m_vmthread_t *tstate, c4m_zinstruction_t *i)
     --tstate->num_frames; // pop call frame
 }
 
+#ifdef C4M_VM_DEBUG
+static bool c4m_vm_debug_on = (bool)(C4M_VM_DEBUG_DEFAULT);
+
+static void
+c4m_vm_debug_show(c4m_vmthread_t *tstate, c4m_zinstruction_t *i)
+{
+    static char *debug_fmt_str =
+        "[i]> {} (PC@{:x}; SP@{:x}; "
+        "FP@{:x}; a = {}; i = {}; m = {})";
+
+    if (c4m_vm_debug_on && i->op != C4M_ZNop) {
+        int num_stack_items = &tstate->stack[C4M_STACK_SIZE] - tstate->sp;
+        printf("stack has %d items on it: ", num_stack_items);
+        for (int i = 0; i < num_stack_items; i++) {
+            if (&tstate->sp[i] == tstate->fp) {
+                printf("\e[34m[%p]\e[0m ", tstate->sp[i].vptr);
+            }
+            else {
+                // stored program counter and module id.
+                if (&tstate->sp[i - 1] == tstate->fp) {
+                    printf("\e[32m[pc: 0x%llx module: %lld]\e[0m ",
+                           tstate->sp[i].uint >> 28,
+                           tstate->sp[i].uint & 0xffffffff);
+                }
+                else {
+                    if (&tstate->sp[i] > tstate->fp) {
+                        // Older frames.
+                        printf("\e[31m[%p]\e[0m ", tstate->sp[i].vptr);
+                    }
+                    else {
+                        // This frame.
+                        printf("\e[33m[%p]\e[0m ", tstate->sp[i].vptr);
+                    }
+                }
+            }
+        }
+        printf("\n");
+        c4m_print(
+            c4m_cstr_format(
+                debug_fmt_str,
+                c4m_fmt_instr_name(i),
+                c4m_box_u64(tstate->pc * 16),
+                c4m_box_u64((uint64_t)(void *)tstate->sp),
+                c4m_box_u64((uint64_t)(void *)tstate->fp),
+                c4m_box_i64((int64_t)i->arg),
+                c4m_box_i64((int64_t)i->immediate),
+                c4m_box_u64((uint64_t)tstate->current_module->module_id)));
+    }
+
+}
+
+#define VM_TRACE() c4m_vm_debug_show(tstate, i)
+#else
+#define VM_TRACE()
+#endif
+
+// Instruction dispatch.
+//
+// The main loop is written in terms of the macros below, so that it
+// can be built either as a plain switch, or as a direct-threaded
+// interpreter where each handler ends with its own indirect jump to
+// the next handler (computed goto). The latter gives the branch
+// predictor one jump site per opcode to learn, instead of funneling
+// every instruction through the top of one switch. Both gcc and clang
+// support labels as values; if that's a problem for some toolchain,
+// define C4M_VM_SWITCH_DISPATCH to fall back to the switch.
+//
+// Handlers end with VM_NEXT() to fall through to the next instruction,
+// or VM_JUMP() to transfer control to an absolute pc in the current
+// module. Instructions are fetched out of the module's frozen `code`
+// array, never the instruction list (see c4m_vm_freeze_instructions()).
+#if defined(__GNUC__) && !defined(C4M_VM_SWITCH_DISPATCH)
+#define C4M_VM_THREADED_DISPATCH
+#endif
+
+#define VM_FETCH() i = &tstate->current_module->code[tstate->pc]
+
+#ifdef C4M_VM_THREADED_DISPATCH
+#define VM_LABEL(op) vm_op_##op
+#define VM_OP(op)    VM_LABEL(op)
+#define VM_DISPATCH() \
+    VM_FETCH();       \
+    VM_TRACE();       \
+    goto *dispatch_table[i->op]
+#define VM_NEXT() \
+    ++tstate->pc; \
+    VM_DISPATCH()
+#define VM_JUMP(target)      \
+    tstate->pc = (target); \
+    VM_DISPATCH()
+#define VM_LOOP_START() VM_DISPATCH()
+#define VM_LOOP_END()    \
+    vm_op_invalid:       \
+    VM_NEXT()
+#define VM_TABLE_ENTRY(op) [op] = &&VM_LABEL(op)
+#else
+#define VM_OP(op) case op
+#define VM_NEXT() break
+#define VM_JUMP(target)      \
+    tstate->pc = (target); \
+    continue
+#define VM_LOOP_START() \
+    for (;;) {          \
+        VM_FETCH();     \
+        VM_TRACE();     \
+        switch (i->op) {
+#define VM_LOOP_END() \
+    default:          \
+        break;        \
+        }             \
+        ++tstate->pc; \
+        }
+#endif
+
 static int
 c4m_vm_runloop(c4m_vmthread_t *tstate_arg)
 {
@@ -812,749 +979,903 @@ c4m_vm_runloop(c4m_vmthread_t *tstate_arg)
 
     C4M_TRY
     {
-        for (;;) {
-            c4m_zinstruction_t *i;
+        c4m_zinstruction_t *i;
+
+#ifdef C4M_VM_THREADED_DISPATCH
+        // Anything we don't have a handler for is skipped, same as
+        // the switch.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+        static void *dispatch_table[256] = {
+            [0 ... 255] = &&vm_op_invalid,
+            VM_TABLE_ENTRY(C4M_ZNop),
+            VM_TABLE_ENTRY(C4M_ZMoveSp),
+            VM_TABLE_ENTRY(C4M_ZMoveSpPushFromR0),
+            VM_TABLE_ENTRY(C4M_ZPushConstObj),
+            VM_TABLE_ENTRY(C4M_ZPushConstRef),
+            VM_TABLE_ENTRY(C4M_ZDeref),
+            VM_TABLE_ENTRY(C4M_ZPushImm),
+            VM_TABLE_ENTRY(C4M_ZPushLocalObj),
+            VM_TABLE_ENTRY(C4M_ZPushLocalPair),
+            VM_TABLE_ENTRY(C4M_ZPushLocalAddImm),
+            VM_TABLE_ENTRY(C4M_ZPushLocalRef),
+            VM_TABLE_ENTRY(C4M_ZPushStaticObj),
+            VM_TABLE_ENTRY(C4M_ZPushStaticRef),
+            VM_TABLE_ENTRY(C4M_ZDupTop),
+            VM_TABLE_ENTRY(C4M_ZPop),
+            VM_TABLE_ENTRY(C4M_ZJz),
+            VM_TABLE_ENTRY(C4M_ZJnz),
+            VM_TABLE_ENTRY(C4M_ZJ),
+            VM_TABLE_ENTRY(C4M_ZCmpJz),
+            VM_TABLE_ENTRY(C4M_ZCmpJnz),
+            VM_TABLE_ENTRY(C4M_ZLocalCmpJz),
+            VM_TABLE_ENTRY(C4M_ZLocalCmpJnz),
+            VM_TABLE_ENTRY(C4M_ZAdd),
+            VM_TABLE_ENTRY(C4M_ZAddImm),
+            VM_TABLE_ENTRY(C4M_ZLocalOp3),
+            VM_TABLE_ENTRY(C4M_ZLocalAddImm),
+            VM_TABLE_ENTRY(C4M_ZSub),
+            VM_TABLE_ENTRY(C4M_ZSubNoPop),
+            VM_TABLE_ENTRY(C4M_ZMul),
+            VM_TABLE_ENTRY(C4M_ZDiv),
+            VM_TABLE_ENTRY(C4M_ZMod),
+            VM_TABLE_ENTRY(C4M_ZUAdd),
+            VM_TABLE_ENTRY(C4M_ZUSub),
+            VM_TABLE_ENTRY(C4M_ZUMul),
+            VM_TABLE_ENTRY(C4M_ZUDiv),
+            VM_TABLE_ENTRY(C4M_ZUMod),
+            VM_TABLE_ENTRY(C4M_ZFAdd),
+            VM_TABLE_ENTRY(C4M_ZFSub),
+            VM_TABLE_ENTRY(C4M_ZFMul),
+            VM_TABLE_ENTRY(C4M_ZFDiv),
+            VM_TABLE_ENTRY(C4M_ZBOr),
+            VM_TABLE_ENTRY(C4M_ZBAnd),
+            VM_TABLE_ENTRY(C4M_ZShl),
+            VM_TABLE_ENTRY(C4M_ZShlI),
+            VM_TABLE_ENTRY(C4M_ZShr),
+            VM_TABLE_ENTRY(C4M_ZBXOr),
+            VM_TABLE_ENTRY(C4M_ZBNot),
+            VM_TABLE_ENTRY(C4M_ZNot),
+            VM_TABLE_ENTRY(C4M_ZAbs),
+            VM_TABLE_ENTRY(C4M_ZGetSign),
+            VM_TABLE_ENTRY(C4M_ZHalt),
+            VM_TABLE_ENTRY(C4M_ZSwap),
+            VM_TABLE_ENTRY(C4M_ZLoadFromAttr),
+            VM_TABLE_ENTRY(C4M_ZAssignAttr),
+            VM_TABLE_ENTRY(C4M_ZLockOnWrite),
+            VM_TABLE_ENTRY(C4M_ZLoadFromView),
+            VM_TABLE_ENTRY(C4M_ZStoreImm),
+            VM_TABLE_ENTRY(C4M_ZPushObjType),
+            VM_TABLE_ENTRY(C4M_ZTypeCmp),
+            VM_TABLE_ENTRY(C4M_ZCmp),
+            VM_TABLE_ENTRY(C4M_ZLt),
+            VM_TABLE_ENTRY(C4M_ZLte),
+            VM_TABLE_ENTRY(C4M_ZGt),
+            VM_TABLE_ENTRY(C4M_ZGte),
+            VM_TABLE_ENTRY(C4M_ZULt),
+            VM_TABLE_ENTRY(C4M_ZULte),
+            VM_TABLE_ENTRY(C4M_ZUGt),
+            VM_TABLE_ENTRY(C4M_ZUGte),
+            VM_TABLE_ENTRY(C4M_ZNeq),
+            VM_TABLE_ENTRY(C4M_ZGteNoPop),
+            VM_TABLE_ENTRY(C4M_ZCmpNoPop),
+            VM_TABLE_ENTRY(C4M_ZUnsteal),
+            VM_TABLE_ENTRY(C4M_ZTCall),
+            VM_TABLE_ENTRY(C4M_Z0Call),
+            VM_TABLE_ENTRY(C4M_ZCallModule),
+            VM_TABLE_ENTRY(C4M_ZRunCallback),
+            VM_TABLE_ENTRY(C4M_ZRet),
+            VM_TABLE_ENTRY(C4M_ZModuleEnter),
+            VM_TABLE_ENTRY(C4M_ZModuleRet),
+            VM_TABLE_ENTRY(C4M_ZFFICall),
+            VM_TABLE_ENTRY(C4M_ZPushFfiPtr),
+            VM_TABLE_ENTRY(C4M_ZPushVmPtr),
+            VM_TABLE_ENTRY(C4M_ZSObjNew),
+            VM_TABLE_ENTRY(C4M_ZAssignToLoc),
+            VM_TABLE_ENTRY(C4M_ZStoreLocal),
+            VM_TABLE_ENTRY(C4M_ZMoveLocal),
+            VM_TABLE_ENTRY(C4M_ZAssert),
+            VM_TABLE_ENTRY(C4M_ZPopToR0),
+            VM_TABLE_ENTRY(C4M_ZPushFromR0),
+            VM_TABLE_ENTRY(C4M_Z0R0c00l),
+            VM_TABLE_ENTRY(C4M_ZPopToR1),
+            VM_TABLE_ENTRY(C4M_ZPushFromR1),
+            VM_TABLE_ENTRY(C4M_ZPopToR2),
+            VM_TABLE_ENTRY(C4M_ZPushFromR2),
+            VM_TABLE_ENTRY(C4M_ZPopToR3),
+            VM_TABLE_ENTRY(C4M_ZPushFromR3),
+            VM_TABLE_ENTRY(C4M_ZBox),
+            VM_TABLE_ENTRY(C4M_ZUnbox),
+            VM_TABLE_ENTRY(C4M_ZUnpack),
+            VM_TABLE_ENTRY(C4M_ZBail),
+            VM_TABLE_ENTRY(C4M_ZLockMutex),
+            VM_TABLE_ENTRY(C4M_ZUnlockMutex),
+#ifdef C4M_DEV
+            VM_TABLE_ENTRY(C4M_ZDebug),
+            VM_TABLE_ENTRY(C4M_ZPrint),
+#endif
+        };
+#pragma GCC diagnostic pop
+#endif
 
-            i = c4m_list_get(tstate->current_module->instructions,
-                             tstate->pc,
-                             NULL);
+        VM_LOOP_START();
 
-#ifdef C4M_VM_DEBUG
-            static bool  debug_on = (bool)(C4M_VM_DEBUG_DEFAULT);
-            static char *debug_fmt_str =
-                "[i]> {} (PC@{:x}; SP@{:x}; "
-                "FP@{:x}; a = {}; i = {}; m = {})";
-
-            if (debug_on && i->op != C4M_ZNop) {
-                int num_stack_items = &tstate->stack[C4M_STACK_SIZE] - tstate->sp;
-                printf("stack has %d items on it: ", num_stack_items);
-                for (int i = 0; i < num_stack_items; i++) {
-                    if (&tstate->sp[i] == tstate->fp) {
-                        printf("\e[34m[%p]\e[0m ", tstate->sp[i].vptr);
+        VM_OP(C4M_ZNop):
+            VM_NEXT();
+        VM_OP(C4M_ZMoveSp):
+            if (i->arg > 0) {
+                STACK_REQUIRE_SLOTS(i->arg);
+            }
+            else {
+                STACK_REQUIRE_VALUES(i->arg);
+            }
+            tstate->sp -= i->arg;
+            VM_NEXT();
+        VM_OP(C4M_ZMoveSpPushFromR0):
+            if (i->arg > 0) {
+                STACK_REQUIRE_SLOTS(i->arg);
+            }
+            else {
+                STACK_REQUIRE_VALUES(i->arg);
+            }
+            tstate->sp -= i->arg;
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            tstate->sp->rvalue = tstate->r0;
+            VM_NEXT();
+            // TODO: need to initialize const_storage_base_addr.
+        VM_OP(C4M_ZPushConstObj):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            *tstate->sp = (c4m_stack_value_t){
+                .uint = tstate->vm->const_pool[i->arg].u,
+            };
+            VM_NEXT();
+        VM_OP(C4M_ZPushConstRef):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            *tstate->sp = (c4m_stack_value_t){
+                .rvalue = (c4m_value_t){
+                    .obj = (c4m_obj_t)(tstate->vm->const_pool + i->arg),
+                },
+            };
+            VM_NEXT();
+        VM_OP(C4M_ZDeref):
+            STACK_REQUIRE_VALUES(1);
+            tstate->sp->uint = *(uint64_t *)tstate->sp->uint;
+            VM_NEXT();
+        VM_OP(C4M_ZPushImm):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            *tstate->sp = (c4m_stack_value_t){
+                .rvalue = (c4m_value_t){
+                    .obj = (c4m_obj_t)i->immediate,
+                },
+            };
+            VM_NEXT();
+        VM_OP(C4M_ZPushLocalObj):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            tstate->sp->rvalue.obj = tstate->fp[-i->arg].rvalue.obj;
+            VM_NEXT();
+        VM_OP(C4M_ZPushLocalPair):
+            STACK_REQUIRE_SLOTS(2);
+            tstate->sp -= 2;
+            tstate->sp[1].rvalue.obj = tstate->fp[-i->arg].rvalue.obj;
+            tstate->sp[0].rvalue.obj = tstate->fp[-i->immediate].rvalue.obj;
+            VM_NEXT();
+        VM_OP(C4M_ZPushLocalAddImm):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            tstate->sp->uint = tstate->fp[-i->arg].uint + i->immediate;
+            VM_NEXT();
+        VM_OP(C4M_ZPushLocalRef):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            *tstate->sp = (c4m_stack_value_t){
+                .lvalue = &tstate->fp[-i->arg].rvalue,
+            };
+            VM_NEXT();
+        VM_OP(C4M_ZPushStaticObj):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            *tstate->sp = (c4m_stack_value_t){
+                .rvalue = *c4m_vm_variable(tstate, i),
+            };
+            VM_NEXT();
+        VM_OP(C4M_ZPushStaticRef):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            *tstate->sp = (c4m_stack_value_t){
+                .lvalue = c4m_vm_variable(tstate, i),
+            };
+            VM_NEXT();
+        VM_OP(C4M_ZDupTop):
+            STACK_REQUIRE_VALUES(1);
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            tstate->sp[0] = tstate->sp[1];
+            VM_NEXT();
+        VM_OP(C4M_ZPop):
+            STACK_REQUIRE_VALUES(1);
+            ++tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZJz):
+            STACK_REQUIRE_VALUES(1);
+            if (c4m_value_iszero(&tstate->sp->rvalue)) {
+                VM_JUMP(i->arg);
+            }
+            ++tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZJnz):
+            STACK_REQUIRE_VALUES(1);
+            if (!c4m_value_iszero(&tstate->sp->rvalue)) {
+                VM_JUMP(i->arg);
+            }
+            ++tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZJ):
+            VM_JUMP(i->arg);
+        VM_OP(C4M_ZCmpJz):
+            STACK_REQUIRE_VALUES(2);
+            if (!fused_compare(i->immediate,
+                               tstate->sp[1].sint,
+                               tstate->sp[0].sint)) {
+                ++tstate->sp;
+                tstate->sp->uint = 0;
+                VM_JUMP(i->arg);
+            }
+            tstate->sp += 2;
+            VM_NEXT();
+        VM_OP(C4M_ZCmpJnz):
+            STACK_REQUIRE_VALUES(2);
+            if (fused_compare(i->immediate,
+                              tstate->sp[1].sint,
+                              tstate->sp[0].sint)) {
+                ++tstate->sp;
+                tstate->sp->uint = 1;
+                VM_JUMP(i->arg);
+            }
+            tstate->sp += 2;
+            VM_NEXT();
+        VM_OP(C4M_ZLocalCmpJz):
+            if (!fused_compare(c4m_local3_op(i->immediate),
+                               tstate->fp[-c4m_local3_a(i->immediate)].sint,
+                               tstate->fp[-c4m_local3_b(i->immediate)].sint)) {
+                STACK_REQUIRE_SLOTS(1);
+                --tstate->sp;
+                tstate->sp->uint = 0;
+                VM_JUMP(i->arg);
+            }
+            VM_NEXT();
+        VM_OP(C4M_ZLocalCmpJnz):
+            if (fused_compare(c4m_local3_op(i->immediate),
+                              tstate->fp[-c4m_local3_a(i->immediate)].sint,
+                              tstate->fp[-c4m_local3_b(i->immediate)].sint)) {
+                STACK_REQUIRE_SLOTS(1);
+                --tstate->sp;
+                tstate->sp->uint = 1;
+                VM_JUMP(i->arg);
+            }
+            VM_NEXT();
+        VM_OP(C4M_ZAdd):
+            STACK_REQUIRE_VALUES(2);
+            rhs.sint = tstate->sp[0].sint;
+            ++tstate->sp;
+            tstate->sp[0].uint += rhs.sint;
+            VM_NEXT();
+        VM_OP(C4M_ZAddImm):
+            STACK_REQUIRE_VALUES(1);
+            tstate->sp->uint += i->immediate;
+            VM_NEXT();
+        VM_OP(C4M_ZLocalOp3):
+            tstate->fp[-i->arg] = local_binop(
+                c4m_local3_op(i->immediate),
+                tstate->fp[-c4m_local3_a(i->immediate)],
+                tstate->fp[-c4m_local3_b(i->immediate)]);
+            VM_NEXT();
+        VM_OP(C4M_ZLocalAddImm):
+            do {
+                int64_t src = c4m_local_add_slot(i->immediate);
+
+                tstate->fp[-i->arg].uint = tstate->fp[-src].uint
+                                         + c4m_local_add_k(i->immediate);
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZSub):
+            STACK_REQUIRE_VALUES(2);
+            rhs.sint = tstate->sp[0].sint;
+            ++tstate->sp;
+
+            tstate->sp[0].sint -= rhs.sint;
+            VM_NEXT();
+        VM_OP(C4M_ZSubNoPop):
+            STACK_REQUIRE_VALUES(2);
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            tstate->sp[0].sint = tstate->sp[2].sint - tstate->sp[1].sint;
+            VM_NEXT();
+        VM_OP(C4M_ZMul):
+            STACK_REQUIRE_VALUES(2);
+            rhs.sint = tstate->sp[0].sint;
+            ++tstate->sp;
+            tstate->sp[0].uint *= rhs.sint;
+            VM_NEXT();
+        VM_OP(C4M_ZDiv):
+            STACK_REQUIRE_VALUES(2);
+            rhs.sint = tstate->sp[0].sint;
+            ++tstate->sp;
+            if (rhs.sint == 0) {
+                C4M_CRAISE("Division by zero error.");
+            }
+            tstate->sp[0].sint /= rhs.sint;
+            VM_NEXT();
+        VM_OP(C4M_ZMod):
+            STACK_REQUIRE_VALUES(2);
+            rhs.sint = tstate->sp[0].sint;
+            ++tstate->sp;
+            tstate->sp[0].uint %= rhs.sint;
+            VM_NEXT();
+        VM_OP(C4M_ZUAdd):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint += rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZUSub):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint -= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZUMul):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint *= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZUDiv):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint /= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZUMod):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint %= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZFAdd):
+            STACK_REQUIRE_VALUES(2);
+            rhs.dbl = tstate->sp[0].dbl;
+            ++tstate->sp;
+            tstate->sp[0].dbl += rhs.dbl;
+            VM_NEXT();
+        VM_OP(C4M_ZFSub):
+            STACK_REQUIRE_VALUES(2);
+            rhs.dbl = tstate->sp[0].dbl;
+            ++tstate->sp;
+            tstate->sp[0].dbl -= rhs.dbl;
+            VM_NEXT();
+        VM_OP(C4M_ZFMul):
+            STACK_REQUIRE_VALUES(2);
+            rhs.dbl = tstate->sp[0].dbl;
+            ++tstate->sp;
+            tstate->sp[0].dbl *= rhs.dbl;
+            VM_NEXT();
+        VM_OP(C4M_ZFDiv):
+            STACK_REQUIRE_VALUES(2);
+            rhs.dbl = tstate->sp[0].dbl;
+            ++tstate->sp;
+            tstate->sp[0].dbl /= rhs.dbl;
+            VM_NEXT();
+        VM_OP(C4M_ZBOr):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint |= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZBAnd):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint &= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZShl):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint <<= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZShlI):
+            STACK_REQUIRE_VALUES(1);
+            rhs.uint           = tstate->sp[0].uint;
+            tstate->sp[0].uint = i->arg << tstate->sp[0].uint;
+            VM_NEXT();
+        VM_OP(C4M_ZShr):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint >>= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZBXOr):
+            STACK_REQUIRE_VALUES(2);
+            rhs.uint = tstate->sp[0].uint;
+            ++tstate->sp;
+            tstate->sp[0].uint ^= rhs.uint;
+            VM_NEXT();
+        VM_OP(C4M_ZBNot):
+            STACK_REQUIRE_VALUES(1);
+            tstate->sp[0].uint = ~tstate->sp[0].uint;
+            VM_NEXT();
+        VM_OP(C4M_ZNot):
+            STACK_REQUIRE_VALUES(1);
+            tstate->sp->uint = !tstate->sp->uint;
+            VM_NEXT();
+        VM_OP(C4M_ZAbs):
+            STACK_REQUIRE_VALUES(1);
+            do {
+                // Done w/o a branch; since value is signed,
+                // when we shift right, if it's negative, we sign
+                // extend to all ones. Meaning, we end up with
+                // either 64 ones or 64 zeros.
+                //
+                // Then, if we DO flip the sign, we need to add back 1;
+                // if we don't, we add back in 0.
+                int64_t  value = (int64_t)tstate->sp->uint;
+                uint64_t tmp   = value >> 63;
+                value ^= tmp;
+                value += tmp & 1;
+                tstate->sp->uint = (uint64_t)value;
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZGetSign):
+            STACK_REQUIRE_VALUES(1);
+            do {
+                // Here, we get tmp to the point where it's either -1
+                // or 0, then OR in a 1, which will do nothing to -1,
+                // and will turn the 0 to 1.
+                tstate->sp->sint >>= 63;
+                tstate->sp->sint |= 1;
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZHalt):
+            C4M_JUMP_TO_TRY_END();
+        VM_OP(C4M_ZSwap):
+            STACK_REQUIRE_VALUES(2);
+            do {
+                c4m_stack_value_t tmp = tstate->sp[0];
+                tstate->sp[0]         = tstate->sp[1];
+                tstate->sp[1]         = tmp;
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZLoadFromAttr):
+            STACK_REQUIRE_VALUES(2);
+            do {
+                bool         found = true;
+                c4m_utf8_t  *key   = c4m_vm_attr_key(tstate,
+                                                  tstate->sp->static_ptr);
+                c4m_value_t *val;
+                uint64_t     flag = c4m_attr_imm_flags(i->immediate);
+                int32_t      slot = c4m_attr_imm_slot(i->immediate);
+
+                if (flag) {
+                    val = c4m_vm_attr_slot_get(tstate, key, slot, &found);
+                }
+                else {
+                    val = c4m_vm_attr_slot_get(tstate, key, slot, NULL);
+                }
+
+                // If we didn't pass the reference to `found`, then
+                // an exception gets thrown if the attr doesn't exist,
+                // which is why `found` is true by default.
+                if (found && (flag != C4M_F_ATTR_SKIP_LOAD)) {
+                    if (i->arg) {
+                        *tstate->sp = (c4m_stack_value_t){
+                            .lvalue = val,
+                        };
                     }
                     else {
-                        // stored program counter and module id.
-                        if (&tstate->sp[i - 1] == tstate->fp) {
-                            printf("\e[32m[pc: 0x%llx module: %lld]\e[0m ",
-                                   tstate->sp[i].uint >> 28,
-                                   tstate->sp[i].uint & 0xffffffff);
-                        }
-                        else {
-                            if (&tstate->sp[i] > tstate->fp) {
-                                // Older frames.
-                                printf("\e[31m[%p]\e[0m ", tstate->sp[i].vptr);
-                            }
-                            else {
-                                // This frame.
-                                printf("\e[33m[%p]\e[0m ", tstate->sp[i].vptr);
-                            }
-                        }
+                        *tstate->sp = (c4m_stack_value_t){
+                            .rvalue = *val,
+                        };
                     }
                 }
-                printf("\n");
-                c4m_print(
-                    c4m_cstr_format(
-                        debug_fmt_str,
-                        c4m_fmt_instr_name(i),
-                        c4m_box_u64(tstate->pc * 16),
-                        c4m_box_u64((uint64_t)(void *)tstate->sp),
-                        c4m_box_u64((uint64_t)(void *)tstate->fp),
-                        c4m_box_i64((int64_t)i->arg),
-                        c4m_box_i64((int64_t)i->immediate),
-                        c4m_box_u64((uint64_t)tstate->current_module->module_id)));
-            }
+                // Only push the status if it was explicitly requested.
+                if (flag) {
+                    *--tstate->sp = (c4m_stack_value_t){
+                        .uint = found ? 1 : 0,
+                    };
+                }
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZAssignAttr):
+            STACK_REQUIRE_VALUES(2);
+            do {
+                c4m_utf8_t *key = c4m_vm_attr_key(tstate,
+                                                  tstate->sp->static_ptr);
+
+                c4m_vm_attr_slot_set(tstate,
+                                     key,
+                                     c4m_attr_imm_slot(i->immediate),
+                                     &tstate->sp[1].rvalue,
+                                     i->arg != 0,
+                                     false,
+                                     false);
+                tstate->sp += 2;
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZLockOnWrite):
+            STACK_REQUIRE_VALUES(1);
+            do {
+                c4m_utf8_t *key = c4m_vm_attr_key(tstate,
+                                                  tstate->sp->static_ptr);
+                c4m_vm_attr_lock(tstate, key, true);
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZLoadFromView):
+            STACK_REQUIRE_VALUES(2);
+            STACK_REQUIRE_SLOTS(2); // Usually 1, except w/ dict.
+            do {
+                uint64_t   obj_len   = tstate->sp->uint;
+                void     **view_slot = &(tstate->sp + 1)->rvalue.obj;
+                char      *p         = *(char **)view_slot;
+                c4m_box_t *box       = (c4m_box_t *)p;
 
-#endif
+                --tstate->sp;
 
-            switch (i->op) {
-            case C4M_ZNop:
-                break;
-            case C4M_ZMoveSp:
-                if (i->arg > 0) {
-                    STACK_REQUIRE_SLOTS(i->arg);
-                }
-                else {
-                    STACK_REQUIRE_VALUES(i->arg);
+                switch (obj_len) {
+                case 1:
+                    tstate->sp->uint = box->u8;
+                    *view_slot       = (void *)(p + 1);
+                    break;
+                case 2:
+                    tstate->sp->uint = box->u16;
+                    *view_slot       = (void *)(p + 2);
+                    break;
+                case 4:
+                    tstate->sp->uint = box->u32;
+                    *view_slot       = (void *)(p + 4);
+                    break;
+                case 8:
+                    tstate->sp->uint = box->u64;
+                    *view_slot       = (void *)(p + 8);
+                    // This is the only size that can be a dict.
+                    // Push the value on first.
+                    if (i->arg) {
+                        --tstate->sp;
+                        p += 8;
+                        box              = (c4m_box_t *)p;
+                        tstate->sp->uint = box->u64;
+                        *view_slot       = (p + 8);
+                    }
+                    break;
+                default:
+                    do {
+                        uint64_t count  = (uint64_t)(tstate->r1.obj);
+                        uint64_t bit_ix = (count - 1) % 64;
+                        uint64_t val    = **(uint64_t **)view_slot;
+
+                        tstate->sp->uint = val & (1 << bit_ix);
+
+                        if (bit_ix == 63) {
+                            *view_slot += 1;
+                        }
+                    } while (0);
                 }
-                tstate->sp -= i->arg;
-                break;
-                // TODO: need to initialize const_storage_base_addr.
-            case C4M_ZPushConstObj:
-                STACK_REQUIRE_SLOTS(1);
-                --tstate->sp;
-                *tstate->sp = (c4m_stack_value_t){
-                    .uint = tstate->vm->const_pool[i->arg].u,
-                };
-                break;
-            case C4M_ZPushConstRef:
-                STACK_REQUIRE_SLOTS(1);
-                --tstate->sp;
-                *tstate->sp = (c4m_stack_value_t){
-                    .rvalue = (c4m_value_t){
-                        .obj = (c4m_obj_t)(tstate->vm->const_pool + i->arg),
-                    },
-                };
-                break;
-            case C4M_ZDeref:
-                STACK_REQUIRE_VALUES(1);
-                tstate->sp->uint = *(uint64_t *)tstate->sp->uint;
-                break;
-            case C4M_ZPushImm:
-                STACK_REQUIRE_SLOTS(1);
-                --tstate->sp;
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZStoreImm):
+            *c4m_vm_variable(tstate, i) = (c4m_value_t){
+                .obj = (c4m_obj_t)i->immediate,
+            };
+            VM_NEXT();
+        VM_OP(C4M_ZPushObjType):
+            STACK_REQUIRE_SLOTS(1);
+            do {
+                c4m_type_t *type = c4m_get_my_type(tstate->sp->rvalue.obj);
+
                 *tstate->sp = (c4m_stack_value_t){
                     .rvalue = (c4m_value_t){
-                        .obj = (c4m_obj_t)i->immediate,
+                        .obj = type,
                     },
                 };
-                break;
-            case C4M_ZPushLocalObj:
-                STACK_REQUIRE_SLOTS(1);
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZTypeCmp):
+            STACK_REQUIRE_VALUES(2);
+            do {
+                c4m_type_t *t1 = tstate->sp[0].rvalue.obj;
+                c4m_type_t *t2 = tstate->sp[1].rvalue.obj;
+
+                ++tstate->sp;
+
+                // Does NOT check for coercible.
+                tstate->sp->uint = (uint64_t)c4m_types_are_compat(t1,
+                                                                  t2,
+                                                                  NULL);
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZCmp):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE(==);
+            VM_NEXT();
+        VM_OP(C4M_ZLt):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE(<);
+            VM_NEXT();
+        VM_OP(C4M_ZLte):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE(<=);
+            VM_NEXT();
+        VM_OP(C4M_ZGt):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE(>);
+            VM_NEXT();
+        VM_OP(C4M_ZGte):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE(>=);
+            VM_NEXT();
+        VM_OP(C4M_ZULt):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE_UNSIGNED(<);
+            VM_NEXT();
+        VM_OP(C4M_ZULte):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE_UNSIGNED(<=);
+            VM_NEXT();
+        VM_OP(C4M_ZUGt):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE_UNSIGNED(>);
+            VM_NEXT();
+        VM_OP(C4M_ZUGte):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE_UNSIGNED(>=);
+            VM_NEXT();
+        VM_OP(C4M_ZNeq):
+            STACK_REQUIRE_VALUES(2);
+            SIMPLE_COMPARE(!=);
+            VM_NEXT();
+        VM_OP(C4M_ZGteNoPop):
+            STACK_REQUIRE_VALUES(2);
+            STACK_REQUIRE_SLOTS(1);
+            do {
+                uint64_t v1 = tstate->sp->uint;
+                uint64_t v2 = (tstate->sp + 1)->uint;
                 --tstate->sp;
-                tstate->sp->rvalue.obj = tstate->fp[-i->arg].rvalue.obj;
-                break;
-            case C4M_ZPushLocalRef:
-                STACK_REQUIRE_SLOTS(1);
+                tstate->sp->uint = (uint64_t)(v2 >= v1);
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZCmpNoPop):
+            STACK_REQUIRE_VALUES(2);
+            STACK_REQUIRE_SLOTS(1);
+            do {
+                uint64_t v1 = tstate->sp->uint;
+                uint64_t v2 = (tstate->sp + 1)->uint;
                 --tstate->sp;
-                *tstate->sp = (c4m_stack_value_t){
-                    .lvalue = &tstate->fp[-i->arg].rvalue,
+                tstate->sp->uint = (uint64_t)(v2 == v1);
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZUnsteal):
+            STACK_REQUIRE_VALUES(1);
+            STACK_REQUIRE_SLOTS(1);
+            *(tstate->sp - 1) = (c4m_stack_value_t){
+                .static_ptr = tstate->sp->static_ptr & 0x07,
+            };
+            tstate->sp->static_ptr &= ~(0x07ULL);
+            --tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZTCall):
+            c4m_vm_tcall(tstate, i);
+            VM_NEXT();
+        VM_OP(C4M_Z0Call):
+            c4m_vm_0call(tstate, i, i->arg);
+            VM_NEXT();
+        VM_OP(C4M_ZCallModule):
+            c4m_vm_call_module(tstate, i);
+            VM_NEXT();
+        VM_OP(C4M_ZRunCallback):
+            c4m_vm_run_callback(tstate, i);
+            VM_NEXT();
+        VM_OP(C4M_ZRet):
+            c4m_vm_return(tstate, i);
+            VM_NEXT();
+        VM_OP(C4M_ZModuleEnter):
+            c4m_vm_module_enter(tstate, i);
+            VM_NEXT();
+        VM_OP(C4M_ZModuleRet):
+            if (tstate->num_frames <= 2) {
+                C4M_JUMP_TO_TRY_END();
+            }
+            c4m_vm_return(tstate, i);
+            VM_NEXT();
+        VM_OP(C4M_ZFFICall):
+            c4m_vm_ffi_call(tstate, i, i->arg);
+            VM_NEXT();
+        VM_OP(C4M_ZPushFfiPtr):
+            STACK_REQUIRE_SLOTS(1);
+            do {
+                c4m_zcallback_t *cb = c4m_new_zcallback();
+
+                *cb = (c4m_zcallback_t){
+                    .impl       = i->arg,
+                    .nameoffset = i->immediate,
+                    .tid        = i->type_info,
+                    .ffi        = true,
                 };
-                break;
-            case C4M_ZPushStaticObj:
-                STACK_REQUIRE_SLOTS(1);
+
                 --tstate->sp;
                 *tstate->sp = (c4m_stack_value_t){
-                    .rvalue = *c4m_vm_variable(tstate, i),
+                    .callback = cb,
                 };
-                break;
-            case C4M_ZPushStaticRef:
-                STACK_REQUIRE_SLOTS(1);
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZPushVmPtr):
+            STACK_REQUIRE_SLOTS(1);
+            do {
+                c4m_zcallback_t *cb = c4m_new_zcallback();
+
+                *cb = (c4m_zcallback_t){
+                    .impl       = i->arg,
+                    .nameoffset = i->immediate,
+                    .tid        = i->type_info,
+                    .ffi        = false,
+                };
+
                 --tstate->sp;
                 *tstate->sp = (c4m_stack_value_t){
-                    .lvalue = c4m_vm_variable(tstate, i),
+                    .callback = cb,
                 };
-                break;
-            case C4M_ZDupTop:
-                STACK_REQUIRE_VALUES(1);
-                STACK_REQUIRE_SLOTS(1);
-                --tstate->sp;
-                tstate->sp[0] = tstate->sp[1];
-                break;
-            case C4M_ZPop:
-                STACK_REQUIRE_VALUES(1);
-                ++tstate->sp;
-                break;
-            case C4M_ZJz:
-                STACK_REQUIRE_VALUES(1);
-                if (c4m_value_iszero(&tstate->sp->rvalue)) {
-                    tstate->pc = i->arg;
-                    continue;
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZSObjNew):
+            STACK_REQUIRE_SLOTS(1);
+            do {
+                // Nim vm doesn't use the length encoded in the instruction,
+                // but codegen does include it as i->arg. We'll use it in
+                // our implementation.
+                char   *data  = &tstate->vm->obj->static_data->data[i->immediate];
+                int64_t avail = c4m_buffer_len(tstate->vm->obj->static_data)
+                              - i->immediate;
+                if (i->arg > avail) {
+                    C4M_CRAISE("could not unmarshal: invalid length / offset combination");
                 }
-                ++tstate->sp;
-                break;
-            case C4M_ZJnz:
-                STACK_REQUIRE_VALUES(1);
-                if (!c4m_value_iszero(&tstate->sp->rvalue)) {
-                    tstate->pc = i->arg;
-                    continue;
+                c4m_buf_t *buffer = c4m_new(c4m_type_buffer(),
+                                            c4m_kw("ptr",
+                                                   data,
+                                                   "length",
+                                                   c4m_ka(i->arg)));
+
+                c4m_stream_t *stream = c4m_buffer_instream(buffer);
+                c4m_obj_t    *obj    = c4m_unmarshal(stream);
+                if (NULL == obj) {
+                    C4M_CRAISE("could not unmarshal");
                 }
-                ++tstate->sp;
-                break;
-            case C4M_ZJ:
-                tstate->pc = i->arg;
-                continue;
-            case C4M_ZAdd:
-                STACK_REQUIRE_VALUES(2);
-                rhs.sint = tstate->sp[0].sint;
-                ++tstate->sp;
-                tstate->sp[0].uint += rhs.sint;
-                break;
-            case C4M_ZSub:
-                STACK_REQUIRE_VALUES(2);
-                rhs.sint = tstate->sp[0].sint;
-                ++tstate->sp;
 
-                tstate->sp[0].sint -= rhs.sint;
-                break;
-            case C4M_ZSubNoPop:
-                STACK_REQUIRE_VALUES(2);
-                STACK_REQUIRE_SLOTS(1);
                 --tstate->sp;
-                tstate->sp[0].sint = tstate->sp[2].sint - tstate->sp[1].sint;
-                break;
-            case C4M_ZMul:
-                STACK_REQUIRE_VALUES(2);
-                rhs.sint = tstate->sp[0].sint;
-                ++tstate->sp;
-                tstate->sp[0].uint *= rhs.sint;
-                break;
-            case C4M_ZDiv:
-                STACK_REQUIRE_VALUES(2);
-                rhs.sint = tstate->sp[0].sint;
-                ++tstate->sp;
-                if (rhs.sint == 0) {
-                    C4M_CRAISE("Division by zero error.");
-                }
-                tstate->sp[0].sint /= rhs.sint;
-                break;
-            case C4M_ZMod:
-                STACK_REQUIRE_VALUES(2);
-                rhs.sint = tstate->sp[0].sint;
-                ++tstate->sp;
-                tstate->sp[0].uint %= rhs.sint;
-                break;
-            case C4M_ZUAdd:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint += rhs.uint;
-                break;
-            case C4M_ZUSub:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint -= rhs.uint;
-                break;
-            case C4M_ZUMul:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint *= rhs.uint;
-                break;
-            case C4M_ZUDiv:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint /= rhs.uint;
-                break;
-            case C4M_ZUMod:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint %= rhs.uint;
-                break;
-            case C4M_ZFAdd:
-                STACK_REQUIRE_VALUES(2);
-                rhs.dbl = tstate->sp[0].dbl;
-                ++tstate->sp;
-                tstate->sp[0].dbl += rhs.dbl;
-                break;
-            case C4M_ZFSub:
-                STACK_REQUIRE_VALUES(2);
-                rhs.dbl = tstate->sp[0].dbl;
-                ++tstate->sp;
-                tstate->sp[0].dbl -= rhs.dbl;
-                break;
-            case C4M_ZFMul:
-                STACK_REQUIRE_VALUES(2);
-                rhs.dbl = tstate->sp[0].dbl;
-                ++tstate->sp;
-                tstate->sp[0].dbl *= rhs.dbl;
-                break;
-            case C4M_ZFDiv:
-                STACK_REQUIRE_VALUES(2);
-                rhs.dbl = tstate->sp[0].dbl;
-                ++tstate->sp;
-                tstate->sp[0].dbl /= rhs.dbl;
-                break;
-            case C4M_ZBOr:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint |= rhs.uint;
-                break;
-            case C4M_ZBAnd:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint &= rhs.uint;
-                break;
-            case C4M_ZShl:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint <<= rhs.uint;
-                break;
-            case C4M_ZShlI:
-                STACK_REQUIRE_VALUES(1);
-                rhs.uint           = tstate->sp[0].uint;
-                tstate->sp[0].uint = i->arg << tstate->sp[0].uint;
-                break;
-            case C4M_ZShr:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint >>= rhs.uint;
-                break;
-            case C4M_ZBXOr:
-                STACK_REQUIRE_VALUES(2);
-                rhs.uint = tstate->sp[0].uint;
-                ++tstate->sp;
-                tstate->sp[0].uint ^= rhs.uint;
-                break;
-            case C4M_ZBNot:
-                STACK_REQUIRE_VALUES(1);
-                tstate->sp[0].uint = ~tstate->sp[0].uint;
-                break;
-            case C4M_ZNot:
-                STACK_REQUIRE_VALUES(1);
-                tstate->sp->uint = !tstate->sp->uint;
-                break;
-            case C4M_ZAbs:
-                STACK_REQUIRE_VALUES(1);
-                do {
-                    // Done w/o a branch; since value is signed,
-                    // when we shift right, if it's negative, we sign
-                    // extend to all ones. Meaning, we end up with
-                    // either 64 ones or 64 zeros.
-                    //
-                    // Then, if we DO flip the sign, we need to add back 1;
-                    // if we don't, we add back in 0.
-                    int64_t  value = (int64_t)tstate->sp->uint;
-                    uint64_t tmp   = value >> 63;
-                    value ^= tmp;
-                    value += tmp & 1;
-                    tstate->sp->uint = (uint64_t)value;
-                } while (0);
-                break;
-            case C4M_ZGetSign:
-                STACK_REQUIRE_VALUES(1);
-                do {
-                    // Here, we get tmp to the point where it's either -1
-                    // or 0, then OR in a 1, which will do nothing to -1,
-                    // and will turn the 0 to 1.
-                    tstate->sp->sint >>= 63;
-                    tstate->sp->sint |= 1;
-                } while (0);
-                break;
-            case C4M_ZHalt:
-                C4M_JUMP_TO_TRY_END();
-            case C4M_ZSwap:
-                STACK_REQUIRE_VALUES(2);
-                do {
-                    c4m_stack_value_t tmp = tstate->sp[0];
-                    tstate->sp[0]         = tstate->sp[1];
-                    tstate->sp[1]         = tmp;
-                } while (0);
-                break;
-            case C4M_ZLoadFromAttr:
-                STACK_REQUIRE_VALUES(2);
-                do {
-                    bool         found = true;
-                    c4m_utf8_t  *key   = c4m_vm_attr_key(tstate,
-                                                      tstate->sp->static_ptr);
-                    c4m_value_t *val;
-                    uint64_t     flag = i->immediate;
-
-                    if (flag) {
-                        val = c4m_vm_attr_get(tstate, key, &found);
-                    }
-                    else {
-                        val = c4m_vm_attr_get(tstate, key, NULL);
-                    }
-
-                    // If we didn't pass the reference to `found`, then
-                    // an exception gets thrown if the attr doesn't exist,
-                    // which is why `found` is true by default.
-                    if (found && (flag != C4M_F_ATTR_SKIP_LOAD)) {
-                        if (i->arg) {
-                            *tstate->sp = (c4m_stack_value_t){
-                                .lvalue = val,
-                            };
-                        }
-                        else {
-                            *tstate->sp = (c4m_stack_value_t){
-                                .rvalue = *val,
-                            };
-                        }
-                    }
-                    // Only push the status if it was explicitly requested.
-                    if (flag) {
-                        *--tstate->sp = (c4m_stack_value_t){
-                            .uint = found ? 1 : 0,
-                        };
-                    }
-                } while (0);
-                break;
-            case C4M_ZAssignAttr:
-                STACK_REQUIRE_VALUES(2);
-                do {
-                    c4m_utf8_t *key = c4m_vm_attr_key(tstate,
-                                                      tstate->sp->static_ptr);
-
-                    c4m_vm_attr_set(tstate,
-                                    key,
-                                    &tstate->sp[1].rvalue,
-                                    i->arg != 0,
-                                    false,
-                                    false);
-                    tstate->sp += 2;
-                } while (0);
-                break;
-            case C4M_ZLockOnWrite:
-                STACK_REQUIRE_VALUES(1);
-                do {
-                    c4m_utf8_t *key = c4m_vm_attr_key(tstate,
-                                                      tstate->sp->static_ptr);
-                    c4m_vm_attr_lock(tstate, key, true);
-                } while (0);
-                break;
-            case C4M_ZLoadFromView:
-                STACK_REQUIRE_VALUES(2);
-                STACK_REQUIRE_SLOTS(2); // Usually 1, except w/ dict.
-                do {
-                    uint64_t   obj_len   = tstate->sp->uint;
-                    void     **view_slot = &(tstate->sp + 1)->rvalue.obj;
-                    char      *p         = *(char **)view_slot;
-                    c4m_box_t *box       = (c4m_box_t *)p;
-
-                    --tstate->sp;
-
-                    switch (obj_len) {
-                    case 1:
-                        tstate->sp->uint = box->u8;
-                        *view_slot       = (void *)(p + 1);
-                        break;
-                    case 2:
-                        tstate->sp->uint = box->u16;
-                        *view_slot       = (void *)(p + 2);
-                        break;
-                    case 4:
-                        tstate->sp->uint = box->u32;
-                        *view_slot       = (void *)(p + 4);
-                        break;
-                    case 8:
-                        tstate->sp->uint = box->u64;
-                        *view_slot       = (void *)(p + 8);
-                        // This is the only size that can be a dict.
-                        // Push the value on first.
-                        if (i->arg) {
-                            --tstate->sp;
-                            p += 8;
-                            box              = (c4m_box_t *)p;
-                            tstate->sp->uint = box->u64;
-                            *view_slot       = (p + 8);
-                        }
-                        break;
-                    default:
-                        do {
-                            uint64_t count  = (uint64_t)(tstate->r1.obj);
-                            uint64_t bit_ix = (count - 1) % 64;
-                            uint64_t val    = **(uint64_t **)view_slot;
-
-                            tstate->sp->uint = val & (1 << bit_ix);
-
-                            if (bit_ix == 63) {
-                                *view_slot += 1;
-                            }
-                        } while (0);
-                    }
-                } while (0);
-                break;
-            case C4M_ZStoreImm:
-                *c4m_vm_variable(tstate, i) = (c4m_value_t){
-                    .obj = (c4m_obj_t)i->immediate,
+                tstate->sp->rvalue = (c4m_value_t){
+                    .obj = obj,
                 };
-                break;
-            case C4M_ZPushObjType:
-                STACK_REQUIRE_SLOTS(1);
-                do {
-                    c4m_type_t *type = c4m_get_my_type(tstate->sp->rvalue.obj);
-
-                    *tstate->sp = (c4m_stack_value_t){
-                        .rvalue = (c4m_value_t){
-                            .obj = type,
-                        },
-                    };
-                } while (0);
-                break;
-            case C4M_ZTypeCmp:
-                STACK_REQUIRE_VALUES(2);
-                do {
-                    c4m_type_t *t1 = tstate->sp[0].rvalue.obj;
-                    c4m_type_t *t2 = tstate->sp[1].rvalue.obj;
-
-                    ++tstate->sp;
-
-                    // Does NOT check for coercible.
-                    tstate->sp->uint = (uint64_t)c4m_types_are_compat(t1,
-                                                                      t2,
-                                                                      NULL);
-                } while (0);
-                break;
-            case C4M_ZCmp:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE(==);
-                break;
-            case C4M_ZLt:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE(<);
-                break;
-            case C4M_ZLte:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE(<=);
-                break;
-            case C4M_ZGt:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE(>);
-                break;
-            case C4M_ZGte:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE(>=);
-                break;
-            case C4M_ZULt:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE_UNSIGNED(<);
-                break;
-            case C4M_ZULte:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE_UNSIGNED(<=);
-                break;
-            case C4M_ZUGt:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE_UNSIGNED(>);
-                break;
-            case C4M_ZUGte:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE_UNSIGNED(>=);
-                break;
-            case C4M_ZNeq:
-                STACK_REQUIRE_VALUES(2);
-                SIMPLE_COMPARE(!=);
-                break;
-            case C4M_ZGteNoPop:
-                STACK_REQUIRE_VALUES(2);
-                STACK_REQUIRE_SLOTS(1);
-                do {
-                    uint64_t v1 = tstate->sp->uint;
-                    uint64_t v2 = (tstate->sp + 1)->uint;
-                    --tstate->sp;
-                    tstate->sp->uint = (uint64_t)(v2 >= v1);
-                } while (0);
-                break;
-            case C4M_ZCmpNoPop:
-                STACK_REQUIRE_VALUES(2);
-                STACK_REQUIRE_SLOTS(1);
-                do {
-                    uint64_t v1 = tstate->sp->uint;
-                    uint64_t v2 = (tstate->sp + 1)->uint;
-                    --tstate->sp;
-                    tstate->sp->uint = (uint64_t)(v2 == v1);
-                } while (0);
-                break;
-            case C4M_ZUnsteal:
-                STACK_REQUIRE_VALUES(1);
-                STACK_REQUIRE_SLOTS(1);
-                *(tstate->sp - 1) = (c4m_stack_value_t){
-                    .static_ptr = tstate->sp->static_ptr & 0x07,
-                };
-                tstate->sp->static_ptr &= ~(0x07ULL);
-                --tstate->sp;
-                break;
-            case C4M_ZTCall:
-                c4m_vm_tcall(tstate, i);
-                break;
-            case C4M_Z0Call:
-                c4m_vm_0call(tstate, i, i->arg);
-                break;
-            case C4M_ZCallModule:
-                c4m_vm_call_module(tstate, i);
-                break;
-            case C4M_ZRunCallback:
-                c4m_vm_run_callback(tstate, i);
-                break;
-            case C4M_ZRet:
-                c4m_vm_return(tstate, i);
-                break;
-            case C4M_ZModuleEnter:
-                c4m_vm_module_enter(tstate, i);
-                break;
-            case C4M_ZModuleRet:
-                if (tstate->num_frames <= 2) {
-                    C4M_JUMP_TO_TRY_END();
-                }
-                c4m_vm_return(tstate, i);
-                break;
-            case C4M_ZFFICall:
-                c4m_vm_ffi_call(tstate, i, i->arg);
-                break;
-            case C4M_ZPushFfiPtr:
-                STACK_REQUIRE_SLOTS(1);
-                do {
-                    c4m_zcallback_t *cb = c4m_new_zcallback();
-
-                    *cb = (c4m_zcallback_t){
-                        .impl       = i->arg,
-                        .nameoffset = i->immediate,
-                        .tid        = i->type_info,
-                        .ffi        = true,
-                    };
-
-                    --tstate->sp;
-                    *tstate->sp = (c4m_stack_value_t){
-                        .callback = cb,
-                    };
-                } while (0);
-                break;
-            case C4M_ZPushVmPtr:
-                STACK_REQUIRE_SLOTS(1);
-                do {
-                    c4m_zcallback_t *cb = c4m_new_zcallback();
-
-                    *cb = (c4m_zcallback_t){
-                        .impl       = i->arg,
-                        .nameoffset = i->immediate,
-                        .tid        = i->type_info,
-                        .ffi        = false,
-                    };
-
-                    --tstate->sp;
-                    *tstate->sp = (c4m_stack_value_t){
-                        .callback = cb,
-                    };
-                } while (0);
-                break;
-            case C4M_ZSObjNew:
-                STACK_REQUIRE_SLOTS(1);
-                do {
-                    // Nim vm doesn't use the length encoded in the instruction,
-                    // but codegen does include it as i->arg. We'll use it in
-                    // our implementation.
-                    char   *data  = &tstate->vm->obj->static_data->data[i->immediate];
-                    int64_t avail = c4m_buffer_len(tstate->vm->obj->static_data)
-                                  - i->immediate;
-                    if (i->arg > avail) {
-                        C4M_CRAISE("could not unmarshal: invalid length / offset combination");
-                    }
-                    c4m_buf_t *buffer = c4m_new(c4m_type_buffer(),
-                                                c4m_kw("ptr",
-                                                       data,
-                                                       "length",
-                                                       c4m_ka(i->arg)));
-
-                    c4m_stream_t *stream = c4m_buffer_instream(buffer);
-                    c4m_obj_t    *obj    = c4m_unmarshal(stream);
-                    if (NULL == obj) {
-                        C4M_CRAISE("could not unmarshal");
-                    }
-
-                    --tstate->sp;
-                    tstate->sp->rvalue = (c4m_value_t){
-                        .obj = obj,
-                    };
-                } while (0);
-                break;
-            case C4M_ZAssignToLoc:
-                STACK_REQUIRE_VALUES(2);
-                *tstate->sp[0].lvalue = tstate->sp[1].rvalue;
-                tstate->sp += 2;
-                break;
-            case C4M_ZAssert:
-                STACK_REQUIRE_VALUES(1);
-                if (!c4m_value_iszero(&tstate->sp->rvalue)) {
-                    ++tstate->sp;
-                }
-                else {
-                    C4M_CRAISE("assertion failed");
-                }
-                break;
+            } while (0);
+            VM_NEXT();
+        VM_OP(C4M_ZAssignToLoc):
+            STACK_REQUIRE_VALUES(2);
+            *tstate->sp[0].lvalue = tstate->sp[1].rvalue;
+            tstate->sp += 2;
+            VM_NEXT();
+        VM_OP(C4M_ZStoreLocal):
+            STACK_REQUIRE_VALUES(1);
+            tstate->fp[-i->arg].rvalue = tstate->sp->rvalue;
+            ++tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZMoveLocal):
+            tstate->fp[-i->arg].rvalue = tstate->fp[-i->immediate].rvalue;
+            VM_NEXT();
+        VM_OP(C4M_ZAssert):
+            STACK_REQUIRE_VALUES(1);
+            if (!c4m_value_iszero(&tstate->sp->rvalue)) {
+                ++tstate->sp;
+            }
+            else {
+                C4M_CRAISE("assertion failed");
+            }
+            VM_NEXT();
 #ifdef C4M_DEV
-            case C4M_ZDebug:
+        VM_OP(C4M_ZDebug):
 #ifdef C4M_VM_DEBUG
-                debug_on = (bool)i->arg;
+            c4m_vm_debug_on = (bool)i->arg;
 #endif
-                break;
-                // This is not threadsafe. It's just for early days.
-            case C4M_ZPrint:
-                STACK_REQUIRE_VALUES(1);
-                c4m_print(tstate->sp->rvalue.obj);
-                c4m_stream_write_object(tstate->vm->print_stream,
-                                        tstate->sp->rvalue.obj,
-                                        false);
-                c4m_stream_putc(tstate->vm->print_stream, '\n');
-                ++tstate->sp;
-                break;
+            VM_NEXT();
+            // This is not threadsafe. It's just for early days.
+        VM_OP(C4M_ZPrint):
+            STACK_REQUIRE_VALUES(1);
+            c4m_print(tstate->sp->rvalue.obj);
+            c4m_stream_write_object(tstate->vm->print_stream,
+                                    tstate->sp->rvalue.obj,
+                                    false);
+            c4m_stream_putc(tstate->vm->print_stream, '\n');
+            ++tstate->sp;
+            VM_NEXT();
 #endif
-            case C4M_ZPopToR0:
-                STACK_REQUIRE_VALUES(1);
-                tstate->r0 = tstate->sp->rvalue;
-                ++tstate->sp;
-                break;
-            case C4M_ZPushFromR0:
-                STACK_REQUIRE_SLOTS(1);
-                --tstate->sp;
-                tstate->sp->rvalue = tstate->r0;
-                break;
-            case C4M_Z0R0c00l:
-                tstate->r0.obj = (void *)NULL;
-                break;
-            case C4M_ZPopToR1:
-                STACK_REQUIRE_VALUES(1);
-                tstate->r1 = tstate->sp->rvalue;
-                ++tstate->sp;
-                break;
-            case C4M_ZPushFromR1:
-                STACK_REQUIRE_SLOTS(1);
-                --tstate->sp;
-                tstate->sp->rvalue = tstate->r1;
-                break;
-            case C4M_ZPopToR2:
-                STACK_REQUIRE_VALUES(1);
-                tstate->r2 = tstate->sp->rvalue;
-                ++tstate->sp;
-                break;
-            case C4M_ZPushFromR2:
-                STACK_REQUIRE_SLOTS(1);
-                --tstate->sp;
-                tstate->sp->rvalue = tstate->r2;
-                break;
-            case C4M_ZPopToR3:
-                STACK_REQUIRE_VALUES(1);
-                tstate->r3 = tstate->sp->rvalue;
-                ++tstate->sp;
-                break;
-            case C4M_ZPushFromR3:
-                --tstate->sp;
-                STACK_REQUIRE_SLOTS(1);
-                tstate->sp->rvalue = tstate->r3;
-                break;
-            case C4M_ZBox:;
-                STACK_REQUIRE_VALUES(1);
-                c4m_box_t item = {
-                    .u64 = tstate->sp->uint,
+        VM_OP(C4M_ZPopToR0):
+            STACK_REQUIRE_VALUES(1);
+            tstate->r0 = tstate->sp->rvalue;
+            ++tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZPushFromR0):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            tstate->sp->rvalue = tstate->r0;
+            VM_NEXT();
+        VM_OP(C4M_Z0R0c00l):
+            tstate->r0.obj = (void *)NULL;
+            VM_NEXT();
+        VM_OP(C4M_ZPopToR1):
+            STACK_REQUIRE_VALUES(1);
+            tstate->r1 = tstate->sp->rvalue;
+            ++tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZPushFromR1):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            tstate->sp->rvalue = tstate->r1;
+            VM_NEXT();
+        VM_OP(C4M_ZPopToR2):
+            STACK_REQUIRE_VALUES(1);
+            tstate->r2 = tstate->sp->rvalue;
+            ++tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZPushFromR2):
+            STACK_REQUIRE_SLOTS(1);
+            --tstate->sp;
+            tstate->sp->rvalue = tstate->r2;
+            VM_NEXT();
+        VM_OP(C4M_ZPopToR3):
+            STACK_REQUIRE_VALUES(1);
+            tstate->r3 = tstate->sp->rvalue;
+            ++tstate->sp;
+            VM_NEXT();
+        VM_OP(C4M_ZPushFromR3):
+            --tstate->sp;
+            STACK_REQUIRE_SLOTS(1);
+            tstate->sp->rvalue = tstate->r3;
+            VM_NEXT();
+        VM_OP(C4M_ZBox):;
+            STACK_REQUIRE_VALUES(1);
+            c4m_box_t item = {
+                .u64 = tstate->sp->uint,
+            };
+            tstate->sp->rvalue.obj = c4m_box_obj(item, i->type_info);
+            VM_NEXT();
+        VM_OP(C4M_ZUnbox):
+            STACK_REQUIRE_VALUES(1);
+            tstate->sp->uint = c4m_unbox_obj(tstate->sp->rvalue.obj).u64;
+            VM_NEXT();
+        VM_OP(C4M_ZUnpack):
+            for (int32_t x = 1; x <= i->arg; ++x) {
+                *tstate->sp[0].lvalue = (c4m_value_t){
+                    .obj = c4m_tuple_get(tstate->r1.obj, i->arg - x),
                 };
-                tstate->sp->rvalue.obj = c4m_box_obj(item, i->type_info);
-                break;
-            case C4M_ZUnbox:
-                STACK_REQUIRE_VALUES(1);
-                tstate->sp->uint = c4m_unbox_obj(tstate->sp->rvalue.obj).u64;
-                break;
-            case C4M_ZUnpack:
-                for (int32_t x = 1; x <= i->arg; ++x) {
-                    *tstate->sp[0].lvalue = (c4m_value_t){
-                        .obj = c4m_tuple_get(tstate->r1.obj, i->arg - x),
-                    };
-                    ++tstate->sp;
-                }
-                break;
-            case C4M_ZBail:
-                STACK_REQUIRE_VALUES(1);
-                C4M_RAISE(tstate->sp->rvalue.obj);
-                break;
-            case C4M_ZLockMutex:
-                STACK_REQUIRE_VALUES(1);
-                pthread_mutex_lock((pthread_mutex_t *)c4m_vm_variable(tstate,
-                                                                      i));
-                break;
-            case C4M_ZUnlockMutex:
-                STACK_REQUIRE_VALUES(1);
-                pthread_mutex_unlock((pthread_mutex_t *)c4m_vm_variable(tstate,
-                                                                        i));
-                break;
+                ++tstate->sp;
             }
-
-            ++tstate->pc;
-        }
+            VM_NEXT();
+        VM_OP(C4M_ZBail):
+            STACK_REQUIRE_VALUES(1);
+            C4M_RAISE(tstate->sp->rvalue.obj);
+            VM_NEXT();
+        VM_OP(C4M_ZLockMutex):
+            STACK_REQUIRE_VALUES(1);
+            pthread_mutex_lock((pthread_mutex_t *)c4m_vm_variable(tstate,
+                                                                  i));
+            VM_NEXT();
+        VM_OP(C4M_ZUnlockMutex):
+            STACK_REQUIRE_VALUES(1);
+            pthread_mutex_unlock((pthread_mutex_t *)c4m_vm_variable(tstate,
+                                                                    i));
+            VM_NEXT();
+
+        VM_LOOP_END();
     }
     C4M_EXCEPT
     {
@@ -1580,7 +1901,7 @@ static void
 c4m_vm_load_const_data(c4m_vm_t *vm)
 {
     int         nc    = vm->obj->num_const_objs;
-    c4m_dict_t *memos = c4m_alloc_unmarshal_memos();
+    c4m_memo_t *memos = c4m_alloc_unmarshal_memos();
     c4m_buf_t  *inbuf = vm->obj->static_data;
 
     if (!nc) {
@@ -1621,10 +1942,15 @@ c4m_vm_setup_ffi(c4m_vm_t *vm)
         return;
     }
 
+    vm->ffi_decls = c4m_gc_array_alloc(c4m_ffi_decl_t *,
+                                       vm->ffi_info_entries);
+
     for (int i = 0; i < vm->ffi_info_entries; i++) {
         c4m_ffi_decl_t *ffi_info = c4m_list_get(vm->obj->ffi_info, i, NULL);
         c4m_zffi_cif   *cif      = &ffi_info->cif;
 
+        vm->ffi_decls[i] = ffi_info;
+
         cif->fptr = c4m_ffi_find_symbol(ffi_info->external_name,
                                         ffi_info->dll_list);
 
@@ -1639,12 +1965,24 @@ c4m_vm_setup_ffi(c4m_vm_t *vm)
         if (n < 0) {
             n = 0;
         }
-        for (int j = 0; j < n; j++) {
-            uint8_t param = ffi_info->external_params[j];
-            arglist[j]    = c4m_ffi_arg_type_map(param);
+        if (n != 0) {
+            cif->arg_plan = c4m_gc_array_value_alloc(uint8_t, n);
+        }
 
-            if (param == C4M_CSTR_CTYPE_CONST && j < 63) {
-                cif->str_convert |= (1UL << j);
+        for (int j = 0; j < n; j++) {
+            uint8_t  param = ffi_info->external_params[j];
+            uint8_t *plan  = &cif->arg_plan[n - j - 1];
+            arglist[j]     = c4m_ffi_arg_type_map(param);
+            *plan          = 0;
+
+            if (param == C4M_CSTR_CTYPE_CONST) {
+                *plan |= C4M_FFI_ARG_CSTR;
+                if (j < 63) {
+                    cif->str_convert |= (1UL << j);
+                }
+            }
+            if (j < 63 && ((1UL << j) & cif->hold_info)) {
+                *plan |= C4M_FFI_ARG_HOLD;
             }
         }
 
@@ -1660,11 +1998,45 @@ c4m_vm_setup_ffi(c4m_vm_t *vm)
     }
 }
 
+// The VM never executes out of a module's instruction list; list
+// access goes through the list's lock, which we definitely don't want
+// to pay for on every single instruction. Instead, once the code is
+// final, we copy it into a flat array that doesn't change for the
+// life of the VM.
+void
+c4m_vm_freeze_instructions(c4m_vm_t *vm)
+{
+    int64_t nmodules = c4m_list_len(vm->obj->module_contents);
+
+    for (int64_t n = 0; n < nmodules; ++n) {
+        c4m_zmodule_info_t *m   = c4m_list_get(vm->obj->module_contents,
+                                             n,
+                                             NULL);
+        int64_t             len = c4m_list_len(m->instructions);
+
+        if (m->code_mapped) {
+            continue;
+        }
+
+        // Always leave room for at least one instruction; a module
+        // with no code still gets a frame pushed, which looks at the
+        // first instruction for its line number.
+        m->code = c4m_gc_array_alloc(c4m_zinstruction_t, len + 1);
+
+        for (int64_t i = 0; i < len; i++) {
+            m->code[i] = *(c4m_zinstruction_t *)c4m_list_get(m->instructions,
+                                                             i,
+                                                             NULL);
+        }
+    }
+}
+
 void
 c4m_vm_setup_runtime(c4m_vm_t *vm)
 {
     c4m_vm_load_const_data(vm);
     c4m_vm_setup_ffi(vm);
+    c4m_vm_freeze_instructions(vm);
 
 #ifdef C4M_DEV
     vm->print_buf    = c4m_buffer_empty();
@@ -1692,6 +2064,7 @@ c4m_vm_reset(c4m_vm_t *vm)
     vm->all_sections = c4m_new(c4m_type_set(c4m_type_utf8()));
     vm->section_docs = c4m_new(c4m_type_dict(c4m_type_utf8(),
                                              c4m_type_ref()));
+    vm->attr_slots   = NULL;
     vm->using_attrs  = false;
 }
 
@@ -1745,9 +2118,7 @@ c4m_vmthread_run(c4m_vmthread_t *tstate)
     assert(!tstate->running);
     tstate->running = true;
 
-    c4m_zinstruction_t *i = c4m_list_get(tstate->current_module->instructions,
-                                         tstate->pc,
-                                         NULL);
+    c4m_zinstruction_t *i = &tstate->current_module->code[tstate->pc];
 
     c4m_vmframe_push(tstate,
                      i,
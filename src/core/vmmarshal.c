@@ -4,16 +4,18 @@ extern c4m_zinstruction_t *c4m_new_instruction();
 extern c4m_zfn_info_t     *c4m_new_zfn();
 extern c4m_zmodule_info_t *c4m_new_zmodule();
 extern c4m_zobject_file_t *c4m_new_zobject();
+extern c4m_ffi_decl_t     *c4m_new_ffi_decl();
+extern c4m_vm_t           *c4m_new_vm(c4m_compile_ctx *);
 
-typedef void (*marshalfn_t)(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid);
+typedef void (*marshalfn_t)(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid);
 
 static void
-marshal_dict_value_ref(c4m_dict_t *in, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid, marshalfn_t fn)
+marshal_dict_value_ref(c4m_dict_t *in, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid, marshalfn_t fn)
 {
     uint64_t             length;
     hatrack_dict_item_t *view = hatrack_dict_items_sort(in, &length);
 
-    c4m_marshal_u32(length, out);
+    c4m_marshal_len(length, out, memos);
     for (uint64_t i = 0; i < length; ++i) {
         c4m_sub_marshal(view[i].key, out, memos, mid);
         fn(view[i].value, out, memos, mid);
@@ -21,21 +23,21 @@ marshal_dict_value_ref(c4m_dict_t *in, c4m_stream_t *out, c4m_dict_t *memos, int
 }
 
 static void
-marshal_xlist_ref(c4m_list_t *in, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid, marshalfn_t fn)
+marshal_xlist_ref(c4m_list_t *in, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid, marshalfn_t fn)
 {
-    c4m_marshal_i32(in->append_ix, out);
-    c4m_marshal_i32(in->length, out);
+    c4m_marshal_len(in->append_ix, out, memos);
+    c4m_marshal_len(in->length, out, memos);
     for (int32_t i = 0; i < in->length; ++i) {
         fn(in->data[i], out, memos, mid);
     }
 }
 
-typedef void *(*unmarshalfn_t)(c4m_stream_t *in, c4m_dict_t *memos);
+typedef void *(*unmarshalfn_t)(c4m_stream_t *in, c4m_memo_t *memos);
 
 static void
-unmarshal_dict_value_ref(c4m_dict_t *out, c4m_stream_t *in, c4m_dict_t *memos, unmarshalfn_t fn)
+unmarshal_dict_value_ref(c4m_dict_t *out, c4m_stream_t *in, c4m_memo_t *memos, unmarshalfn_t fn)
 {
-    uint32_t length = c4m_unmarshal_u32(in);
+    uint32_t length = c4m_unmarshal_len(in, memos);
 
     for (uint32_t i = 0; i < length; ++i) {
         c4m_obj_t key   = c4m_sub_unmarshal(in, memos);
@@ -45,11 +47,11 @@ unmarshal_dict_value_ref(c4m_dict_t *out, c4m_stream_t *in, c4m_dict_t *memos, u
 }
 
 static c4m_list_t *
-unmarshal_xlist_ref(c4m_stream_t *in, c4m_dict_t *memos, unmarshalfn_t fn)
+unmarshal_xlist_ref(c4m_stream_t *in, c4m_memo_t *memos, unmarshalfn_t fn)
 {
     c4m_list_t *x = c4m_list(c4m_type_ref());
-    x->append_ix  = c4m_unmarshal_i32(in);
-    x->length     = c4m_unmarshal_i32(in);
+    x->append_ix  = c4m_unmarshal_len(in, memos);
+    x->length     = c4m_unmarshal_len(in, memos);
     x->data       = c4m_gc_array_alloc(int64_t *, x->length);
 
     for (int32_t i = 0; i < x->append_ix; ++i) {
@@ -60,7 +62,7 @@ unmarshal_xlist_ref(c4m_stream_t *in, c4m_dict_t *memos, unmarshalfn_t fn)
 }
 
 static void
-marshal_instruction(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_instruction(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
     c4m_zinstruction_t *in = ref;
 
@@ -74,7 +76,7 @@ marshal_instruction(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mi
 }
 
 static void *
-unmarshal_instruction(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_instruction(c4m_stream_t *in, c4m_memo_t *memos)
 {
     c4m_zinstruction_t *out = c4m_new_instruction();
 
@@ -91,7 +93,7 @@ unmarshal_instruction(c4m_stream_t *in, c4m_dict_t *memos)
 
 #if 0 // Removing for now
 static void
-marshal_ffi_arg_info(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_ffi_arg_info(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
     c4m_zffi_arg_info_t *in = ref;
 
@@ -109,7 +111,7 @@ ffi_decl_gc_map(uint64_t *bitmap, c4m_zffi_arg_info_t *info)
 }
 
 static void *
-unmarshal_ffi_arg_info(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_ffi_arg_info(c4m_stream_t *in, c4m_memo_t *memos)
 {
 
     c4m_zffi_arg_info_t *out = c4m_gc_alloc_mapped(c4m_zffi_arg_info_t,
@@ -126,46 +128,61 @@ unmarshal_ffi_arg_info(c4m_stream_t *in, c4m_dict_t *memos)
 #endif
 
 static void
-marshal_ffi_info(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_ffi_info(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
-#if 0
     c4m_zffi_info_t *in = ref;
 
-    c4m_marshal_i64(in->nameoffset, out);
-    c4m_marshal_i64(in->localname, out);
-    c4m_marshal_i32(in->mid, out);
-    c4m_sub_marshal(in->tid, out, memos, mid);
-    c4m_marshal_bool(in->va, out);
-    c4m_sub_marshal(in->dlls, out, memos, mid);
-    marshal_xlist_ref(in->arg_info, out, memos, mid, marshal_ffi_arg_info);
-    c4m_sub_marshal(in->shortdoc, out, memos, mid);
-    c4m_sub_marshal(in->longdoc, out, memos, mid);
-#endif
+    // Only what the runtime needs gets saved; local_params is
+    // compile-time only, and the cif itself (function pointer, arg
+    // types, str_convert) gets rebuilt by c4m_vm_setup_ffi().
+    c4m_sub_marshal(in->short_doc, out, memos, mid);
+    c4m_sub_marshal(in->long_doc, out, memos, mid);
+    c4m_sub_marshal(in->local_name, out, memos, mid);
+    c4m_sub_marshal(in->external_name, out, memos, mid);
+    c4m_sub_marshal(in->dll_list, out, memos, mid);
+    c4m_marshal_i32(in->num_ext_params, out);
+    for (int i = 0; i < in->num_ext_params; i++) {
+        c4m_marshal_u8(in->external_params[i], out);
+    }
+    c4m_marshal_u8(in->external_return_type, out);
+    c4m_marshal_bool(in->skip_boxes, out);
+    c4m_marshal_u64(in->cif.hold_info, out);
+    c4m_marshal_u64(in->cif.alloc_info, out);
+    c4m_marshal_i32(in->global_ffi_call_ix, out);
 }
 
 static void *
-unmarshal_ffi_info(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_ffi_info(c4m_stream_t *in, c4m_memo_t *memos)
 {
-#if 0
-    c4m_zffi_info_t *out = c4m_gc_alloc(c4m_zffi_info_t);
-
-    out->nameoffset = c4m_unmarshal_i64(in);
-    out->localname  = c4m_unmarshal_i64(in);
-    out->mid        = c4m_unmarshal_i32(in);
-    out->tid        = c4m_sub_unmarshal(in, memos);
-    out->va         = c4m_unmarshal_bool(in);
-    out->dlls       = c4m_sub_unmarshal(in, memos);
-    out->arg_info   = unmarshal_xlist_ref(in, memos, unmarshal_ffi_arg_info);
-    out->shortdoc   = c4m_sub_unmarshal(in, memos);
-    out->longdoc    = c4m_sub_unmarshal(in, memos);
+    c4m_zffi_info_t *out = c4m_new_ffi_decl();
+
+    out->short_doc      = c4m_sub_unmarshal(in, memos);
+    out->long_doc       = c4m_sub_unmarshal(in, memos);
+    out->local_name     = c4m_sub_unmarshal(in, memos);
+    out->external_name  = c4m_sub_unmarshal(in, memos);
+    out->dll_list       = c4m_sub_unmarshal(in, memos);
+    out->num_ext_params = c4m_unmarshal_i32(in);
+
+    if (out->num_ext_params > 0) {
+        out->external_params = c4m_gc_array_alloc(uint8_t,
+                                                  out->num_ext_params);
+
+        for (int i = 0; i < out->num_ext_params; i++) {
+            out->external_params[i] = c4m_unmarshal_u8(in);
+        }
+    }
+
+    out->external_return_type = c4m_unmarshal_u8(in);
+    out->skip_boxes           = c4m_unmarshal_bool(in);
+    out->cif.hold_info        = c4m_unmarshal_u64(in);
+    out->cif.alloc_info       = c4m_unmarshal_u64(in);
+    out->global_ffi_call_ix   = c4m_unmarshal_i32(in);
 
     return out;
-#endif
-    return NULL;
 }
 
 static void
-marshal_symbol(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_symbol(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
 #if 0
     c4m_zsymbol_t *in = ref;
@@ -176,7 +193,7 @@ marshal_symbol(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
 }
 
 static void *
-unmarshal_symbol(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_symbol(c4m_stream_t *in, c4m_memo_t *memos)
 {
 #if 0
     c4m_zsymbol_t *out = c4m_gc_alloc(c4m_zsymbol_t);
@@ -190,7 +207,7 @@ unmarshal_symbol(c4m_stream_t *in, c4m_dict_t *memos)
 }
 
 static void
-marshal_fn_info(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_fn_info(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
     c4m_zfn_info_t *in = ref;
 
@@ -201,40 +218,42 @@ marshal_fn_info(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
     c4m_marshal_i32(in->mid, out);
     c4m_marshal_i32(in->offset, out);
     c4m_marshal_i32(in->size, out);
+    c4m_marshal_i32(in->static_lock, out);
     c4m_sub_marshal(in->shortdoc, out, memos, mid);
     c4m_sub_marshal(in->longdoc, out, memos, mid);
 }
 
 static void *
-unmarshal_fn_info(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_fn_info(c4m_stream_t *in, c4m_memo_t *memos)
 {
     c4m_zfn_info_t *out = c4m_new_zfn();
 
-    out->funcname  = c4m_sub_unmarshal(in, memos);
-    out->syms      = c4m_sub_unmarshal(in, memos);
-    out->sym_types = unmarshal_xlist_ref(in, memos, unmarshal_symbol);
-    out->tid       = c4m_sub_unmarshal(in, memos);
-    out->mid       = c4m_unmarshal_i32(in);
-    out->offset    = c4m_unmarshal_i32(in);
-    out->size      = c4m_unmarshal_i32(in);
-    out->shortdoc  = c4m_sub_unmarshal(in, memos);
-    out->longdoc   = c4m_sub_unmarshal(in, memos);
+    out->funcname    = c4m_sub_unmarshal(in, memos);
+    out->syms        = c4m_sub_unmarshal(in, memos);
+    out->sym_types   = unmarshal_xlist_ref(in, memos, unmarshal_symbol);
+    out->tid         = c4m_sub_unmarshal(in, memos);
+    out->mid         = c4m_unmarshal_i32(in);
+    out->offset      = c4m_unmarshal_i32(in);
+    out->size        = c4m_unmarshal_i32(in);
+    out->static_lock = c4m_unmarshal_i32(in);
+    out->shortdoc    = c4m_sub_unmarshal(in, memos);
+    out->longdoc     = c4m_sub_unmarshal(in, memos);
 
     return out;
 }
 
 static void
-marshal_value(c4m_value_t *in, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_value(c4m_value_t *in, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
 }
 
 static void
-unmarshal_value(c4m_value_t *out, c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_value(c4m_value_t *out, c4m_stream_t *in, c4m_memo_t *memos)
 {
 }
 
 static void
-marshal_param_info(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_param_info(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
 #if 0
     c4m_zparam_info_t *in = ref;
@@ -257,7 +276,7 @@ marshal_param_info(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid
 }
 
 static void *
-unmarshal_param_info(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_param_info(c4m_stream_t *in, c4m_memo_t *memos)
 {
 #if 0
     c4m_zparam_info_t *out = c4m_gc_alloc(c4m_zparam_info_t);
@@ -283,11 +302,10 @@ unmarshal_param_info(c4m_stream_t *in, c4m_dict_t *memos)
     return NULL;
 }
 
+// Everything but the code, which images store separately.
 static void
-marshal_module_info(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_module_header(c4m_zmodule_info_t *in, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
-    c4m_zmodule_info_t *in = ref;
-
     c4m_marshal_i32(in->module_id, out);
     c4m_marshal_u64(in->module_hash, out);
     c4m_sub_marshal(in->modname, out, memos, mid);
@@ -301,11 +319,19 @@ marshal_module_info(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mi
     c4m_marshal_i32(in->module_var_size, out);
     c4m_marshal_i32(in->init_size, out);
     marshal_xlist_ref(in->parameters, out, memos, mid, marshal_param_info);
+}
+
+static void
+marshal_module_info(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
+{
+    c4m_zmodule_info_t *in = ref;
+
+    marshal_module_header(in, out, memos, mid);
     marshal_xlist_ref(in->instructions, out, memos, mid, marshal_instruction);
 }
 
-static void *
-unmarshal_module_info(c4m_stream_t *in, c4m_dict_t *memos)
+static c4m_zmodule_info_t *
+unmarshal_module_header(c4m_stream_t *in, c4m_memo_t *memos)
 {
     c4m_zmodule_info_t *out = c4m_new_zmodule();
 
@@ -325,13 +351,22 @@ unmarshal_module_info(c4m_stream_t *in, c4m_dict_t *memos)
     out->module_var_size = c4m_unmarshal_i32(in);
     out->init_size       = c4m_unmarshal_i32(in);
     out->parameters      = unmarshal_xlist_ref(in, memos, unmarshal_param_info);
-    out->instructions    = unmarshal_xlist_ref(in, memos, unmarshal_instruction);
+
+    return out;
+}
+
+static void *
+unmarshal_module_info(c4m_stream_t *in, c4m_memo_t *memos)
+{
+    c4m_zmodule_info_t *out = unmarshal_module_header(in, memos);
+
+    out->instructions = unmarshal_xlist_ref(in, memos, unmarshal_instruction);
 
     return out;
 }
 
 static void
-marshal_object_file(c4m_zobject_file_t *in, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_object_file(c4m_zobject_file_t *in, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
 #if 0
     // XXX The Nim code does some funny business with nextmid and nextEntrypoint
@@ -372,7 +407,7 @@ marshal_object_file(c4m_zobject_file_t *in, c4m_stream_t *out, c4m_dict_t *memos
 }
 
 static c4m_zobject_file_t *
-unmarshal_object_file(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_object_file(c4m_stream_t *in, c4m_memo_t *memos)
 {
     c4m_zobject_file_t *out = c4m_new_zobject();
 
@@ -393,7 +428,7 @@ unmarshal_object_file(c4m_stream_t *in, c4m_dict_t *memos)
 static void
 marshal_attr_contents(void         *ref,
                       c4m_stream_t *out,
-                      c4m_dict_t   *memos,
+                      c4m_memo_t   *memos,
                       int64_t      *mid)
 {
 #if 0
@@ -412,7 +447,7 @@ marshal_attr_contents(void         *ref,
 }
 
 static void *
-unmarshal_attr_contents(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_attr_contents(c4m_stream_t *in, c4m_memo_t *memos)
 {
 #if 0
     c4m_attr_contents_t *out = c4m_gc_alloc(c4m_attr_contents_t);
@@ -433,7 +468,7 @@ unmarshal_attr_contents(c4m_stream_t *in, c4m_dict_t *memos)
 }
 
 static void
-marshal_docs_container(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_docs_container(void *ref, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
 #if 0
     c4m_docs_container_t *in = ref;
@@ -444,7 +479,7 @@ marshal_docs_container(void *ref, c4m_stream_t *out, c4m_dict_t *memos, int64_t
 }
 
 static void *
-unmarshal_docs_container(c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_docs_container(c4m_stream_t *in, c4m_memo_t *memos)
 {
 #if 0
     c4m_docs_container_t *out = c4m_gc_alloc(c4m_docs_container_t);
@@ -458,7 +493,7 @@ unmarshal_docs_container(c4m_stream_t *in, c4m_dict_t *memos)
 }
 
 static void
-marshal_module_allocations(c4m_vm_t *vm, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+marshal_module_allocations(c4m_vm_t *vm, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
     const int64_t nmodules = c4m_list_len(vm->obj->module_contents);
     for (int64_t n = 0; n < nmodules; ++n) {
@@ -472,7 +507,7 @@ marshal_module_allocations(c4m_vm_t *vm, c4m_stream_t *out, c4m_dict_t *memos, i
 }
 
 static void
-unmarshal_module_allocations(c4m_vm_t *vm, c4m_stream_t *in, c4m_dict_t *memos)
+unmarshal_module_allocations(c4m_vm_t *vm, c4m_stream_t *in, c4m_memo_t *memos)
 {
     const int64_t nmodules = c4m_list_len(vm->obj->module_contents);
     for (int64_t n = 0; n < nmodules; ++n) {
@@ -486,7 +521,7 @@ unmarshal_module_allocations(c4m_vm_t *vm, c4m_stream_t *in, c4m_dict_t *memos)
 }
 
 void
-c4m_vm_marshal(c4m_vm_t *vm, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
+c4m_vm_marshal(c4m_vm_t *vm, c4m_stream_t *out, c4m_memo_t *memos, int64_t *mid)
 {
     marshal_object_file(vm->obj, out, memos, mid);
 
@@ -506,7 +541,7 @@ c4m_vm_marshal(c4m_vm_t *vm, c4m_stream_t *out, c4m_dict_t *memos, int64_t *mid)
 }
 
 void
-c4m_vm_unmarshal(c4m_vm_t *vm, c4m_stream_t *in, c4m_dict_t *memos)
+c4m_vm_unmarshal(c4m_vm_t *vm, c4m_stream_t *in, c4m_memo_t *memos)
 {
     vm->obj = unmarshal_object_file(in, memos);
 
@@ -514,6 +549,7 @@ c4m_vm_unmarshal(c4m_vm_t *vm, c4m_stream_t *in, c4m_dict_t *memos)
     // c4m_global_type_env = c4m_sub_unmarshal(in, memos);
 
     c4m_vm_reset(vm);
+    c4m_vm_freeze_instructions(vm);
     unmarshal_module_allocations(vm, in, memos);
 
     vm->using_attrs = c4m_unmarshal_bool(in);
@@ -523,3 +559,503 @@ c4m_vm_unmarshal(c4m_vm_t *vm, c4m_stream_t *in, c4m_dict_t *memos)
         unmarshal_dict_value_ref(vm->section_docs, in, memos, unmarshal_docs_container);
     }
 }
+
+// Flat program images.
+//
+// Loading a VM with c4m_vm_unmarshal() decodes and allocates every
+// instruction separately, then c4m_vm_freeze_instructions() copies
+// them all again. For a program that is compiled once and then loaded
+// many times, that's most of the load time.
+//
+// An image lays a program out so its code can run from wherever the
+// file is mapped. It's a fixed header, then page-aligned sections:
+//
+// - Metadata: the rest of the object file (module info, the function
+//   and FFI tables), plus a table of the types the code refers to,
+//   written with the regular marshaling code. This part is small.
+// - Static data: the raw bytes the constant pool is built from.
+// - Code: each module's instructions as an array of
+//   c4m_zinstruction_t, exactly as the VM runs them, with one zeroed
+//   instruction after each module (see c4m_vm_freeze_instructions()).
+// - Aux: whatever the writer wants kept with the image; the object
+//   cache keeps its source digests there.
+//
+// All offsets are from the start of the file. The only pointers in
+// the code are the instruction types, which are stored as an index
+// into the type table, plus one (so 0 is still NULL). The loader maps
+// the file privately and patches those in place; there's no
+// allocation per instruction, and only the pages that hold typed
+// instructions stop being shared with the page cache.
+//
+// Because the code is stored in its in-memory form, an image only
+// loads on builds with the same instruction layout and byte order;
+// anything else is rejected, just like a version mismatch.
+
+#define C4M_IMAGE_MAGIC   0xc4c41a6ec4c41a6eULL
+#define C4M_IMAGE_VERSION 1
+#define C4M_IMAGE_ALIGN   4096
+#define C4M_IMAGE_BOM     0x0102
+
+typedef struct {
+    uint64_t offset;
+    uint64_t len;
+} image_section_t;
+
+typedef struct {
+    uint64_t        magic;
+    uint16_t        version;
+    uint16_t        obj_version;
+    uint16_t        instr_size;
+    uint16_t        byte_order;
+    image_section_t meta;
+    image_section_t static_data;
+    image_section_t code;
+    image_section_t aux;
+} image_header_t;
+
+static inline uint64_t
+image_align(uint64_t n)
+{
+    return (n + C4M_IMAGE_ALIGN - 1) & ~(uint64_t)(C4M_IMAGE_ALIGN - 1);
+}
+
+static inline uint64_t
+image_place(image_section_t *sect, uint64_t at, int64_t len)
+{
+    sect->offset = image_align(at);
+    sect->len    = len;
+
+    return sect->offset + len;
+}
+
+static void
+image_write_section(c4m_stream_t    *out,
+                    uint64_t        *at,
+                    image_section_t *sect,
+                    char            *data)
+{
+    static char zeros[C4M_IMAGE_ALIGN];
+
+    if (!sect->len) {
+        return;
+    }
+
+    c4m_stream_raw_write(out, sect->offset - *at, zeros);
+    c4m_stream_raw_write(out, sect->len, data);
+
+    *at = sect->offset + sect->len;
+}
+
+void
+c4m_vm_write_image(c4m_vm_t *vm, c4m_buf_t *aux, c4m_stream_t *out)
+{
+    c4m_zobject_file_t *obj      = vm->obj;
+    int                 nmodules = c4m_list_len(obj->module_contents);
+    c4m_dict_t         *type_ix  = c4m_new(c4m_type_dict(c4m_type_ref(),
+                                                   c4m_type_u64()));
+    c4m_list_t         *types    = c4m_list(c4m_type_ref());
+    uint64_t            ncode    = 0;
+
+    // Number the types the code uses, and size the code section.
+    for (int i = 0; i < nmodules; i++) {
+        c4m_zmodule_info_t *m   = c4m_list_get(obj->module_contents, i, NULL);
+        int                 len = c4m_list_len(m->instructions);
+
+        for (int j = 0; j < len; j++) {
+            c4m_zinstruction_t *ins   = c4m_list_get(m->instructions, j, NULL);
+            bool                found = false;
+
+            if (ins->type_info == NULL) {
+                continue;
+            }
+
+            hatrack_dict_get(type_ix, ins->type_info, &found);
+
+            if (!found) {
+                c4m_list_append(types, ins->type_info);
+                hatrack_dict_put(type_ix,
+                                 ins->type_info,
+                                 (void *)(uint64_t)c4m_list_len(types));
+            }
+        }
+
+        ncode += len + 1;
+    }
+
+    c4m_buf_t *code = c4m_new(c4m_type_buffer(),
+                              c4m_kw("length",
+                                     c4m_ka(ncode
+                                            * sizeof(c4m_zinstruction_t))));
+    c4m_buf_t *meta = c4m_buffer_empty();
+
+    memset(code->data, 0, code->byte_len);
+
+    c4m_stream_t *s     = c4m_buffer_outstream(meta, false);
+    c4m_memo_t   *memos = c4m_alloc_marshal_memos();
+    int64_t       mid   = 1;
+    uint64_t      next  = 0;
+
+    c4m_marshal_i32(obj->num_const_objs, s);
+    c4m_marshal_i32(obj->entrypoint, s);
+    c4m_marshal_i32(obj->next_entrypoint, s);
+    c4m_marshal_u32(nmodules, s);
+
+    for (int i = 0; i < nmodules; i++) {
+        c4m_zmodule_info_t *m    = c4m_list_get(obj->module_contents, i, NULL);
+        int                 len  = c4m_list_len(m->instructions);
+        c4m_zinstruction_t *dest = ((c4m_zinstruction_t *)code->data) + next;
+
+        marshal_module_header(m, s, memos, &mid);
+        c4m_marshal_u32(len, s);
+        c4m_marshal_u64(next * sizeof(c4m_zinstruction_t), s);
+
+        for (int j = 0; j < len; j++) {
+            c4m_zinstruction_t *ins = c4m_list_get(m->instructions, j, NULL);
+            uint64_t            tix = 0;
+
+            if (ins->type_info != NULL) {
+                tix = (uint64_t)hatrack_dict_get(type_ix,
+                                                 ins->type_info,
+                                                 NULL);
+            }
+
+            // Field by field, so the padding is always zero.
+            dest[j].op        = ins->op;
+            dest[j].pad       = ins->pad;
+            dest[j].module_id = ins->module_id;
+            dest[j].line_no   = ins->line_no;
+            dest[j].arg       = ins->arg;
+            dest[j].immediate = ins->immediate;
+            dest[j].type_info = (c4m_type_t *)tix;
+        }
+
+        next += len + 1;
+    }
+
+    marshal_xlist_ref(obj->func_info, s, memos, &mid, marshal_fn_info);
+    marshal_xlist_ref(obj->ffi_info, s, memos, &mid, marshal_ffi_info);
+
+    int ntypes = c4m_list_len(types);
+
+    c4m_marshal_u32(ntypes, s);
+
+    for (int i = 0; i < ntypes; i++) {
+        c4m_sub_marshal(c4m_list_get(types, i, NULL), s, memos, &mid);
+    }
+
+    c4m_stream_close(s);
+
+    image_header_t hdr = {
+        .magic       = C4M_IMAGE_MAGIC,
+        .version     = C4M_IMAGE_VERSION,
+        .obj_version = C4M_OBJ_VERSION,
+        .instr_size  = sizeof(c4m_zinstruction_t),
+        .byte_order  = C4M_IMAGE_BOM,
+    };
+    c4m_buf_t *sdata = obj->static_data;
+    uint64_t   at;
+
+    at = image_place(&hdr.meta, sizeof(hdr), meta->byte_len);
+    at = image_place(&hdr.static_data, at, sdata ? sdata->byte_len : 0);
+    at = image_place(&hdr.code, at, code->byte_len);
+    at = image_place(&hdr.aux, at, aux ? aux->byte_len : 0);
+
+    c4m_stream_raw_write(out, sizeof(hdr), (char *)&hdr);
+    at = sizeof(hdr);
+
+    image_write_section(out, &at, &hdr.meta, meta->data);
+    image_write_section(out, &at, &hdr.static_data, sdata ? sdata->data : NULL);
+    image_write_section(out, &at, &hdr.code, code->data);
+    image_write_section(out, &at, &hdr.aux, aux ? aux->data : NULL);
+}
+
+static inline bool
+image_section_ok(image_section_t *sect, uint64_t size)
+{
+    return sect->offset <= size && sect->len <= size - sect->offset
+        && sect->len <= INT32_MAX;
+}
+
+static bool
+image_header_ok(image_header_t *hdr, uint64_t size)
+{
+    return hdr->magic == C4M_IMAGE_MAGIC
+        && hdr->version == C4M_IMAGE_VERSION
+        && hdr->obj_version == C4M_OBJ_VERSION
+        && hdr->instr_size == sizeof(c4m_zinstruction_t)
+        && hdr->byte_order == C4M_IMAGE_BOM
+        && image_section_ok(&hdr->meta, size)
+        && image_section_ok(&hdr->static_data, size)
+        && image_section_ok(&hdr->code, size)
+        && image_section_ok(&hdr->aux, size)
+        && !(hdr->code.offset % sizeof(c4m_zinstruction_t));
+}
+
+// A buffer that points into the mapping, rather than copying it.
+static c4m_buf_t *
+image_section_buf(char *base, image_section_t *sect)
+{
+    if (!sect->len) {
+        return c4m_buffer_empty();
+    }
+
+    return c4m_new(c4m_type_buffer(),
+                   c4m_kw("length",
+                          c4m_ka(sect->len),
+                          "ptr",
+                          c4m_ka(base + sect->offset)));
+}
+
+static c4m_vm_t *
+image_to_vm(char *base, image_header_t *hdr)
+{
+    c4m_vm_t           *vm    = c4m_new_vm(NULL);
+    c4m_zobject_file_t *obj   = vm->obj;
+    c4m_memo_t         *memos = c4m_alloc_unmarshal_memos();
+    c4m_stream_t       *s     = c4m_buffer_instream(image_section_buf(base,
+                                                                &hdr->meta));
+
+    obj->num_const_objs  = c4m_unmarshal_i32(s);
+    obj->entrypoint      = c4m_unmarshal_i32(s);
+    obj->next_entrypoint = c4m_unmarshal_i32(s);
+
+    uint32_t  nmodules = c4m_unmarshal_u32(s);
+    uint32_t *lens     = c4m_gc_array_value_alloc(uint32_t, nmodules + 1);
+    uint64_t *starts   = c4m_gc_array_value_alloc(uint64_t, nmodules + 1);
+
+    for (uint32_t i = 0; i < nmodules; i++) {
+        c4m_list_append(obj->module_contents,
+                        unmarshal_module_header(s, memos));
+        lens[i]   = c4m_unmarshal_u32(s);
+        starts[i] = c4m_unmarshal_u64(s);
+    }
+
+    obj->func_info = unmarshal_xlist_ref(s, memos, unmarshal_fn_info);
+    obj->ffi_info  = unmarshal_xlist_ref(s, memos, unmarshal_ffi_info);
+
+    uint32_t     ntypes = c4m_unmarshal_u32(s);
+    c4m_type_t **types  = c4m_gc_array_alloc(c4m_type_t *, ntypes + 1);
+
+    for (uint32_t i = 0; i < ntypes; i++) {
+        types[i] = c4m_sub_unmarshal(s, memos);
+    }
+
+    c4m_stream_close(s);
+
+    // Check everything before touching the code.
+    c4m_zinstruction_t *code = (c4m_zinstruction_t *)(base + hdr->code.offset);
+
+    for (uint32_t i = 0; i < nmodules; i++) {
+        uint64_t n = (uint64_t)lens[i] + 1;
+
+        if (starts[i] % sizeof(c4m_zinstruction_t)
+            || starts[i] > hdr->code.len
+            || n > (hdr->code.len - starts[i]) / sizeof(c4m_zinstruction_t)) {
+            return NULL;
+        }
+
+        c4m_zinstruction_t *ins = code + starts[i] / sizeof(c4m_zinstruction_t);
+
+        for (uint64_t j = 0; j < n; j++) {
+            if ((uint64_t)ins[j].type_info > ntypes) {
+                return NULL;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < nmodules; i++) {
+        c4m_zmodule_info_t *m   = c4m_list_get(obj->module_contents, i, NULL);
+        c4m_zinstruction_t *ins = code + starts[i] / sizeof(c4m_zinstruction_t);
+
+        m->code        = ins;
+        m->code_mapped = true;
+
+        // The list is only for the compiler-side tools (disassembly,
+        // re-marshaling); it points at the mapped code.
+        m->instructions = c4m_list(c4m_type_ref());
+
+        for (uint64_t j = 0; j < lens[i]; j++) {
+            c4m_list_append(m->instructions, &ins[j]);
+        }
+    }
+
+    obj->static_data = image_section_buf(base, &hdr->static_data);
+
+    // Last, since nothing can fail after this: once the types are
+    // patched in, the collector has to know about (and possibly
+    // update) them, so the mapping becomes a root for good. Nothing
+    // here allocates, so nothing moves while we patch.
+    c4m_gc_register_root(code, hdr->code.len / sizeof(uint64_t));
+
+    for (uint32_t i = 0; i < nmodules; i++) {
+        c4m_zinstruction_t *ins = code + starts[i] / sizeof(c4m_zinstruction_t);
+
+        for (uint64_t j = 0; j < lens[i]; j++) {
+            uint64_t tix = (uint64_t)ins[j].type_info;
+
+            ins[j].type_info = tix ? types[tix - 1] : NULL;
+        }
+    }
+
+    return vm;
+}
+
+// Images get mapped once per path. The object cache maps its file on
+// every hit, and a mapping is a GC root for as long as any VM might
+// run from it, so mapping the same file over and over would pile up
+// both. Instead, as long as the path still names the same file, a hit
+// gets a fresh VM over the program we already decoded. Cache files
+// only ever get replaced by a rename, never rewritten in place, so
+// an old mapping stays valid for anyone still running from it; we
+// just stop handing it out.
+typedef struct image_map_t {
+    struct image_map_t *next;
+    char               *path;
+    c4m_zobject_file_t *obj; // Registered as a root.
+    char               *base;
+    dev_t               dev;
+    ino_t               ino;
+    off_t               size;
+    struct timespec     mtime;
+} image_map_t;
+
+static image_map_t    *image_maps     = NULL;
+static pthread_mutex_t image_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static image_map_t *
+find_image_map(char *path, struct stat *info)
+{
+    image_map_t *m;
+
+    pthread_mutex_lock(&image_map_lock);
+
+    for (m = image_maps; m != NULL; m = m->next) {
+        if (!strcmp(m->path, path)) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&image_map_lock);
+
+    if (m == NULL || m->dev != info->st_dev || m->ino != info->st_ino
+        || m->size != info->st_size
+        || m->mtime.tv_sec != info->st_mtim.tv_sec
+        || m->mtime.tv_nsec != info->st_mtim.tv_nsec) {
+        return NULL;
+    }
+
+    return m;
+}
+
+static void
+remember_image_map(char *path, struct stat *info, char *base, c4m_vm_t *vm)
+{
+    image_map_t *m;
+
+    pthread_mutex_lock(&image_map_lock);
+
+    for (m = image_maps; m != NULL; m = m->next) {
+        if (!strcmp(m->path, path)) {
+            break;
+        }
+    }
+
+    if (m == NULL) {
+        m          = calloc(1, sizeof(image_map_t));
+        m->path    = strdup(path);
+        m->next    = image_maps;
+        image_maps = m;
+        c4m_gc_register_root(&m->obj, 1);
+    }
+
+    m->obj   = vm->obj;
+    m->base  = base;
+    m->dev   = info->st_dev;
+    m->ino   = info->st_ino;
+    m->size  = info->st_size;
+    m->mtime = info->st_mtim;
+
+    pthread_mutex_unlock(&image_map_lock);
+}
+
+c4m_vm_t *
+c4m_vm_map_image(c4m_str_t *path, c4m_image_check_fn check, void *thunk)
+{
+    c4m_utf8_t  *p  = c4m_to_utf8(path);
+    int          fd = open(p->data, O_RDONLY | O_CLOEXEC);
+    struct stat  info;
+    char        *base;
+    image_map_t *known;
+
+    if (fd == -1) {
+        return NULL;
+    }
+
+    if (fstat(fd, &info) || (uint64_t)info.st_size < sizeof(image_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    known = find_image_map(p->data, &info);
+
+    if (known != NULL) {
+        image_header_t *hdr = (image_header_t *)known->base;
+        c4m_vm_t       *vm;
+
+        close(fd);
+
+        if (check != NULL
+            && !check(image_section_buf(known->base, &hdr->aux), thunk)) {
+            return NULL;
+        }
+
+        vm      = c4m_new_vm(NULL);
+        vm->obj = known->obj;
+
+        c4m_vm_setup_runtime(vm);
+        c4m_vm_reset(vm);
+
+        return vm;
+    }
+
+    base = mmap(NULL,
+                info.st_size,
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE,
+                fd,
+                0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    image_header_t *hdr = (image_header_t *)base;
+    c4m_vm_t       *vm  = NULL;
+
+    if (image_header_ok(hdr, info.st_size)
+        && (check == NULL
+            || check(image_section_buf(base, &hdr->aux), thunk))) {
+        C4M_TRY
+        {
+            vm = image_to_vm(base, hdr);
+        }
+        C4M_EXCEPT
+        {
+            vm = NULL;
+        }
+        C4M_TRY_END;
+    }
+
+    if (vm == NULL) {
+        munmap(base, info.st_size);
+        return NULL;
+    }
+
+    remember_image_map(p->data, &info, base, vm);
+
+    c4m_vm_setup_runtime(vm);
+    c4m_vm_reset(vm);
+
+    return vm;
+}
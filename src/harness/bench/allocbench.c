@@ -0,0 +1,203 @@
+// Measures the cost of constructing small objects through c4m_new():
+// boxed ints, short strings, and empty lists. None of these do much
+// work past allocation, so most of what's left is the per-call
+// overhead of c4m_new() itself, including resolving the type.
+//
+// The last few objects from each run get checked after it's timed.
+// They have to be distinct objects with the right contents, and their
+// types have to be the canonical, resolved nodes for what was asked
+// for. Any mismatch makes the run fail.
+//
+// Usage: allocbench [count]
+
+#define C4M_USE_INTERNAL_API
+#include "con4m.h"
+
+#define DEFAULT_COUNT 1000000
+#define NUM_KEPT      64
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report(char *name, int64_t n, double secs)
+{
+    printf("%-12s %10.1f ns/object  %10.1f M objects/s\n",
+           name,
+           secs * 1e9 / n,
+           n / 1e6 / secs);
+}
+
+// Keep the last few objects alive, both so the loops can't be
+// optimized away, and so they can be checked.
+static c4m_obj_t kept[NUM_KEPT];
+
+static void
+fail(char *name, int64_t i, char *what)
+{
+    fprintf(stderr, "%s: object %lld %s\n", name, (long long)i, what);
+    exit(1);
+}
+
+// Calls `ok` on each kept object, with the iteration that made it.
+static void
+check_kept(char *name, int64_t n, char *(*ok)(c4m_obj_t, int64_t))
+{
+    for (int64_t i = c4m_max(n - NUM_KEPT, 0); i < n; i++) {
+        c4m_obj_t obj  = kept[i % NUM_KEPT];
+        char     *what = (*ok)(obj, i);
+
+        if (what) {
+            fail(name, i, what);
+        }
+
+        if (i > 0 && i > n - NUM_KEPT && obj == kept[(i - 1) % NUM_KEPT]) {
+            fail(name, i, "is the same object as the one before it");
+        }
+    }
+}
+
+static char *
+check_type(c4m_obj_t obj, c4m_type_t *want)
+{
+    c4m_type_t *t = c4m_get_my_type(obj);
+
+    if (t->typeid != want->typeid) {
+        return "has the wrong type";
+    }
+
+    if (!t->resolved) {
+        return "has a type that was never resolved";
+    }
+
+    return NULL;
+}
+
+static char *
+box_ok(c4m_obj_t obj, int64_t i)
+{
+    if (c4m_type_unbox(c4m_get_my_type(obj))->typeid
+        != c4m_type_i64()->typeid) {
+        return "isn't a boxed int";
+    }
+
+    if ((int64_t)c4m_unbox(obj) != i) {
+        return "has the wrong value";
+    }
+
+    return NULL;
+}
+
+static char *
+str_ok(c4m_obj_t obj, int64_t i)
+{
+    if (!c4m_str_eq(obj, c4m_new_utf8("allocbench"))) {
+        return "has the wrong text";
+    }
+
+    return check_type(obj, c4m_type_utf8());
+}
+
+static char *
+list_ok(c4m_obj_t obj, int64_t i)
+{
+    if (c4m_len(obj) != 0) {
+        return "isn't empty";
+    }
+
+    return check_type(obj, c4m_type_list(c4m_type_utf8()));
+}
+
+static char *
+dict_ok(c4m_obj_t obj, int64_t i)
+{
+    if (c4m_len(obj) != 0) {
+        return "isn't empty";
+    }
+
+    return check_type(obj, c4m_type_dict(c4m_type_utf8(), c4m_type_int()));
+}
+
+static void
+bench_boxes(int64_t n)
+{
+    double t0 = now();
+
+    for (int64_t i = 0; i < n; i++) {
+        kept[i % NUM_KEPT] = c4m_box_i64(i);
+    }
+
+    report("box[int]", n, now() - t0);
+    check_kept("box[int]", n, box_ok);
+}
+
+static void
+bench_strings(int64_t n)
+{
+    double t0 = now();
+
+    for (int64_t i = 0; i < n; i++) {
+        kept[i % NUM_KEPT] = c4m_new_utf8("allocbench");
+    }
+
+    report("utf8", n, now() - t0);
+    check_kept("utf8", n, str_ok);
+}
+
+static void
+bench_lists(int64_t n)
+{
+    double t0 = now();
+
+    for (int64_t i = 0; i < n; i++) {
+        kept[i % NUM_KEPT] = c4m_list(c4m_type_utf8());
+    }
+
+    report("list[str]", n, now() - t0);
+    check_kept("list[str]", n, list_ok);
+}
+
+static void
+bench_dicts(int64_t n)
+{
+    double t0 = now();
+
+    for (int64_t i = 0; i < n; i++) {
+        kept[i % NUM_KEPT] = c4m_new(c4m_type_dict(c4m_type_utf8(), c4m_type_int()));
+    }
+
+    report("dict[str,int]", n, now() - t0);
+    check_kept("dict[str,int]", n, dict_ok);
+}
+
+int
+main(int argc, char **argv, char **envp)
+{
+    int64_t n = DEFAULT_COUNT;
+
+    if (argc > 1) {
+        n = atoll(argv[1]);
+    }
+
+    if (n <= 0) {
+        fprintf(stderr, "usage: %s [count]\n", argv[0]);
+        return 1;
+    }
+
+    c4m_gc_register_root(kept, NUM_KEPT);
+
+    bench_boxes(n);
+    bench_strings(n);
+    bench_lists(n);
+    // Dicts are much bigger than the rest; don't let them dominate.
+    bench_dicts(n / 10 ? n / 10 : 1);
+
+    return 0;
+}
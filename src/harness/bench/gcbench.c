@@ -0,0 +1,121 @@
+// Reports how many heap bytes each live object costs, for a few kinds
+// of small allocation. Run it against builds with and without
+// -Dcompact_alloc_headers=enabled to compare. Every object gets
+// checked after the collection, and any that didn't come through it
+// intact make the run fail.
+//
+// Usage: gcbench [num_objects]
+
+#include "con4m.h"
+
+#define DEFAULT_OBJECTS 1000000
+
+static void **live;
+
+static uint64_t
+heap_in_use(void)
+{
+    uint64_t used;
+
+    c4m_gc_thread_collect();
+    c4m_gc_heap_stats(&used, NULL, NULL);
+
+    return used;
+}
+
+static void
+run_one(char *name, int n, void *(*make)(int), bool (*ok)(void *, int))
+{
+    uint64_t before = heap_in_use();
+
+    for (int i = 0; i < n; i++) {
+        live[i] = make(i);
+    }
+
+    uint64_t after = heap_in_use();
+
+    for (int i = 0; i < n; i++) {
+        if (!ok(live[i], i)) {
+            fprintf(stderr,
+                    "%s: object %d is wrong after collecting\n",
+                    name,
+                    i);
+            exit(1);
+        }
+    }
+
+    printf("%-16s %10d objects  %8.1f bytes/object\n",
+           name,
+           n,
+           (double)(after - before) / n);
+
+    memset(live, 0, n * sizeof(void *));
+}
+
+static void *
+make_raw(int i)
+{
+    uint64_t *p = c4m_gc_raw_alloc(sizeof(uint64_t), C4M_GC_SCAN_NONE);
+
+    *p = i;
+
+    return p;
+}
+
+static bool
+raw_ok(void *p, int i)
+{
+    c4m_alloc_hdr *hdr = c4m_find_alloc(p);
+
+    return *(uint64_t *)p == (uint64_t)i && hdr != NULL
+        && c4m_alloc_scan_fn(hdr) == C4M_GC_SCAN_NONE;
+}
+
+static void *
+make_box(int i)
+{
+    return c4m_box_i64(i);
+}
+
+static bool
+box_ok(void *p, int i)
+{
+    return (int64_t)c4m_unbox(p) == i;
+}
+
+static void *
+make_str(int i)
+{
+    return c4m_new_utf8("val");
+}
+
+static bool
+str_ok(void *p, int i)
+{
+    return c4m_str_eq(p, c4m_new_utf8("val"));
+}
+
+int
+main(int argc, char **argv, char **envp)
+{
+    int n = DEFAULT_OBJECTS;
+
+    if (argc > 1) {
+        n = atoi(argv[1]);
+    }
+
+    if (n <= 0) {
+        fprintf(stderr, "usage: %s [num_objects]\n", argv[0]);
+        return 1;
+    }
+
+    live = calloc(n, sizeof(void *));
+    c4m_gc_register_root(live, n);
+
+    printf("alloc header: %zu bytes\n", sizeof(c4m_alloc_hdr));
+    run_one("raw (8 bytes)", n, make_raw, raw_ok);
+    run_one("boxed i64", n, make_box, box_ok);
+    run_one("short string", n, make_str, str_ok);
+
+    return 0;
+}
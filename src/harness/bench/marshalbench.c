@@ -0,0 +1,219 @@
+// Measures marshal and unmarshal throughput through a buffer stream,
+// for a list of strings, a dict of dicts, and a grid of text cells,
+// with and without compression. Every case shares some of its leaf
+// objects, so the memo tables see both hits and misses.
+//
+// Every copy gets checked after it's timed. It has to marshal back to
+// exactly the same bytes as the original, and in the list, every use
+// of a shared leaf has to come back as the same object. Every case
+// repeats itself a lot, so compressing has to make it smaller. Any
+// mismatch makes the run fail.
+//
+// Usage: marshalbench [scale]
+
+#define C4M_USE_INTERNAL_API
+#include "con4m.h"
+
+#define DEFAULT_SCALE 100000
+#define NUM_SHARED    64
+
+static c4m_utf8_t *shared[NUM_SHARED];
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static c4m_utf8_t *
+leaf(int i)
+{
+    if (i % 4 == 0) {
+        return shared[i % NUM_SHARED];
+    }
+
+    return c4m_cstr_format("item-{}", c4m_box_i64(i));
+}
+
+static c4m_obj_t
+make_list(int n)
+{
+    c4m_list_t *l = c4m_list(c4m_type_utf8());
+
+    for (int i = 0; i < n; i++) {
+        c4m_list_append(l, leaf(i));
+    }
+
+    return l;
+}
+
+static c4m_obj_t
+make_dicts(int n)
+{
+    c4m_type_t *inner_t = c4m_type_dict(c4m_type_utf8(), c4m_type_utf8());
+    c4m_dict_t *outer   = c4m_new(c4m_type_dict(c4m_type_utf8(), inner_t));
+    int         width   = 16;
+
+    for (int i = 0; i < n / width; i++) {
+        c4m_dict_t *inner = c4m_new(inner_t);
+
+        for (int j = 0; j < width; j++) {
+            hatrack_dict_put(inner, leaf(i * width + j), leaf(j));
+        }
+
+        hatrack_dict_put(outer,
+                         c4m_cstr_format("row-{}", c4m_box_i64(i)),
+                         inner);
+    }
+
+    return outer;
+}
+
+static c4m_obj_t
+make_grid(int n)
+{
+    int         cols = 8;
+    int         rows = c4m_max(n / cols, 1);
+    c4m_grid_t *g    = c4m_grid(rows, cols, "table", "th", "td", 1, 0, 0);
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            c4m_grid_set_cell_contents(g, r, c, leaf(r * cols + c));
+        }
+    }
+
+    return g;
+}
+
+static void
+fail(char *name, bool compress, char *what)
+{
+    fprintf(stderr, "%s%s: %s\n", name, compress ? " (lz)" : "", what);
+    exit(1);
+}
+
+static c4m_buf_t *
+marshal_bytes(c4m_obj_t obj)
+{
+    c4m_buf_t    *buf = c4m_buffer_empty();
+    c4m_stream_t *s   = c4m_buffer_outstream(buf, false);
+
+    c4m_marshal(obj, s);
+    c4m_stream_close(s);
+
+    return buf;
+}
+
+static void
+check_copy(char *name, c4m_obj_t obj, c4m_obj_t copy, bool compress)
+{
+    if (copy == NULL) {
+        fail(name, compress, "nothing came back");
+    }
+
+    c4m_buf_t *want = marshal_bytes(obj);
+    c4m_buf_t *got  = marshal_bytes(copy);
+
+    if (want->byte_len != got->byte_len
+        || memcmp(want->data, got->data, want->byte_len)) {
+        fail(name, compress, "the copy doesn't match the original");
+    }
+}
+
+// Every fourth item is one of the NUM_SHARED shared strings, so item i
+// is the same object as item i % NUM_SHARED.
+static void
+check_shared(c4m_list_t *copy, bool compress)
+{
+    int n = c4m_list_len(copy);
+
+    for (int i = 0; i < n; i += 4) {
+        c4m_utf8_t *first = c4m_list_get(copy, i % NUM_SHARED, NULL);
+
+        if (c4m_list_get(copy, i, NULL) != first) {
+            fail("list[str]", compress, "a shared leaf came back twice");
+        }
+    }
+}
+
+static c4m_obj_t
+run_one(char *name, c4m_obj_t obj, bool compress, int64_t *len)
+{
+    c4m_buf_t    *buf = c4m_buffer_empty();
+    c4m_stream_t *s   = c4m_buffer_outstream(buf, false);
+    double        t0, t1, t2;
+
+    t0 = now();
+    if (compress) {
+        c4m_marshal_compressed(obj, s);
+    }
+    else {
+        c4m_marshal(obj, s);
+    }
+    c4m_stream_close(s);
+    t1 = now();
+
+    s = c4m_buffer_instream(buf);
+    c4m_obj_t copy = c4m_unmarshal(s);
+    c4m_stream_close(s);
+    t2 = now();
+
+    printf("%-12s %-4s %10d bytes  "
+           "marshal %8.1f MB/s  unmarshal %8.1f MB/s\n",
+           name,
+           compress ? "lz" : "",
+           buf->byte_len,
+           buf->byte_len / 1e6 / (t1 - t0),
+           buf->byte_len / 1e6 / (t2 - t1));
+
+    check_copy(name, obj, copy, compress);
+    *len = buf->byte_len;
+
+    return copy;
+}
+
+int
+main(int argc, char **argv, char **envp)
+{
+    int n = DEFAULT_SCALE;
+
+    if (argc > 1) {
+        n = atoi(argv[1]);
+    }
+
+    if (n <= 0) {
+        fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+        return 1;
+    }
+
+    c4m_gc_register_root(shared, NUM_SHARED);
+
+    for (int i = 0; i < NUM_SHARED; i++) {
+        shared[i] = c4m_cstr_format("shared-{}", c4m_box_i64(i));
+    }
+
+    c4m_obj_t cases[] = {make_list(n), make_dicts(n), make_grid(n / 8)};
+    char     *names[] = {"list[str]", "dict[dict]", "grid"};
+
+    for (int i = 0; i < 3; i++) {
+        int64_t   plain_len;
+        int64_t   packed_len;
+        c4m_obj_t plain  = run_one(names[i], cases[i], false, &plain_len);
+        c4m_obj_t packed = run_one(names[i], cases[i], true, &packed_len);
+
+        if (packed_len >= plain_len) {
+            fail(names[i], true, "compressing didn't save anything");
+        }
+
+        if (i == 0) {
+            check_shared(plain, false);
+            check_shared(packed, true);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+// Compares string search, codepoint counting and UTF-8 validation
+// against the byte-at-a-time versions they replaced, on a log-like
+// buffer that's mostly ASCII with some multi-byte text mixed in.
+// Before timing anything, it checks the new kernels against the old
+// loops, at every alignment the vector code can hit; a mismatch makes
+// the run fail.
+//
+// Usage: strbench [megabytes]
+
+#define C4M_USE_INTERNAL_API
+#include "con4m.h"
+
+#define DEFAULT_MB 16
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+check(bool ok, char *what, int64_t where)
+{
+    if (!ok) {
+        fprintf(stderr, "%s is wrong (at %lld)\n", what, (long long)where);
+        exit(1);
+    }
+}
+
+static void
+report(char *name, int64_t bytes, double old_secs, double new_secs)
+{
+    printf("%-12s %10.1f MB/s -> %10.1f MB/s  (%.1fx)\n",
+           name,
+           bytes / 1e6 / old_secs,
+           bytes / 1e6 / new_secs,
+           old_secs / new_secs);
+}
+
+// The old c4m_str_find(): convert to UTF-32, then a nested loop.
+static int64_t
+old_find(c4m_str_t *str, c4m_str_t *sub)
+{
+    c4m_utf32_t *s32   = c4m_to_utf32(str);
+    c4m_utf32_t *sub32 = c4m_to_utf32(sub);
+    int64_t      n     = c4m_str_codepoint_len(s32);
+    int64_t      m     = c4m_str_codepoint_len(sub32);
+    uint32_t    *p     = (uint32_t *)s32->data;
+    uint32_t    *q     = (uint32_t *)sub32->data;
+
+    for (int64_t i = 0; i + m <= n; i++) {
+        int64_t j = 0;
+
+        while (j < m && p[i + j] == q[j]) {
+            j++;
+        }
+        if (j == m) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int64_t
+old_count(c4m_utf8_t *s)
+{
+    uint8_t        *p   = (uint8_t *)s->data;
+    uint8_t        *end = p + s->byte_len;
+    int64_t         n   = 0;
+    c4m_codepoint_t cp;
+
+    while (p < end) {
+        n++;
+        int len = utf8proc_iterate(p, 4, &cp);
+        if (len < 0) {
+            break;
+        }
+        p += len;
+    }
+
+    return n;
+}
+
+static int64_t
+old_ascii_prefix_len(char *p, int64_t len)
+{
+    int64_t i = 0;
+
+    while (i < len && !(p[i] & 0x80)) {
+        i++;
+    }
+
+    return i;
+}
+
+// Every needle start and haystack alignment over a window wider than
+// the widest vector, so the head, body and tail paths all get used.
+static void
+check_kernels(char *text, int64_t len)
+{
+    int64_t window = c4m_min(len, 200);
+
+    for (int64_t start = 0; start < 64 && start < window; start++) {
+        char   *hay = text + start;
+        int64_t n   = window - start;
+
+        check(c4m_ascii_prefix_len(hay, n) == old_ascii_prefix_len(hay, n),
+              "c4m_ascii_prefix_len()",
+              start);
+
+        for (int64_t at = 0; at < n; at += 7) {
+            for (int64_t m = 1; m <= 5 && at + m <= n; m += 2) {
+                char *want = memmem(hay, n, hay + at, m);
+
+                check(c4m_find_bytes(hay, n, hay + at, m) == want,
+                      "c4m_find_bytes()",
+                      start + at);
+            }
+        }
+    }
+
+    check(c4m_find_bytes(text, window, "\x01", 1) == NULL,
+          "c4m_find_bytes() on a missing byte",
+          0);
+}
+
+// Needles that are there, including ones that start or end inside
+// the multi-byte text, searched for in both encodings.
+static void
+check_find(c4m_utf8_t *s, int64_t llen)
+{
+    c4m_utf32_t *s32 = c4m_to_utf32(c4m_str_slice(s, 0, 4 * llen));
+    char        *at[] = {"2024", "café", "é ✓", "✓\n2024", "worker-7"};
+
+    for (unsigned i = 0; i < sizeof(at) / sizeof(at[0]); i++) {
+        c4m_utf8_t *needle = c4m_new_utf8(at[i]);
+        int64_t     want   = old_find(s, needle);
+
+        check(want != -1, "the test needle", i);
+        check(c4m_str_find(s, needle) == want, "c4m_str_find()", i);
+        check(c4m_str_find(s32, needle) == want,
+              "c4m_str_find() on UTF-32",
+              i);
+    }
+}
+
+static void
+check_validate(char *line, int64_t llen)
+{
+    char *bad = strdup(line);
+
+    check(c4m_utf8_validate(c4m_new_utf8(bad)) == 0,
+          "c4m_utf8_validate() on good text",
+          0);
+
+    bad[llen / 2] = (char)0xff;
+    check(c4m_utf8_validate(c4m_new_utf8(bad)) != 0,
+          "c4m_utf8_validate() on bad text",
+          llen / 2);
+
+    free(bad);
+}
+
+int
+main(int argc, char **argv, char **envp)
+{
+    int64_t mb = DEFAULT_MB;
+
+    if (argc > 1) {
+        mb = atoi(argv[1]);
+    }
+
+    if (mb <= 0) {
+        fprintf(stderr, "usage: %s [megabytes]\n", argv[0]);
+        return 1;
+    }
+
+    int64_t len  = mb << 20;
+    char   *text = malloc(len + 1);
+    char   *line = "2024-05-01T12:00:00Z INFO request served in 12ms "
+                 "by worker-7 for user café ✓\n";
+    int64_t llen = strlen(line);
+
+    for (int64_t i = 0; i < len; i += llen) {
+        memcpy(text + i, line, c4m_min(llen, len - i));
+    }
+
+    // Don't end in the middle of a codepoint.
+    while (len && (text[len - 1] & 0xc0) == 0x80) {
+        len--;
+    }
+    text[len] = 0;
+
+    c4m_utf8_t *s      = c4m_new(c4m_type_utf8(),
+                            c4m_kw("cstring", c4m_ka(text), "length", c4m_ka(len)));
+    c4m_utf8_t *needle = c4m_new_utf8("not in the text");
+    double      t0, t1, t2;
+    int64_t     r1, r2;
+
+    check_kernels(text, len);
+    check_find(s, llen);
+    check_validate(line, llen);
+
+    t0 = now();
+    r1 = old_find(s, needle);
+    t1 = now();
+    r2 = c4m_str_find(s, needle);
+    t2 = now();
+    check(r1 == r2, "c4m_str_find() on a missing needle", r2);
+    report("find", len, t1 - t0, t2 - t1);
+
+    t0 = now();
+    r1 = old_count(s);
+    t1 = now();
+    c4m_internal_utf8_set_codepoint_count(s);
+    t2 = now();
+    check(r1 == c4m_str_codepoint_len(s), "the codepoint count", r1);
+    report("count", len, t1 - t0, t2 - t1);
+
+    c4m_utf8_t *ascii = c4m_new(c4m_type_utf8(),
+                                c4m_kw("cstring",
+                                       c4m_ka(text),
+                                       "length",
+                                       c4m_ka(llen - 12)));
+
+    t0 = now();
+    for (int i = 0; i < 100000; i++) {
+        old_count(ascii);
+    }
+    t1 = now();
+    for (int i = 0; i < 100000; i++) {
+        c4m_internal_utf8_set_codepoint_count(ascii);
+    }
+    t2 = now();
+    report("count/ascii", (llen - 12) * 100000, t1 - t0, t2 - t1);
+
+    t0 = now();
+    r1 = old_count(s);
+    t1 = now();
+    r2 = c4m_utf8_validate(s);
+    t2 = now();
+    check(r2 == 0, "c4m_utf8_validate()", r2);
+    report("validate", len, t1 - t0, t2 - t1);
+
+    return 0;
+}
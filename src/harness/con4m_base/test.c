@@ -20,12 +20,1146 @@ extern bool c4m_definite_memcheck_error;
 bool c4m_definite_memcheck_error = false;
 #endif
 
+static c4m_grid_t *
+build_span_grid(void)
+{
+    c4m_grid_t *g = c4m_grid(4, 3, "table", "th", "td", 1, 0, 0);
+
+    for (int i = 1; i < 4; i++) {
+        for (int j = 0; j < 3; j++) {
+            c4m_grid_set_cell_contents(g,
+                                       i,
+                                       j,
+                                       c4m_cstr_format("cell {}.{}",
+                                                       c4m_box_i64(i),
+                                                       c4m_box_i64(j)));
+        }
+    }
+
+    c4m_grid_add_col_span(g,
+                          c4m_to_str_renderable(c4m_new_utf8("Header"),
+                                                "th"),
+                          0,
+                          0,
+                          3);
+    c4m_grid_add_row_span(g,
+                          c4m_to_str_renderable(
+                              c4m_new_utf8("This spans a couple of rows"),
+                              "td"),
+                          0,
+                          1,
+                          3);
+
+    return g;
+}
+
+// Checks that c4m_grid_write() streams out exactly what
+// c4m_grid_to_str() builds, for a grid w/ both row and column spans.
+// Returns "ok" when they match, and both renderings when they don't.
+static c4m_utf8_t *
+grid_write_check(int64_t width)
+{
+    c4m_grid_t   *g1       = build_span_grid();
+    c4m_grid_t   *g2       = build_span_grid();
+    c4m_buf_t    *buf      = c4m_buffer_empty();
+    c4m_stream_t *s        = c4m_buffer_outstream(buf, false);
+    c4m_utf8_t   *expected = c4m_to_utf8(
+        c4m_str_join(c4m_grid_render(g1, c4m_kw("width", c4m_ka(width))),
+                     c4m_str_newline(),
+                     c4m_kw("add_trailing", c4m_ka(true))));
+
+    c4m_grid_write(g2, s, c4m_kw("width", c4m_ka(width), "ansi", c4m_ka(false)));
+
+    c4m_utf8_t *written = c4m_buf_to_utf8_string(buf);
+
+    c4m_stream_close(s);
+
+    if (c4m_str_eq(expected, written)) {
+        return c4m_new_utf8("ok");
+    }
+
+    return c4m_cstr_format("c4m_grid_to_str():\n{}c4m_grid_write():\n{}",
+                           expected,
+                           written);
+}
+
+extern thread_local c4m_arena_t *c4m_current_heap;
+
+static uint32_t
+num_heap_roots(void)
+{
+    return hatrack_zarray_len(c4m_current_heap->roots);
+}
+
+// Compiles a program with imports several times over, collecting
+// after each one. With C4M_COMPILE_THREADS, the modules get loaded on
+// worker heaps, which the next collection should evacuate and free.
+// Past the first compile (which also fills process-wide caches),
+// neither the roots nor the live heap should keep growing.
+static c4m_utf8_t *
+threaded_compile_check(int64_t rounds)
+{
+    c4m_utf8_t *path = c4m_new_utf8("tests/use1.c4m");
+    uint64_t    before;
+    uint64_t    first;
+    uint64_t    last;
+    uint32_t    roots;
+
+    c4m_gc_thread_collect();
+    c4m_gc_heap_stats(&before, NULL, NULL);
+
+    c4m_compile_from_entry_point(path);
+    c4m_gc_thread_collect();
+    c4m_gc_heap_stats(&first, NULL, NULL);
+    roots = num_heap_roots();
+
+    for (int64_t i = 1; i < rounds; i++) {
+        c4m_compile_from_entry_point(path);
+        c4m_gc_thread_collect();
+    }
+
+    c4m_gc_heap_stats(&last, NULL, NULL);
+
+    if (num_heap_roots() != roots) {
+        return c4m_cstr_format("roots went from {} to {}",
+                               c4m_box_u64(roots),
+                               c4m_box_u64(num_heap_roots()));
+    }
+
+    // Give it as much slack as the whole first compile kept.
+    if (last > first && last - first > first - before) {
+        return c4m_cstr_format("live heap went from {} to {} bytes",
+                               c4m_box_u64(first),
+                               c4m_box_u64(last));
+    }
+
+    return c4m_new_utf8("ok");
+}
+
+typedef struct survivor_t {
+    struct survivor_t *next;
+    int64_t            n;
+    int64_t            payload[14];
+} survivor_t;
+
+static survivor_t *survivors = NULL;
+
+// Sets up a collection whose survivors don't fit in the to-space the
+// collector estimates for them: a worker heap full of live data gets
+// adopted by a heap a fraction of its size. Everything here sticks to
+// raw allocations, so nothing that outlives the test (type or format
+// caches, say) can end up pointing into the heaps we throw away.
+static c4m_utf8_t *
+tospace_growth_check(int64_t n)
+{
+    c4m_arena_t *saved  = c4m_current_heap;
+    c4m_arena_t *small  = c4m_new_arena(1 << 18,
+                                       hatrack_zarray_unsafe_copy(
+                                           saved->roots));
+    uint64_t     before = (char *)small->heap_end - (char *)small;
+    uint64_t     after;
+    c4m_arena_t *worker;
+    char        *err = NULL;
+    int64_t      i;
+
+    c4m_internal_set_heap(small);
+    worker = c4m_internal_new_worker_heap();
+    c4m_internal_set_heap(worker);
+
+    c4m_gc_register_root(&survivors, 1);
+
+    for (i = 0; i < n; i++) {
+        survivor_t *s = c4m_gc_alloc(survivor_t);
+
+        s->n    = i;
+        s->next = survivors;
+        for (int j = 0; j < 14; j++) {
+            s->payload[j] = i * 14 + j;
+        }
+        survivors = s;
+
+        // Some garbage in between, too.
+        c4m_gc_array_value_alloc(char, 40 + (i % 200));
+    }
+
+    worker = c4m_internal_release_worker_heap();
+    c4m_internal_set_heap(small);
+    c4m_internal_adopt_worker_heap(worker);
+    c4m_gc_thread_collect();
+
+    small = c4m_current_heap;
+    after = (char *)small->heap_end - (char *)small;
+
+    survivor_t *s = survivors;
+
+    for (i = n - 1; i >= 0 && s != NULL; i--, s = s->next) {
+        if (s->n != i || s->payload[13] != i * 14 + 13) {
+            err = "survivors came out of the collection corrupted";
+            break;
+        }
+    }
+
+    if (err == NULL && (i != -1 || s != NULL)) {
+        err = "wrong number of survivors after the collection";
+    }
+
+    if (err == NULL && after <= before) {
+        err = "to-space never had to grow";
+    }
+
+    survivors = NULL;
+    c4m_internal_set_heap(saved);
+    hatrack_zarray_delete(small->roots);
+    c4m_delete_arena(small);
+
+    if (err != NULL) {
+        return c4m_new_utf8(err);
+    }
+
+    return c4m_new_utf8("ok");
+}
+
+// Streams over an fd keep the flags they're opened with (these used
+// to be dropped, so reading from one raised), the std streams don't
+// buffer, and a buffered stream holds output until it's flushed.
+static c4m_utf8_t *
+stream_flags_check(int64_t unused)
+{
+    c4m_stream_t *w;
+    c4m_stream_t *r;
+    char          got[6] = {0};
+    int           fds[2];
+
+    if (c4m_get_stdout()->flags & C4M_F_STREAM_BUFFERED) {
+        return c4m_new_utf8("stdout is buffered");
+    }
+
+    if (!(c4m_get_stdin()->flags & C4M_F_STREAM_READ)) {
+        return c4m_new_utf8("stdin isn't readable");
+    }
+
+    if (pipe(fds)) {
+        return c4m_new_utf8("pipe() failed");
+    }
+
+    w = c4m_new(c4m_type_stream(),
+                c4m_kw("fd",
+                       c4m_ka(fds[1]),
+                       "write",
+                       c4m_ka(true),
+                       "read",
+                       c4m_ka(false)));
+    r = c4m_new(c4m_type_stream(), c4m_kw("fd", c4m_ka(fds[0])));
+
+    if (!(w->flags & C4M_F_STREAM_BUFFERED) || !(r->flags & C4M_F_STREAM_READ)) {
+        return c4m_new_utf8("fd streams didn't keep their flags");
+    }
+
+    c4m_stream_raw_write(w, 5, "hello");
+
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    if (read(fds[0], got, 5) != -1) {
+        return c4m_new_utf8("buffered write went out before a flush");
+    }
+
+    c4m_stream_flush(w);
+    c4m_stream_raw_read(r, 5, got);
+    c4m_stream_close(w);
+    c4m_stream_close(r);
+
+    if (strcmp(got, "hello")) {
+        return c4m_new_utf8("didn't read back what was written");
+    }
+
+    return c4m_new_utf8("ok");
+}
+
+static bool
+write_scratch_file(c4m_utf8_t *path, char *contents)
+{
+    FILE *f = fopen(path->data, "w");
+
+    if (f == NULL) {
+        return false;
+    }
+
+    fputs(contents, f);
+
+    return fclose(f) == 0;
+}
+
+static void
+remove_scratch_dir(c4m_utf8_t *dir)
+{
+    DIR           *d = opendir(dir->data);
+    struct dirent *e;
+
+    if (d == NULL) {
+        return;
+    }
+
+    while ((e = readdir(d)) != NULL) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) {
+            continue;
+        }
+
+        c4m_utf8_t *sub = c4m_cstr_format("{}/{}",
+                                          dir,
+                                          c4m_new_utf8(e->d_name));
+
+        if (unlink(sub->data)) {
+            remove_scratch_dir(sub);
+        }
+    }
+
+    closedir(d);
+    rmdir(dir->data);
+}
+
+static c4m_utf8_t *
+cache_compile(c4m_utf8_t *path, c4m_compile_ctx **ctxp)
+{
+    c4m_compile_ctx *ctx = c4m_compile_from_entry_point(path);
+
+    *ctxp = ctx;
+
+    if (ctx->fatality || c4m_generate_code(ctx) == NULL) {
+        return c4m_new_utf8("scratch program didn't compile");
+    }
+
+    return NULL;
+}
+
+// Compiles a scratch program three times with the object cache
+// pointed at a scratch directory. The first compile is a miss that
+// fills the cache, and the second should be a hit that still reports
+// the same modules. Then a file shows up where the entry point's
+// import is looked for before the directory it was found in, so the
+// third compile has to miss.
+static c4m_utf8_t *
+object_cache_check(int64_t unused)
+{
+    char             tmpl[]     = "/tmp/c4m_cache_XXXXXX";
+    c4m_utf8_t      *cache_var  = c4m_new_utf8("CON4M_CACHE_DIR");
+    c4m_utf8_t      *saved_dir  = c4m_get_env(cache_var);
+    c4m_list_t      *saved_path = con4m_path;
+    c4m_utf8_t      *err        = NULL;
+    c4m_compile_ctx *first;
+    c4m_compile_ctx *second;
+    c4m_compile_ctx *third;
+    c4m_utf8_t      *root;
+    c4m_utf8_t      *entry;
+
+    if (mkdtemp(tmpl) == NULL) {
+        return c4m_new_utf8("mkdtemp() failed");
+    }
+
+    root  = c4m_new_utf8(tmpl);
+    entry = c4m_cstr_format("{}/main.c4m", root);
+
+    mkdir(c4m_cstr_format("{}/lib", root)->data, 0700);
+
+    if (!write_scratch_file(entry, "use helper\n\nprint(twice(21))\n")
+        || !write_scratch_file(c4m_cstr_format("{}/lib/helper.c4m", root),
+                               "func twice(x) {\n  return x * 2\n}\n")) {
+        remove_scratch_dir(root);
+        return c4m_new_utf8("couldn't write the scratch program");
+    }
+
+    con4m_path = c4m_list_shallow_copy(saved_path);
+    c4m_list_append(con4m_path, c4m_cstr_format("{}/lib", root));
+    c4m_set_env(cache_var, c4m_cstr_format("{}/cache", root));
+
+    err = cache_compile(entry, &first);
+
+    if (err == NULL) {
+        err = cache_compile(entry, &second);
+    }
+
+    if (err == NULL && first->cached_vm != NULL) {
+        err = c4m_new_utf8("first compile hit an empty cache");
+    }
+
+    if (err == NULL && second->cached_vm == NULL) {
+        err = c4m_new_utf8("second compile missed the cache");
+    }
+
+    if (err == NULL) {
+        int n = c4m_list_len(first->module_ordering);
+
+        if (c4m_list_len(second->module_ordering) != n) {
+            err = c4m_cstr_format("cache hit reported {} modules, not {}",
+                                  c4m_box_i64(c4m_list_len(
+                                      second->module_ordering)),
+                                  c4m_box_i64(n));
+        }
+
+        for (int i = 0; err == NULL && i < n; i++) {
+            c4m_module_compile_ctx *a = c4m_list_get(first->module_ordering,
+                                                     i,
+                                                     NULL);
+            c4m_module_compile_ctx *b = c4m_list_get(second->module_ordering,
+                                                     i,
+                                                     NULL);
+
+            if (!c4m_str_eq(a->loaded_from, b->loaded_from)
+                || a->module_id != b->module_id) {
+                err = c4m_cstr_format("cache hit has {} where {} was",
+                                      b->loaded_from,
+                                      a->loaded_from);
+            }
+        }
+    }
+
+    if (err == NULL
+        && !write_scratch_file(c4m_cstr_format("{}/helper.c4m", root),
+                               "func twice(x) {\n  return x + x\n}\n")) {
+        err = c4m_new_utf8("couldn't write the shadowing module");
+    }
+
+    if (err == NULL) {
+        err = cache_compile(entry, &third);
+    }
+
+    if (err == NULL && third->cached_vm != NULL) {
+        err = c4m_new_utf8("a shadowed module still hit the cache");
+    }
+
+    c4m_set_env(cache_var, saved_dir);
+    con4m_path = saved_path;
+    remove_scratch_dir(root);
+
+    return err == NULL ? c4m_new_utf8("ok") : err;
+}
+
+// Generates code for tests/peephole.c4m, whose second function comes
+// after one the optimizer shrinks, and checks that every function's
+// decl still agrees with the object file about where its code starts.
+static c4m_utf8_t *
+fn_offset_check(int64_t unused)
+{
+    c4m_utf8_t      *cache_var = c4m_new_utf8("CON4M_CACHE_DIR");
+    c4m_utf8_t      *saved_dir = c4m_get_env(cache_var);
+    c4m_compile_ctx *ctx;
+    c4m_vm_t        *vm = NULL;
+
+    // A cache hit wouldn't have any decls to look at.
+    c4m_set_env(cache_var, NULL);
+
+    ctx = c4m_compile_from_entry_point(c4m_new_utf8("tests/peephole.c4m"));
+
+    if (!ctx->fatality) {
+        vm = c4m_generate_code(ctx);
+    }
+
+    c4m_set_env(cache_var, saved_dir);
+
+    if (vm == NULL) {
+        return c4m_new_utf8("tests/peephole.c4m didn't compile");
+    }
+
+    int n = c4m_list_len(ctx->module_ordering);
+
+    for (int i = 0; i < n; i++) {
+        c4m_module_compile_ctx *m  = c4m_list_get(ctx->module_ordering,
+                                                 i,
+                                                 NULL);
+        int                     nf = c4m_list_len(m->fn_def_syms);
+
+        for (int j = 0; j < nf; j++) {
+            c4m_symbol_t   *sym  = c4m_list_get(m->fn_def_syms, j, NULL);
+            c4m_fn_decl_t  *decl = sym->value;
+            c4m_zfn_info_t *info = c4m_list_get(vm->obj->func_info,
+                                                decl->local_id - 1,
+                                                NULL);
+
+            if (decl->offset != info->offset) {
+                return c4m_cstr_format("{}() starts at {}, but its decl says {}",
+                                       sym->name,
+                                       c4m_box_i64(info->offset),
+                                       c4m_box_i64(decl->offset));
+            }
+        }
+    }
+
+    return c4m_new_utf8("ok");
+}
+
+// Hands out marshal memo IDs for n objects, then collects, which
+// moves all of them. Every object has to still find its ID at its
+// new address.
+static c4m_utf8_t *
+memo_rehash_check(int64_t n)
+{
+    c4m_memo_t *memos = c4m_alloc_marshal_memos();
+    void      **objs  = c4m_gc_raw_alloc(n * sizeof(void *),
+                                   C4M_GC_SCAN_ALL);
+    uint64_t    first;
+
+    for (int64_t i = 0; i < n; i++) {
+        objs[i] = c4m_gc_raw_alloc(sizeof(int64_t) * 4, C4M_GC_SCAN_NONE);
+        c4m_memo_put_id(memos, objs[i], i + 1);
+    }
+
+    // Inverted, so the collector doesn't take it for a pointer and
+    // update it along with everything else on the stack.
+    first = ~(uint64_t)objs[0];
+
+    c4m_gc_thread_collect();
+
+    if ((uint64_t)objs[0] == ~first) {
+        return c4m_new_utf8("the collection didn't move anything");
+    }
+
+    for (int64_t i = 0; i < n; i++) {
+        uint64_t id = c4m_memo_get_id(memos, objs[i]);
+
+        if (id != (uint64_t)i + 1) {
+            return c4m_cstr_format("object {} came back as memo {}",
+                                   c4m_box_i64(i + 1),
+                                   c4m_box_u64(id));
+        }
+    }
+
+    return c4m_new_utf8("ok");
+}
+
+static void
+scan_check_fn(uint64_t *bitfield, void *alloc)
+{
+    c4m_mark_raw_to_addr(bitfield, alloc, alloc);
+}
+
+// Every allocation has to hand back the scan function it was made
+// with. With compact headers that goes through the scan_ix index, so
+// also make sure the largest index the table allows fits in the field
+// without spilling into the flag bits next to it.
+static c4m_utf8_t *
+scan_index_check(int64_t unused)
+{
+    c4m_mem_scan_fn fns[] = {
+        C4M_GC_SCAN_ALL,
+        C4M_GC_SCAN_NONE,
+        scan_check_fn,
+    };
+
+    for (unsigned i = 0; i < sizeof(fns) / sizeof(fns[0]); i++) {
+        void          *p   = c4m_gc_raw_alloc(sizeof(uint64_t) * 2, fns[i]);
+        c4m_alloc_hdr *hdr = c4m_find_alloc(p);
+
+        if (hdr == NULL || c4m_alloc_scan_fn(hdr) != fns[i]) {
+            return c4m_cstr_format("allocation {} lost its scan function",
+                                   c4m_box_u64(i));
+        }
+    }
+
+#ifdef C4M_GC_COMPACT_HDR
+    c4m_alloc_hdr hdr = {0};
+
+    hdr.finalize  = 1;
+    hdr.con4m_obj = 1;
+    hdr.large     = 1;
+    hdr.scan_ix   = C4M_GC_MAX_SCAN_FNS - 1;
+
+    if (hdr.scan_ix != C4M_GC_MAX_SCAN_FNS - 1) {
+        return c4m_new_utf8("the largest scan index got truncated");
+    }
+
+    if (!hdr.finalize || !hdr.con4m_obj || !hdr.large) {
+        return c4m_new_utf8("the scan index spilled into the flag bits");
+    }
+#endif
+
+    return c4m_new_utf8("ok");
+}
+
+// Bigger than a pipe's buffer, so reads and writes have to take
+// turns. Captures get room for all of it up front.
+#define SB_PAYLOAD_LEN 100000
+#define SB_CAPTURE_LEN (SB_PAYLOAD_LEN + C4M_SB_MSG_LEN)
+
+static c4m_utf8_t *
+sb_check_capture(c4m_capture_result_t *res, char *tag, char *want)
+{
+    for (int i = 0; i < res->num_captures; i++) {
+        c4m_one_capture_t *c = res->captures + i;
+
+        if (strcmp(c->tag, tag)) {
+            continue;
+        }
+
+        if (c->len != SB_PAYLOAD_LEN || memcmp(c->contents, want, c->len)) {
+            return c4m_cstr_format("the {} capture came back wrong",
+                                   c4m_new_utf8(tag));
+        }
+
+        return NULL;
+    }
+
+    return c4m_cstr_format("no {} capture", c4m_new_utf8(tag));
+}
+
+// Pushes a string through a pipe and captures what comes out the
+// other end, all on one switchboard. With `file` set, it also
+// captures a regular file, which epoll won't take, so an epoll
+// switchboard has to fall back to select() before it can finish.
+static c4m_utf8_t *
+switchboard_run(c4m_sb_poller_t poller, bool file)
+{
+    c4m_switchboard_t    *sb      = c4m_gc_alloc(c4m_switchboard_t);
+    c4m_capture_result_t *res     = c4m_gc_alloc(c4m_capture_result_t);
+    char                 *payload = c4m_gc_raw_alloc(SB_PAYLOAD_LEN,
+                                     C4M_GC_SCAN_NONE);
+    char                  tmpl[]  = "/tmp/c4m_sb_XXXXXX";
+    c4m_utf8_t           *err     = NULL;
+    int                   fds[2];
+    int                   ffd     = -1;
+
+    for (int i = 0; i < SB_PAYLOAD_LEN; i++) {
+        payload[i] = 'a' + i % 23;
+    }
+
+    if (pipe(fds)) {
+        return c4m_new_utf8("pipe() failed");
+    }
+
+    c4m_sb_init(sb, C4M_IO_HEAP_SZ);
+
+    if (!c4m_sb_set_poller(sb, poller)) {
+        close(fds[0]);
+        close(fds[1]);
+        return c4m_new_utf8("couldn't pick the poller");
+    }
+
+    c4m_party_t *in  = c4m_sb_new_party_input_buf(sb,
+                                                 payload,
+                                                 SB_PAYLOAD_LEN,
+                                                 false,
+                                                 true);
+    c4m_party_t *w   = c4m_sb_new_party_fd(sb,
+                                         fds[1],
+                                         O_WRONLY,
+                                         false,
+                                         false,
+                                         false);
+    c4m_party_t *r   = c4m_sb_new_party_fd(sb,
+                                         fds[0],
+                                         O_RDONLY,
+                                         false,
+                                         false,
+                                         false);
+    c4m_party_t *out = c4m_sb_new_party_output_buf(sb,
+                                                   "pipe",
+                                                   SB_CAPTURE_LEN);
+
+    c4m_sb_route(sb, r, out);
+    c4m_sb_route(sb, in, w);
+
+    if (file) {
+        ffd = mkstemp(tmpl);
+
+        if (ffd == -1
+            || write(ffd, payload, SB_PAYLOAD_LEN) != SB_PAYLOAD_LEN
+            || lseek(ffd, 0, SEEK_SET) != 0) {
+            err = c4m_new_utf8("couldn't write the scratch file");
+            close(fds[1]);
+            goto done;
+        }
+
+        c4m_sb_route(sb,
+                     c4m_sb_new_party_fd(sb, ffd, O_RDONLY, false, false, false),
+                     c4m_sb_new_party_output_buf(sb, "file", SB_CAPTURE_LEN));
+    }
+
+    c4m_sb_operate_switchboard(sb, true);
+    c4m_sb_get_results(sb, res);
+
+    err = sb_check_capture(res, "pipe", payload);
+
+    if (err == NULL && file) {
+        err = sb_check_capture(res, "file", payload);
+    }
+
+    if (err == NULL && poller == C4M_SB_POLL_EPOLL) {
+        if (file && sb->poller != C4M_SB_POLL_SELECT) {
+            err = c4m_new_utf8("epoll took a regular file");
+        }
+        if (!file && sb->poller != C4M_SB_POLL_EPOLL) {
+            err = c4m_new_utf8("a pipe made epoll fall back to select()");
+        }
+    }
+
+done:
+    // The pipe's write end got closed when the input ran out.
+    c4m_sb_set_poller(sb, C4M_SB_POLL_SELECT);
+    close(fds[0]);
+    if (ffd != -1) {
+        close(ffd);
+        unlink(tmpl);
+    }
+
+    return err;
+}
+
+static c4m_utf8_t *
+switchboard_check(int64_t unused)
+{
+    c4m_utf8_t *err = switchboard_run(C4M_SB_POLL_SELECT, false);
+
+    if (err == NULL) {
+        err = switchboard_run(C4M_SB_POLL_SELECT, true);
+    }
+
+#ifdef __linux__
+    if (err == NULL) {
+        err = switchboard_run(C4M_SB_POLL_EPOLL, false);
+    }
+
+    if (err == NULL) {
+        err = switchboard_run(C4M_SB_POLL_EPOLL, true);
+    }
+#endif
+
+    return err == NULL ? c4m_new_utf8("ok") : err;
+}
+
+static c4m_buf_t *
+compress_buf(c4m_buf_t *in)
+{
+    c4m_buf_t    *out = c4m_buffer_empty();
+    c4m_stream_t *s   = c4m_buffer_outstream(out, false);
+
+    c4m_compress_to_stream(in, s);
+    c4m_stream_close(s);
+
+    return out;
+}
+
+// Returns NULL when the input fails to decompress.
+static c4m_buf_t *
+try_decompress(c4m_buf_t *in)
+{
+    c4m_stream_t *s      = c4m_buffer_instream(in);
+    c4m_buf_t    *result = NULL;
+
+    C4M_TRY
+    {
+        result = c4m_decompress_from_stream(s);
+    }
+    C4M_EXCEPT
+    {
+        result = NULL;
+    }
+    C4M_TRY_END;
+
+    c4m_stream_close(s);
+
+    return result;
+}
+
+static c4m_buf_t *
+raw_bytes(char *bytes, int64_t len)
+{
+    c4m_buf_t *result = c4m_new(c4m_type_buffer(),
+                                c4m_kw("length", c4m_ka(len)));
+
+    memcpy(result->data, bytes, len);
+
+    return result;
+}
+
+// Round-trips empty, incompressible, repetitive and multi-block
+// inputs, where the repetitive ones have matches that overlap their
+// own output. Then feeds the decoder bad data, which has to raise
+// rather than hand back something wrong.
+static c4m_utf8_t *
+compress_check(int64_t unused)
+{
+    int64_t     sizes[] = {0, 1, 5000, 65535, 65536, 65537, 300000};
+    char       *kinds[] = {"random", "zeros", "text"};
+    c4m_buf_t  *in;
+    c4m_buf_t  *packed;
+    c4m_buf_t  *out;
+    c4m_buf_t  *text = NULL;
+    c4m_utf8_t *err  = NULL;
+
+    for (int k = 0; k < 3; k++) {
+        for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            int64_t len = sizes[i];
+
+            in = c4m_new(c4m_type_buffer(), c4m_kw("length", c4m_ka(len)));
+
+            for (int64_t j = 0; j < len; j++) {
+                switch (k) {
+                case 0:
+                    in->data[j] = (char)c4m_rand64();
+                    break;
+                case 1:
+                    in->data[j] = 0;
+                    break;
+                default:
+                    in->data[j] = "the quick brown fox "[(j * 7 / 5) % 20];
+                    break;
+                }
+            }
+
+            packed = compress_buf(in);
+            out    = try_decompress(packed);
+
+            if (out == NULL || out->byte_len != len
+                || memcmp(out->data, in->data, len)) {
+                return c4m_cstr_format("{} bytes of {} didn't round trip",
+                                       c4m_box_i64(len),
+                                       c4m_new_utf8(kinds[k]));
+            }
+
+            // Past the first block, repetitive input has to shrink.
+            if (k && len > 65536 && packed->byte_len >= len / 2) {
+                return c4m_cstr_format("{} bytes of {} only shrank to {}",
+                                       c4m_box_i64(len),
+                                       c4m_new_utf8(kinds[k]),
+                                       c4m_box_i64(packed->byte_len));
+            }
+
+            if (k == 2 && len == 300000) {
+                text = packed;
+            }
+        }
+    }
+
+    // Blocks are: uncompressed length, compressed length (0 for
+    // stored), the block, and a final 0.
+    struct {
+        char   *what;
+        char   *bytes;
+        int64_t len;
+    } bad[] = {
+        // A block longer than 64K.
+        {"an oversized block", "\x81\x80\x08\x00", 4},
+        // A match 5 bytes back, with nothing written yet.
+        {"an offset past the start", "\x08\x03\x00\x05\x00\x00", 6},
+        // One literal where the header promised 10 bytes.
+        {"a short block", "\x0a\x02\x10\x61\x00", 5},
+        // A stored block whose data isn't all there.
+        {"a truncated stored block", "\x0a\x00\x61\x62", 4},
+        // A varint that never ends.
+        {"a truncated length", "\x80", 1},
+        // 8 literals claimed, 1 present.
+        {"too few literals", "\x08\x02\x80\x61\x00", 5},
+    };
+
+    for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (try_decompress(raw_bytes(bad[i].bytes, bad[i].len)) != NULL) {
+            return c4m_cstr_format("decompressed {}",
+                                   c4m_new_utf8(bad[i].what));
+        }
+    }
+
+    // Any prefix of real output is missing at least its end marker.
+    for (int64_t cut = 1; cut < text->byte_len; cut += 97) {
+        if (try_decompress(raw_bytes(text->data, cut)) != NULL) {
+            err = c4m_cstr_format("decompressed the first {} bytes",
+                                  c4m_box_i64(cut));
+            break;
+        }
+    }
+
+    return err == NULL ? c4m_new_utf8("ok") : err;
+}
+
+static c4m_type_t *
+big_tuple(int n, c4m_type_t *last)
+{
+    c4m_list_t *items = c4m_list(c4m_type_typespec());
+
+    for (int i = 0; i < n - 1; i++) {
+        c4m_list_append(items, i % 2 ? c4m_type_utf8() : c4m_type_int());
+    }
+
+    c4m_list_append(items, last);
+
+    return c4m_type_tuple_from_xlist(items);
+}
+
+static c4m_buf_t *
+marshal_with_version(c4m_obj_t obj, int version)
+{
+    c4m_buf_t    *buf = c4m_buffer_empty();
+    c4m_stream_t *s   = c4m_buffer_outstream(buf, false);
+
+    if (version == C4M_MARSHAL_VERSION) {
+        c4m_marshal(obj, s);
+    }
+    else {
+        // Old writers didn't put a header on anything.
+        c4m_memo_t *memos = c4m_alloc_marshal_memos();
+        int64_t     next  = 1;
+
+        memos->version = version;
+        c4m_sub_marshal(obj, s, memos, &next);
+    }
+
+    c4m_stream_close(s);
+
+    return buf;
+}
+
+// Types built the same way have to hash the same, and concrete
+// container types have to come back as the same node. Types that
+// differ anywhere, including past the hash's inline buffer, have to
+// hash differently. Objects unmarshaled from either format version
+// have to end up with the same type IDs as types built here.
+static c4m_utf8_t *
+type_hash_check(int64_t unused)
+{
+    c4m_type_t *a = c4m_type_dict(c4m_type_utf8(),
+                                  c4m_type_list(c4m_type_int()));
+    c4m_type_t *b = c4m_type_dict(c4m_type_utf8(),
+                                  c4m_type_list(c4m_type_int()));
+    c4m_type_t *slow;
+
+    if (a != b) {
+        return c4m_new_utf8("dict[string, list[int]] got built twice");
+    }
+
+    if (!c4m_type_is_concrete(a) || (a->typeid & (1ULL << 63))) {
+        return c4m_new_utf8("a concrete type got a type variable's ID");
+    }
+
+    slow = c4m_new(c4m_type_typespec(), C4M_T_DICT);
+    c4m_list_append(slow->details->items, c4m_type_utf8());
+    c4m_list_append(slow->details->items, c4m_type_list(c4m_type_int()));
+
+    if (c4m_calculate_type_hash(slow) != a->typeid) {
+        return c4m_new_utf8("a hand-built dict hashed differently");
+    }
+
+    c4m_type_t *pairs[][2] = {
+        {c4m_type_dict(c4m_type_utf8(), c4m_type_int()),
+         c4m_type_dict(c4m_type_int(), c4m_type_utf8())},
+        {c4m_type_list(c4m_type_int()), c4m_type_set(c4m_type_int())},
+        {c4m_type_tuple(2, c4m_type_int(), c4m_type_utf8()),
+         c4m_type_tuple(3, c4m_type_int(), c4m_type_utf8(), c4m_type_int())},
+        {c4m_type_list(c4m_type_list(c4m_type_int())),
+         c4m_type_list(c4m_type_int())},
+        {big_tuple(20, c4m_type_int()), big_tuple(20, c4m_type_utf8())},
+    };
+
+    for (unsigned i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        if (pairs[i][0]->typeid == pairs[i][1]->typeid) {
+            return c4m_cstr_format("pair {} hashed the same",
+                                   c4m_box_u64(i));
+        }
+    }
+
+    if (big_tuple(20, c4m_type_int())->typeid != pairs[4][0]->typeid) {
+        return c4m_new_utf8("a big tuple hashed differently twice");
+    }
+
+    c4m_type_t *tv = c4m_type_list(c4m_new_typevar());
+
+    if (!(tv->typeid & (1ULL << 63))) {
+        return c4m_new_utf8("list[`a] got a concrete type's ID");
+    }
+
+    if (tv == c4m_type_list(c4m_new_typevar())) {
+        return c4m_new_utf8("two different type variables got shared");
+    }
+
+    c4m_type_t *dict_t = c4m_type_dict(c4m_type_utf8(), c4m_type_int());
+    c4m_list_t *l      = c4m_list(dict_t);
+
+    c4m_list_append(l, c4m_new(dict_t));
+
+    c4m_buf_t *v1 = marshal_with_version(l, C4M_MARSHAL_V1);
+    c4m_buf_t *v2 = marshal_with_version(l, C4M_MARSHAL_V2);
+
+    if ((uint8_t)v2->data[0] != C4M_MARSHAL_MAGIC
+        || v2->data[1] != C4M_MARSHAL_V2) {
+        return c4m_new_utf8("the current format has no header");
+    }
+
+    if (v1->byte_len <= v2->byte_len) {
+        return c4m_new_utf8("V1 data came out as small as V2");
+    }
+
+    c4m_buf_t *bufs[] = {v1, v2};
+
+    for (int i = 0; i < 2; i++) {
+        c4m_stream_t *s    = c4m_buffer_instream(bufs[i]);
+        c4m_list_t   *copy = c4m_unmarshal(s);
+
+        c4m_stream_close(s);
+
+        if (copy == NULL || c4m_list_len(copy) != 1) {
+            return c4m_cstr_format("V{} data didn't unmarshal",
+                                   c4m_box_i64(i + 1));
+        }
+
+        c4m_obj_t item = c4m_list_get(copy, 0, NULL);
+
+        if (c4m_get_my_type(copy)->typeid != c4m_get_my_type(l)->typeid
+            || c4m_get_my_type(item)->typeid != dict_t->typeid) {
+            return c4m_cstr_format("V{} data came back with new type IDs",
+                                   c4m_box_i64(i + 1));
+        }
+    }
+
+    return c4m_new_utf8("ok");
+}
+
+extern c4m_type_universe_t c4m_type_universe;
+
+// Unifying the same pair of concrete types a second time has to come
+// straight from the cache, in one step, with the same answer. Then
+// builds a chain of forwarded type variables, and checks that
+// resolving one end points every link at the other end, and that
+// binding the chain binds every variable on it.
+static c4m_utf8_t *
+unify_cache_check(int64_t unused)
+{
+    c4m_type_t *pairs[][2] = {
+        {c4m_type_dict(c4m_type_utf8(), c4m_type_list(c4m_type_int())),
+         c4m_type_dict(c4m_type_utf8(), c4m_type_list(c4m_type_int()))},
+        {c4m_type_list(c4m_type_int()), c4m_type_list(c4m_type_int())},
+        {c4m_type_list(c4m_type_int()), c4m_type_list(c4m_type_utf8())},
+    };
+    uint64_t steps[2];
+    uint64_t hits[2];
+
+    for (unsigned i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        c4m_type_t *first = c4m_unify(pairs[i][0], pairs[i][1]);
+
+        c4m_type_unify_stats(&steps[0], &hits[0]);
+
+        c4m_type_t *again = c4m_unify(pairs[i][0], pairs[i][1]);
+
+        c4m_type_unify_stats(&steps[1], &hits[1]);
+
+        if (c4m_type_is_error(first) != (i == 2)) {
+            return c4m_cstr_format("pair {} unified wrong",
+                                   c4m_box_u64(i));
+        }
+
+        if (again->typeid != first->typeid) {
+            return c4m_cstr_format("pair {} unified differently twice",
+                                   c4m_box_u64(i));
+        }
+
+        if (i != 2 && first->typeid != pairs[i][0]->typeid) {
+            return c4m_cstr_format("pair {} unified to a new type",
+                                   c4m_box_u64(i));
+        }
+
+        if (i != 2 && (steps[1] != steps[0] + 1 || hits[1] != hits[0] + 1)) {
+            return c4m_cstr_format("pair {} missed the cache",
+                                   c4m_box_u64(i));
+        }
+    }
+
+    c4m_type_t *tv[5];
+
+    for (int i = 0; i < 5; i++) {
+        tv[i] = c4m_new_typevar();
+        c4m_universe_put(&c4m_type_universe, tv[i]);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        c4m_universe_forward(&c4m_type_universe, tv[i], tv[i + 1]);
+    }
+
+    if (c4m_universe_get(&c4m_type_universe, tv[0]->typeid) != tv[1]) {
+        return c4m_new_utf8("the chain got built short");
+    }
+
+    if (c4m_type_resolve(tv[0]) != tv[4]) {
+        return c4m_new_utf8("the chain didn't resolve to its end");
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (c4m_universe_get(&c4m_type_universe, tv[i]->typeid) != tv[4]
+            || tv[i]->fw != tv[4]->typeid) {
+            return c4m_cstr_format("link {} didn't get compressed",
+                                   c4m_box_i64(i));
+        }
+    }
+
+    // Forwarding the end back to the start can't make a cycle.
+    c4m_universe_forward(&c4m_type_universe, tv[4], tv[0]);
+
+    if (c4m_type_resolve(tv[4]) != tv[4]) {
+        return c4m_new_utf8("the end of the chain got forwarded");
+    }
+
+    c4m_type_t *bound = c4m_unify(tv[0], c4m_type_int());
+
+    if (bound->typeid != c4m_type_int()->typeid) {
+        return c4m_new_utf8("the chain didn't unify with int");
+    }
+
+    for (int i = 0; i < 5; i++) {
+        if (c4m_type_resolve(tv[i])->typeid != c4m_type_int()->typeid) {
+            return c4m_cstr_format("variable {} didn't get bound",
+                                   c4m_box_i64(i));
+        }
+    }
+
+    return c4m_new_utf8("ok");
+}
+
+// These take strings (which the FFI converts or passes through) mixed
+// in with values of several widths, so an argument plan that's off by
+// one, reversed, or converting the wrong slot gives the wrong output.
+static c4m_utf8_t *
+ffi_arg_echo(int64_t a, char *s, int32_t b, char *t, uint8_t c)
+{
+    return c4m_cstr_format("{} {} {} {} {}",
+                           c4m_box_i64(a),
+                           c4m_new_utf8(s),
+                           c4m_box_i64(b),
+                           c4m_new_utf8(t),
+                           c4m_box_u64(c));
+}
+
+static c4m_utf8_t *
+ffi_arg_hold(c4m_utf8_t *s, int64_t n)
+{
+    return c4m_cstr_format("{} {}", s, c4m_box_i64(n));
+}
+
 void
 add_static_test_symbols()
 {
     c4m_add_static_symbols();
     c4m_add_static_function(c4m_new_utf8("strndup"),
                             strndup);
+    c4m_add_static_function(c4m_new_utf8("grid_write_check"),
+                            grid_write_check);
+    c4m_add_static_function(c4m_new_utf8("threaded_compile_check"),
+                            threaded_compile_check);
+    c4m_add_static_function(c4m_new_utf8("tospace_growth_check"),
+                            tospace_growth_check);
+    c4m_add_static_function(c4m_new_utf8("stream_flags_check"),
+                            stream_flags_check);
+    c4m_add_static_function(c4m_new_utf8("object_cache_check"),
+                            object_cache_check);
+    c4m_add_static_function(c4m_new_utf8("fn_offset_check"),
+                            fn_offset_check);
+    c4m_add_static_function(c4m_new_utf8("memo_rehash_check"),
+                            memo_rehash_check);
+    c4m_add_static_function(c4m_new_utf8("scan_index_check"),
+                            scan_index_check);
+    c4m_add_static_function(c4m_new_utf8("switchboard_check"),
+                            switchboard_check);
+    c4m_add_static_function(c4m_new_utf8("compress_check"),
+                            compress_check);
+    c4m_add_static_function(c4m_new_utf8("type_hash_check"),
+                            type_hash_check);
+    c4m_add_static_function(c4m_new_utf8("unify_cache_check"),
+                            unify_cache_check);
+    c4m_add_static_function(c4m_new_utf8("ffi_arg_echo"), ffi_arg_echo);
+    c4m_add_static_function(c4m_new_utf8("ffi_arg_hold"), ffi_arg_hold);
 }
 
 int
@@ -0,0 +1,98 @@
+// Build-time tool that turns the sys/ modules into a C file, so they
+// can be linked into libcon4m instead of being found and read from
+// disk every time something gets compiled.
+//
+// Usage: sysembed output.c module.c4m ...
+//
+// This runs before libcon4m exists, so it's plain C.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BYTES_PER_LINE 12
+
+static int
+emit_module(FILE *out, int n, char *path)
+{
+    FILE *in = fopen(path, "rb");
+    int   c;
+    long  len = 0;
+
+    if (in == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(out, "static const char sys_module_%d[] = {", n);
+
+    while ((c = fgetc(in)) != EOF) {
+        if (!(len % BYTES_PER_LINE)) {
+            fprintf(out, "\n    ");
+        }
+        fprintf(out, "0x%02x, ", (unsigned char)c);
+        len++;
+    }
+
+    fprintf(out, "\n    0x00,\n};\n\n");
+    fclose(in);
+
+    return (int)len;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s output.c module.c4m ...\n", argv[0]);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    int  *lens;
+
+    if (out == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    lens = calloc(argc, sizeof(int));
+
+    fprintf(out, "// Generated by sysembed from the sys/ modules; do not edit.\n");
+    fprintf(out, "#define C4M_USE_INTERNAL_API\n");
+    fprintf(out, "#include \"con4m.h\"\n\n");
+    fprintf(out, "// clang-format off\n");
+
+    for (int i = 2; i < argc; i++) {
+        lens[i] = emit_module(out, i - 2, argv[i]);
+
+        if (lens[i] < 0) {
+            fclose(out);
+            remove(argv[1]);
+            return 1;
+        }
+    }
+
+    fprintf(out,
+            "const c4m_embedded_module_t c4m_embedded_sys_modules[] = {\n");
+
+    for (int i = 2; i < argc; i++) {
+        char *name = strrchr(argv[i], '/');
+
+        name = name ? name + 1 : argv[i];
+
+        fprintf(out,
+                "    {\"%s\", sys_module_%d, %d},\n",
+                name,
+                i - 2,
+                lens[i]);
+    }
+
+    fprintf(out, "};\n\n");
+    fprintf(out,
+            "const int c4m_num_embedded_sys_modules = %d;\n",
+            argc - 2);
+    fprintf(out, "// clang-format on\n");
+
+    return fclose(out) ? 1 : 0;
+}
@@ -144,11 +144,12 @@ ansi_render_style_end(c4m_stream_t *outstream)
     c4m_stream_putc(outstream, 'm');
 }
 
+// This runs once per styled region, so it doesn't flush; the public
+// entry points below flush once when they're done.
 static inline void
 ansi_render_style_final(c4m_stream_t *outstream)
 {
     c4m_stream_puts(outstream, "\e[0m\e[K");
-    c4m_stream_flush(outstream);
 }
 
 static inline void
@@ -188,6 +189,55 @@ ansi_render_one_c4m_codepoint_title(c4m_codepoint_t cp, bool go_up, c4m_stream_t
     return c4m_codepoint_is_space(cp);
 }
 
+// When no case mapping is in effect, UTF-8 input can go out as-is.
+// This writes the next `n` codepoints starting at `p` in as few
+// writes as possible, splitting only around the (always single-byte)
+// characters ignore_for_printing() drops. Returns where it stopped.
+static uint8_t *
+ansi_render_u8_run(uint8_t *p, uint8_t *end, int64_t n, c4m_stream_t *outstream)
+{
+    uint8_t *start = p;
+
+    while (p < end) {
+        if ((*p & 0xc0) != 0x80) {
+            if (n-- == 0) {
+                break;
+            }
+            if (*p < 0x80 && ignore_for_printing(*p)) {
+                c4m_stream_raw_write(outstream, p - start, (char *)start);
+                start = p + 1;
+            }
+        }
+        p++;
+    }
+
+    c4m_stream_raw_write(outstream, p - start, (char *)start);
+
+    return p;
+}
+
+// Same idea for UTF-32: encode into a local buffer and write that out
+// in chunks, instead of one stream write per codepoint.
+static void
+ansi_render_u32_run(c4m_codepoint_t *p, int32_t n, c4m_stream_t *outstream)
+{
+    uint8_t buf[512];
+    int     len = 0;
+
+    for (int32_t i = 0; i < n; i++) {
+        if (ignore_for_printing(p[i])) {
+            continue;
+        }
+        if (len > (int)sizeof(buf) - 4) {
+            c4m_stream_raw_write(outstream, len, (char *)buf);
+            len = 0;
+        }
+        len += utf8proc_encode_char(p[i], buf + len);
+    }
+
+    c4m_stream_raw_write(outstream, len, (char *)buf);
+}
+
 void
 c4m_utf8_ansi_render(const c4m_utf8_t *s, c4m_stream_t *outstream)
 {
@@ -203,7 +253,7 @@ c4m_utf8_ansi_render(const c4m_utf8_t *s, c4m_stream_t *outstream)
     uint32_t           style_ix      = 0;
     c4m_u8_state_t     style_state   = C4M_U8_STATE_START_DEFAULT;
     uint8_t           *p             = (uint8_t *)s->data;
-    uint8_t           *end           = p + s->codepoints;
+    uint8_t           *end           = p + s->byte_len;
     c4m_style_entry_t *entry         = NULL;
     bool               case_up       = true;
     c4m_codepoint_t    codepoint;
@@ -295,6 +345,14 @@ c4m_utf8_ansi_render(const c4m_utf8_t *s, c4m_stream_t *outstream)
             break;
         }
 
+        if (!casing) {
+            int64_t n = cp_stop > cp_ix ? cp_stop - cp_ix : 1;
+
+            p = ansi_render_u8_run(p, end, n, outstream);
+            cp_ix += n;
+            continue;
+        }
+
         int tmp = utf8proc_iterate(p, 4, &codepoint);
         assert(tmp > 0);
         p += tmp;
@@ -310,13 +368,11 @@ c4m_utf8_ansi_render(const c4m_utf8_t *s, c4m_stream_t *outstream)
         case C4M_STY_TITLE:
             case_up = ansi_render_one_c4m_codepoint_title(codepoint, case_up, outstream);
             break;
-        default:
-            ansi_render_one_codepoint_plain(codepoint, outstream);
-            break;
         }
     }
 
     ansi_render_style_final(outstream);
+    c4m_stream_flush(outstream);
 }
 
 // This will have to convert characters to utf-8, since terminals
@@ -352,20 +408,18 @@ ansi_render_u32_region(const c4m_utf32_t *s,
         }
         break;
     default:
-        for (int32_t i = from; i < to; i++) {
-            ansi_render_one_codepoint_plain(p[i], outstream);
-        }
+        ansi_render_u32_run(p + from, to - from, outstream);
         break;
     }
 
     ansi_render_style_final(outstream);
 }
 
-void
-c4m_utf32_ansi_render(const c4m_utf32_t *s,
-                      int32_t            start_ix,
-                      int32_t            end_ix,
-                      c4m_stream_t      *outstream)
+static void
+utf32_ansi_render(const c4m_utf32_t *s,
+                  int32_t            start_ix,
+                  int32_t            end_ix,
+                  c4m_stream_t      *outstream)
 {
     if (!s) {
         return;
@@ -418,6 +472,16 @@ c4m_utf32_ansi_render(const c4m_utf32_t *s,
     }
 }
 
+void
+c4m_utf32_ansi_render(const c4m_utf32_t *s,
+                      int32_t            start_ix,
+                      int32_t            end_ix,
+                      c4m_stream_t      *outstream)
+{
+    utf32_ansi_render(s, start_ix, end_ix, outstream);
+    c4m_stream_flush(outstream);
+}
+
 void
 c4m_ansi_render(const c4m_str_t *s, c4m_stream_t *out)
 {
@@ -480,12 +544,14 @@ c4m_ansi_render_to_width(const c4m_str_t *s,
         if (end > width) {
             end = internal_truncate_to_width(line, end, width);
         }
-        c4m_utf32_ansi_render(line, 0, end, out);
+        utf32_ansi_render(line, 0, end, out);
         if (i + 1 == n) {
             break;
         }
         c4m_stream_putcp(out, '\n');
     }
+
+    c4m_stream_flush(out);
 }
 
 static inline size_t
@@ -1,5 +1,7 @@
 /*
- * Currently, we're using select() here, not epoll(), etc.
+ * On Linux we wait on fds with epoll by default; everywhere else (and
+ * whenever epoll can't be used) we use select(). See
+ * c4m_sb_set_poller().
  */
 #include "con4m.h"
 
@@ -121,6 +123,31 @@ get_listener_obj(c4m_party_t *party)
     return &party->info.listenerinfo;
 }
 
+#ifdef __linux__
+// The epoll backend finds the party for a ready fd through this table,
+// instead of walking the party lists. The table is kept up to date
+// whichever poller is active, so we can switch at any time.
+static c4m_sb_fdslot_t *
+get_fdslot(c4m_switchboard_t *ctx, int fd)
+{
+    if (fd >= ctx->num_fdslots) {
+        int              n     = c4m_max(fd + 1, ctx->num_fdslots * 2);
+        c4m_sb_fdslot_t *slots = c4m_gc_array_alloc(c4m_sb_fdslot_t, n);
+
+        if (ctx->fdslots) {
+            memcpy(slots,
+                   ctx->fdslots,
+                   sizeof(c4m_sb_fdslot_t) * ctx->num_fdslots);
+        }
+
+        ctx->fdslots     = slots;
+        ctx->num_fdslots = n;
+    }
+
+    return &ctx->fdslots[fd];
+}
+#endif
+
 /* Here we link together readers so we can walk through them to build
  * the read FD set, and to do memory management.
  *
@@ -133,6 +160,10 @@ register_read_fd(c4m_switchboard_t *ctx, c4m_party_t *read_from)
 
     read_from->next_reader   = ctx->parties_for_reading;
     ctx->parties_for_reading = read_from;
+
+#ifdef __linux__
+    get_fdslot(ctx, c4m_sb_party_fd(read_from))->reader = read_from;
+#endif
 }
 
 static inline void
@@ -141,6 +172,10 @@ register_writer_fd(c4m_switchboard_t *ctx, c4m_party_t *write_to)
     register_fd(ctx, c4m_sb_party_fd(write_to));
     write_to->next_writer    = ctx->parties_for_writing;
     ctx->parties_for_writing = write_to;
+
+#ifdef __linux__
+    get_fdslot(ctx, c4m_sb_party_fd(write_to))->writer = write_to;
+#endif
 }
 
 /* 'Loner' is a horrible name for this; it's taking the party metaphor
@@ -890,7 +925,49 @@ c4m_sb_init(c4m_switchboard_t *ctx, size_t heap_size)
 {
     memset(ctx, 0, sizeof(c4m_switchboard_t));
     ctx->heap_elems = heap_size;
+    ctx->epoll_fd   = -1;
     add_heap(ctx);
+    c4m_sb_set_poller(ctx, C4M_SB_POLL_EPOLL);
+}
+
+/*
+ * Picks how we wait for fds. Asking for epoll where it isn't
+ * available (or where epoll_create1() fails) leaves the switchboard
+ * on select(), and returns false.
+ */
+bool
+c4m_sb_set_poller(c4m_switchboard_t *ctx, c4m_sb_poller_t poller)
+{
+    if (ctx->epoll_fd != -1) {
+        close(ctx->epoll_fd);
+        ctx->epoll_fd = -1;
+    }
+
+    ctx->poller = C4M_SB_POLL_SELECT;
+
+    if (poller == C4M_SB_POLL_SELECT) {
+        return true;
+    }
+
+#ifdef __linux__
+    ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (ctx->epoll_fd == -1) {
+        return false;
+    }
+
+    // Nothing is registered with a brand new epoll instance.
+    for (int i = 0; i < ctx->num_fdslots; i++) {
+        ctx->fdslots[i].registered = false;
+        ctx->fdslots[i].events     = 0;
+    }
+
+    ctx->poller = C4M_SB_POLL_EPOLL;
+
+    return true;
+#else
+    return false;
+#endif
 }
 
 /*
@@ -911,6 +988,40 @@ c4m_sb_init(c4m_switchboard_t *ctx, size_t heap_size)
  * If neither of these conditions are met, we shut down.
  * down.
  */
+static inline bool
+reader_wants_io(c4m_party_t *cur)
+{
+    c4m_party_fd_t     *r_fd_obj    = get_fd_obj(cur);
+    c4m_subscription_t *subscribers = r_fd_obj->subscribers;
+
+    if (!cur->open_for_read) {
+        return false;
+    }
+
+    while (subscribers != NULL) {
+        if (cur->c4m_party_type == C4M_PT_FD) {
+            c4m_party_t *onesub = subscribers->subscriber;
+
+            if (onesub && onesub->open_for_write) {
+                return true;
+            }
+        }
+        else {
+            return true;
+        }
+        subscribers = subscribers->next;
+    }
+
+    return false;
+}
+
+static inline bool
+writer_wants_io(c4m_party_t *cur)
+{
+    return cur->c4m_party_type == C4M_PT_FD && cur->open_for_write
+        && cur->info.fdinfo.first_msg != NULL;
+}
+
 static inline void
 set_fdinfo(c4m_switchboard_t *ctx)
 {
@@ -923,34 +1034,16 @@ set_fdinfo(c4m_switchboard_t *ctx)
     cur = ctx->parties_for_reading;
 
     while (cur != NULL) {
-        c4m_party_fd_t     *r_fd_obj    = get_fd_obj(cur);
-        c4m_subscription_t *subscribers = r_fd_obj->subscribers;
-
-        if (cur->open_for_read) {
-            while (subscribers != NULL) {
-                if (cur->c4m_party_type == C4M_PT_FD) {
-                    c4m_party_t *onesub = subscribers->subscriber;
-
-                    if (onesub && onesub->open_for_write) {
-                        FD_SET(c4m_sb_party_fd(cur), &ctx->readset);
-                        open = true;
-                        break;
-                    }
-                }
-                else {
-                    open = true;
-                    FD_SET(c4m_sb_party_fd(cur), &ctx->readset);
-                    break;
-                }
-                subscribers = subscribers->next;
-            }
+        if (reader_wants_io(cur)) {
+            FD_SET(c4m_sb_party_fd(cur), &ctx->readset);
+            open = true;
         }
         cur = cur->next_reader;
     }
 
     cur = ctx->parties_for_writing;
     while (cur != NULL) {
-        if (cur->c4m_party_type == C4M_PT_FD && cur->open_for_write && cur->info.fdinfo.first_msg != NULL) {
+        if (writer_wants_io(cur)) {
             open = true;
             FD_SET(c4m_sb_party_fd(cur), &ctx->writeset);
         }
@@ -964,6 +1057,122 @@ set_fdinfo(c4m_switchboard_t *ctx)
     }
 }
 
+#ifdef __linux__
+/*
+ * Brings the kernel's view of one fd in line with slot->want. fds stay
+ * registered when we lose interest in them (we just MOD them down to
+ * no events), so a writer whose queue keeps draining and refilling
+ * costs one epoll_ctl() per transition, not an add and a delete.
+ *
+ * Returns false only if epoll refuses the fd outright, in which case
+ * the caller falls back to select().
+ */
+static bool
+epoll_sync_fd(c4m_switchboard_t *ctx, int fd)
+{
+    c4m_sb_fdslot_t   *slot = &ctx->fdslots[fd];
+    struct epoll_event ev   = {
+          .events  = slot->want,
+          .data.fd = fd,
+    };
+
+    if (slot->registered ? slot->want == slot->events : !slot->want) {
+        return true;
+    }
+
+    if (slot->registered) {
+        if (!epoll_ctl(ctx->epoll_fd, EPOLL_CTL_MOD, fd, &ev)) {
+            slot->events = slot->want;
+            return true;
+        }
+
+        // If the fd got closed (and maybe reopened), the kernel
+        // dropped our registration.
+        slot->registered = false;
+        slot->events     = 0;
+
+        if (errno != ENOENT || !slot->want) {
+            return true;
+        }
+    }
+
+    if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+        return false;
+    }
+
+    slot->registered = true;
+    slot->events     = slot->want;
+
+    return true;
+}
+
+/*
+ * The epoll version of set_fdinfo(): same rules for what we wait on
+ * and when we're done, but instead of rebuilding fd_sets, we compute
+ * the events wanted per fd and only tell the kernel about changes.
+ */
+static bool
+epoll_set_fdinfo(c4m_switchboard_t *ctx)
+{
+    c4m_party_t     *cur;
+    c4m_sb_fdslot_t *slot;
+    bool             open = false;
+
+    for (cur = ctx->parties_for_reading; cur; cur = cur->next_reader) {
+        ctx->fdslots[c4m_sb_party_fd(cur)].want = 0;
+    }
+    for (cur = ctx->parties_for_writing; cur; cur = cur->next_writer) {
+        ctx->fdslots[c4m_sb_party_fd(cur)].want = 0;
+    }
+
+    for (cur = ctx->parties_for_reading; cur; cur = cur->next_reader) {
+        if (reader_wants_io(cur)) {
+            slot = &ctx->fdslots[c4m_sb_party_fd(cur)];
+            open = true;
+
+            if (slot->reader == cur) {
+                slot->want |= EPOLLIN;
+            }
+        }
+    }
+    for (cur = ctx->parties_for_writing; cur; cur = cur->next_writer) {
+        if (writer_wants_io(cur)) {
+            slot = &ctx->fdslots[c4m_sb_party_fd(cur)];
+            open = true;
+
+            if (slot->writer == cur) {
+                slot->want |= EPOLLOUT;
+            }
+        }
+    }
+
+    for (cur = ctx->parties_for_reading; cur; cur = cur->next_reader) {
+        if (!epoll_sync_fd(ctx, c4m_sb_party_fd(cur))) {
+            goto fall_back;
+        }
+    }
+    for (cur = ctx->parties_for_writing; cur; cur = cur->next_writer) {
+        if (!epoll_sync_fd(ctx, c4m_sb_party_fd(cur))) {
+            goto fall_back;
+        }
+    }
+
+    if (!open) {
+        ctx->done = true;
+    }
+
+    return true;
+
+fall_back:
+#ifdef C4M_SB_DEBUG
+    printf("epoll_ctl() failed (%s); falling back to select().\n",
+           strerror(errno));
+#endif
+    c4m_sb_set_poller(ctx, C4M_SB_POLL_SELECT);
+    return false;
+}
+#endif
+
 /*
  * Setting this timeout sets how long we will wait before timing out
  * on a single select() call. Without setting it, select() will wait
@@ -1308,6 +1517,112 @@ handle_ready_writes(c4m_switchboard_t *ctx)
     }
 }
 
+#ifdef __linux__
+#define C4M_SB_MAX_EVENTS 64
+
+/*
+ * Waits, then dispatches straight to the parties for the fds that are
+ * ready. As with select(), all reads happen before any writes, and an
+ * fd that was read from doesn't also get written to on the same pass.
+ *
+ * This is level-triggered on purpose: fds handed to us don't have to
+ * be non-blocking, and we only do one read or write per fd per pass,
+ * so anything left over needs to show up as ready again next time.
+ *
+ * Handlers can register new parties, which can move the slot table,
+ * so slots are looked up fresh each time.
+ */
+static int
+epoll_wait_and_dispatch(c4m_switchboard_t *ctx)
+{
+    struct epoll_event events[C4M_SB_MAX_EVENTS];
+    int                timeout = -1;
+    int                n;
+
+    if (ctx->io_timeout_ptr) {
+        timeout = ctx->io_timeout.tv_sec * 1000
+                + (ctx->io_timeout.tv_usec + 999) / 1000;
+    }
+
+    n = epoll_wait(ctx->epoll_fd, events, C4M_SB_MAX_EVENTS, timeout);
+
+    for (int i = 0; i < n; i++) {
+        int          fd     = events[i].data.fd;
+        c4m_party_t *reader = ctx->fdslots[fd].reader;
+
+        if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+            continue;
+        }
+        if (!(ctx->fdslots[fd].events & EPOLLIN) || !reader->open_for_read) {
+            continue;
+        }
+
+        if (reader->c4m_party_type == C4M_PT_FD) {
+            handle_one_read(ctx, reader);
+        }
+        else {
+            handle_one_accept(ctx, reader);
+        }
+
+        events[i].events = 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int          fd     = events[i].data.fd;
+        c4m_party_t *writer = ctx->fdslots[fd].writer;
+
+        if (!(events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+            continue;
+        }
+        if (!(ctx->fdslots[fd].events & EPOLLOUT) || !writer->open_for_write) {
+            continue;
+        }
+
+        handle_one_write(ctx, writer);
+    }
+
+    return n;
+}
+#endif
+
+// Figure out what to wait on, marking the switchboard done if there's
+// nothing left.
+static inline void
+prepare_wait(c4m_switchboard_t *ctx)
+{
+#ifdef __linux__
+    if (ctx->poller == C4M_SB_POLL_EPOLL && epoll_set_fdinfo(ctx)) {
+        return;
+    }
+#endif
+    set_fdinfo(ctx);
+}
+
+static inline int
+wait_and_dispatch(c4m_switchboard_t *ctx)
+{
+    int n;
+
+#ifdef __linux__
+    if (ctx->poller == C4M_SB_POLL_EPOLL) {
+        return epoll_wait_and_dispatch(ctx);
+    }
+#endif
+
+    n = select(ctx->max_fd,
+               &ctx->readset,
+               &ctx->writeset,
+               NULL,
+               ctx->io_timeout_ptr);
+
+    if (n > 0) {
+        handle_ready_reads(ctx);
+        handle_ready_writes(ctx);
+    }
+
+    return n;
+}
+
 // Doesn't seem to be used anymore?
 
 #if 0
@@ -1529,6 +1844,8 @@ c4m_sb_destroy(c4m_switchboard_t *ctx, bool free_parties)
         next = cur->next_writer;
         cur  = next;
     }
+
+    c4m_sb_set_poller(ctx, C4M_SB_POLL_SELECT);
 }
 
 /*
@@ -1645,22 +1962,14 @@ c4m_sb_operate_switchboard(c4m_switchboard_t *ctx, bool loop)
         return true;
     }
     do {
-        set_fdinfo(ctx);
+        prepare_wait(ctx);
         if (c4m_sb_default_check_exit_conditions(ctx)) {
             return true;
         }
         if (ctx->done && !waiting_writes(ctx)) {
             return true;
         }
-        ctx->fds_ready = select(ctx->max_fd,
-                                &ctx->readset,
-                                &ctx->writeset,
-                                NULL,
-                                ctx->io_timeout_ptr);
-        if (ctx->fds_ready > 0) {
-            handle_ready_reads(ctx);
-            handle_ready_writes(ctx);
-        }
+        ctx->fds_ready = wait_and_dispatch(ctx);
         if (ctx->fds_ready >= 0) {
             handle_loop_end(ctx);
         }
@@ -0,0 +1,290 @@
+// A small LZ77 block compressor, used for compressed marshal output.
+//
+// The input is cut into blocks of at most 64K, each written as:
+//
+// - The block's uncompressed length, as a varint.
+// - The compressed length, as a varint, or 0 if the block didn't
+//   shrink and is stored as-is.
+// - The block itself.
+//
+// A 0 length marks the end.
+//
+// Inside a compressed block, the format is the same sequence layout
+// LZ4 uses: a token byte whose top nibble is a literal count and
+// bottom nibble a match length (minus 4), each extended with extra
+// bytes when it's 15; then the literals; then a 16-bit little-endian
+// offset back into the output, then any match length extension. The
+// last sequence is literals only, and ends the block.
+
+#define C4M_USE_INTERNAL_API
+#include "con4m.h"
+
+#define BLOCK_SIZE 65536
+#define MIN_MATCH  4
+#define HASH_BITS  12
+
+static inline uint32_t
+load32(uint8_t *p)
+{
+    uint32_t result;
+
+    memcpy(&result, p, sizeof(result));
+
+    return result;
+}
+
+static inline uint32_t
+hash_seq(uint32_t seq)
+{
+    return (seq * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static inline uint8_t *
+put_extra_len(uint8_t *op, int64_t n)
+{
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+
+    *op++ = (uint8_t)n;
+
+    return op;
+}
+
+static uint8_t *
+put_sequence(uint8_t *op,
+             uint8_t *lits,
+             int64_t  nlits,
+             int64_t  offset,
+             int64_t  mlen)
+{
+    uint8_t *token = op++;
+    int64_t  mcode = mlen ? mlen - MIN_MATCH : 0;
+
+    *token = (uint8_t)((c4m_min(nlits, 15) << 4) | c4m_min(mcode, 15));
+
+    if (nlits >= 15) {
+        op = put_extra_len(op, nlits - 15);
+    }
+
+    memcpy(op, lits, nlits);
+    op += nlits;
+
+    if (!mlen) {
+        return op;
+    }
+
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+
+    if (mcode >= 15) {
+        op = put_extra_len(op, mcode - 15);
+    }
+
+    return op;
+}
+
+// `dst` must have room for worst_case(len).
+static int64_t
+compress_block(uint8_t *src, int64_t len, uint8_t *dst)
+{
+    uint32_t table[1 << HASH_BITS] = {0};
+    uint8_t *op                    = dst;
+    int64_t  ip                    = 0;
+    int64_t  anchor                = 0;
+
+    while (ip + MIN_MATCH <= len) {
+        uint32_t seq = load32(src + ip);
+        uint32_t h   = hash_seq(seq);
+        int64_t  ref = (int64_t)table[h] - 1;
+
+        // Positions are stored off by one, so 0 means empty.
+        table[h] = (uint32_t)(ip + 1);
+
+        if (ref < 0 || load32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        int64_t mlen = MIN_MATCH;
+
+        while (ip + mlen < len && src[ref + mlen] == src[ip + mlen]) {
+            mlen++;
+        }
+
+        op = put_sequence(op, src + anchor, ip - anchor, ip - ref, mlen);
+        ip += mlen;
+        anchor = ip;
+    }
+
+    op = put_sequence(op, src + anchor, len - anchor, 0, 0);
+
+    return op - dst;
+}
+
+static inline int64_t
+worst_case(int64_t len)
+{
+    return len + len / 255 + 16;
+}
+
+static inline bool
+get_extra_len(uint8_t *src, int64_t slen, int64_t *ip, int64_t *n)
+{
+    uint8_t b;
+
+    do {
+        if (*ip >= slen) {
+            return false;
+        }
+        b = src[(*ip)++];
+        *n += b;
+    } while (b == 255);
+
+    return true;
+}
+
+static bool
+decompress_block(uint8_t *src, int64_t slen, uint8_t *dst, int64_t dlen)
+{
+    int64_t ip = 0;
+    int64_t op = 0;
+
+    while (ip < slen) {
+        uint8_t token = src[ip++];
+        int64_t nlits = token >> 4;
+        int64_t mlen  = token & 0x0f;
+        int64_t offset;
+
+        if (nlits == 15 && !get_extra_len(src, slen, &ip, &nlits)) {
+            return false;
+        }
+
+        if (ip + nlits > slen || op + nlits > dlen) {
+            return false;
+        }
+
+        memcpy(dst + op, src + ip, nlits);
+        ip += nlits;
+        op += nlits;
+
+        if (ip == slen) {
+            break;
+        }
+
+        if (ip + 2 > slen) {
+            return false;
+        }
+
+        offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+
+        if (mlen == 15 && !get_extra_len(src, slen, &ip, &mlen)) {
+            return false;
+        }
+
+        mlen += MIN_MATCH;
+
+        if (offset == 0 || offset > op || op + mlen > dlen) {
+            return false;
+        }
+
+        // Matches can overlap their own output, so this has to go a
+        // byte at a time.
+        for (int64_t i = 0; i < mlen; i++) {
+            dst[op + i] = dst[op - offset + i];
+        }
+
+        op += mlen;
+    }
+
+    return op == dlen;
+}
+
+static inline bool
+read_all(c4m_stream_t *s, uint64_t len, uint8_t *dst)
+{
+    return (uint64_t)c4m_stream_raw_read(s, len, (char *)dst) == len;
+}
+
+void
+c4m_compress_to_stream(c4m_buf_t *buf, c4m_stream_t *s)
+{
+    int64_t  done = 0;
+    uint8_t *dst  = c4m_gc_raw_alloc(worst_case(BLOCK_SIZE), C4M_GC_SCAN_NONE);
+
+    // Writing can allocate, so don't hold on to pointers into `buf`
+    // across iterations.
+    while (done < buf->byte_len) {
+        uint8_t *src  = (uint8_t *)buf->data + done;
+        int64_t  len  = c4m_min(buf->byte_len - done, BLOCK_SIZE);
+        int64_t  clen = compress_block(src, len, dst);
+
+        c4m_marshal_varint(len, s);
+
+        if (clen < len) {
+            c4m_marshal_varint(clen, s);
+            c4m_stream_raw_write(s, clen, (char *)dst);
+        }
+        else {
+            c4m_marshal_varint(0, s);
+            c4m_stream_raw_write(s, len, buf->data + done);
+        }
+
+        done += len;
+    }
+
+    c4m_marshal_varint(0, s);
+}
+
+c4m_buf_t *
+c4m_decompress_from_stream(c4m_stream_t *s)
+{
+    int64_t  cap = BLOCK_SIZE;
+    int64_t  len = 0;
+    uint8_t *out = c4m_gc_raw_alloc(cap, C4M_GC_SCAN_NONE);
+    uint8_t *in  = c4m_gc_raw_alloc(worst_case(BLOCK_SIZE), C4M_GC_SCAN_NONE);
+
+    while (true) {
+        uint64_t rlen = c4m_unmarshal_varint(s);
+
+        if (!rlen) {
+            break;
+        }
+
+        uint64_t clen = c4m_unmarshal_varint(s);
+
+        if (rlen > BLOCK_SIZE || clen > (uint64_t)worst_case(BLOCK_SIZE)) {
+            C4M_CRAISE("Invalid compressed data (bad block length)");
+        }
+
+        if (len + (int64_t)rlen > cap) {
+            uint8_t *bigger = c4m_gc_raw_alloc(cap * 2, C4M_GC_SCAN_NONE);
+
+            memcpy(bigger, out, len);
+            out = bigger;
+            cap *= 2;
+        }
+
+        if (!clen) {
+            if (!read_all(s, rlen, out + len)) {
+                C4M_CRAISE("Invalid compressed data (truncated)");
+            }
+        }
+        else {
+            if (!read_all(s, clen, in)) {
+                C4M_CRAISE("Invalid compressed data (truncated)");
+            }
+
+            if (!decompress_block(in, clen, out + len, rlen)) {
+                C4M_CRAISE("Invalid compressed data");
+            }
+        }
+
+        len += rlen;
+    }
+
+    return c4m_new(c4m_type_buffer(),
+                   c4m_kw("length", c4m_ka(len), "ptr", c4m_ka(out)));
+}
@@ -353,65 +353,6 @@ apply_padding_and_alignment(c4m_utf8_t *instr, c4m_fmt_spec_t *spec)
     }
 }
 
-static inline c4m_list_t *
-lookup_arg_strings(c4m_fmt_info_t *specs, c4m_dict_t *args)
-{
-    c4m_list_t     *result = c4m_list(c4m_type_utf8());
-    c4m_fmt_info_t *info   = specs;
-    int             i      = 0;
-    c4m_utf8_t     *key;
-    c4m_obj_t       obj;
-
-    while (info != NULL) {
-        switch (info->spec.kind) {
-        case C4M_FMT_FMT_ONLY:
-            key = c4m_str_from_int(i);
-            break;
-        case C4M_FMT_NUMBERED:
-            key = c4m_str_from_int(info->reference.position);
-            break;
-        default:
-            key = c4m_new(c4m_type_utf8(),
-                          c4m_kw("cstring", c4m_ka(info->reference.name)));
-            break;
-        }
-
-        i++;
-
-        bool found = false;
-
-        obj = hatrack_dict_get(args, key, &found);
-
-        if (!found) {
-            c4m_utf8_t *err = c4m_new(
-                c4m_type_utf8(),
-                c4m_kw("cstring", c4m_ka("Format parameter not found: ")));
-
-            err = c4m_to_utf8(c4m_str_concat(err, key));
-
-            C4M_RAISE(err);
-        }
-        c4m_vtable_t *vtable = c4m_vtable(obj);
-        c4m_format_fn fn     = (c4m_format_fn)vtable->methods[C4M_BI_FORMAT];
-        c4m_utf8_t   *s;
-
-        if (fn != NULL) {
-            s = c4m_to_utf8(fn(obj, &info->spec));
-        }
-        else {
-            s = c4m_to_utf8(c4m_to_str(obj, c4m_get_my_type(obj)));
-        }
-
-        s = apply_padding_and_alignment(s, &info->spec);
-
-        c4m_list_append(result, s);
-
-        info = info->next;
-    }
-
-    return result;
-}
-
 static inline void
 style_adjustment(c4m_utf32_t *s, int64_t start, int64_t offset)
 {
@@ -434,43 +375,109 @@ style_adjustment(c4m_utf32_t *s, int64_t start, int64_t offset)
     }
 }
 
-static inline c4m_utf8_t *
-assemble_formatted_result(const c4m_str_t *fmt, c4m_list_t *arg_strings)
+// Compiled format strings.
+//
+// Formatting used to re-parse the format string on every call: pull
+// out the specifiers, rewrite each one to {}, run the result through
+// c4m_rich_lit(), then walk it again to splice in the arguments, all
+// after packing the arguments into a dictionary keyed by their
+// position as a string.
+//
+// None of that depends on the arguments, so now we do it once per
+// format string, producing a template: a 'skeleton' string with
+// escapes processed and styling applied, where each argument is a
+// two-character {} placeholder, plus one slot per placeholder with
+// its position, which argument it takes, and its spec. Rendering only
+// has to format the arguments and copy.
+//
+// Templates are cached in a direct-mapped table keyed on a hash of
+// the format string's bytes, and every hit is checked against those
+// bytes, so a collision (or a racing overwrite from another thread)
+// can only ever cause a miss. Templates are never modified once
+// they're in the cache.
+#define FMT_CACHE_SLOTS  256
+#define FMT_INLINE_SLOTS 16
+
+static c4m_fmt_template_t *fmt_cache[FMT_CACHE_SLOTS];
+
+static void
+fmt_template_gc_bits(uint64_t *bitmap, c4m_fmt_template_t *t)
 {
-    // We need to re-parse the {}'s, and also copy stuff (including
-    // style info) into the final string.
+    c4m_mark_raw_to_addr(bitmap, t, &t->slots);
+}
 
-    fmt = c4m_to_utf32(fmt);
+static c4m_fmt_template_t *
+compile_format(c4m_str_t *fmt, uint64_t hash)
+{
+    c4m_fmt_template_t *t   = c4m_gc_alloc_mapped(c4m_fmt_template_t,
+                                                fmt_template_gc_bits);
+    int64_t             len = fmt->byte_len;
+    c4m_fmt_info_t     *info;
+
+    t->src     = c4m_gc_raw_alloc(len + 1, C4M_GC_SCAN_NONE);
+    t->src_len = len;
+    t->hash    = hash;
+    memcpy(t->src, fmt->data, len);
+
+    // Note that the input fmt string is treated as a rich literal,
+    // meaning that if there is attached style info it will be 100%
+    // stripped.
+    info = c4m_extract_format_specifiers(fmt);
+
+    if (info == NULL) {
+        t->skeleton = c4m_rich_lit(fmt->data);
+        return t;
+    }
+
+    // We're going to create a version of the format string where all
+    // the parameters are replaced with just {}; we are going to then
+    // pass this to c4m_rich_lit to do any formatting we've been asked
+    // to do, before we do object substitutions.
+    c4m_list_t     *segments = c4m_new(c4m_type_list(c4m_type_utf32()));
+    int             cur_pos  = 0;
+    c4m_fmt_info_t *cur_arg  = info;
+    int64_t         n        = 0;
+
+    while (cur_arg != NULL) {
+        c4m_utf32_t *s = c4m_str_slice(fmt, cur_pos, cur_arg->start);
+        c4m_list_append(segments, s);
+        cur_pos = cur_arg->end;
+        cur_arg = cur_arg->next;
+        n++;
+    }
+
+    int l = c4m_str_codepoint_len(fmt);
+
+    if (cur_pos != l) {
+        c4m_utf32_t *s = c4m_str_slice(fmt, cur_pos, l);
+        c4m_list_append(segments, s);
+    }
+
+    fmt = c4m_str_join(segments, c4m_empty_string());
+
+    // After this point, we will potentially have a formatted string,
+    // so the locations for the {} may not be where we might compute
+    // them to be, so we will just reparse them.
+    fmt = c4m_to_utf32(c4m_rich_lit(c4m_to_utf8(fmt)->data));
 
-    int64_t          to_alloc = c4m_str_codepoint_len(fmt);
-    int64_t          list_len = c4m_list_len(arg_strings);
-    int64_t          arg_ix   = 0;
-    int64_t          out_ix   = 0;
-    int64_t          alen; // length of one argument being substituted in.
     int64_t          fmt_len = c4m_str_codepoint_len(fmt);
     c4m_codepoint_t *fmtp    = (c4m_codepoint_t *)fmt->data;
-    c4m_codepoint_t *outp;
-    c4m_codepoint_t *argp;
+    c4m_utf32_t     *skel    = c4m_new(c4m_type_utf32(),
+                                c4m_kw("length", c4m_ka(fmt_len)));
+    c4m_codepoint_t *outp    = (c4m_codepoint_t *)skel->data;
+    int64_t          out_ix  = 0;
+    int64_t          slot_ix = 0;
     c4m_codepoint_t  cp;
-    c4m_str_t       *result;
-    c4m_utf8_t      *arg;
 
-    for (int64_t i = 0; i < list_len; i++) {
-        c4m_str_t *s = (c4m_str_t *)c4m_list_get(arg_strings, i, NULL);
-        to_alloc += c4m_str_codepoint_len(s);
-    }
-
-    result = c4m_new(c4m_type_utf32(),
-                     c4m_kw("length", c4m_ka(to_alloc)));
-    outp   = (c4m_codepoint_t *)result->data;
+    t->slots = c4m_gc_array_value_alloc(c4m_fmt_slot_t, n);
 
-    c4m_copy_style_info(fmt, result);
+    c4m_copy_style_info(fmt, skel);
 
     for (int64_t i = 0; i < fmt_len; i++) {
         // This is not yet handling hex or unicode etc in format strings.
         switch (fmtp[i]) {
         case '\\':
-            style_adjustment(result, out_ix, -1);
+            style_adjustment(skel, out_ix, -1);
             cp = fmtp[++i];
             switch (cp) {
             case 'n':
@@ -493,26 +500,35 @@ assemble_formatted_result(const c4m_str_t *fmt, c4m_list_t *arg_strings)
         case '}':
             continue;
         case '{':
-            // For now, we will not copy over styles from the format call.
-            // Might do that later.
-            arg  = c4m_list_get(arg_strings, arg_ix++, NULL);
-            alen = c4m_str_codepoint_len(arg);
-            arg  = c4m_to_utf32(arg);
-            argp = (c4m_codepoint_t *)arg->data;
-
-            style_adjustment(result, out_ix, alen - 2);
-
-            for (int64_t j = 0; j < alen; j++) {
-                if (argp[j]) {
-                    outp[out_ix++] = argp[j];
-                }
+            if (slot_ix == n) {
+                C4M_CRAISE("Format string has more {} than specifiers.");
+            }
+
+            c4m_fmt_slot_t *slot = &t->slots[slot_ix];
+
+            slot->spec   = info->spec;
+            slot->offset = out_ix;
+
+            if (info->spec.kind == C4M_FMT_NUMBERED) {
+                slot->arg = info->reference.position;
+            }
+            else {
+                slot->arg = slot_ix;
             }
 
+            // The placeholder stays in the skeleton, so that styles
+            // that start or end at it do the same thing they always
+            // have once we know how wide the argument is.
+            outp[out_ix++] = '{';
+            outp[out_ix++] = '}';
+            info           = info->next;
+            slot_ix++;
+
             i++; // Skip the } too.
             continue;
         case '\0':
             outp[out_ix] = 0;
-            style_adjustment(result, out_ix + 1, -1);
+            style_adjustment(skel, out_ix + 1, -1);
             continue;
         default:
             outp[out_ix++] = fmtp[i];
@@ -520,6 +536,166 @@ assemble_formatted_result(const c4m_str_t *fmt, c4m_list_t *arg_strings)
         }
     }
 
+    skel->codepoints = out_ix;
+    t->skeleton      = skel;
+    t->num_slots     = slot_ix;
+
+    return t;
+}
+
+// Doesn't allocate, so `bytes` can point into a string.
+static inline c4m_fmt_template_t *
+fmt_cache_lookup(char *bytes, int64_t len, uint64_t hash)
+{
+    c4m_fmt_template_t *t = fmt_cache[hash & (FMT_CACHE_SLOTS - 1)];
+
+    if (t && t->hash == hash && t->src_len == len
+        && !memcmp(t->src, bytes, len)) {
+        return t;
+    }
+
+    return NULL;
+}
+
+// Called once from c4m_init(), before any thread (or worker heap)
+// can get here, like the type caches.
+void
+c4m_init_format_cache(void)
+{
+    c4m_gc_register_root(&fmt_cache[0], FMT_CACHE_SLOTS);
+}
+
+static inline c4m_fmt_template_t *
+fmt_cache_remember(c4m_fmt_template_t *t)
+{
+    fmt_cache[t->hash & (FMT_CACHE_SLOTS - 1)] = t;
+
+    return t;
+}
+
+c4m_fmt_template_t *
+c4m_fmt_compile_cstr(char *fmt, int64_t len)
+{
+    uint64_t            hash = XXH3_64bits(fmt, len);
+    c4m_fmt_template_t *t    = fmt_cache_lookup(fmt, len, hash);
+
+    if (t) {
+        return t;
+    }
+
+    return fmt_cache_remember(compile_format(c4m_cstring(fmt, len), hash));
+}
+
+c4m_fmt_template_t *
+c4m_fmt_compile(const c4m_str_t *fmt)
+{
+    c4m_utf8_t         *u8   = c4m_to_utf8(fmt);
+    uint64_t            hash = XXH3_64bits(u8->data, u8->byte_len);
+    c4m_fmt_template_t *t    = fmt_cache_lookup(u8->data, u8->byte_len, hash);
+
+    if (t) {
+        return t;
+    }
+
+    return fmt_cache_remember(compile_format(u8, hash));
+}
+
+static inline c4m_utf32_t *
+format_one_arg(c4m_obj_t obj, c4m_fmt_spec_t *template_spec)
+{
+    // Format functions get a pointer to the spec; give them a copy,
+    // since the template's is shared.
+    c4m_fmt_spec_t spec   = *template_spec;
+    c4m_vtable_t  *vtable = c4m_vtable(obj);
+    c4m_format_fn  fn     = (c4m_format_fn)vtable->methods[C4M_BI_FORMAT];
+    c4m_utf8_t    *s;
+
+    if (fn != NULL) {
+        s = c4m_to_utf8(fn(obj, &spec));
+    }
+    else {
+        s = c4m_to_utf8(c4m_to_str(obj, c4m_get_my_type(obj)));
+    }
+
+    return c4m_to_utf32(apply_padding_and_alignment(s, &spec));
+}
+
+static inline void
+fmt_missing_arg(int64_t n)
+{
+    c4m_utf8_t *err = c4m_new(
+        c4m_type_utf8(),
+        c4m_kw("cstring", c4m_ka("Format parameter not found: ")));
+
+    err = c4m_to_utf8(c4m_str_concat(err, c4m_str_from_int(n)));
+
+    C4M_RAISE(err);
+}
+
+c4m_utf8_t *
+c4m_fmt_render(c4m_fmt_template_t *t, int nargs, c4m_obj_t *args)
+{
+    // No specifiers at all, so the skeleton is just the rich literal.
+    if (t->slots == NULL) {
+        return c4m_str_copy(t->skeleton);
+    }
+
+    c4m_utf32_t  *inline_strs[FMT_INLINE_SLOTS];
+    c4m_utf32_t **arg_strs = inline_strs;
+    c4m_utf32_t  *skel     = (c4m_utf32_t *)t->skeleton;
+    int64_t       to_alloc = c4m_str_codepoint_len(skel);
+
+    if (t->num_slots > FMT_INLINE_SLOTS) {
+        arg_strs = c4m_gc_array_alloc(c4m_utf32_t *, t->num_slots);
+    }
+
+    for (int64_t i = 0; i < t->num_slots; i++) {
+        c4m_fmt_slot_t *slot = &t->slots[i];
+
+        if (slot->arg < 0 || slot->arg >= nargs) {
+            fmt_missing_arg(slot->arg);
+        }
+
+        arg_strs[i] = format_one_arg(args[slot->arg], &slot->spec);
+        to_alloc += c4m_str_codepoint_len(arg_strs[i]);
+    }
+
+    c4m_utf32_t     *result = c4m_new(c4m_type_utf32(),
+                                  c4m_kw("length", c4m_ka(to_alloc)));
+    c4m_codepoint_t *outp   = (c4m_codepoint_t *)result->data;
+    c4m_codepoint_t *skelp  = (c4m_codepoint_t *)skel->data;
+    int64_t          out_ix = 0;
+    int64_t          pos    = 0;
+
+    c4m_copy_style_info(skel, result);
+
+    for (int64_t i = 0; i < t->num_slots; i++) {
+        c4m_fmt_slot_t  *slot = &t->slots[i];
+        c4m_codepoint_t *argp = (c4m_codepoint_t *)arg_strs[i]->data;
+        int64_t          alen = c4m_str_codepoint_len(arg_strs[i]);
+        int64_t          run  = slot->offset - pos;
+
+        memcpy(outp + out_ix, skelp + pos, run * sizeof(c4m_codepoint_t));
+        out_ix += run;
+
+        // For now, we will not copy over styles from the format call.
+        // Might do that later.
+        style_adjustment(result, out_ix, alen - 2);
+
+        for (int64_t j = 0; j < alen; j++) {
+            if (argp[j]) {
+                outp[out_ix++] = argp[j];
+            }
+        }
+
+        pos = slot->offset + 2;
+    }
+
+    int64_t run = c4m_str_codepoint_len(skel) - pos;
+
+    memcpy(outp + out_ix, skelp + pos, run * sizeof(c4m_codepoint_t));
+    out_ix += run;
+
     while (out_ix != 0) {
         if (outp[out_ix - 1] == 0) {
             --out_ix;
@@ -539,65 +715,50 @@ c4m_str_vformat(const c4m_str_t *fmt, c4m_dict_t *args)
 {
     // Positional items are looked up via their ASCII string.
     // Keys are expected to be utf8.
-    //
-    // Note that the input fmt string is treated as a rich literal,
-    // meaning that if there is attached style info it will be 100%
-    // stripped.
-    c4m_fmt_info_t *info = c4m_extract_format_specifiers(fmt);
-
-    if (info == NULL) {
-        return c4m_rich_lit(c4m_to_utf8(fmt)->data);
+    c4m_fmt_template_t *t     = c4m_fmt_compile(fmt);
+    int64_t             given = c4m_len(args);
+    int64_t             nargs = 0;
+
+    // An index past the number of arguments can't be there; check
+    // before sizing the array by it.
+    for (int64_t i = 0; i < t->num_slots; i++) {
+        if (t->slots[i].arg >= given) {
+            fmt_missing_arg(t->slots[i].arg);
+        }
+        nargs = c4m_max(nargs, t->slots[i].arg + 1);
     }
 
-    // We're going to create a version of the format string where all
-    // the parameters are replaced with just {}; we are going to then
-    // pass this to c4m_rich_lit to do any formatting we've been asked
-    // to do, before we do object substitutions.
-    c4m_list_t *segments = c4m_new(c4m_type_list(c4m_type_utf32()));
-
-    int             cur_pos = 0;
-    c4m_fmt_info_t *cur_arg = info;
+    c4m_obj_t *objs = c4m_gc_array_alloc(c4m_obj_t, nargs);
 
-    while (cur_arg != NULL) {
-        c4m_utf32_t *s = c4m_str_slice(fmt, cur_pos, cur_arg->start);
-        c4m_list_append(segments, s);
-        cur_pos = cur_arg->end;
-        cur_arg = cur_arg->next;
-    }
+    for (int64_t i = 0; i < t->num_slots; i++) {
+        int64_t n     = t->slots[i].arg;
+        bool    found = false;
 
-    if (cur_pos != 0) {
-        int l = c4m_str_codepoint_len(fmt);
+        objs[n] = hatrack_dict_get(args, c4m_str_from_int(n), &found);
 
-        if (cur_pos != l) {
-            c4m_utf32_t *s = c4m_str_slice(fmt, cur_pos, l);
-            c4m_list_append(segments, s);
+        if (!found) {
+            fmt_missing_arg(n);
         }
-
-        fmt = c4m_str_join(segments, c4m_empty_string());
     }
 
-    // After this point, we will potentially have a formatted string,
-    // so the locations for the {} may not be where we might compute
-    // them to be, so we will just reparse them.
-    fmt                     = c4m_rich_lit(c4m_to_utf8(fmt)->data);
-    c4m_list_t *arg_strings = lookup_arg_strings(info, args);
-
-    return assemble_formatted_result(fmt, arg_strings);
+    return c4m_fmt_render(t, nargs, objs);
 }
 
 c4m_utf8_t *
 c4m_base_format(const c4m_str_t *fmt, int nargs, va_list args)
 {
-    c4m_obj_t   one;
-    c4m_dict_t *dict = c4m_dict(c4m_type_utf8(), c4m_type_ref());
+    c4m_obj_t  inline_args[FMT_INLINE_SLOTS];
+    c4m_obj_t *argv = inline_args;
 
-    for (int i = 0; i < nargs; i++) {
-        one = va_arg(args, c4m_obj_t);
+    if (nargs > FMT_INLINE_SLOTS) {
+        argv = c4m_gc_array_alloc(c4m_obj_t, nargs);
+    }
 
-        c4m_utf8_t *key = c4m_str_from_int(i);
-        hatrack_dict_add(dict, key, one);
+    for (int i = 0; i < nargs; i++) {
+        argv[i] = va_arg(args, c4m_obj_t);
     }
-    return c4m_str_vformat(fmt, dict);
+
+    return c4m_fmt_render(c4m_fmt_compile(fmt), nargs, argv);
 }
 
 c4m_utf8_t *
@@ -616,29 +777,30 @@ _c4m_str_format(const c4m_str_t *fmt, int nargs, ...)
 c4m_utf8_t *
 _c4m_cstr_format(char *fmt, int nargs, ...)
 {
-    va_list     args;
-    c4m_utf8_t *utf8fmt;
-    c4m_utf8_t *result;
+    va_list    args;
+    c4m_obj_t  inline_args[FMT_INLINE_SLOTS];
+    c4m_obj_t *argv = inline_args;
+
+    // No need to box the format string up just to hash it.
+    c4m_fmt_template_t *t = c4m_fmt_compile_cstr(fmt, strlen(fmt));
+
+    if (nargs > FMT_INLINE_SLOTS) {
+        argv = c4m_gc_array_alloc(c4m_obj_t, nargs);
+    }
 
     va_start(args, nargs);
-    utf8fmt = c4m_new_utf8(fmt);
-    result  = c4m_base_format((const c4m_str_t *)utf8fmt, nargs, args);
+    for (int i = 0; i < nargs; i++) {
+        argv[i] = va_arg(args, c4m_obj_t);
+    }
     va_end(args);
 
-    return result;
+    return c4m_fmt_render(t, nargs, argv);
 }
 
 c4m_utf8_t *
 c4m_cstr_array_format(char *fmt, int num_args, c4m_utf8_t **params)
 {
-    c4m_utf8_t *one;
-    c4m_dict_t *dict = c4m_dict(c4m_type_utf8(), c4m_type_ref());
-
-    for (int i = 0; i < num_args; i++) {
-        one             = params[i];
-        c4m_utf8_t *key = c4m_str_from_int(i);
-        hatrack_dict_add(dict, key, one);
-    }
-
-    return c4m_str_vformat((const c4m_str_t *)c4m_new_utf8(fmt), dict);
+    return c4m_fmt_render(c4m_fmt_compile_cstr(fmt, strlen(fmt)),
+                          num_args,
+                          (c4m_obj_t *)params);
 }
@@ -0,0 +1,188 @@
+#include "con4m.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define C4M_SIMD_X86
+#include <immintrin.h>
+#endif
+
+static int64_t
+ascii_prefix_scalar(const uint8_t *p, int64_t len)
+{
+    int64_t  i = 0;
+    uint64_t w;
+
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&w, p + i, 8);
+        if (w & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+
+    while (i < len && p[i] < 0x80) {
+        i++;
+    }
+
+    return i;
+}
+
+// Searches from `i` on, using memchr() to get to candidate first bytes.
+static char *
+find_bytes_scalar(const char *h,
+                  int64_t     hlen,
+                  const char *n,
+                  int64_t     nlen,
+                  int64_t     i)
+{
+    while (i + nlen <= hlen) {
+        const char *p = memchr(h + i, n[0], hlen - nlen - i + 1);
+
+        if (p == NULL) {
+            return NULL;
+        }
+        if (!memcmp(p, n, nlen)) {
+            return (char *)p;
+        }
+
+        i = p - h + 1;
+    }
+
+    return NULL;
+}
+
+#ifdef C4M_SIMD_X86
+static int64_t
+ascii_prefix_sse2(const uint8_t *p, int64_t len)
+{
+    int64_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((__m128i *)(p + i)));
+
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + ascii_prefix_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2"))) static int64_t
+ascii_prefix_avx2(const uint8_t *p, int64_t len)
+{
+    int64_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_loadu_si256((__m256i *)(p + i)));
+
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + ascii_prefix_sse2(p + i, len - i);
+}
+
+// Compare the first and last byte of the needle against 16 (or 32)
+// positions at once, and only memcmp() where both match.
+static char *
+find_bytes_sse2(const char *h, int64_t hlen, const char *n, int64_t nlen)
+{
+    __m128i first = _mm_set1_epi8(n[0]);
+    __m128i last  = _mm_set1_epi8(n[nlen - 1]);
+    int64_t i     = 0;
+
+    for (; i + nlen - 1 + 16 <= hlen; i += 16) {
+        __m128i  bf   = _mm_loadu_si128((__m128i *)(h + i));
+        __m128i  bl   = _mm_loadu_si128((__m128i *)(h + i + nlen - 1));
+        uint32_t mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(bf, first),
+                          _mm_cmpeq_epi8(bl, last)));
+
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+
+            if (!memcmp(h + i + bit, n, nlen)) {
+                return (char *)h + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return find_bytes_scalar(h, hlen, n, nlen, i);
+}
+
+__attribute__((target("avx2"))) static char *
+find_bytes_avx2(const char *h, int64_t hlen, const char *n, int64_t nlen)
+{
+    __m256i first = _mm256_set1_epi8(n[0]);
+    __m256i last  = _mm256_set1_epi8(n[nlen - 1]);
+    int64_t i     = 0;
+
+    for (; i + nlen - 1 + 32 <= hlen; i += 32) {
+        __m256i  bf   = _mm256_loadu_si256((__m256i *)(h + i));
+        __m256i  bl   = _mm256_loadu_si256((__m256i *)(h + i + nlen - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(bf, first),
+                             _mm256_cmpeq_epi8(bl, last)));
+
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+
+            if (!memcmp(h + i + bit, n, nlen)) {
+                return (char *)h + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return find_bytes_scalar(h, hlen, n, nlen, i);
+}
+
+static int8_t have_avx2 = -1;
+
+static inline bool
+use_avx2(void)
+{
+    // Racing here is harmless; everyone computes the same answer.
+    if (have_avx2 == -1) {
+        __builtin_cpu_init();
+        have_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+
+    return have_avx2 == 1;
+}
+#endif
+
+int64_t
+c4m_ascii_prefix_len(const char *p, int64_t len)
+{
+#ifdef C4M_SIMD_X86
+    if (use_avx2()) {
+        return ascii_prefix_avx2((const uint8_t *)p, len);
+    }
+    return ascii_prefix_sse2((const uint8_t *)p, len);
+#else
+    return ascii_prefix_scalar((const uint8_t *)p, len);
+#endif
+}
+
+char *
+c4m_find_bytes(const char *h, int64_t hlen, const char *n, int64_t nlen)
+{
+    if (nlen == 0) {
+        return (char *)h;
+    }
+    if (nlen > hlen) {
+        return NULL;
+    }
+
+#ifdef C4M_SIMD_X86
+    if (use_avx2()) {
+        return find_bytes_avx2(h, hlen, n, nlen);
+    }
+    return find_bytes_sse2(h, hlen, n, nlen);
+#else
+    return find_bytes_scalar(h, hlen, n, nlen, 0);
+#endif
+}
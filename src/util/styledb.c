@@ -640,7 +640,7 @@ c4m_layer_styles(const c4m_render_style_t *base, c4m_render_style_t *cur)
 void
 c4m_style_marshal(c4m_render_style_t *obj,
                   c4m_stream_t       *s,
-                  c4m_dict_t         *memos,
+                  c4m_memo_t         *memos,
                   int64_t            *mid)
 {
     uint8_t flags = 0;
@@ -671,7 +671,7 @@ c4m_style_marshal(c4m_render_style_t *obj,
 void
 c4m_style_unmarshal(c4m_render_style_t *obj,
                     c4m_stream_t       *s,
-                    c4m_dict_t         *memos)
+                    c4m_memo_t         *memos)
 {
     uint8_t flags;
     char   *theme;